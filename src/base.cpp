@@ -7,6 +7,7 @@
 #include <queue>
 #include <netinet/in.h>
 #include <svl/SVL.h>
+#include <atomic>
 
 #include "sssim.h"
 #include "udp.h"
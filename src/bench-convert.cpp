@@ -0,0 +1,122 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Microbenchmark of the scalar & batch equation of state functions in
+ * util-convert, over random Baltic-like (S, T, p) triples.
+ *
+ * For each function prints the time per value of a scalar loop and of the
+ * batch call, and the largest difference between the two; the batch
+ * versions are meant to be bit-identical, so anything but 0 is a bug (or a
+ * build with -ffast-math or FMA contraction).
+ *
+ * usage: bench-convert [-n values] [-r rounds]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include <unistd.h>
+
+#include "util-convert.h"
+
+typedef double scalar_func_t(double a, double b, unsigned int pressure);
+typedef void batch_func_t(const double *a, const double *b, const unsigned int *pressure, double *out, unsigned int n);
+
+//-----------------------------------------------------------------------------
+static double now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double rnd(double lo, double hi)
+{
+	return lo + (hi - lo) * (rand() / (RAND_MAX + 1.0));
+}
+
+//-----------------------------------------------------------------------------
+static void bench(const char *name, scalar_func_t *f_scalar, batch_func_t *f_batch,
+				  const std::vector<double> &a, const std::vector<double> &b, const std::vector<unsigned int> &p,
+				  unsigned int rounds)
+{
+	const unsigned int n = a.size();
+	std::vector<double> out_scalar(n), out_batch(n);
+
+	double t_scalar = 1e30, t_batch = 1e30;
+	for (unsigned int r = 0; r < rounds; ++r)
+	{
+		double t0 = now_ns();
+		for (unsigned int i = 0; i < n; ++i)
+			out_scalar[i] = f_scalar(a[i], b[i], p[i]);
+		double t1 = now_ns();
+		f_batch(&a[0], &b[0], &p[0], &out_batch[0], n);
+		double t2 = now_ns();
+
+		if (t1 - t0 < t_scalar)
+			t_scalar = t1 - t0;
+		if (t2 - t1 < t_batch)
+			t_batch = t2 - t1;
+	}
+
+	double err_max = 0.0;
+	unsigned int n_diff = 0;
+	for (unsigned int i = 0; i < n; ++i)
+	{
+		const double e = fabs(out_batch[i] - out_scalar[i]);
+		if (e > err_max)
+			err_max = e;
+		if (out_batch[i] != out_scalar[i])
+			++n_diff;
+	}
+
+	printf("%-14s %8.2f %8.2f %6.2fx %10.3g %8u\n",
+		   name, t_scalar / n, t_batch / n, t_scalar / t_batch, err_max, n_diff);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	unsigned int n = 100000, rounds = 20;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:r:h")) != -1)
+		switch (opt)
+		{
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n values] [-r rounds]\n", argv[0]);
+			return 1;
+		}
+	if ((n == 0) || (rounds == 0))
+		return 1;
+
+	srand(1);
+	std::vector<double> S(n), T(n), C(n);
+	std::vector<unsigned int> P(n);
+	for (unsigned int i = 0; i < n; ++i)
+	{
+		S[i] = rnd(2.0, 20.0);
+		T[i] = rnd(0.0, 22.0);
+		P[i] = pressure_from_depth(rnd(0.0, 450.0));
+		C[i] = conductivity_from_STD(S[i], T[i], P[i]);
+	}
+
+	printf("%u values, best of %u rounds\n", n, rounds);
+	printf("%-14s %8s %8s %7s %10s %8s\n", "", "ns/val", "batch", "", "max diff", "n diff");
+	bench("salinity", salinity_from_CTD, salinity_from_CTD_n, C, T, P, rounds);
+	bench("density", density_from_STD, density_from_STD_n, S, T, P, rounds);
+	bench("soundspeed", soundspeed_from_STD, soundspeed_from_STD_n, S, T, P, rounds);
+	bench("conductivity", conductivity_from_STD, conductivity_from_STD_n, S, T, P, rounds);
+
+	return 0;
+}
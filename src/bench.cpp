@@ -0,0 +1,526 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Microbenchmarks of the hot kernels of env & the clients: the sea data
+ * lookups on the real fields of data/2008_08, the equation of state, the float
+ * physics, the acoustic message model, the Kalman filter, the CTD tracker and
+ * the satellite message format.
+ *
+ * Each benchmark is run in rounds of as many calls as take about -t ms, and
+ * its time per call reported as the fastest & median of -r rounds: as JSON to
+ * stdout or with -o to a file, for comparing builds, and as a table to
+ * stderr. The inputs are random but seeded, so they are the same every run.
+ *
+ * usage: bench [-o output] [-r rounds] [-t ms] [-d data_dir] [name ..]
+ *
+ * With names, runs only the benchmarks whose names start with one of them,
+ * e.g. "bench sea. kalman.".
+ */
+
+#include <list>
+#include <map>
+#include <deque>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netcdfcpp.h>
+#include <svl/SVL.h>
+
+#include "util-trigger.h"
+#include "util-leastsquares.h"
+#include "sssim.h"
+#include "sssim-structs.h"
+#include "util-convert.h"
+#include "sea-data.h"
+#include "sea-layers.h"
+#include "env-sea.h"
+#include "env-catalogue.h"
+#include "env-float.h"
+#include "env-server.h"
+#include "env-clients.h"
+#include "env-events.h"
+#include "env-stats.h"
+#include "float-structs.h"
+#include "satmsg-fmt.h"
+#include "satmsg-data.h"
+#include "ctd-tracker.h"
+#include "kalman_filter.h"
+
+#define USAGE "usage: %s [-o output] [-r rounds] [-t ms] [-d data_dir] [name ..]\n"
+#define BENCH_ROUNDS 7
+#define BENCH_ROUND_MS 50
+#define BENCH_INPUTS 1024 // of each kind, cycled through
+#define BENCH_SEED 20080801
+#define BENCH_GROUP_SIZE 6 // as SWARM_NUM_OF_UNITS_IN_GROUP in float.cpp
+
+// as in env.cpp, for the env modules linked in
+trigger_t runtime(false);
+simtime_t env_time = 0;
+SeaCatalogue *sea;
+EventJournal events;
+EnvStats stats;
+
+T_env_client_vector clients;
+int clients_awake = 0;
+pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t client_sleeping = PTHREAD_COND_INITIALIZER;
+
+void show_timerate(bool end) {}
+
+// the private parts timed here
+class Bench
+{
+  public:
+	static bool map(const Sea &s, const double *pos, double t, sea_loc_t &loc) { return s.map(pos, t, loc); }
+	static double value(const Sea &s, const sea_loc_t &loc) { return s.value(loc, *s.salt_data); }
+	static void step(SimFloat &f, double td) { f.StepRungeKutta4(td); }
+};
+
+struct bench_result_t
+{
+	std::string name;
+	unsigned long n; // calls per round
+	double ns_min, ns_median;
+};
+
+static std::vector<bench_result_t> results;
+static std::vector<const char *> only;
+static unsigned int rounds = BENCH_ROUNDS;
+static double round_ns = BENCH_ROUND_MS * 1e6;
+static volatile double sink;
+
+//-----------------------------------------------------------------------------
+static double now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double rnd(double lo, double hi)
+{
+	return lo + (hi - lo) * (rand() / (RAND_MAX + 1.0));
+}
+
+static bool selected(const char *name)
+{
+	if (only.empty())
+		return true;
+	for (unsigned int i = 0; i < only.size(); ++i)
+		if (!strncmp(name, only[i], strlen(only[i])))
+			return true;
+	return false;
+}
+
+// f(n) makes n calls, returning something of their results
+template <class F>
+static void bench(const char *name, F f)
+{
+	if (!selected(name))
+		return;
+
+	unsigned long n = 1;
+	double t;
+	for (;;)
+	{
+		const double t0 = now_ns();
+		sink = f(n);
+		t = now_ns() - t0;
+		if ((t >= 0.25 * round_ns) || (n >= (1UL << 40)))
+			break;
+		n *= 2;
+	}
+	n = std::max(1.0, n * round_ns / t);
+
+	std::vector<double> ns(rounds);
+	for (unsigned int r = 0; r < rounds; ++r)
+	{
+		const double t0 = now_ns();
+		sink = f(n);
+		ns[r] = (now_ns() - t0) / n;
+	}
+	std::sort(ns.begin(), ns.end());
+
+	bench_result_t res;
+	res.name = name;
+	res.n = n;
+	res.ns_min = ns[0];
+	res.ns_median = ns[rounds / 2];
+	results.push_back(res);
+	fprintf(stderr, "%-32s %12.1f %12.1f %12lu\n", name, res.ns_min, res.ns_median, n);
+}
+
+//-----------------------------------------------------------------------------
+// random points in the sea, away from land and the bottom
+struct sea_point_t
+{
+	double pos[3];
+	double t;
+};
+
+static void sea_points(const Sea &s, std::vector<sea_point_t> &pts)
+{
+	const double
+		x_hi = s.min.x + (SEA_NX - 1) * s.step.x,
+		y_hi = s.min.y + (SEA_NY - 1) * s.step.y,
+		t_hi = s.min.t + (s.n_t - 1) * s.step.t;
+
+	pts.clear();
+	for (unsigned int tries = 0; (pts.size() < BENCH_INPUTS) && (tries < 1000 * BENCH_INPUTS); ++tries)
+	{
+		sea_point_t p;
+		p.pos[0] = rnd(s.min.x, x_hi);
+		p.pos[1] = rnd(s.min.y, y_hi);
+		p.pos[2] = rnd(1.0, 80.0);
+		p.t = rnd(s.min.t, t_hi);
+
+		double salt, temp, drift[3];
+		if ((s.bottom(p.pos) > p.pos[2] + 2 * DRIFTER_HALF_HEIGHT) && s.variables(p.pos, p.t, &salt, &temp, drift))
+			pts.push_back(p);
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void bench_sea(const char *data_dir)
+{
+	if (!selected("sea.") && !selected("float.") && !selected("comms."))
+		return;
+
+	Sea s(NULL, SEA_TILE_CACHE_DEFAULT, data_dir);
+	std::vector<sea_point_t> pts;
+	sea_points(s, pts);
+	if (pts.empty())
+	{
+		fprintf(stderr, "|| no sea data in %s\n", data_dir);
+		exit(EXIT_FAILURE);
+	}
+	const unsigned int n_pts = pts.size();
+
+	bench("sea.map", [&](unsigned long n) {
+		double sum = 0.0;
+		sea_loc_t loc;
+		for (unsigned long i = 0; i < n; ++i)
+		{
+			const sea_point_t &p = pts[i % n_pts];
+			Bench::map(s, p.pos, p.t, loc);
+			sum += loc.z.frac;
+		}
+		return sum;
+	});
+
+	std::vector<sea_loc_t> locs(n_pts);
+	for (unsigned int i = 0; i < n_pts; ++i)
+		Bench::map(s, pts[i].pos, pts[i].t, locs[i]);
+	bench("sea.value", [&](unsigned long n) {
+		double sum = 0.0;
+		for (unsigned long i = 0; i < n; ++i)
+			sum += Bench::value(s, locs[i % n_pts]);
+		return sum;
+	});
+
+	bench("sea.variables", [&](unsigned long n) {
+		double sum = 0.0, salt, temp, drift[3], rho;
+		for (unsigned long i = 0; i < n; ++i)
+		{
+			const sea_point_t &p = pts[i % n_pts];
+			s.variables(p.pos, p.t, &salt, &temp, drift, &rho);
+			sum += rho;
+		}
+		return sum;
+	});
+
+	bench("sea.bottom", [&](unsigned long n) {
+		double sum = 0.0;
+		for (unsigned long i = 0; i < n; ++i)
+			sum += s.bottom(pts[i % n_pts].pos);
+		return sum;
+	});
+
+	bench("sea.min_soundspeed", [&](unsigned long n) {
+		double sum = 0.0, z;
+		for (unsigned long i = 0; i < n; ++i)
+		{
+			const sea_point_t &p = pts[i % n_pts];
+			sum += s.min_soundspeed(p.pos, p.t, s.bottom(p.pos), &z);
+		}
+		return sum;
+	});
+
+	// the same data for SimFloat & msg_travel_time, through the global catalogue
+	sea = new SeaCatalogue();
+	sea->add(0.0, data_dir);
+	sea->start(s.min.t);
+	env_time = pts[0].t;
+
+	std::vector<SimFloat> floats;
+	for (unsigned int i = 0; i < n_pts; ++i)
+	{
+		FloatState fs;
+		fs.pos = Vec3(pts[i].pos[0], pts[i].pos[1], pts[i].pos[2]);
+		floats.push_back(SimFloat(i, fs));
+	}
+
+	bench("float.rk4", [&](unsigned long n) {
+		double sum = 0.0;
+		for (unsigned long i = 0; i < n; ++i)
+		{
+			SimFloat f = floats[i % n_pts];
+			Bench::step(f, SIMULATOR_STEPSIZE);
+			sum += f.pos[2];
+		}
+		return sum;
+	});
+
+	// pairs within acoustic range, at the depths of the points
+	std::vector<SimFloat> peers;
+	for (unsigned int i = 0; i < n_pts; ++i)
+	{
+		FloatState fs;
+		fs.pos = Vec3(pts[i].pos[0] + rnd(-1000.0, 1000.0), pts[i].pos[1] + rnd(-1000.0, 1000.0), pts[i].pos[2]);
+		peers.push_back(SimFloat(n_pts + i, fs));
+	}
+	srand48(BENCH_SEED);
+	bench("comms.msg_travel_time", [&](unsigned long n) {
+		double sum = 0.0;
+		for (unsigned long i = 0; i < n; ++i)
+			sum += msg_travel_time(&floats[i % n_pts], &peers[i % n_pts]);
+		return sum;
+	});
+}
+
+//-----------------------------------------------------------------------------
+static void bench_convert()
+{
+	std::vector<double> S(BENCH_INPUTS), T(BENCH_INPUTS), C(BENCH_INPUTS), out(BENCH_INPUTS);
+	std::vector<unsigned int> p(BENCH_INPUTS);
+	for (unsigned int i = 0; i < BENCH_INPUTS; ++i)
+	{
+		S[i] = rnd(SEA_SALT_MIN, SEA_SALT_MAX);
+		T[i] = rnd(SEA_TEMP_MIN, SEA_TEMP_MAX);
+		p[i] = pressure_from_depth(rnd(0.0, 150.0));
+		C[i] = conductivity_from_STD(S[i], T[i], p[i]);
+	}
+
+	bench("convert.density_from_STD", [&](unsigned long n) {
+		double sum = 0.0;
+		for (unsigned long i = 0; i < n; ++i)
+			sum += density_from_STD(S[i % BENCH_INPUTS], T[i % BENCH_INPUTS], p[i % BENCH_INPUTS]);
+		return sum;
+	});
+	bench("convert.soundspeed_from_STD", [&](unsigned long n) {
+		double sum = 0.0;
+		for (unsigned long i = 0; i < n; ++i)
+			sum += soundspeed_from_STD(S[i % BENCH_INPUTS], T[i % BENCH_INPUTS], p[i % BENCH_INPUTS]);
+		return sum;
+	});
+	bench("convert.salinity_from_CTD", [&](unsigned long n) {
+		double sum = 0.0;
+		for (unsigned long i = 0; i < n; ++i)
+			sum += salinity_from_CTD(C[i % BENCH_INPUTS], T[i % BENCH_INPUTS], p[i % BENCH_INPUTS]);
+		return sum;
+	});
+	bench("convert.conductivity_from_STD", [&](unsigned long n) {
+		double sum = 0.0;
+		for (unsigned long i = 0; i < n; ++i)
+			sum += conductivity_from_STD(S[i % BENCH_INPUTS], T[i % BENCH_INPUTS], p[i % BENCH_INPUTS]);
+		return sum;
+	});
+
+	// per value, in batches of BENCH_INPUTS; see also bin/bench-convert
+	bench("convert.density_from_STD_n", [&](unsigned long n) {
+		for (unsigned long i = 0; i < n; i += BENCH_INPUTS)
+			density_from_STD_n(&S[0], &T[0], &p[0], &out[0], std::min<unsigned long>(n - i, BENCH_INPUTS));
+		return out[0];
+	});
+	bench("convert.soundspeed_from_STD_n", [&](unsigned long n) {
+		for (unsigned long i = 0; i < n; i += BENCH_INPUTS)
+			soundspeed_from_STD_n(&S[0], &T[0], &p[0], &out[0], std::min<unsigned long>(n - i, BENCH_INPUTS));
+		return out[0];
+	});
+	bench("convert.salinity_from_CTD_n", [&](unsigned long n) {
+		for (unsigned long i = 0; i < n; i += BENCH_INPUTS)
+			salinity_from_CTD_n(&C[0], &T[0], &p[0], &out[0], std::min<unsigned long>(n - i, BENCH_INPUTS));
+		return out[0];
+	});
+}
+
+//-----------------------------------------------------------------------------
+// a run of the filter as in float.cpp, after a full set of ranges
+static void bench_kalman(int n_units)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "kalman.run_%d", n_units);
+	if (!selected(name))
+		return;
+
+	std::vector<double> x(n_units), y(n_units);
+	for (int i = 0; i < n_units; ++i)
+	{
+		x[i] = rnd(-2000.0, 2000.0);
+		y[i] = rnd(-2000.0, 2000.0);
+	}
+
+	kalman_data K;
+	memset(&K, 0, sizeof(K));
+	initialize_kalman(&K, n_units, 900);
+	set_measurement_noise(&K, 0, 10, 0.001, 5, 10000, 0.0001);
+	set_model_noise(&K, 10, 1, 0.5, 0.0001);
+	for (int i = 0; i < n_units; ++i)
+	{
+		set_unit_position(&K, i, x[i], y[i], 0.0);
+		set_current(&K, i, 0.0, 0.0, 0.0);
+	}
+
+	// the measured ranges, noise included, cycled through
+	std::vector<double> dist(BENCH_INPUTS * n_units);
+	for (unsigned int k = 0; k < BENCH_INPUTS; ++k)
+		for (int i = 1; i < n_units; ++i)
+			dist[k * n_units + i] = hypot(x[i] - x[0], y[i] - y[0]) + rnd(-5.0, 5.0);
+
+	bench(name, [&](unsigned long n) {
+		for (unsigned long k = 0; k < n; ++k)
+		{
+			const double *d = &dist[(k % BENCH_INPUTS) * n_units];
+			position_measurement(&K, 0, 0, x[0], y[0], 40.0);
+			for (int i = 1; i < n_units; ++i)
+				distance_measurement(&K, 0, i, d[i]);
+			run_kalman(&K);
+		}
+		return K.X[0];
+	});
+	end_kalman(&K);
+}
+
+//-----------------------------------------------------------------------------
+// a float drifting at ~40 m, sampled once a second
+static void bench_ctd()
+{
+	std::vector<ctd_data_t> samples(BENCH_INPUTS);
+	for (unsigned int i = 0; i < BENCH_INPUTS; ++i)
+	{
+		samples[i].temperature = 5.0;
+		samples[i].conductivity = conductivity_from_STD(7.0, 5.0, 5000);
+		samples[i].pressure = 1013 + pressure_from_depth(40.0 + 2.0 * sin(i * 2 * M_PI / BENCH_INPUTS)) + rand() % 3;
+	}
+
+	CTDTracker tracker;
+	uint32_t t = 0;
+	bench("ctd.add", [&](unsigned long n) {
+		double sum = 0.0;
+		for (unsigned long i = 0; i < n; ++i)
+		{
+			samples[i % BENCH_INPUTS].time = ++t;
+			sum += tracker.add(samples[i % BENCH_INPUTS]);
+		}
+		return sum;
+	});
+}
+
+//-----------------------------------------------------------------------------
+// a full float report to the base, to the wire and back
+static void bench_satmsg()
+{
+	floatmsg_t fm;
+	fm.self = new self_status_t();
+	fm.group = new rel_group_status_t();
+	fm.group->n_floats = BENCH_GROUP_SIZE;
+	fm.group->floats = new rel_status_with_id[fm.group->n_floats]();
+	fm.env = new env_status_t();
+	fm.env->n_layers = ENV_LAYERS_COUNT;
+	fm.env->layers = new env_layer_status_t[fm.env->n_layers]();
+
+	bench("satmsg.floatmsg_roundtrip", [&](unsigned long n) {
+		double sum = 0.0;
+		for (unsigned long i = 0; i < n; ++i)
+		{
+			SatMsg tx(fm.type(), fm.cdata(), fm.csize(), 0);
+			const char *wire = tx.cdata();
+			SatMsg rx(wire, tx.csize());
+			floatmsg_t back(&rx);
+			sum += back.csize();
+		}
+		return sum;
+	});
+}
+
+//-----------------------------------------------------------------------------
+static bool write_json(FILE *f)
+{
+	char host[64] = "";
+	gethostname(host, sizeof(host) - 1);
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"time\": %lu,\n", (unsigned long)time(NULL));
+	fprintf(f, "  \"host\": \"%s\",\n", host);
+	fprintf(f, "  \"compiler\": \"%s\",\n", __VERSION__);
+	fprintf(f, "  \"rounds\": %u,\n", rounds);
+	fprintf(f, "  \"round_ms\": %g,\n", 1e-6 * round_ns);
+	fprintf(f, "  \"results\": [");
+	for (unsigned int i = 0; i < results.size(); ++i)
+		fprintf(f, "%s\n    { \"name\": \"%s\", \"n\": %lu, \"ns_min\": %.3f, \"ns_median\": %.3f }",
+				i ? "," : "", results[i].name.c_str(), results[i].n, results[i].ns_min, results[i].ns_median);
+	fprintf(f, "\n  ]\n}\n");
+	return !ferror(f);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	const char *out_fn = NULL;
+	const char *data_dir = SEA_DATA_DIR;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "o:r:t:d:h")) != -1)
+		switch (opt)
+		{
+		case 'o':
+			out_fn = optarg;
+			break;
+		case 'r':
+			rounds = std::max(1, atoi(optarg));
+			break;
+		case 't':
+			round_ns = std::max(1.0, atof(optarg)) * 1e6;
+			break;
+		case 'd':
+			data_dir = optarg;
+			break;
+		default:
+			fprintf(stderr, USAGE, argv[0]);
+			exit(1);
+		}
+	for (int i = optind; i < argc; ++i)
+		only.push_back(argv[i]);
+
+	fprintf(stderr, "%-32s %12s %12s %12s\n", "name", "ns_min", "ns_median", "n");
+	srand(BENCH_SEED);
+	bench_convert();
+	bench_kalman(6);
+	bench_kalman(12);
+	bench_kalman(24);
+	bench_ctd();
+	bench_satmsg();
+	bench_sea(data_dir);
+
+	FILE *out = out_fn ? fopen(out_fn, "w") : stdout;
+	if ((out == NULL) || !write_json(out) || (out_fn && fclose(out)))
+	{
+		perror(out_fn ? out_fn : "stdout");
+		exit(1);
+	}
+	return 0;
+}
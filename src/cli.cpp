@@ -15,7 +15,7 @@ int main(int argc, char **argv)
 {
 	if (argc < 2)
 	{
-		printf("usage: %s start|stop|quit\n", argv[0]);
+		printf("usage: %s start|stop|quit|stats\n", argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
@@ -26,13 +26,27 @@ int main(int argc, char **argv)
 		msg = MSG_PAUSE;
 	else if (!strcmp(argv[1], "quit"))
 		msg = MSG_QUIT;
+	else if (!strcmp(argv[1], "stats"))
+		msg = MSG_GET_STATS;
 	else
 	{
-		printf("usage: %s start|stop|quit\n", argv[0]);
+		printf("usage: %s start|stop|quit|stats\n", argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
 	sockaddr_in env_addr = inet(SSS_ENV_ADDRESS).addr;
-	ssize_t ok = UDPclient(&env_addr).send(&msg, 1);
+	UDPclient env(&env_addr);
+	ssize_t ok = env.send(&msg, 1);
+	if ((ok > 0) && (msg == MSG_GET_STATS))
+	{
+		// the timings of env as text, see src/env-stats.h
+		static char buf[65536];
+		timeval tv = {2, 0};
+		ok = env.recv(buf, sizeof(buf), &tv);
+		if ((ok > 1) && (buf[0] == (char)(MSG_GET_STATS | MSG_ACK_MASK)))
+			fwrite(buf + 1, 1, ok - 1, stdout);
+		else
+			ok = 0;
+	}
 	exit((ok > 0) ? EXIT_SUCCESS : EXIT_FAILURE);
 }
@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <netinet/in.h>
 #include <queue>
+#include <atomic>
 
 #include "sssim.h"
 #include "udp.h"
@@ -21,9 +22,31 @@
 extern SimSocket *gui_socket;
 extern SimTime sim_time;
 
+#define RX_QUEUE_MSGS_PER_FLOAT 4 // in a burst, e.g. a GPS fix, an estimate & pongs
+#define SWARM_SIZE_DEFAULT 32	// floats, if not given in $SSSIM_SWARM_SIZE
+
 msg_queue satmsg_rx_queue, soundmsg_rx_queue;
 SimSocket *ctrl_socket = NULL;
 
+//-----------------------------------------------------------------------------
+// before the ctrl thread starts; e.g. SSSIM_SWARM_SIZE=100 for a bigger swarm, as bin/swarm-scale sets
+void init_rx_queues()
+{
+	const char *swarm_size_s = getenv("SSSIM_SWARM_SIZE");
+	const int swarm_size = swarm_size_s ? atoi(swarm_size_s) : 0;
+	size_t capacity = RX_QUEUE_MSGS_PER_FLOAT * ((swarm_size > 0) ? swarm_size : SWARM_SIZE_DEFAULT);
+	if (capacity < MSGQUEUE_DEFAULT_CAPACITY)
+		capacity = MSGQUEUE_DEFAULT_CAPACITY;
+	satmsg_rx_queue.set_capacity(capacity);
+	soundmsg_rx_queue.set_capacity(capacity);
+}
+
+static void rx_queue_push(msg_queue &queue, const char *name, const char *buf, ssize_t len)
+{
+	if (!queue.push(buf, len))
+		dprint_error("|| rx %s queue full, %lu messages dropped\n", name, queue.dropped());
+}
+
 //-----------------------------------------------------------------------------
 void handle_ctrl_msg(char msg_type, const char *msg_body, ssize_t msg_len, const sockaddr_in *addr)
 {
@@ -50,7 +73,7 @@ void handle_pong_msg(const char *buf, ssize_t len)
 	SoundMsg msg(SOUNDMSG_PONG, buf, len);
 	msg.from = SOUNDMSG__ID_MODEM;
 	msg.time = sim_time.now();
-	soundmsg_rx_queue.push(msg.cdata(), msg.csize());
+	rx_queue_push(soundmsg_rx_queue, "pong", msg.cdata(), msg.csize());
 }
 
 //-----------------------------------------------------------------------------
@@ -64,8 +87,8 @@ void init_gui_socket(const void *buf, ssize_t len)
 			dprint_logonly("\tMSG:");
 			const char *msg = reinterpret_cast<const char *>(buf);
 			for (int i = 0; i < len; ++i)
-				fprintf(log_file, " %02hhX", msg[i]);
-			fputc('\n', log_file);
+				dprint_put(DPRINT_FILE, 0, NULL, " %02hhX", msg[i]);
+			dprint_put(DPRINT_FILE, 0, NULL, "\n");
 		}
 		return;
 	}
@@ -106,10 +129,10 @@ void *ctrl_thread_function(void *unused)
 			switch (msg_type)
 			{
 			case MSG_SATMSG:
-				satmsg_rx_queue.push(msg_body, msg_len);
+				rx_queue_push(satmsg_rx_queue, "satmsg", msg_body, msg_len);
 				break;
 			case MSG_SOUNDMSG:
-				soundmsg_rx_queue.push(msg_body, msg_len);
+				rx_queue_push(soundmsg_rx_queue, "soundmsg", msg_body, msg_len);
 				break;
 			case MSG_PINGPONG:
 				handle_pong_msg(msg_body, msg_len);
@@ -1,6 +1,7 @@
 #ifndef _client_ctrl_h
 #define _client_ctrl_h
 
+void init_rx_queues();
 void * ctrl_thread_function(void * unused);
 
 #endif
@@ -2,7 +2,12 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <atomic>
 #include <cstdio>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <svl/SVL.h>
 
@@ -12,6 +17,9 @@
 #include "client-socket.h"
 #include "client-ctrl.h"
 #include "client-print.h"
+#include "float-structs.h"
+#include "client-time.h"
+#include "util-trace.h"
 
 void *dive_thread_function(void *unused);
 
@@ -19,6 +27,9 @@ extern int16_t client_id;
 extern sockaddr_in env_addr;
 extern SimSocket *ctrl_socket;
 extern FILE *log_file;
+extern SimTime sim_time;
+
+static uint32_t trace_sim_time() { return sim_time.now(); }
 
 //-----------------------------------------------------------------------------
 enum ClientType
@@ -103,6 +114,11 @@ void init_client(ClientType type, int argc, char **argv)
 	if (client_id < 0)
 		exit(EXIT_FAILURE);
 
+	// with $SSSIM_SEED (see src/env-time.cpp), one sequence per client
+	const char *seed = getenv("SSSIM_SEED");
+	if (seed != NULL)
+		srand48(atol(seed) + client_id);
+
 	char logpath[64];
 	logpath[0] = '\0';
 	switch (type)
@@ -124,10 +140,24 @@ void init_client(ClientType type, int argc, char **argv)
 
 	if (logpath[0])
 		log_file = fopen(logpath, "w");
+	dprint_start();
 	dprint("start: id %d\n", client_id);
 
+	if (logpath[0])
+	{
+		char tracepath[80], name[32];
+		snprintf(tracepath, sizeof(tracepath), "%s" TRACE_SUFFIX, logpath);
+		snprintf(name, sizeof(name), "%s %d", (type == base_station) ? "base" : "float", client_id);
+		if (trace_open(tracepath, name, trace_sim_time))
+		{
+			dprint("trace to %s\n", tracepath);
+			trace_thread_name(TRACE_TIDS, "awake");
+		}
+	}
+
 	//init_sig_handler();
 
+	init_rx_queues();
 	pthread_create(&ctrl_thread, NULL, &ctrl_thread_function, NULL);
 }
 
@@ -3,56 +3,227 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include <stdint.h>
-#include <stdarg.h>
 #include <cstdio>
 #include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "vt100.h"
 #include "sssim.h"
 #include "float-structs.h"
 #include "client-time.h"
+#include "client-print.h"
 
 extern SimTime sim_time;
 
 
 FILE * log_file = NULL;
 
-uint32_t dprint_stdout_timestamp() {
-	static uint32_t prev_time = 0;
+// one per thread, written by it & read by the drain thread; never freed, as
+// the client threads live as long as the process
+struct DprintRing {
+	std::atomic<uint32_t> head, tail;	// records written & read
+	std::atomic<uint32_t> dropped;	// since the drain thread last reported
+	unsigned int line_level;	// drain thread only
+	dprint_record_t slots[DPRINT_RING_SIZE];
+	dprint_record_t spare;	// filled & dropped when the ring is full
 
-	uint32_t time = sim_time.now();
-	if (time == prev_time) {
-		for (int i = 0; i < 12; ++i) putc(' ', stdout);
-	} else {
-		char * timestr;
-		if ((timestr = time2str(time))) {
-			fprintf(stdout, VT_SET(VT_BLUE) "%s " VT_RESET, timestr);
-			free(timestr);
+	DprintRing() : head(0), tail(0), dropped(0), line_level(DPRINT_INFO) {}
+};
+
+static thread_local DprintRing * ring = NULL;
+static std::vector<DprintRing *> rings;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static std::atomic<uint64_t> next_seq(0);
+static std::atomic<bool> running(false), quit(false);
+static std::atomic<unsigned int> reserved(0);	// ring records between reserve & commit
+static pthread_t drain_thread;
+static unsigned int console_level = DPRINT_DEBUG;
+
+// for printing without the drain thread, & held by it while writing
+static DprintRing sync_ring;
+static pthread_mutex_t sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+//-----------------------------------------------------------------------------
+static void write_record(DprintRing * rg, const dprint_record_t & r) {
+	static uint32_t prev_time = 0;	// on the console
+
+	const unsigned int level = r.level ? r.level : rg->line_level;
+	const bool to_console = (r.flags & DPRINT_CONSOLE) && (level <= console_level);
+	const bool to_file = (r.flags & DPRINT_FILE) && (log_file != NULL);
+	if (r.level) rg->line_level = r.level;
+
+	if (r.flags & DPRINT_STAMP) {
+		if (to_console) {
+			if (r.time == prev_time) {
+				for (int i = 0; i < 12; ++i) putc(' ', stdout);
+			} else {
+				char * timestr;
+				if ((timestr = time2str(r.time))) {
+					fprintf(stdout, VT_SET(VT_BLUE) "%s " VT_RESET, timestr);
+					free(timestr);
+				}
+				prev_time = r.time;
+			}
 		}
-		prev_time = time;
+		if (to_file) fprintf(log_file, "%u\t", r.time);
+		return;
 	}
-	return time;
+
+	char buffer[1024];
+	int len = r.format(buffer, sizeof(buffer), r.fmt, r.args);
+	if (len < 0) return;
+	if (len >= (int)sizeof(buffer)) len = sizeof(buffer) - 1;
+
+	if (to_console) {
+		if (r.style) fputs(r.style, stdout);
+		fwrite(buffer, 1, len, stdout);
+		if (r.style) fputs(VT_RESET, stdout);
+	}
+	if (to_file) fwrite(buffer, 1, len, log_file);
+
+	if (len && (buffer[len - 1] == '\n')) rg->line_level = DPRINT_INFO;
 }
 
-void dprint_timestamp(bool log_only) {
-	uint32_t t_now = log_only
-		? sim_time.now()
-		: dprint_stdout_timestamp();
-	if (log_file != NULL) fprintf(log_file, "%u\t", t_now);
+// the records of all threads in order, as far as they're there
+static void drain() {
+	pthread_mutex_lock(&rings_mutex);
+	std::vector<DprintRing *> rs(rings);
+	pthread_mutex_unlock(&rings_mutex);
+
+	std::vector<uint32_t> end(rs.size());
+	for (size_t i = 0; i < rs.size(); ++i) end[i] = rs[i]->head.load(std::memory_order_acquire);
+
+	bool wrote = false;
+	unsigned long dropped = 0;
+	pthread_mutex_lock(&sync_mutex);
+	for (;;) {
+		DprintRing * next = NULL;
+		for (size_t i = 0; i < rs.size(); ++i) {
+			const uint32_t t = rs[i]->tail.load(std::memory_order_relaxed);
+			if ((t != end[i]) && ((next == NULL) || (rs[i]->slots[t % DPRINT_RING_SIZE].seq < next->slots[next->tail.load(std::memory_order_relaxed) % DPRINT_RING_SIZE].seq)))
+				next = rs[i];
+		}
+		if (next == NULL) break;
+
+		const uint32_t t = next->tail.load(std::memory_order_relaxed);
+		write_record(next, next->slots[t % DPRINT_RING_SIZE]);
+		next->tail.store(t + 1, std::memory_order_release);
+		wrote = true;
+	}
+	for (size_t i = 0; i < rs.size(); ++i) dropped += rs[i]->dropped.exchange(0);
+	if (dropped) {
+		fprintf(stdout, VT_SET(VT_RED) "[dprint: %lu records dropped, ring full]" VT_RESET "\n", dropped);
+		if (log_file != NULL) fprintf(log_file, "[dprint: %lu records dropped, ring full]\n", dropped);
+		wrote = true;
+	}
+	pthread_mutex_unlock(&sync_mutex);
+
+	if (wrote) {
+		fflush(stdout);
+		if (log_file != NULL) fflush(log_file);
+	}
 }
 
-int dprint_printf(const char * fmt, ...) {
-	char buffer[1024];
+static void * drain_thread_function(void * unused) {
+	for (;;) {
+		const bool last = quit.load();
+		drain();
+		if (last) break;
+		usleep(DPRINT_DRAIN_US);
+	}
+	return NULL;
+}
 
-	va_list arg;
-	va_start(arg, fmt);
-		int len = vsnprintf(buffer, 1024, fmt, arg);
-	va_end(arg);
+// the last drain gets every record reserved before running is cleared
+static void dprint_stop() {
+	if (!running.load()) return;
+	running = false;	// from here on, synchronous
+	while (reserved.load()) sched_yield();
+	quit = true;
+	pthread_join(drain_thread, NULL);
+}
+
+void dprint_start() {
+	if (running.load()) return;
+
+	const char * s = getenv("SSSIM_PRINT_LEVEL");
+	if (s && *s) console_level = atoi(s);
+
+	quit = false;
+	if (pthread_create(&drain_thread, NULL, &drain_thread_function, NULL)) return;
+	running = true;
+	atexit(dprint_stop);
+}
+
+
+//-----------------------------------------------------------------------------
+dprint_record_t * dprint_reserve() {
+	if (!running.load()) {
+		// written right away in dprint_commit
+		pthread_mutex_lock(&sync_mutex);
+		return &sync_ring.slots[0];
+	}
+
+	if (ring == NULL) {
+		ring = new DprintRing();
+		pthread_mutex_lock(&rings_mutex);
+		rings.push_back(ring);
+		pthread_mutex_unlock(&rings_mutex);
+	}
+
+	++reserved;
+	if (!running.load()) {	// dprint_stop() got in between
+		--reserved;
+		pthread_mutex_lock(&sync_mutex);
+		return &sync_ring.slots[0];
+	}
+
+	const uint32_t h = ring->head.load(std::memory_order_relaxed);
+	if (h - ring->tail.load(std::memory_order_acquire) >= DPRINT_RING_SIZE)
+		return &ring->spare;
+	return &ring->slots[h % DPRINT_RING_SIZE];
+}
 
-	if (log_file != NULL) {
-		fwrite(buffer, 1, len, log_file);
-		fflush(log_file);
+void dprint_commit(dprint_record_t * r) {
+	if (r == &sync_ring.slots[0]) {
+		write_record(&sync_ring, *r);
+		fflush(stdout);
+		if (log_file != NULL) fflush(log_file);
+		pthread_mutex_unlock(&sync_mutex);
+		return;
 	}
 
-	return fwrite(buffer, 1, len, stdout);
+	if (r == &ring->spare) {
+		++ring->dropped;
+	} else {
+		r->seq = next_seq.fetch_add(1, std::memory_order_relaxed);
+		ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	--reserved;
+}
+
+
+//-----------------------------------------------------------------------------
+void dprint_stamp(unsigned int flags, unsigned int level) {
+	dprint_record_t * r = dprint_reserve();
+	r->flags = flags | DPRINT_STAMP;
+	r->level = level;
+	r->time = sim_time.now();
+	dprint_commit(r);
+}
+
+void dprint_timestamp(bool log_only) {
+	dprint_stamp(log_only ? DPRINT_FILE : (DPRINT_CONSOLE | DPRINT_FILE), 0);
+}
+
+uint32_t dprint_stdout_timestamp() {
+	const uint32_t time = sim_time.now();
+	dprint_stamp(DPRINT_CONSOLE, 0);
+	return time;
 }
@@ -4,20 +4,173 @@
 #include "vt100.h"
 
 #include <stdio.h>
+#include <stdint.h>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
 
 extern FILE * log_file;
 
-#define  printf  dprint_printf
-#define  putchar(c)         do { putchar(c); if (log_file != NULL) putc(c, log_file); } while(0)
-#define  dprint(...)        do { dprint_timestamp(); dprint_printf(__VA_ARGS__); } while(0)
-#define  dprint_fn(...)     do { dprint_timestamp(); dprint_printf("%s: ", __FUNCTION__); dprint_printf(__VA_ARGS__); } while(0)
-#define  dprint_dim(...)    do { dprint_timestamp(); fprintf(stdout, VT_SET(VT_DIM)); dprint_printf(__VA_ARGS__); fprintf(stdout, VT_RESET); } while(0)
-#define  dprint_error(...)  do { dprint_timestamp(); fprintf(stdout, VT_SET(VT_RED)); dprint_printf(__VA_ARGS__); fprintf(stdout, VT_RESET); } while(0)
-#define  dprint_stdout(...) do { dprint_stdout_timestamp(); fprintf(stdout, VT_SET(VT_GREEN)); fprintf(stdout, __VA_ARGS__); fprintf(stdout, VT_RESET); } while(0)
-#define  dprint_logonly(...)  do if (log_file != NULL) { putc('@', log_file); dprint_timestamp(true); fprintf(log_file, __VA_ARGS__); fflush(log_file);	} while(0)
+/**
+ * Console & log file output of the float and base clients
+ *
+ * The print calls don't format or write anything themselves: each call is a
+ * binary record (time, format, arguments) in a ring of the calling thread,
+ * and a background thread formats the records of all threads in order, to the
+ * console & log_file, flushing each once per pass. Strings are copied into the
+ * record, so any %s argument may be freed after the call; all other arguments
+ * are stored as they are.
+ *
+ * When a thread's ring is full, its records are dropped rather than waited
+ * for; the background thread reports how many, in red & in the log file.
+ *
+ * Before dprint_start() and after exit(), printing is synchronous.
+ *
+ * The console shows the lines of level $SSSIM_PRINT_LEVEL and below (default
+ * DPRINT_DEBUG, i.e. all); the log file gets every line but those of
+ * dprint_stdout.
+ */
 
-uint32_t dprint_stdout_timestamp();
+#define  DPRINT_ERROR      1
+#define  DPRINT_INFO       2
+#define  DPRINT_DEBUG      3	// dprint_dim
+
+#define  DPRINT_CONSOLE    0x1
+#define  DPRINT_FILE       0x2
+#define  DPRINT_STAMP      0x4	// the sim time, as the start of a line
+
+#define  DPRINT_RING_SIZE  1024	// records per thread
+#define  DPRINT_ARGS_SIZE  216	// bytes, longer strings are truncated
+#define  DPRINT_DRAIN_US   10000
+
+typedef int (*dprint_format_fn)(char * buf, size_t size, const char * fmt, const unsigned char * args);
+
+struct dprint_record_t {
+	uint64_t seq;	// over all threads
+	dprint_format_fn format;
+	const char * fmt;
+	const char * style;	// VT_SET(..) or NULL
+	uint32_t time;	// of DPRINT_STAMP
+	uint8_t flags;
+	uint8_t level;	// of the line; 0 to continue it
+	unsigned char args[DPRINT_ARGS_SIZE];
+};
+
+void dprint_start();	// once log_file is open
+dprint_record_t * dprint_reserve();	// the next free record of this thread
+void dprint_commit(dprint_record_t * r);
+
+
+//-----------------------------------------------------------------------------
+// packing the arguments of a record, in order
+template< typename T >
+struct dprint_arg {
+	static_assert(std::is_trivially_copyable<T>::value, "dprint: not a printf argument");
+	typedef T type;
+	static bool put(unsigned char *& p, const unsigned char * end, const T & v) {
+		if (p + sizeof(T) > end) return false;
+		memcpy(p, &v, sizeof(T));
+		p += sizeof(T);
+		return true;
+	}
+	static T get(const unsigned char *& p) {
+		T v;
+		memcpy(&v, p, sizeof(T));
+		p += sizeof(T);
+		return v;
+	}
+};
+
+// strings by value: length (0xFFFF for NULL), chars & '\0'
+template<>
+struct dprint_arg<const char *> {
+	typedef const char * type;
+	static bool put(unsigned char *& p, const unsigned char * end, const char * s) {
+		if (p + sizeof(uint16_t) + 1 > end) return false;
+		uint16_t len = 0xFFFF;
+		if (s != NULL) {
+			const size_t max = end - p - sizeof(uint16_t) - 1;
+			len = strnlen(s, max);
+		}
+		memcpy(p, &len, sizeof(len));
+		p += sizeof(len);
+		if (s != NULL) {
+			memcpy(p, s, len);
+			p += len;
+			*p++ = '\0';
+		}
+		return true;
+	}
+	static const char * get(const unsigned char *& p) {
+		uint16_t len;
+		memcpy(&len, p, sizeof(len));
+		p += sizeof(len);
+		if (len == 0xFFFF) return NULL;
+		const char * s = reinterpret_cast<const char *>(p);
+		p += len + 1;
+		return s;
+	}
+};
+
+template<>
+struct dprint_arg<char *> : dprint_arg<const char *> {};
+
+template< unsigned int... I > struct dprint_index {};
+template< unsigned int N, unsigned int... I > struct dprint_indices : dprint_indices<N - 1, N - 1, I...> {};
+template< unsigned int... I > struct dprint_indices<0, I...> { typedef dprint_index<I...> type; };
+
+template< typename... A >
+struct dprint_args {
+	static bool put(unsigned char * p, const unsigned char * end, A... a) {
+		const bool ok[] = { true, dprint_arg<A>::put(p, end, a)... };
+		for (size_t i = 0; i < sizeof(ok); ++i) if (!ok[i]) return false;
+		return true;
+	}
+
+	template< unsigned int... I >
+	static int call(char * buf, size_t size, const char * fmt, const std::tuple<typename dprint_arg<A>::type...> & t, dprint_index<I...>) {
+		return snprintf(buf, size, fmt, std::get<I>(t)...);
+	}
+
+	static int format(char * buf, size_t size, const char * fmt, const unsigned char * p) {
+		// braced, so that the arguments are read in order
+		const std::tuple<typename dprint_arg<A>::type...> t { dprint_arg<A>::get(p)... };
+		return call(buf, size, fmt, t, typename dprint_indices<sizeof...(A)>::type());
+	}
+};
+
+template< typename... A >
+void dprint_put(unsigned int flags, unsigned int level, const char * style, const char * fmt, A... a) {
+	dprint_record_t * r = dprint_reserve();
+	r->flags = flags;
+	r->level = level;
+	r->style = style;
+	r->fmt = fmt;
+	r->format = &dprint_args<A...>::format;
+	if (!dprint_args<A...>::put(r->args, r->args + DPRINT_ARGS_SIZE, a...)) {
+		r->fmt = "[dprint: arguments too long: %s]";
+		r->format = &dprint_args<const char *>::format;
+		dprint_args<const char *>::put(r->args, r->args + DPRINT_ARGS_SIZE, fmt);
+	}
+	dprint_commit(r);
+}
+
+template< typename... A >
+void dprint_printf(const char * fmt, A... a) { dprint_put(DPRINT_CONSOLE | DPRINT_FILE, 0, NULL, fmt, a...); }
+
+void dprint_stamp(unsigned int flags, unsigned int level);
 void dprint_timestamp(bool log_only = false);
-int dprint_printf(const char *fmt, ...);
+uint32_t dprint_stdout_timestamp();
+
+
+//-----------------------------------------------------------------------------
+#define  printf  dprint_printf
+#define  putchar(c)         dprint_printf("%c", c)
+#define  dprint(...)        do { dprint_stamp(DPRINT_CONSOLE | DPRINT_FILE, DPRINT_INFO); dprint_printf(__VA_ARGS__); } while(0)
+#define  dprint_fn(...)     do { dprint_stamp(DPRINT_CONSOLE | DPRINT_FILE, DPRINT_INFO); dprint_printf("%s: ", __FUNCTION__); dprint_printf(__VA_ARGS__); } while(0)
+#define  dprint_dim(...)    do { dprint_stamp(DPRINT_CONSOLE | DPRINT_FILE, DPRINT_DEBUG); dprint_put(DPRINT_CONSOLE | DPRINT_FILE, 0, VT_SET(VT_DIM), __VA_ARGS__); } while(0)
+#define  dprint_error(...)  do { dprint_stamp(DPRINT_CONSOLE | DPRINT_FILE, DPRINT_ERROR); dprint_put(DPRINT_CONSOLE | DPRINT_FILE, 0, VT_SET(VT_RED), __VA_ARGS__); } while(0)
+#define  dprint_stdout(...) do { dprint_stamp(DPRINT_CONSOLE, DPRINT_INFO); dprint_put(DPRINT_CONSOLE, 0, VT_SET(VT_GREEN), __VA_ARGS__); } while(0)
+#define  dprint_logonly(...)  do { dprint_put(DPRINT_FILE, DPRINT_INFO, NULL, "@"); dprint_stamp(DPRINT_FILE, 0); dprint_put(DPRINT_FILE, 0, NULL, __VA_ARGS__); } while(0)
 
 #endif // _client_print_h
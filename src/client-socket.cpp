@@ -20,7 +20,8 @@ timeval SimSocket::default_wait_tv = { 0, 3000 };
 //-----------------------------------------------------------------------------
 ssize_t SimSocket::send(char msg_type, const void * msg_body, size_t body_len, int flags) const {
 	const size_t msg_len = 1 + sizeof(client_id) + body_len;
-	char * buf = new char[msg_len];
+	char small_buf[SIMSOCKET_SMALL_MSG];	// e.g. MSG_SLEEP, on each MSG_TIME
+	char * buf = (msg_len <= sizeof(small_buf)) ? small_buf : new char[msg_len];
 	buf[0] = msg_type;
 	void * bp = mempcpy(buf + 1, &client_id, sizeof(client_id));
 	if (body_len > 0) memcpy(bp, msg_body, body_len);
@@ -31,7 +32,7 @@ ssize_t SimSocket::send(char msg_type, const void * msg_body, size_t body_len, i
 	//if (tx_bytes != (int)msg_len) printf(": " VT_SET2(VT_BRIGHT, VT_RED) "ERROR: tx %zi of %zu bytes\n" VT_RESET, tx_bytes, msg_len);
 	//else putchar('\n');
 
-	delete[] buf;
+	if (buf != small_buf) delete[] buf;
 	if (tx_bytes == -1) PRINT_PERROR("send");
 	return tx_bytes;
 }
@@ -9,6 +9,8 @@
 	#include "udp.h"
 */
 
+#define SIMSOCKET_SMALL_MSG 64	// bytes; shorter messages are built on the stack
+
 class SimSocket : public UDPclient
 {
   private:
@@ -5,6 +5,9 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <map>
+#include <atomic>
+#include <vector>
+#include <cstring>
 #include <netinet/in.h>
 
 #include "sssim.h"
@@ -12,37 +15,137 @@
 #include "float-structs.h"
 #include "client-socket.h"
 #include "client-time.h"
+#include "util-trace.h"
 
 extern sockaddr_in env_addr;
+extern int16_t client_id;
 
 //-----------------------------------------------------------------------------
 struct sleeper_t
 {
 	bool may_sleep;
+	bool waiting; // blocked in sleep_until()
 	simtime_t wakeup_time;
+	int heap_index; // in sleep_heap, -1 if not there
+	pthread_cond_t wake_cond;
 
-	void set(simtime_t t)
+	sleeper_t() : may_sleep(false), waiting(false), wakeup_time(0), heap_index(-1), wake_cond()
 	{
-		wakeup_time = t;
-		may_sleep = true;
+		pthread_cond_init(&wake_cond, NULL);
 	}
+	~sleeper_t() { pthread_cond_destroy(&wake_cond); }
 };
 
 std::map<pthread_t, sleeper_t> sleepers; // NOTE: assumes pthread_t is a basic type
 
+// all sleepers with may_sleep set, as a min-heap on wakeup_time; guarded by SimTime::mutex
+std::vector<sleeper_t *> sleep_heap;
+std::vector<int> wake_stack; // for heap_wake_due(), kept to reuse its buffer
+simtime_t sleep_sent = 0; // wakeup time in the latest MSG_SLEEP to env
+SimSocket *sleep_skt = NULL;
+uint64_t trace_woken = 0; // trace_now() at the latest MSG_TIME, 0 once MSG_SLEEP is sent
+simtime_t trace_woken_t = 0;
+
+//-----------------------------------------------------------------------------
+static void heap_place(int i, sleeper_t *s)
+{
+	sleep_heap[i] = s;
+	s->heap_index = i;
+}
+
+static void heap_sift_up(int i)
+{
+	sleeper_t *s = sleep_heap[i];
+	while (i > 0)
+	{
+		const int parent = (i - 1) / 2;
+		if (sleep_heap[parent]->wakeup_time <= s->wakeup_time)
+			break;
+		heap_place(i, sleep_heap[parent]);
+		i = parent;
+	}
+	heap_place(i, s);
+}
+
+static void heap_sift_down(int i)
+{
+	const int n = sleep_heap.size();
+	sleeper_t *s = sleep_heap[i];
+	while (true)
+	{
+		int child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if ((child + 1 < n) && (sleep_heap[child + 1]->wakeup_time < sleep_heap[child]->wakeup_time))
+			++child;
+		if (s->wakeup_time <= sleep_heap[child]->wakeup_time)
+			break;
+		heap_place(i, sleep_heap[child]);
+		i = child;
+	}
+	heap_place(i, s);
+}
+
+static void heap_update(sleeper_t *s)
+{
+	if (s->heap_index < 0)
+	{
+		sleep_heap.push_back(s);
+		s->heap_index = sleep_heap.size() - 1;
+	}
+	heap_sift_up(s->heap_index);
+	heap_sift_down(s->heap_index);
+}
+
+static void heap_remove(sleeper_t *s)
+{
+	const int i = s->heap_index;
+	if (i < 0)
+		return;
+	s->heap_index = -1;
+	sleeper_t *last = sleep_heap.back();
+	sleep_heap.pop_back();
+	if (last == s)
+		return;
+	heap_place(i, last);
+	heap_sift_up(i);
+	heap_sift_down(last->heap_index);
+}
+
+// signal the blocked sleepers that are due; visits only the due part of the heap
+static void heap_wake_due(simtime_t t)
+{
+	if (sleep_heap.empty())
+		return;
+	std::vector<int> &stack = wake_stack;
+	stack.assign(1, 0);
+	while (!stack.empty())
+	{
+		const int i = stack.back();
+		stack.pop_back();
+		sleeper_t *s = sleep_heap[i];
+		if (s->wakeup_time > t)
+			continue;
+		if (s->waiting)
+			pthread_cond_signal(&s->wake_cond);
+		const size_t child = 2 * i + 1;
+		if (child < sleep_heap.size())
+			stack.push_back(child);
+		if (child + 1 < sleep_heap.size())
+			stack.push_back(child + 1);
+	}
+}
+
 //-----------------------------------------------------------------------------
 SimTime::SimTime() : mutex(),
-					 run_cond(),
 					 time_now(0),
 					 cycle()
 {
 	pthread_mutex_init(&mutex, NULL);
-	pthread_cond_init(&run_cond, NULL);
 }
 
 SimTime::~SimTime()
 {
-	pthread_cond_destroy(&run_cond);
 	pthread_mutex_destroy(&mutex);
 }
 
@@ -63,7 +166,14 @@ int SimTime::set(char ctrl, const void *buf, ssize_t len)
 	}
 	//dprint_timestamp(); putchar('\n');
 	if (ok)
-		pthread_cond_broadcast(&run_cond);
+	{
+		if (trace_on())
+		{
+			trace_woken = trace_now();
+			trace_woken_t = time_now;
+		}
+		heap_wake_due(time_now);
+	}
 	pthread_mutex_unlock(&mutex);
 
 	return ok ? 0 : -1;
@@ -107,17 +217,35 @@ int SimTime::cycle_time(simtime_t t, bool pre_start_ok) const
 }
 
 //-----------------------------------------------------------------------------
-void SimTime::do_sleep_until(const simtime_t t) const
+// tell env when the earliest sleeper is due, if that has changed; called with mutex held
+void SimTime::do_sleep_until() const
 {
-	static SimSocket skt(&env_addr);
-	skt.send(MSG_SLEEP, &t, sizeof(t));
+	if (sleep_heap.empty())
+		return;
+	const simtime_t t = sleep_heap.front()->wakeup_time;
+	if ((t <= time_now) || ((t == sleep_sent) && (sleep_sent > time_now)))
+		return;
+
+	if (sleep_skt == NULL)
+		sleep_skt = new SimSocket(&env_addr);
+	if (sleep_skt->send(MSG_SLEEP, &t, sizeof(t)) == (ssize_t)(1 + sizeof(client_id) + sizeof(t)))
+		sleep_sent = t;
+	if (trace_woken)
+	{
+		trace_span("awake", "client", trace_woken, trace_now(), trace_woken_t, time_now, TRACE_TIDS);
+		trace_woken = 0;
+	}
 	//dprint("%lu: sleeping %is\n", pthread_self(), (int)t - time_now);
 }
 
 simtime_t SimTime::sleep_until(const simtime_t wakeup_time)
 {
+	TraceScope trace("sleep_until", "time");
 	pthread_mutex_lock(&mutex);
-	sleepers[pthread_self()].set(wakeup_time);
+	sleeper_t &s = sleepers[pthread_self()];
+	s.may_sleep = true;
+	s.wakeup_time = wakeup_time;
+	heap_update(&s);
 
 	if (wakeup_time <= time_now)
 	{
@@ -125,24 +253,12 @@ simtime_t SimTime::sleep_until(const simtime_t wakeup_time)
 		return time_now;
 	}
 
-	simtime_t tw = wakeup_time;
-	FOREACH_CONST(it, sleepers)
-	{
-		const sleeper_t &s = it->second;
-		if (s.may_sleep && (s.wakeup_time < tw))
-			tw = s.wakeup_time;
-		//dprint("sleeper %lu: %s %is\n", it->first, s.may_sleep ? "ON" : "OFF", (int)s.wakeup_time - time_now);
-	}
-	//dprint("     >> %lu: %is\n", pthread_self(), (int)tw - time_now);
-	if (tw > time_now)
-		do_sleep_until(tw);
+	do_sleep_until();
 
+	s.waiting = true;
 	while (time_now < wakeup_time)
-	{
-		//dprint("        %lu: sleeping %is...\n", pthread_self(), (int)wakeup_time - time_now);
-		pthread_cond_wait(&run_cond, &mutex);
-	}
-	//dprint("        %lu: sleep done!\n", pthread_self());
+		pthread_cond_wait(&s.wake_cond, &mutex);
+	s.waiting = false;
 	pthread_mutex_unlock(&mutex);
 	return time_now;
 }
@@ -152,7 +268,10 @@ simtime_t SimTime::sleep(int sleep_seconds) { return sleep_until(time_now + slee
 void SimTime::enable_sleep()
 {
 	pthread_mutex_lock(&mutex);
-	sleepers[pthread_self()].set(time_now);
+	sleeper_t &s = sleepers[pthread_self()];
+	s.may_sleep = true;
+	s.wakeup_time = time_now;
+	heap_update(&s);
 	pthread_mutex_unlock(&mutex);
 
 	//dprint("%lu: sleep enabled\n", pthread_self());
@@ -161,24 +280,10 @@ void SimTime::enable_sleep()
 void SimTime::suspend_sleep()
 {
 	pthread_mutex_lock(&mutex);
-	sleepers[pthread_self()].may_sleep = false;
-
-	bool no_sleep = true;
-	simtime_t tw = 0;
-	FOREACH_CONST(it, sleepers)
-	{
-		const sleeper_t &s = it->second;
-		if (s.may_sleep && (no_sleep || (s.wakeup_time < tw)))
-		{
-			tw = s.wakeup_time;
-			no_sleep = false;
-		}
-		//dprint("sleeper %lu: %s %is\n", it->first, s.may_sleep ? "ON" : "OFF", (int)s.wakeup_time - time_now);
-	}
-	//dprint("     >> %lu: %is\n", pthread_self(), (int)tw - time_now);
-
-	if (tw > time_now)
-		do_sleep_until(tw);
+	sleeper_t &s = sleepers[pthread_self()];
+	s.may_sleep = false;
+	heap_remove(&s);
+	do_sleep_until();
 	pthread_mutex_unlock(&mutex);
 
 	//dprint("%lu: sleep suspended\n", pthread_self());
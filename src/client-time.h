@@ -12,9 +12,8 @@
 class SimTime {
 	private:
 		mutable pthread_mutex_t mutex;
-		pthread_cond_t run_cond;
 		simtime_t time_now;
-		void do_sleep_until(const simtime_t t) const;
+		void do_sleep_until() const;
 
 	public:
 		SimTime(); ~SimTime();
@@ -0,0 +1,93 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "sssim.h"
+#include "float-structs.h"
+#include "client-time.h"
+#include "client-timer.h"
+
+extern SimTime sim_time;
+
+//-----------------------------------------------------------------------------
+SimTimer::SimTimer() : thread_id(),
+					   mutex(),
+					   jobs(),
+					   running(false)
+{
+	pthread_mutex_init(&mutex, NULL);
+}
+
+SimTimer::~SimTimer()
+{
+	pthread_mutex_destroy(&mutex);
+}
+
+//-----------------------------------------------------------------------------
+void SimTimer::add(job_func_t *fn, void *context, simtime_t period, simtime_t first)
+{
+	job_t job;
+	job.fn = fn;
+	job.context = context;
+	job.period = (period > 0) ? period : 1;
+	job.next = first ? first : sim_time.now() + job.period;
+
+	pthread_mutex_lock(&mutex);
+	jobs.push_back(job);
+	pthread_mutex_unlock(&mutex);
+}
+
+bool SimTimer::start()
+{
+	if (running)
+		return false;
+	running = (pthread_create(&thread_id, NULL, &thread_wrap, this) == 0);
+	return running;
+}
+
+//-----------------------------------------------------------------------------
+void *SimTimer::thread()
+{
+	while (true)
+	{
+		pthread_mutex_lock(&mutex);
+		if (jobs.empty())
+		{
+			pthread_mutex_unlock(&mutex);
+			sim_time.sleep(60);
+			continue;
+		}
+		simtime_t t_next = jobs.front().next;
+		FOREACH_CONST(it, jobs)
+		{
+			if (it->next < t_next)
+				t_next = it->next;
+		}
+		pthread_mutex_unlock(&mutex);
+
+		const simtime_t t = sim_time.sleep_until(t_next);
+
+		pthread_mutex_lock(&mutex);
+		for (size_t i = 0; i < jobs.size(); ++i)
+		{
+			job_t &job = jobs[i];
+			if (job.next > t)
+				continue;
+			job_func_t *fn = job.fn;
+			void *context = job.context;
+			while (job.next <= t)
+				job.next += job.period;
+			pthread_mutex_unlock(&mutex);
+			fn(context);
+			pthread_mutex_lock(&mutex);
+		}
+		pthread_mutex_unlock(&mutex);
+	}
+
+	return NULL;
+}
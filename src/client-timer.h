@@ -0,0 +1,51 @@
+#ifndef _client_timer_h
+#define _client_timer_h
+
+/* requires:
+	#include <vector>
+	#include <pthread.h>
+	#include <stdint.h>
+	#include "client-time.h"
+*/
+
+
+//-----------------------------------------------------------------------------
+/** periodic jobs run in sim time, all from a single thread
+ *
+ *  The thread sleeps in SimTime::sleep_until() until the earliest job is due,
+ *  so jobs follow sim time at any speed ratio and never overlap each other.
+ *  Each job is called with its own context, e.g. a Seafloat, so that one
+ *  timer may serve several floats of a process. Jobs sharing data with other
+ *  threads must lock it themselves.
+ */
+class SimTimer {
+	public:
+		typedef void job_func_t(void * context);
+
+	private:
+		struct job_t {
+			job_func_t * fn;
+			void * context;
+			simtime_t period;
+			simtime_t next;
+		};
+
+		pthread_t thread_id;
+		pthread_mutex_t mutex;
+		std::vector<job_t> jobs;
+		bool running;
+
+		SimTimer(const SimTimer & _);
+		SimTimer & operator= (const SimTimer & _);
+
+		void * thread();
+		static void * thread_wrap(void * context) { return reinterpret_cast<SimTimer *>(context)->thread(); }
+
+	public:
+		SimTimer(); ~SimTimer();
+
+		void add(job_func_t * fn, void * context, simtime_t period, simtime_t first = 0);  // first = 0: one period from now
+		bool start();
+};
+
+#endif
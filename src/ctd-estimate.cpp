@@ -9,6 +9,7 @@
 #include <vector>
 #include <algorithm>
 #include <deque>
+#include <memory>
 #include <pthread.h>
 
 #include "util-leastsquares.h"
@@ -17,7 +18,7 @@
 #include "ctd-tracker.h"
 #include "ctd-estimate.h"
 
-double salt_est[] = {
+static const double salt_est_init[] = {
 	6.1252307891845703, 6.1252307891845703, 6.1264242172241214, 6.1288110733032228, 6.1311979293823242, 6.1368541717529297,   // first: 0 m
 	6.1425104141235352, 6.1550354957580566, 6.1675605773925781, 6.1778645515441895, 6.1881685256958008, 6.2043288092214164,
 	6.2204890927470320, 6.2374983623482807, 6.2560843177319301, 6.2746702731155803, 6.2934159839970230, 6.3151970371481791,
@@ -44,7 +45,7 @@ double salt_est[] = {
 	10.276322218577066, 10.304047883351643, 10.331773548126220, 10.359499212900797, 10.387224877675374, 10.414950542449951,
 	10.442676207224528, 10.470401871999105, 10.498127536773682, 10.525853201548259, 10.553578866322836, 10.581304531097413 }; // last: 149 m
 
-double temp_est[] = {
+static const double temp_est_init[] = {
 	16.285240173339844, 16.285240173339844, 16.270661926269533, 16.241505432128907, 16.212348937988281, 16.155048370361328,   // first: 0 m
 	16.097747802734375, 15.940177917480469, 15.782608032226562, 15.529661655426025, 15.276715278625488, 15.000703178116119,
 	14.724691077606748, 14.412858638490398, 14.034502824935450, 13.656147011380501, 13.277691827478384, 12.897348614561357,
@@ -79,7 +80,7 @@ inline double mix(double a, double b, double s) { return (1.0 - s) * a + s * b;
 
 
 // distance from z0 to find v0 in v[z]
-double z_distance(double v0, double z0, double v[], double zd_max) {
+double z_distance(double v0, double z0, const double v[], double zd_max) {
 	double zd = zd_max;
 
 	// below
@@ -117,7 +118,7 @@ double z_distance(double v0, double z0, double v[], double zd_max) {
 	return zd;
 }
 
-double z_distance(double v0, double z0, double v[], bool * zd_max) {
+double z_distance(double v0, double z0, const double v[], bool * zd_max) {
 	static double zd_max_dist = 5.0;
 	double zd = z_distance(v0, z0, v, zd_max_dist);
 	*zd_max = (zd >= zd_max_dist);
@@ -125,22 +126,6 @@ double z_distance(double v0, double z0, double v[], bool * zd_max) {
 }
 
 
-void ctd_minmax_depth(uint32_t t_lim, const ctd_iter_t & it_end, ctd_iter_t & it, double & z0, double & z1) {
-	unsigned int pressure_min = 1e9, pressure_max = 0;
-	do {
-		if (it->pressure > pressure_max) pressure_max = it->pressure;
-		if (it->pressure < pressure_min) pressure_min = it->pressure;
-		if (it->time <= t_lim) break;
-	} while (++it != it_end);
-	if (it == it_end) --it;
-
-	z0 = ctd.depth(pressure_min);
-	if (z0 < 0.0) z0 = 0.0;
-	z1 = ctd.depth(pressure_max);
-	if (z1 < z0) z1 = z0;
-}
-
-
 //-----------------------------------------------------------------------------
 bool _cmp_depth(const zvt_struct & a, const zvt_struct & b) { return a.depth < b.depth; }
 void density_filter(zvt_vector & dv) {
@@ -188,7 +173,7 @@ zvt_vector salt_vector(zvt_vector & dv) {
 
 
 //-----------------------------------------------------------------------------
-double _estimate_var(double var[], double z) {
+double _estimate_var(const double var[], double z) {
 	double z_int_d, z_fract = modf(z, &z_int_d);
 	int z_int = z_int_d;
 	if (z_int < 0)               return var[0];
@@ -196,92 +181,166 @@ double _estimate_var(double var[], double z) {
 	                             return var[z_int] + z_fract * (var[z_int + 1] - var[z_int]);
 }
 
+double ProfileSnapshot::temperature(double z) const { return _estimate_var(temp, z); }
+double ProfileSnapshot::salinity(double z) const { return _estimate_var(salt, z); }
+
+
+//-----------------------------------------------------------------------------
+ProfileEstimator profile;
+
+ProfileEstimator::ProfileEstimator():
+	current(),
+	mutex(),
+	bins_t0(0),
+	bins_t_last(0),
+	bins_n(0),
+	bins_serial(0),
+	bins_z_min(0.0),
+	bins_z_max(0.0),
+	cache_base(),
+	cache_serial(0),
+	cache_ok(false),
+	sc_mutex(),
+	sc_version(0),
+	sc_z_max(-1),
+	sc()
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_mutex_init(&sc_mutex, NULL);
+	memset(bins, 0, sizeof(bins));
+
+	ProfileSnapshot * p = new ProfileSnapshot;
+	p->version = 1;
+	memcpy(p->temp, temp_est_init, sizeof(p->temp));
+	memcpy(p->salt, salt_est_init, sizeof(p->salt));
+	std::atomic_store(&current, profile_ptr(p));
+}
+
+ProfileEstimator::~ProfileEstimator() {
+	pthread_mutex_destroy(&sc_mutex);
+	pthread_mutex_destroy(&mutex);
+}
+
+// with mutex held
+void ProfileEstimator::publish(ProfileSnapshot * p) {
+	const profile_ptr prev = snapshot();
+	if (!memcmp(p->temp, prev->temp, sizeof(p->temp)) && !memcmp(p->salt, prev->salt, sizeof(p->salt))) {
+		delete p;
+		return;
+	}
+	p->version = prev->version + 1;
+	std::atomic_store(&current, profile_ptr(p));
+}
+
+
+//-----------------------------------------------------------------------------
+// bring the bins up to date with ctd.data: new samples are added as they
+// come, a new t0 (or a reset CTD history) rebuilds from the newest sample
+// back to the first one taken at or before t0
+void ProfileEstimator::fold_ctd(uint32_t t0) {
+	ctd.lock_data();
+		ctd_iter_t it = ctd.data.begin(), it_end = ctd.data.end();
+		bool rebuild = (t0 != bins_t0) || ((it != it_end) && (it->time < bins_t_last));
+		if (rebuild) {
+			memset(bins, 0, sizeof(bins));
+			bins_t0 = t0;
+			bins_t_last = 0;
+			bins_n = 0;
+			++bins_serial;
+		}
+
+		if ((it != it_end) && (rebuild || (it->time > bins_t_last))) {
+			const uint32_t t_last = it->time;
+			for ( ; it != it_end; ++it) {
+				if (!rebuild && (it->time <= bins_t_last)) break;
+
+				double d_i = ctd.depth(it->pressure);
+				if (d_i < 0.0) d_i = 0.0;
+				if (d_i > zvar_count - 1) d_i = zvar_count - 1;
+
+				int d_above = floor(d_i);
+				bins[d_above].add(it->temperature, 1 - fabs(d_i - d_above));
+				int d_below = ceil(d_i);
+				bins[d_below].add(it->temperature, 1 - fabs(d_below - d_i));
+
+				if (!bins_n || (d_i < bins_z_min)) bins_z_min = d_i;
+				if (!bins_n || (d_i > bins_z_max)) bins_z_max = d_i;
+				++bins_n;
+
+				if (rebuild && (it->time <= t0)) break;
+			}
+			bins_t_last = t_last;
+			++bins_serial;
+		}
+	ctd.unlock_data();
+}
+
+
 //-----------------------------------------------------------------------------
-double estimate_temperature(double z) { return _estimate_var(temp_est, z); }
+double estimate_temperature(double z) { return profile.snapshot()->temperature(z); }
 
-bool new_temperature_estimate(double depth, double temp, double range, double temp_new_est[]) {
+bool new_temperature_estimate(double depth, double temp, double range, const ProfileSnapshot & base, double temp_new_est[]) {
 	static double zd_max = 5.0;
 
-	double zd = z_distance(temp, depth, temp_est, zd_max);
+	double zd = z_distance(temp, depth, base.temp, zd_max);
 	if (fabs(zd) >= zd_max) zd = 0.0;
-	double td = temp - estimate_temperature(depth + zd);
+	double td = temp - base.temperature(depth + zd);
 
 	int zr_lim_above = depth - range;     if (zr_lim_above < 0) zr_lim_above = 0;
 	int zr_lim_below = depth + range + 1; if (zr_lim_below > zvar_count) zr_lim_below = zvar_count;
 
 	int z;
-	for (z = 0; z <= zr_lim_above; ++z) temp_new_est[z] = estimate_temperature(z);
+	for (z = 0; z <= zr_lim_above; ++z) temp_new_est[z] = base.temperature(z);
 	for ( ; z < zr_lim_below; ++z) {
 		double zf = 1.0 - fabs(depth - z) / range;
-		temp_new_est[z] = estimate_temperature(z + zd * zf) + td * zf;
+		temp_new_est[z] = base.temperature(z + zd * zf) + td * zf;
 	}
-	for ( ; z < zvar_count; ++z) temp_new_est[z] = estimate_temperature(z);
+	for ( ; z < zvar_count; ++z) temp_new_est[z] = base.temperature(z);
 
 	return true;
 }
 
-bool new_temperature_estimate(uint32_t t0, double range, double temp_new_est[], bool debug_print = false) {
+// only the bins covered by the segment & range meters above & below it are
+// computed, the rest of temp_new_est is left as in base
+bool ProfileEstimator::new_temperature_estimate(uint32_t t0, double range, const ProfileSnapshot & base, double temp_new_est[], bool debug_print) {
 	static int z_adj_range = 3;
 	static double zd_max = 5.0;
 
-	ctd.lock_data();
-		ctd_iter_t ctd_last = ctd.data.begin();
-		double z0, z1;
-		ctd_minmax_depth(t0, ctd.data.end(), ctd_last, z0, z1);
-
-		int depth_above = floor(z0), depth_below = ceil(z1);
-		UpdateSum * temp_adj = new UpdateSum[depth_below - depth_above + 1];
-		for (int i = 0; i <= depth_below - depth_above; ++i) {
-			temp_adj[i].value = 0.0;
-			temp_adj[i].weight = 0.0;
-		}
-		int depth_0 = depth_above;
-
-		ctd_iter_t ctd_i;
-		for (ctd_i = ctd.data.begin(); ctd_i <= ctd_last; ++ctd_i) {
-			double d_i = depth_from_pressure(ctd_i->pressure - ctd.atm_p);
-
-			int d_above = floor(d_i);
-			double w_above = 1 - fabs(d_i - d_above);
-			temp_adj[d_above - depth_0].add(ctd_i->temperature, w_above);
-
-			int d_below = ceil(d_i);
-			double w_below = 1 - fabs(d_below - d_i);
-			temp_adj[d_below - depth_0].add(ctd_i->temperature, w_below);
-		}
-	ctd.unlock_data();
+	memcpy(temp_new_est, base.temp, sizeof(base.temp));
+	if (!bins_n) return false;
 
-	while ((temp_adj[depth_above - depth_0].weight < 0.5) && (depth_above <= depth_below)) ++depth_above;
-	while ((temp_adj[depth_below - depth_0].weight < 0.5) && (depth_above <= depth_below)) --depth_below;
+	int depth_above = floor(bins_z_min), depth_below = ceil(bins_z_max);
+	while ((depth_above <= depth_below) && (bins[depth_above].weight < 0.5)) ++depth_above;
+	while ((depth_above <= depth_below) && (bins[depth_below].weight < 0.5)) --depth_below;
 	if (depth_above >= depth_below) {
 		//printf("T: fail, valid only from %d to %d m\n", depth_above, depth_below);
-		delete[] temp_adj;
 		return false;
 	}
 
 	if (debug_print) dprint_stdout("NT: z %im .. %im\n", depth_above, depth_below);
 
-	for (int i = depth_above - depth_0; i <= depth_below - depth_0; ++i) temp_adj[i].normalize();
+	for (int z = depth_above; z <= depth_below; ++z)
+		if (bins[z].weight > 0.0) temp_new_est[z] = bins[z].value / bins[z].weight;
 
 	// interpolate missing data
-	for (int i = depth_above - depth_0 + 1; i < depth_below - depth_0; ++i) {
-		if (temp_adj[i].weight > 0.0) continue;
+	for (int z = depth_above + 1; z < depth_below; ++z) {
+		if (bins[z].weight > 0.0) continue;
 		int jump = 1;
-		while (temp_adj[i + jump].weight <= 0.0) ++jump;
-		double dv = (temp_adj[i + jump].value - temp_adj[i - 1].value) / (jump+1);
-		for (int j = 0; j < jump; ++j) temp_adj[i + j].value = temp_adj[i - 1].value + (j+1) * dv;
-		i += jump;
+		while (bins[z + jump].weight <= 0.0) ++jump;
+		double dv = (temp_new_est[z + jump] - temp_new_est[z - 1]) / (jump+1);
+		for (int j = 0; j < jump; ++j) temp_new_est[z + j] = temp_new_est[z - 1] + (j+1) * dv;
+		z += jump;
 	}
 
-	for (int z = depth_above; z <= depth_below; ++z) temp_new_est[z] = temp_adj[z - depth_0].value;
-	delete[] temp_adj;
-
 	// find mean error in z for above & below ends of new measurements wrt prev estimate
 	UpdateSum zd_above = {0.0, 0.0}, zd_below = {0.0, 0.0};
 	for (int z = depth_above; z <= depth_below; ++z) {
-		if ((z >= depth_above + z_adj_range) && (z <= depth_below - z_adj_range)) continue;
+		if ((z >= depth_above + z_adj_range) && (z <= depth_below - z_adj_range)) {
+			z = depth_below - z_adj_range;
+			continue;
+		}
 
-		double zd = z_distance(temp_new_est[z], z, temp_est, zd_max);
+		double zd = z_distance(temp_new_est[z], z, base.temp, zd_max);
 		if (fabs(zd) < zd_max) {
 			if (z < depth_above + z_adj_range) zd_above.add(zd, 1.0);
 			if (z > depth_below - z_adj_range) zd_below.add(zd, 1.0);
@@ -290,40 +349,43 @@ bool new_temperature_estimate(uint32_t t0, double range, double temp_new_est[],
 	zd_above.normalize();
 	zd_below.normalize();
 
-	double td_above = temp_new_est[depth_above] - estimate_temperature(depth_above + zd_above.value);
-	double td_below = temp_new_est[depth_below] - estimate_temperature(depth_below + zd_below.value);
+	double td_above = temp_new_est[depth_above] - base.temperature(depth_above + zd_above.value);
+	double td_below = temp_new_est[depth_below] - base.temperature(depth_below + zd_below.value);
 
 	//printf("T: %dm:Z%+.2f,T%+.2f  %dm:Z%+.2f,T%+.2f\n",
 	//	depth_above, zd_above.value, td_above,
 	//	depth_below, zd_below.value, td_below);
 
-	int z;
-	for (z = 0; z <= depth_above - range; ++z) temp_new_est[z] = estimate_temperature(z);
+	int z = floor(depth_above - range) + 1;
+	if (z < 0) z = 0;
 	for ( ; z < depth_above; ++z) {
 		double zf = 1.0 - (depth_above - z) / range;
-		temp_new_est[z] = estimate_temperature(z + zd_above.value * zf) + td_above * zf;
+		temp_new_est[z] = base.temperature(z + zd_above.value * zf) + td_above * zf;
 	}
 
 	z = depth_below + 1;
 	for (int i = 0; (i < range) && (z < zvar_count); ++i, ++z) {
 		double zf = 1.0 - (z - depth_below) / range;
-		temp_new_est[z] = estimate_temperature(z + zd_below.value * zf) + td_below * zf;
+		temp_new_est[z] = base.temperature(z + zd_below.value * zf) + td_below * zf;
 	}
-	for ( ; z < zvar_count; ++z) temp_new_est[z] = estimate_temperature(z);
-	//for (int z = depth_below + 1; z < zvar_count; ++z)
-		//temp_new_est[z] = estimate_temperature(z + zd_below.value) + td_below;
 
 	return true;
 }
 
-void adjust_temperature_estimate(uint32_t t0, bool debug_print) {
-	double temp_new_est[zvar_count];
-	bool new_temp_ok = new_temperature_estimate(t0, TEMP_UPDATE_RANGE, temp_new_est, debug_print);
-	if (new_temp_ok) memcpy(temp_est, temp_new_est, sizeof(temp_est));
+void ProfileEstimator::adjust_temperature(uint32_t t0, bool debug_print) {
+	pthread_mutex_lock(&mutex);
+		fold_ctd(t0);
+		const profile_ptr base = snapshot();
+		ProfileSnapshot * p = new ProfileSnapshot(*base);
+		if (new_temperature_estimate(t0, TEMP_UPDATE_RANGE, *base, p->temp, debug_print)) publish(p);
+		else delete p;
+	pthread_mutex_unlock(&mutex);
 }
 
+void adjust_temperature_estimate(uint32_t t0, bool debug_print) { profile.adjust_temperature(t0, debug_print); }
+
 //-----------------------------------------------------------------------------
-double estimate_salinity(double z) { return _estimate_var(salt_est, z); }
+double estimate_salinity(double z) { return profile.snapshot()->salinity(z); }
 
 double estimate_salinity(double salt_guess, double temp, unsigned int pressure, double d0) {
 	static double ds_dd = 1.30;
@@ -387,7 +449,7 @@ double estimate_salinity(double z, double temp, double density) {
 	return estimate_salinity(estimate_salinity(z), temp, pressure_from_depth(z), density);
 }
 
-bool new_salinity_estimate(const zvt_vector & salt_map, double range, double salt_new_est[]) {
+bool new_salinity_estimate(const zvt_vector & salt_map, double range, const ProfileSnapshot & base, double salt_new_est[]) {
 	if (salt_map.empty()) {
 		//printf("S: fail, empty data!\n");
 		return false;
@@ -399,10 +461,10 @@ bool new_salinity_estimate(const zvt_vector & salt_map, double range, double sal
 		const double & z = it->depth;
 		const double & s = it->value;
 		bool zd_max = true;
-		double zd = z_distance(s, z, salt_est, &zd_max);
-		if (zd_max) zs_delta.push_back(zs_delta_s(z, 0.0, s - estimate_salinity(z)));
+		double zd = z_distance(s, z, base.salt, &zd_max);
+		if (zd_max) zs_delta.push_back(zs_delta_s(z, 0.0, s - base.salinity(z)));
 		else        zs_delta.push_back(zs_delta_s(z, zd, 0.0));
-		//printf("  %.2fm:%.3f %c%+.2f\n", z, s, zd_max?'S':'Z', zd_max?(s - estimate_salinity(z)):zd);
+		//printf("  %.2fm:%.3f %c%+.2f\n", z, s, zd_max?'S':'Z', zd_max?(s - base.salinity(z)):zd);
 	}
 	if (zs_delta.empty()) {
 		//printf("S: fail, all points (%u) too near surface\n", static_cast<int>(salt_map.size()));
@@ -414,10 +476,10 @@ bool new_salinity_estimate(const zvt_vector & salt_map, double range, double sal
 	zs_delta_t::iterator zs_it = zs_delta.begin();
 
 	// above
-	for (z = 0; z <= zs_it->z - range; ++z) salt_new_est[z] = estimate_salinity(z);
+	for (z = 0; z <= zs_it->z - range; ++z) salt_new_est[z] = base.salinity(z);
 	for ( ; z < zs_it->z; ++z) {
 		double zf = 1.0 - (zs_it->z - z) / range;
-		salt_new_est[z] = estimate_salinity(z + zs_it->zd * zf) + zs_it->sd * zf;
+		salt_new_est[z] = base.salinity(z + zs_it->zd * zf) + zs_it->sd * zf;
 	}
 
 	// between
@@ -428,7 +490,7 @@ bool new_salinity_estimate(const zvt_vector & salt_map, double range, double sal
 		double sd_d = zs_it->sd - zs_prev->sd;
 		for ( ; z < zs_it->z; ++z) {
 			double f = fm * (z - zs_prev->z);
-			salt_new_est[z] = estimate_salinity(z + zs_prev->zd + f * zd_d) + zs_prev->sd + f * sd_d;
+			salt_new_est[z] = base.salinity(z + zs_prev->zd + f * zd_d) + zs_prev->sd + f * sd_d;
 		}
 		zs_prev = zs_it;
 	}
@@ -436,20 +498,34 @@ bool new_salinity_estimate(const zvt_vector & salt_map, double range, double sal
 	// below
 	for (int i = 0; (i < range) && (z < zvar_count); ++i, ++z) {
 		double zf = 1.0 - (z - zs_prev->z) / range;
-		salt_new_est[z] = estimate_salinity(z + zs_prev->zd * zf) + zs_prev->sd * zf;
+		salt_new_est[z] = base.salinity(z + zs_prev->zd * zf) + zs_prev->sd * zf;
 	}
-	for ( ; z < zvar_count; ++z) salt_new_est[z] = estimate_salinity(z);
+	for ( ; z < zvar_count; ++z) salt_new_est[z] = base.salinity(z);
 
 	return true;
 }
 
-void adjust_salinity_estimate(zvt_vector & density_map) {
-	double salt_new_est[zvar_count];
+void ProfileEstimator::adjust_salinity(zvt_vector & density_map) {
 	density_filter(density_map);
-	bool new_salt_ok = new_salinity_estimate(salt_vector(density_map), SALT_UPDATE_RANGE, salt_new_est);
-	if (new_salt_ok) memcpy(salt_est, salt_new_est, sizeof(salt_est));
+	const zvt_vector salt_map = salt_vector(density_map);
+	pthread_mutex_lock(&mutex);
+		const profile_ptr base = snapshot();
+		ProfileSnapshot * p = new ProfileSnapshot(*base);
+		if (new_salinity_estimate(salt_map, SALT_UPDATE_RANGE, *base, p->salt)) publish(p);
+		else delete p;
+	pthread_mutex_unlock(&mutex);
 }
 
+void ProfileEstimator::set_salinity(const double salt_new[]) {
+	pthread_mutex_lock(&mutex);
+		ProfileSnapshot * p = new ProfileSnapshot(*snapshot());
+		memcpy(p->salt, salt_new, sizeof(p->salt));
+		publish(p);
+	pthread_mutex_unlock(&mutex);
+}
+
+void adjust_salinity_estimate(zvt_vector & density_map) { profile.adjust_salinity(density_map); }
+
 
 //-----------------------------------------------------------------------------
 double estimate_density(double z) {
@@ -461,16 +537,31 @@ double estimate_density(double z) {
 
 #define _estimate_density(z)\
 	density_from_STD(\
-		_estimate_var(new_salt_ok ? salt_new_est : salt_est, z),\
-		_estimate_var(new_temp_ok ? temp_new_est : temp_est, z),\
+		_estimate_var(new_salt_ok ? salt_new_est : base->salt, z),\
+		_estimate_var(new_temp_ok ? temp_new_est : base->temp, z),\
 		pressure_from_depth(z)\
 	)
 
-double estimate_density(double z, zvt_vector & density_map, uint32_t t0) {
+double estimate_density(double z, zvt_vector & density_map, uint32_t t0) { return profile.density(z, density_map, t0); }
+
+double ProfileEstimator::density(double z, zvt_vector & density_map, uint32_t t0) {
 	density_filter(density_map);
+	const zvt_vector salt_map = salt_vector(density_map);
 	double salt_new_est[zvar_count], temp_new_est[zvar_count];
-	bool new_temp_ok = new_temperature_estimate(t0, TEMP_ADJUST_RANGE, temp_new_est);
-	bool new_salt_ok = new_salinity_estimate(salt_vector(density_map), SALT_ADJUST_RANGE, salt_new_est);
+	bool new_temp_ok, new_salt_ok;
+
+	pthread_mutex_lock(&mutex);
+		const profile_ptr base = snapshot();
+		fold_ctd(t0);
+		if ((cache_base != base) || (cache_serial != bins_serial)) {
+			cache_ok = new_temperature_estimate(t0, TEMP_ADJUST_RANGE, *base, cache_temp);
+			cache_base = base;
+			cache_serial = bins_serial;
+		}
+		new_temp_ok = cache_ok;
+		if (new_temp_ok) memcpy(temp_new_est, cache_temp, sizeof(temp_new_est));
+	pthread_mutex_unlock(&mutex);
+	new_salt_ok = new_salinity_estimate(salt_map, SALT_ADJUST_RANGE, *base, salt_new_est);
 
 	double de = _estimate_density(z); //density_from_STD(salt, temp, pressure_from_depth(z));
 
@@ -556,38 +647,66 @@ double estimate_density(double z, zvt_vector & density_map, uint32_t t0) {
 
 
 //-----------------------------------------------------------------------------
-bool estimate_soundchannel(int z_max, int * z, int * z_above, int * z_below) {
+soundchannel_t ProfileEstimator::soundchannel(int z_max) {
 	const double soundchannel_range = 1.5; // seconds faster than min soundspeed
-	double ss[zvar_count];
 
 	//int z_max = get_bottom_depth();
 	if (z_max >= zvar_count) z_max = zvar_count - 1;
+
+	const profile_ptr p = snapshot();
+	pthread_mutex_lock(&sc_mutex);
+	if ((p->version == sc_version) && (z_max == sc_z_max)) {
+		soundchannel_t r = sc;
+		pthread_mutex_unlock(&sc_mutex);
+		return r;
+	}
+
+	static unsigned int pressure[zvar_count];
+	static bool pressure_set = false;  // under sc_mutex
+	if (!pressure_set) {
+		for (int zi = 0; zi < zvar_count; ++zi) pressure[zi] = pressure_from_depth(zi);
+		pressure_set = true;
+	}
+
+	double ss[zvar_count];
+	if (z_max >= 0) soundspeed_from_STD_n(p->salt, p->temp, pressure, ss, z_max + 1);
 	double ss_min = 1.0e9;
 	int ss_min_z = -1;
 	for (int zi = 0; zi <= z_max; ++zi) {
-		double ss_z = soundspeed_from_STD(salt_est[zi], temp_est[zi], pressure_from_depth(zi));
-		ss[zi] = ss_z;
-		if (ss_z < ss_min) {
-			ss_min = ss_z;
+		if (ss[zi] < ss_min) {
+			ss_min = ss[zi];
 			ss_min_z = zi;
 		}
 	}
 
-	*z = ss_min_z;
-	if (z_above != NULL) *z_above = -1;
-	if (z_below != NULL) *z_below = -1;
-	if ((ss_min_z <= 0) || (ss_min_z >= z_max)) return false;
+	soundchannel_t r = { false, ss_min_z, -1, -1, (ss_min_z > 0) ? ss_min : -1.0 };
+	if ((ss_min_z > 0) && (ss_min_z < z_max)) {
+		double ss_max = ss_min + soundchannel_range;
 
-	double ss_max = ss_min + soundchannel_range;
+		int za;
+		for (za = ss_min_z; za >= 0; --za) if (ss[za] >= ss_max) break;
+		r.z_above = za + 1;
 
-	int za;
-	for (za = ss_min_z; za >= 0; --za) if (ss[za] >= ss_max) break;
-	if (z_above != NULL) *z_above = za + 1;
+		int zb;
+		for (zb = ss_min_z; zb <= z_max; ++zb) if (ss[zb] >= ss_max) break;
+		r.z_below = zb - 1;
 
-	int zb;
-	for (zb = ss_min_z; zb <= z_max; ++zb) if (ss[zb] >= ss_max) break;
-	if (z_below != NULL) *z_below = zb - 1;
+		r.ok = (za > 0) && (zb < z_max);
+	}
 
-	return ((za > 0) && (zb < z_max));
+	sc_version = p->version;
+	sc_z_max = z_max;
+	sc = r;
+	pthread_mutex_unlock(&sc_mutex);
+	return r;
+}
+
+bool estimate_soundchannel(int z_max, int * z, int * z_above, int * z_below) {
+	const soundchannel_t sc = profile.soundchannel(z_max);
+	*z = sc.z;
+	if (z_above != NULL) *z_above = sc.z_above;
+	if (z_below != NULL) *z_below = sc.z_below;
+	return sc.ok;
 }
 
+double estimate_soundchannel_soundspeed(int z_max) { return profile.soundchannel(z_max).soundspeed; }
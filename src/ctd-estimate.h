@@ -1,6 +1,11 @@
 #ifndef _ctd_estimate_h
 #define _ctd_estimate_h
 
+/* requires:
+	#include <memory>
+	#include <vector>
+	#include <pthread.h>
+*/
 
 #define  SALT_UPDATE_RANGE   3.0
 #define  SALT_ADJUST_RANGE  20.0
@@ -49,6 +54,81 @@ struct UpdateSum {
 	}
 };
 
+/**
+ * One published state of the water column estimate, 1 m bins from the
+ * surface down. Never modified once published, so any number of readers
+ * may hold on to one while the estimator publishes the next.
+ */
+struct ProfileSnapshot {
+	unsigned int version;  // bumped by each published change
+	double temp[zvar_count];
+	double salt[zvar_count];
+
+	double temperature(double z) const;
+	double salinity(double z) const;
+};
+typedef std::shared_ptr<const ProfileSnapshot> profile_ptr;
+
+struct soundchannel_t {
+	bool ok;            // see estimate_soundchannel()
+	int z, z_above, z_below;
+	double soundspeed;  // at z, m/s; < 0 if none
+};
+
+/**
+ * Temperature & salinity profile estimator of one float
+ *
+ * CTD samples since the start of the current dive segment are folded into
+ * per-meter bins as they arrive, so an adjustment only touches the bins
+ * covered by the segment & their blend margins. Readers get the current
+ * estimate with snapshot() without taking any lock.
+ */
+class ProfileEstimator {
+	private:
+		profile_ptr current;  // only via std::atomic_load/store
+		pthread_mutex_t mutex;
+
+		// CTD samples since t0, binned by depth
+		uint32_t bins_t0;
+		uint32_t bins_t_last;     // time of newest folded sample
+		unsigned int bins_n;      // folded samples
+		unsigned int bins_serial; // changes with the bins
+		double bins_z_min, bins_z_max;
+		UpdateSum bins[zvar_count];
+
+		// TEMP_ADJUST_RANGE estimate for density(), reused while nothing changes
+		profile_ptr cache_base;
+		unsigned int cache_serial;
+		bool cache_ok;
+		double cache_temp[zvar_count];
+
+		// sound channel of the latest version & z_max asked for
+		pthread_mutex_t sc_mutex;
+		unsigned int sc_version;
+		int sc_z_max;
+		soundchannel_t sc;
+
+		void fold_ctd(uint32_t t0);
+		bool new_temperature_estimate(uint32_t t0, double range, const ProfileSnapshot & base, double temp_new_est[], bool debug_print = false);
+		void publish(ProfileSnapshot * p);  // takes ownership; dropped if no different from current
+
+	public:
+		ProfileEstimator(); ~ProfileEstimator();
+
+		profile_ptr snapshot() const { return std::atomic_load(&current); }
+
+		void adjust_temperature(uint32_t t0, bool debug_print = false);
+		void adjust_salinity(zvt_vector & density_map);
+		void set_salinity(const double salt_new[]);
+
+		double density(double z, zvt_vector & density_map, uint32_t t0);
+		soundchannel_t soundchannel(int z_max);
+};
+
+extern ProfileEstimator profile;
+
+
+// shorthands for the float's profile
 double estimate_temperature(double z);
 void adjust_temperature_estimate(uint32_t t0, bool debug_print = false);
 
@@ -65,5 +145,6 @@ double estimate_density(double z, zvt_vector & density_map, uint32_t t0);
  * always sets z, z_above and z_below -- if return FALSE, these may be -1 if invalid
  */
 bool estimate_soundchannel(int z_max, int * z, int * z_above = NULL, int * z_below = NULL);
+double estimate_soundchannel_soundspeed(int z_max);  // < 0 if no channel depth
 
 #endif // _ctd_estimate_h
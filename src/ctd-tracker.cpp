@@ -2,6 +2,7 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <cmath>
 #include <deque>
 #include <pthread.h>
 #include <stdint.h>
@@ -19,29 +20,36 @@ CTDTracker ctd;
 
 /**
  * Chi-square distribution with n degrees of freedom
- * used for checking probability of v (normalized)
+ * used for checking probability of v (normalized): lo < v < hi
  *
  * with precalculated numbers found using Distribution Calculator
  * from http://www.vias.org/simulations/simusoft_distcalc.html
  */
-bool chi_square_crit_range_check(unsigned int n, double v) {
-	// bool doubleEnded = true;
-	// double significanceLevel = 1.0e-5;
-
-	switch(n) {
-		case 1:
-			return (v < 23.9355);  // single-ended, level 1e-6 (1e-5: 19.5132)
-		case 5:
-			return ((v > 0.0246) && (v < 32.3761));
-		case 20:
-			return ((v > 3.0694) && (v < 60.9879));
-		case 50:
-			return ((v > 17.4178) && (v < 107.0165));
-		default:
-			return false;  // fail on uncalculated deg. of freedom
-	}
+static const struct {
+	unsigned int n;
+	double lo, hi;
+} chi_square_crit[] = {
+	{  1, -HUGE_VAL, 23.9355 },  // single-ended, level 1e-6 (1e-5: 19.5132)
+	{  5,  0.0246,   32.3761 },
+	{ 20,  3.0694,   60.9879 },
+	{ 50, 17.4178,  107.0165 }
+};
+
+static void chi_square_crit_range(unsigned int n, double & lo, double & hi) {
+	for (unsigned int i = 0; i < sizeof(chi_square_crit) / sizeof(chi_square_crit[0]); ++i)
+		if (chi_square_crit[i].n == n) {
+			lo = chi_square_crit[i].lo;
+			hi = chi_square_crit[i].hi;
+			return;
+		}
+	lo = HUGE_VAL;  // fail on uncalculated deg. of freedom
+	hi = -HUGE_VAL;
 }
 
+// fast residual checks closer than this (relative) to a critical value are
+// redone by summing the residuals one at a time
+#define  CTD_CHI2_MARGIN  1e-6
+
 
 //-----------------------------------------------------------------------------
 CTDTracker::CTDTracker():
@@ -59,6 +67,9 @@ CTDTracker::CTDTracker():
 	pred_length[0] =  1; pred_min_length[0] =  7; // no proper reasons for exactly these pred_min_lengths,
 	pred_length[1] =  5; pred_min_length[1] = 20; // they depend on signal noise autocorrelation
 	pred_length[2] = 20; pred_min_length[2] = 40;
+	for (unsigned int i = 0; i < CTD_PRED_COUNT; ++i)
+		chi_square_crit_range(pred_length[i], chi2_lo[i], chi2_hi[i]);
+	lst_reset();
 	depth_state.depth_now = -1.0;
 }
 
@@ -81,7 +92,7 @@ double CTDTracker::max_surf_p() {
 bool CTDTracker::surface_ds_ok() {
 	if (!surfacing_time) {
 		surfacing_time = data[0].time;
-		lst.reset();
+		lst_reset();
 	}
 
 	depth_state.depth_now = depth(data[0].pressure);
@@ -94,6 +105,60 @@ bool CTDTracker::surface_ds_ok() {
 
 
 //-----------------------------------------------------------------------------
+// lst and the prediction windows are only modified together, through these
+
+void CTDTracker::lst_reset() {
+	lst.reset();
+	for (unsigned int i = 0; i < CTD_PRED_COUNT; ++i) {
+		latest[i].reset();
+		earliest[i].reset();
+	}
+}
+
+// data[0] has just been pushed to data
+void CTDTracker::lst_push_front() {
+	lst.add(data[0].time, data[0].pressure);
+	const int64_t t0 = lst.t0;
+	for (unsigned int i = 0; i < CTD_PRED_COUNT; ++i) {
+		const unsigned int pl = pred_length[i];
+		latest[i].add(int64_t(data[0].time) - t0, data[0].pressure);
+		if (lst.n > pl) latest[i].remove(int64_t(data[pl].time) - t0, data[pl].pressure);
+		if (lst.n <= pl) earliest[i].add(int64_t(data[0].time) - t0, data[0].pressure);
+	}
+}
+
+// drops data[lst.n-1]
+void CTDTracker::lst_pop_back() {
+	if (lst.n == 0) return;
+	const unsigned int n = lst.n;
+	const int64_t t0 = lst.t0;
+	const ctd_data_t & d = data[n-1];
+	for (unsigned int i = 0; i < CTD_PRED_COUNT; ++i) {
+		const unsigned int pl = pred_length[i];
+		if (n <= pl) latest[i].remove(int64_t(d.time) - t0, d.pressure);
+		earliest[i].remove(int64_t(d.time) - t0, d.pressure);
+		if (n > pl) earliest[i].add(int64_t(data[n-1-pl].time) - t0, data[n-1-pl].pressure);
+	}
+	lst.remove(d.time, d.pressure);
+}
+
+// after lst has been refilled directly
+void CTDTracker::lst_rebuild_windows() {
+	const int64_t t0 = lst.t0;
+	for (unsigned int i = 0; i < CTD_PRED_COUNT; ++i) {
+		const unsigned int pl = (pred_length[i] < lst.n) ? pred_length[i] : lst.n;
+		latest[i].reset();
+		earliest[i].reset();
+		for (unsigned int j = 0; j < pl; ++j) {
+			latest[i].add(int64_t(data[j].time) - t0, data[j].pressure);
+			earliest[i].add(int64_t(data[lst.n-1-j].time) - t0, data[lst.n-1-j].pressure);
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// reference check: sum the residuals of data[test_end-test_length .. test_end)
 bool CTDTracker::validate_range(uint32_t test_length, uint32_t test_end) {
 	LeastSquaresTracker lst_base = lst;
 	for (unsigned int j = test_end - test_length; j < test_end; ++j)
@@ -108,8 +173,54 @@ bool CTDTracker::validate_range(uint32_t test_length, uint32_t test_end) {
 		i_s2 += e * e;
 	}
 
+	double lo, hi;
+	chi_square_crit_range(test_length, lo, hi);
 	return (e_s2 == 0.0) ? (i_s2 <= e_s2)
-		: chi_square_crit_range_check(test_length, i_s2/e_s2);
+		: ((i_s2/e_s2 > lo) && (i_s2/e_s2 < hi));
+}
+
+/**
+ * Same result as validate_range(pred_length[i], test_end), where w holds the
+ * window's sums, but in constant time: the base fit comes from exact sums and
+ * the residuals are expanded around the window's mean time & an integer
+ * pressure offset, so that the integer parts cancel exactly. Only if the
+ * result is too close to call is the window summed sample by sample.
+ */
+bool CTDTracker::validate_window(unsigned int i, const ctd_window_t & w, uint32_t test_end) {
+	LeastSquaresTracker lst_base = lst;
+	lst_base.remove_sums(w.n, w.s_t, w.s_t2, w.s_p, w.s_p2, w.s_tp);
+
+	double a, b, e_s2;
+	if (!lst_base.get_state(a, b, e_s2)) return true;
+
+	if ((e_s2 > 0.0) && (w.n > 0)) {
+		const int64_t n = w.n;
+		const int64_t tc = w.s_t / n;
+		const double pc = a + b * tc;
+		const int64_t pi = llround(pc);
+		const double da = pc - pi;
+
+		// sums of u = t - tc & q = p - pi
+		const double s_u = w.s_t - n * tc;
+		const double s_u2 = w.s_t2 - 2 * tc * w.s_t + n * tc * tc;
+		const double s_q = w.s_p - n * pi;
+		const double s_q2 = w.s_p2 - 2 * pi * w.s_p + n * pi * pi;
+		const double s_uq = w.s_tp - pi * w.s_t - tc * w.s_p + n * tc * pi;
+
+		// sum( (q - da - b u)^2 )
+		const double i_s2 = s_q2 - 2.0 * da * s_q - 2.0 * b * s_uq
+			+ n * da * da + 2.0 * da * b * s_u + b * b * s_u2;
+
+		const double v = i_s2 / e_s2;
+		const double m = CTD_CHI2_MARGIN * (fabs(v) + 1.0);
+		if ((i_s2 > CTD_CHI2_MARGIN * (s_q2 + 1.0))
+			&& (fabs(v - chi2_lo[i]) > m) && (fabs(v - chi2_hi[i]) > m))
+		{
+			return (v > chi2_lo[i]) && (v < chi2_hi[i]);
+		}
+	}
+
+	return validate_range(pred_length[i], test_end);
 }
 
 bool CTDTracker::validate_state(int * first_valid) {
@@ -119,14 +230,14 @@ bool CTDTracker::validate_state(int * first_valid) {
 		if (lst.n < pl + pred_min_length[i]) break;
 
 		// latest
-		if (!validate_range(pl, pl)) {
+		if (!validate_window(i, latest[i], pl)) {
 			//printf("[CTD invalid latest %u]\n", pl); // DEBUG
 			*first_valid = (i < 1) ? 0 : pred_length[i-1] - 1;
 			return false;
 		}
 
 		// earliest
-		if (!validate_range(pl, lst.n)) {
+		if (!validate_window(i, earliest[i], lst.n)) {
 			//printf("[CTD invalid earliest %u]\n", pl); // DEBUG
 			*first_valid = pred_min_length[0] - 1;
 			return false;
@@ -148,20 +259,21 @@ bool CTDTracker::underwater_ds_ok() {
 		}
 		surfacing_time = 0;
 	}
-	lst.add(data[0].time, data[0].pressure);
+	lst_push_front();
 
 	// check fitness of latest & earliest measurement(s)
 	int first_valid = 0;
 	if (!validate_state(&first_valid)) {
 		lst.reset();
 		for (int j = first_valid; j >= 0; --j) lst.add(data[j].time, data[j].pressure);
+		lst_rebuild_windows();
 	}
 
 	// check variance
 	double a, b, s2;
 	if (lst.get_state(a, b, s2) && (s2 > max_variance)) {
-		lst.reset();
-		lst.add(data[0].time, data[0].pressure);
+		lst_reset();
+		lst_push_front();
 	}
 
 	if (lst.n >= 3) {
@@ -189,7 +301,7 @@ bool CTDTracker::underwater_ds_ok() {
 //-----------------------------------------------------------------------------
 bool CTDTracker::add(const ctd_data_t & ctd_new) {
 	lock_data();
-		while (lst.n >= pred_max_length) lst.remove(data[lst.n-1].time, data[lst.n-1].pressure);
+		while (lst.n >= pred_max_length) lst_pop_back();
 
 		while (data.size() >= max_size) data.pop_back();
 		data.push_front(ctd_new);
@@ -207,7 +319,7 @@ bool CTDTracker::add(const ctd_data_t & ctd_new) {
 void CTDTracker::reset(bool clear_data) {
 	lock_data();
 		surfacing_time = 0;
-		lst.reset();
+		lst_reset();
 		if (clear_data) {
 			data.clear();
 			depth_state.depth_now = -1.0;
@@ -29,6 +29,22 @@ struct DepthState {
 typedef std::deque<ctd_data_t> ctd_history_t;
 typedef ctd_history_t::iterator ctd_iter_t;
 
+/**
+ * Running sums over a window of the samples held by a LeastSquaresTracker
+ *
+ * Times (relative to the tracker's t0) and pressures are whole numbers, so
+ * these sums are exact and can be subtracted from the tracker's own sums
+ * without changing a single bit of the result.
+ */
+struct ctd_window_t {
+	unsigned int n;
+	int64_t s_t, s_t2, s_p, s_p2, s_tp;
+
+	void reset() { n = 0; s_t = s_t2 = s_p = s_p2 = s_tp = 0; }
+	void add(int64_t t, int64_t p) { ++n; s_t += t; s_t2 += t*t; s_p += p; s_p2 += p*p; s_tp += t*p; }
+	void remove(int64_t t, int64_t p) { --n; s_t -= t; s_t2 -= t*t; s_p -= p; s_p2 -= p*p; s_tp -= t*p; }
+};
+
 class CTDTracker {
 	private:
 		unsigned int max_size;
@@ -47,8 +63,16 @@ class CTDTracker {
 		bool surface_ds_ok();
 
 		// underwater
-		LeastSquaresTracker lst;
+		LeastSquaresTracker lst;  // holds data[0 .. lst.n)
+		ctd_window_t latest[CTD_PRED_COUNT];    // data[0 .. pred_length)
+		ctd_window_t earliest[CTD_PRED_COUNT];  // data[lst.n - pred_length .. lst.n)
+		double chi2_lo[CTD_PRED_COUNT], chi2_hi[CTD_PRED_COUNT];
+		void lst_reset();
+		void lst_push_front();
+		void lst_pop_back();
+		void lst_rebuild_windows();
 		bool validate_range(uint32_t test_length, uint32_t test_end);
+		bool validate_window(unsigned int i, const ctd_window_t & w, uint32_t test_end);
 		bool validate_state(int * first_valid);
 		bool underwater_ds_ok();
 
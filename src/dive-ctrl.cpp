@@ -8,6 +8,7 @@
 #include <netinet/in.h>
 #include <svl/SVL.h>
 #include <deque>
+#include <memory>
 
 #include "vt100.h"
 #include "util-leastsquares.h"
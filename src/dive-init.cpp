@@ -5,6 +5,7 @@
 #include <unistd.h>
 #include <vector>
 #include <stack>
+#include <memory>
 #include <netinet/in.h>
 #include <svl/SVL.h>
 
@@ -25,7 +26,6 @@
 
 extern SimTime sim_time;
 
-extern double salt_est[];
 extern ts_double bottom_depth;
 extern ts_double bottom_min_distance;
 
@@ -325,6 +325,7 @@ void dive_init_t::_set_salinity_estimate()
 		return;
 	}
 
+	double salt_est[zvar_count];
 	zvt_const_iter it = salt_map.begin();
 	int zi = 0;
 	double
@@ -344,6 +345,7 @@ void dive_init_t::_set_salinity_estimate()
 	}
 	for (; (zi < zvar_count); ++zi)
 		salt_est[zi] = s0 + (zi - z0) * ds_dz;
+	profile.set_salinity(salt_est);
 }
 
 //-----------------------------------------------------------------------------
@@ -0,0 +1,337 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include <pthread.h>
+#include <svl/SVL.h>
+
+#include "sssim.h"
+#include "sea-data.h"
+#include "sea-layers.h"
+#include "env-sea.h"
+#include "env-catalogue.h"
+#include "util-math.h"
+
+// as Sea::value() joins nodes: 0 is missing data
+static double join(double f, double a, double b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+	return interpolate(f, a, b);
+}
+
+// -1 is missing data
+static double join_soundspeed(double f, double a, double b)
+{
+	if (a <= 0.0)
+		return b;
+	if (b <= 0.0)
+		return a;
+	return interpolate(f, a, b);
+}
+
+//-----------------------------------------------------------------------------
+SeaCatalogue::SeaCatalogue(size_t _tile_cache) : min(), step(),
+												  periods(), tile_cache(_tile_cache),
+												  derive_fields(0), slice_step(0.0), current()
+{
+	pthread_mutex_init(&load_mutex, NULL);
+}
+
+SeaCatalogue::~SeaCatalogue()
+{
+	pthread_mutex_lock(&load_mutex);
+	FOREACH(it, periods)
+	{
+		if ((*it)->loading)
+			pthread_join((*it)->loader, NULL);
+		delete *it;
+	}
+	pthread_mutex_unlock(&load_mutex);
+	pthread_mutex_destroy(&load_mutex);
+}
+
+bool SeaCatalogue::add(double t0, const char *source)
+{
+	if (!periods.empty() && (t0 <= periods.back()->t0))
+		return false;
+
+	period_t *p = new period_t();
+	p->t0 = t0;
+	p->source = source;
+	p->loading = false;
+	periods.push_back(p);
+	return true;
+}
+
+bool SeaCatalogue::read(const char *fn)
+{
+	FILE *f = fopen(fn, "r");
+	if (f == NULL)
+		return false;
+
+	char line[1024], source[1024];
+	double t0;
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), f))
+	{
+		if ((line[0] == '#') || (sscanf(line, " %c", source) < 1))
+			continue; // comment or empty
+		ok = (sscanf(line, "%lf %1023s", &t0, source) == 2) && add(t0, source);
+	}
+	fclose(f);
+
+	return ok && !periods.empty();
+}
+
+//-----------------------------------------------------------------------------
+unsigned int SeaCatalogue::index(double t) const
+{
+	unsigned int i = 0;
+	while ((i + 1 < periods.size()) && (periods[i + 1]->t0 <= t))
+		++i;
+	return i;
+}
+
+SeaCatalogue::sea_ptr SeaCatalogue::load(unsigned int i)
+{
+	period_t *p = periods[i];
+	const bool is_dir = !p->source.empty() && (p->source[p->source.size() - 1] == '/');
+	sea_ptr s(is_dir ? new Sea(NULL, tile_cache, p->source.c_str()) : new Sea(p->source.c_str(), tile_cache));
+
+	if ((step.x != 0.0) && ((s->min.x != min.x) || (s->min.y != min.y) || (s->step.x != step.x) || (s->step.y != step.y)))
+	{
+		printf("%s: %s: grid differs from the first period\n", __FUNCTION__, p->source.c_str());
+		exit(1);
+	}
+
+	s->min.t = p->t0;
+	s->derive(derive_fields);
+	s->set_slice_step(slice_step);
+
+	std::atomic_store(&p->sea, s);
+	return s;
+}
+
+void *SeaCatalogue::loader_thread(void *arg)
+{
+	loader_arg_t *a = reinterpret_cast<loader_arg_t *>(arg);
+	a->catalogue->load(a->i);
+	delete a;
+	return NULL;
+}
+
+void SeaCatalogue::preload(unsigned int i)
+{
+	pthread_mutex_lock(&load_mutex);
+	period_t *p = periods[i];
+	if (!p->loading && !std::atomic_load(&p->sea))
+	{
+		loader_arg_t *a = new loader_arg_t;
+		a->catalogue = this;
+		a->i = i;
+		p->loading = (pthread_create(&p->loader, NULL, &loader_thread, a) == 0);
+		if (!p->loading)
+			delete a;
+	}
+	pthread_mutex_unlock(&load_mutex);
+}
+
+SeaCatalogue::sea_ptr SeaCatalogue::get(unsigned int i)
+{
+	sea_ptr s = std::atomic_load(&periods[i]->sea);
+	if (s)
+		return s;
+
+	pthread_mutex_lock(&load_mutex);
+	period_t *p = periods[i];
+	if (p->loading)
+	{
+		printf("|| waiting for sea data %s\n", p->source.c_str());
+		pthread_join(p->loader, NULL);
+		p->loading = false;
+	}
+	s = std::atomic_load(&p->sea);
+	if (!s)
+		s = load(i);
+	pthread_mutex_unlock(&load_mutex);
+
+	return s;
+}
+
+//-----------------------------------------------------------------------------
+void SeaCatalogue::start(double t)
+{
+	sea_ptr s = get(index(t));
+	if (step.x == 0.0)
+	{
+		min = s->min;
+		step = s->step;
+	}
+	std::atomic_store(&current, s);
+}
+
+void SeaCatalogue::update(double t)
+{
+	const unsigned int i = index(t);
+	sea_ptr s = get(i);
+	std::atomic_store(&current, s);
+
+	if ((i + 1 < periods.size()) && (t >= periods[i + 1]->t0 - SEA_CATALOGUE_PRELOAD))
+		preload(i + 1);
+
+	// reap finished loaders, drop the periods that are over
+	pthread_mutex_lock(&load_mutex);
+	for (unsigned int j = 0; j < periods.size(); ++j)
+	{
+		period_t *p = periods[j];
+		if (p->loading && std::atomic_load(&p->sea))
+		{
+			pthread_join(p->loader, NULL);
+			p->loading = false;
+		}
+		if ((j < i) && !p->loading && std::atomic_load(&p->sea))
+		{
+			std::atomic_store(&p->sea, sea_ptr());
+			printf("|| sea data %s done\n", p->source.c_str());
+		}
+	}
+	pthread_mutex_unlock(&load_mutex);
+
+	s->update_slice(t);
+}
+
+double SeaCatalogue::end_time()
+{
+	sea_ptr s = std::atomic_load(&periods.back()->sea);
+	if (!s)
+		return HUGE_VAL;
+	return s->min.t + s->max_loc.t * s->step.t; // as far as Sea::map() goes
+}
+
+double SeaCatalogue::last_length()
+{
+	sea_ptr s = std::atomic_load(&periods.back()->sea);
+	if (!s)
+		return HUGE_VAL;
+	return s->n_t * s->step.t;
+}
+
+void SeaCatalogue::resolve(double t, sea_ptr &a, double &ta, sea_ptr &b, double &tb, double &f)
+{
+	const unsigned int i = index(t);
+	a = get(i);
+	ta = tb = t;
+	b.reset();
+	f = 0.0;
+
+	if (i + 1 >= periods.size())
+		return;
+	const double t_last = a->min.t + a->max_loc.t * a->step.t;
+	if (t <= t_last)
+		return;
+
+	b = get(i + 1);
+	ta = t_last;
+	tb = b->min.t;
+	f = (t - ta) / (tb - ta);
+}
+
+//-----------------------------------------------------------------------------
+void SeaCatalogue::derive(unsigned int fields)
+{
+	derive_fields = fields;
+	FOREACH(it, periods)
+	{
+		sea_ptr s = std::atomic_load(&(*it)->sea);
+		if (s)
+			s->derive(fields);
+	}
+}
+
+unsigned int SeaCatalogue::derived()
+{
+	return std::atomic_load(&current)->derived();
+}
+
+void SeaCatalogue::set_slice_step(double _slice_step)
+{
+	slice_step = _slice_step;
+	FOREACH(it, periods)
+	{
+		sea_ptr s = std::atomic_load(&(*it)->sea);
+		if (s)
+			s->set_slice_step(slice_step);
+	}
+}
+
+void SeaCatalogue::prefetch(const double *lo, const double *hi, double t)
+{
+	get(index(t))->prefetch(lo, hi, t);
+}
+
+//-----------------------------------------------------------------------------
+double SeaCatalogue::bottom(const double *pos) const
+{
+	return std::atomic_load(&current)->bottom(pos);
+}
+
+bool SeaCatalogue::variables(const double *pos, const double t, double *salinity, double *temperature, double *drift, double *density)
+{
+	sea_ptr a, b;
+	double ta, tb, f;
+	resolve(t, a, ta, b, tb, f);
+	if (!b)
+		return a->variables(pos, t, salinity, temperature, drift, density);
+
+	double sa, sb, tempa, tempb, da[3], db[3], rhoa, rhob;
+	if (!a->variables(pos, ta, &sa, &tempa, da, density ? &rhoa : NULL) || !b->variables(pos, tb, &sb, &tempb, db, density ? &rhob : NULL))
+		return false;
+
+	if (salinity != NULL)
+		*salinity = join(f, sa, sb);
+	if (temperature != NULL)
+		*temperature = join(f, tempa, tempb);
+	if (density != NULL)
+		*density = join(f, rhoa, rhob);
+	if (drift != NULL)
+		for (unsigned int i = 0; i < 3; ++i)
+			drift[i] = join(f, da[i], db[i]);
+
+	return true;
+}
+
+double SeaCatalogue::soundspeed(const double *pos, const double t)
+{
+	sea_ptr a, b;
+	double ta, tb, f;
+	resolve(t, a, ta, b, tb, f);
+	if (!b)
+		return a->soundspeed(pos, t);
+
+	return join_soundspeed(f, a->soundspeed(pos, ta), b->soundspeed(pos, tb));
+}
+
+double SeaCatalogue::min_soundspeed(const double *pos, const double t, double max_depth, double *min_soundspeed_depth)
+{
+	sea_ptr a, b;
+	double ta, tb, f;
+	resolve(t, a, ta, b, tb, f);
+	if (!b)
+		return a->min_soundspeed(pos, t, max_depth, min_soundspeed_depth);
+
+	double za, zb;
+	const double ssa = a->min_soundspeed(pos, ta, max_depth, &za), ssb = b->min_soundspeed(pos, tb, max_depth, &zb);
+	if (min_soundspeed_depth != NULL)
+		*min_soundspeed_depth = ((ssb <= 0.0) || ((f < 0.5) && (ssa > 0.0))) ? za : zb;
+	return join_soundspeed(f, ssa, ssb);
+}
@@ -0,0 +1,96 @@
+#ifndef _env_catalogue_h
+#define _env_catalogue_h
+
+/* requires:
+	#include <vector>
+	#include <string>
+	#include <memory>
+	#include <pthread.h>
+
+	#include "env-sea.h"
+*/
+
+#define  SEA_CATALOGUE_PRELOAD  (24 * 3600)  // s before a period starts
+
+
+/**
+ * An ordered list of sea data periods, e.g. consecutive months of model
+ * output, looked up as one continuous sea
+ *
+ * Each period is a netCDF data directory (ending in '/') or a tile file,
+ * starting at a given simulation time. The next period is loaded in a
+ * background thread SEA_CATALOGUE_PRELOAD seconds before it starts, and
+ * periods that are over are dropped. Between the last time step of a period
+ * and the start of the next one, values are interpolated between the two, as
+ * between the time steps within a period.
+ *
+ * Catalogue files have one period per line: start time (s), then source, e.g.
+ *
+ *   0        data/2008_08/
+ *   2678400  data/2008_09.sst
+ */
+class SeaCatalogue {
+	public:
+		typedef std::shared_ptr<Sea> sea_ptr;
+
+		sea_lim_t min, step;  // of the first period; x, y & z are the same for all
+
+		SeaCatalogue(size_t _tile_cache = SEA_TILE_CACHE_DEFAULT);
+		~SeaCatalogue();
+
+		bool read(const char * fn);
+		bool add(double t0, const char * source);  // in order of t0
+		unsigned int size() const { return periods.size(); }
+
+		void start(double t);    // loads the period of t; call after adding
+		void update(double t);   // once per tick, from the thread that advances t
+		double end_time();       // HUGE_VAL until the last period is loaded
+		double last_length();    // n_t steps of the last period, HUGE_VAL until it's loaded
+
+		// as in Sea, applied to every period
+		void derive(unsigned int fields);
+		unsigned int derived();
+		void set_slice_step(double slice_step);
+		void prefetch(const double * lo, const double * hi, double t);
+
+		double bottom(const double * pos) const;
+		bool variables(const double * pos, const double t, double * salinity, double * temperature, double * drift, double * density = NULL);
+		double soundspeed(const double * pos, const double t);
+		double min_soundspeed(const double * pos, const double t, double max_depth, double * min_soundspeed_depth = NULL);
+
+	private:
+		struct period_t {
+			double t0;
+			std::string source;
+			sea_ptr sea;       // atomic_load/store only; NULL unless loaded
+			bool loading;      // in a thread; requires load_mutex
+			pthread_t loader;
+		};
+
+		struct loader_arg_t {
+			SeaCatalogue * catalogue;
+			unsigned int i;
+		};
+
+		std::vector<period_t *> periods;
+		const size_t tile_cache;
+		unsigned int derive_fields;
+		double slice_step;
+		sea_ptr current;  // atomic_load/store only
+		pthread_mutex_t load_mutex;
+
+		unsigned int index(double t) const;
+		sea_ptr load(unsigned int i);
+		sea_ptr get(unsigned int i);
+		void preload(unsigned int i);
+		static void * loader_thread(void * arg);
+
+		// a & b with weights 1-f & f at times ta & tb; b is NULL unless t is
+		// between two periods
+		void resolve(double t, sea_ptr & a, double & ta, sea_ptr & b, double & tb, double & f);
+
+		SeaCatalogue(const SeaCatalogue &);
+		SeaCatalogue & operator=(const SeaCatalogue &);
+};
+
+#endif // _env_catalogue_h
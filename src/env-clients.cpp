@@ -4,7 +4,12 @@
 
 #include <list>
 #include <vector>
+#include <string>
+#include <atomic>
+#include <cstdio>
 #include <cstring>
+#include <stdint.h>
+#include <time.h>
 #include <netinet/in.h>
 #include <svl/SVL.h>
 
@@ -17,6 +22,8 @@
 #include "env-gui.h"
 #include "env-time.h"
 #include "env-clients.h"
+#include "env-stats.h"
+#include "util-trace.h"
 
 const simtime_t gui_sleep_time = 10;
 
@@ -29,6 +36,7 @@ extern pthread_mutex_t clients_mutex;
 extern pthread_cond_t client_sleeping;
 
 extern UDPserver * udp;
+extern EnvStats stats;
 
 //-----------------------------------------------------------------------------
 void T_env_client::wakeup() {
@@ -39,6 +47,7 @@ void T_env_client::wakeup() {
 		_sleep(env_time + gui_sleep_time);
 	} else {
 		const time_msg_t msg(MSG_TIME);
+		woken = stats_now();
 		udp_send(&addr, msg.buf, msg.len);
 	}
 }
@@ -51,6 +60,12 @@ void T_env_client::_sleep(const simtime_t t) {
 	const simtime_t prev_t = wakeup_time;
 	wakeup_time = t;
 	if ((prev_t <= env_time) && (wakeup_time > env_time)) {
+		if (woken && (id >= 0)) {
+			const uint64_t slept = stats_now();
+			if (id < STATS_MAX_CLIENTS) stats.response[id].add(slept - woken);
+			trace_span("awake", "client", woken, slept, env_time, env_time, TRACE_TIDS + id);
+		}
+		woken = 0;
 		__sync_sub_and_fetch(&clients_awake, 1);
 		pthread_cond_signal(&client_sleeping);
 	}
@@ -90,8 +105,8 @@ void T_env_client::handle_messages() {
 
 
 //-----------------------------------------------------------------------------
-T_env_client::T_env_client(const sockaddr_in _addr, const char _type):
-	messages(), addr(_addr), type(UNDEFINED), simfloat(NULL), wakeup_time(0)
+T_env_client::T_env_client(int16_t _id, const sockaddr_in _addr, const char _type):
+	messages(), woken(0), id(_id), addr(_addr), type(UNDEFINED), simfloat(NULL), wakeup_time(0)
 {
 	switch (_type) {
 		case FLOAT: case MSG_NEW_FLOAT:	type = FLOAT;     break;
@@ -102,12 +117,14 @@ T_env_client::T_env_client(const sockaddr_in _addr, const char _type):
 }
 
 T_env_client::T_env_client(const T_env_client & c2):
-	messages(c2.messages), addr(c2.addr), type(c2.type), simfloat(c2.simfloat), wakeup_time(c2.wakeup_time)
+	messages(c2.messages), woken(c2.woken), id(c2.id), addr(c2.addr), type(c2.type), simfloat(c2.simfloat), wakeup_time(c2.wakeup_time)
 { }
 
 T_env_client & T_env_client::operator= (const T_env_client & c2) {
 	if (&c2 != this) {
 		messages = c2.messages;
+		woken = c2.woken;
+		id = c2.id;
 		addr = c2.addr;
 		type = c2.type;
 		simfloat = c2.simfloat;
@@ -122,8 +139,14 @@ T_env_client & T_env_client::operator= (const T_env_client & c2) {
 int16_t new_client(const sockaddr_in * addr, const char type) {
 	pthread_mutex_lock(&clients_mutex);
 		int16_t n = clients.size();
-		clients.push_back(T_env_client(*addr, type));
+		clients.push_back(T_env_client(n, *addr, type));
 	pthread_mutex_unlock(&clients_mutex);
+
+	if (trace_on()) {
+		char name[32];
+		snprintf(name, sizeof(name), "%s %d", (type == MSG_NEW_FLOAT) ? "float" : (type == MSG_NEW_BASE) ? "base" : "client", n);
+		trace_thread_name(TRACE_TIDS + n, name);
+	}
 	return n;
 }
 
@@ -50,8 +50,10 @@ class T_env_client {
 	private:
 		void _sleep(const simtime_t t);
 		std::list<msg_t> messages;
+		uint64_t woken;	// stats_now() at MSG_TIME
 
 	public:
+		int16_t id;
 		sockaddr_in addr;
 		enum T_env_client_type type;
 		SimFloat * simfloat;
@@ -64,7 +66,7 @@ class T_env_client {
 		void queue_message(size_t len, const char * cdata, simtime_t transit_time);
 		void handle_messages();
 
-		T_env_client(const sockaddr_in _addr, const char _type);	
+		T_env_client(int16_t _id, const sockaddr_in _addr, const char _type);
 		T_env_client(const T_env_client & c2);
 		T_env_client & operator= (const T_env_client & c2);
 };
@@ -0,0 +1,222 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <map>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <svl/SVL.h>
+
+#include "sssim.h"
+#include "float-structs.h"
+#include "satmsg-fmt.h"
+#include "satmsg-data.h"
+#include "env-events.h"
+
+
+static const char * type_names[EVENT_TYPES] = {
+	"none", "new", "out_of_area", "beached", "hit_bottom", "satmsg", "lift_off"
+};
+
+const char * event_type_name(unsigned int type) {
+	return (type < EVENT_TYPES) ? type_names[type] : "unknown";
+}
+
+int event_type_from_name(const char * name) {
+	for (int i = 1; i < EVENT_TYPES; ++i)
+		if (!strcmp(name, type_names[i])) return i;
+	return EVENT_NONE;
+}
+
+int event_str(char * s, size_t len, const env_event_t & e) {
+	const double lon = meters_east_to_degrees(e.pos[0]), lat = meters_north_to_degrees(e.pos[1]);
+
+	switch (e.type) {
+		case EVENT_CLIENT_NEW:
+			if (e.code == MSG_NEW_FLOAT)
+				return snprintf(s, len, "%s #%i: at %.4f E, %.4f N, %.1f m", msg_name(e.code), e.id, lon, lat, e.pos[2]);
+			return snprintf(s, len, "%s #%i", msg_name(e.code), e.id);
+
+		case EVENT_OUT_OF_AREA:
+			return snprintf(s, len, "float %i: stopped, out of area at %.2f E, %.2f N, %.1f m", e.id, lon, lat, e.pos[2]);
+
+		case EVENT_BEACHED:
+			return snprintf(s, len, "float %i: stopped, beached (depth %.2fm) at %.2f E, %.2f N", e.id, e.value, lon, lat);
+
+		case EVENT_HIT_BOTTOM:
+			return snprintf(s, len, "float %i: hit bottom at %+.2fcm/s at %.2f E, %.2f N, %.1f m", e.id, e.value * 100, lon, lat, e.pos[2]);
+
+		case EVENT_LIFT_OFF:
+			return snprintf(s, len, "float %i: off the bottom at %+.2fcm/s at %.2f E, %.2f N, %.1f m", e.id, e.value * 100, lon, lat, e.pos[2]);
+
+		case EVENT_SATMSG: {
+			char type_str[32], result_str[32];
+			if (!satmsg_type2str(e.code, type_str, sizeof(type_str))) type_str[0] = '\0';
+			if (!satmsg_type2str(e.result, result_str, sizeof(result_str))) result_str[0] = '\0';
+			return snprintf(s, len, "msg #%d > #%d: %s [%.0fc]: %s", e.id, e.to, e.code ? type_str : "?", e.value, result_str);
+		}
+	}
+	return snprintf(s, len, "#%i: event %u", e.id, e.type);
+}
+
+
+//-----------------------------------------------------------------------------
+EventJournal::EventJournal() :
+	file(NULL), head(0), tail(0), dropped(0), running(false), quit(false), closed(true), shown()
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&ring_cond, NULL);
+}
+
+EventJournal::~EventJournal() {
+	close();
+	pthread_cond_destroy(&ring_cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+bool EventJournal::open(const char * fn) {
+	close();
+
+	file = fopen(fn, "wb");
+	if ((file != NULL) && (fwrite(EVENTS_MAGIC, 8, 1, file) != 1)) {
+		fclose(file);
+		file = NULL;
+	}
+
+	head = tail = dropped = 0;
+	quit = false;
+	closed = false;
+	running = !pthread_create(&thread, NULL, &writer_thread, this);
+	return file != NULL;
+}
+
+void EventJournal::close() {
+	pthread_mutex_lock(&mutex);
+	if (closed) {
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+	closed = true;
+	const bool was_running = running;
+	running = false;
+	quit = true;
+	pthread_cond_signal(&ring_cond);
+	pthread_mutex_unlock(&mutex);
+	if (was_running) pthread_join(thread, NULL);
+
+	show_counts();
+	if (dropped) printf("|| %lu events dropped\n", dropped);
+	dropped = 0;
+
+	if (file != NULL) fclose(file);
+	file = NULL;
+}
+
+void EventJournal::add(const env_event_t & e) {
+	pthread_mutex_lock(&mutex);
+	if (!running) {
+		// not journaled
+	} else if (head - tail >= EVENTS_RING_SIZE) {
+		++dropped;
+	} else {
+		ring[head++ % EVENTS_RING_SIZE] = e;
+		if (head - tail == EVENTS_RING_SIZE / 2) pthread_cond_signal(&ring_cond);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void EventJournal::add(uint16_t type, int16_t id, uint32_t t, const double * pos, double value, int16_t to, uint8_t code, uint8_t result) {
+	env_event_t e;
+	memset(&e, 0, sizeof(e));
+	e.t = t;
+	e.type = type;
+	e.id = id;
+	e.to = to;
+	e.code = code;
+	e.result = result;
+	if (pos != NULL)
+		for (unsigned int i = 0; i < 3; ++i) e.pos[i] = pos[i];
+	e.value = value;
+	add(e);
+}
+
+
+//-----------------------------------------------------------------------------
+void EventJournal::show(const env_event_t & e, const timeval & now) {
+	// new clients & sat messages are few enough to show all
+	const bool always = (e.type == EVENT_CLIENT_NEW) || (e.type == EVENT_SATMSG);
+	const uint32_t key = ((uint32_t)e.type << 16) | (uint16_t)e.id;
+	std::map<uint32_t, shown_t>::iterator it = shown.find(key);
+	if (!always && (it != shown.end()) && (now.tv_sec - it->second.t.tv_sec < EVENTS_CONSOLE_GAP)) {
+		++it->second.n;
+		return;
+	}
+
+	const unsigned long more = (it != shown.end()) ? it->second.n : 0;
+	shown_t & s = shown[key];
+	s.t = now;
+	s.n = 0;
+
+	char str[256];
+	event_str(str, sizeof(str), e);
+	char * timestr = time2str(e.t);
+	if (more) printf("\e[34m%s\e[0m %s (+%lu before)\n", timestr ? timestr : "", str, more);
+	else printf("\e[34m%s\e[0m %s\n", timestr ? timestr : "", str);
+	free(timestr);
+}
+
+void EventJournal::show_counts() {
+	for (std::map<uint32_t, shown_t>::iterator it = shown.begin(); it != shown.end(); ++it)
+		if (it->second.n)
+			printf("|| #%u: %lu more %s events\n", it->first & 0xFFFF, it->second.n, event_type_name(it->first >> 16));
+	shown.clear();
+}
+
+void * EventJournal::writer_thread(void * arg) {
+	EventJournal * j = reinterpret_cast<EventJournal *>(arg);
+	std::vector<env_event_t> batch;
+
+	pthread_mutex_lock(&j->mutex);
+	for (;;) {
+		if (!j->quit && (j->head - j->tail < EVENTS_RING_SIZE / 2)) {
+			timeval now;
+			gettimeofday(&now, NULL);
+			timespec until;
+			until.tv_sec = now.tv_sec;
+			until.tv_nsec = (now.tv_usec + EVENTS_FLUSH_MS * 1000L) * 1000L;
+			until.tv_sec += until.tv_nsec / 1000000000L;
+			until.tv_nsec %= 1000000000L;
+			pthread_cond_timedwait(&j->ring_cond, &j->mutex, &until);
+		}
+
+		batch.clear();
+		for (; j->tail != j->head; ++j->tail) batch.push_back(j->ring[j->tail % EVENTS_RING_SIZE]);
+		const bool last = j->quit;
+		pthread_mutex_unlock(&j->mutex);
+
+		if (!batch.empty()) {
+			if (j->file != NULL) {
+				if ((fwrite(&batch[0], sizeof(env_event_t), batch.size(), j->file) != batch.size()) || fflush(j->file)) {
+					perror("EventJournal");
+					fclose(j->file);
+					j->file = NULL;
+				}
+			}
+			timeval now;
+			gettimeofday(&now, NULL);
+			for (size_t i = 0; i < batch.size(); ++i) j->show(batch[i], now);
+			fflush(stdout);
+		}
+
+		if (last) break;
+		pthread_mutex_lock(&j->mutex);
+	}
+
+	return NULL;
+}
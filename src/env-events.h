@@ -0,0 +1,100 @@
+#ifndef _env_events_h
+#define _env_events_h
+
+/* requires:
+	#include <map>
+	#include <cstdio>
+	#include <stdint.h>
+	#include <pthread.h>
+	#include <sys/time.h>
+*/
+
+/**
+ * Journal of the physics & comms events of env
+ *
+ * Events are fixed-size records, added from any thread into a ring without
+ * any formatting or I/O, and written by a background thread to a file every
+ * EVENTS_FLUSH_MS, or sooner if the ring is half full; bin/event-query reads
+ * the file back. If the ring is full, events are dropped & counted.
+ *
+ * The same thread prints a summary to the console: an event of a float is
+ * shown if none of its type was shown for the float in the last
+ * EVENTS_CONSOLE_GAP seconds of real time, else just counted, and the count
+ * shown with the next one.
+ *
+ * File layout, native byte order: EVENTS_MAGIC, then env_event_t records
+ * in the order they were added.
+ */
+
+#define  EVENTS_MAGIC        "SSSEVNT1"
+#define  EVENTS_RING_SIZE    16384
+#define  EVENTS_FLUSH_MS     200
+#define  EVENTS_CONSOLE_GAP  5	// s
+
+enum env_event_type {
+	EVENT_NONE = 0,
+	EVENT_CLIENT_NEW,	// code: MSG_NEW_*
+	EVENT_OUT_OF_AREA,	// float stopped
+	EVENT_BEACHED,	// float stopped; value: bottom depth, m
+	EVENT_HIT_BOTTOM,	// first touch; value: vertical speed, m/s
+	EVENT_SATMSG,	// to, code: SATMSG type, result: SATMSG__OK or __ERROR_*, value: bytes
+	EVENT_LIFT_OFF,	// off the bottom after EVENT_HIT_BOTTOM; value: vertical speed, m/s
+	EVENT_TYPES
+};
+
+struct env_event_t {
+	uint32_t t;	// env_time
+	uint16_t type;	// env_event_type
+	int16_t id;	// client
+	int16_t to;	// other client, or -1
+	uint8_t code, result;
+	float pos[3];	// m, of a float; depth positive down
+	float value;
+	uint32_t reserved;
+};
+
+const char * event_type_name(unsigned int type);
+int event_type_from_name(const char * name);	// EVENT_NONE if unknown
+
+// "[+n] type details" for the console & bin/event-query
+int event_str(char * s, size_t len, const env_event_t & e);
+
+
+//-----------------------------------------------------------------------------
+class EventJournal {
+	public:
+		EventJournal();
+		~EventJournal();
+
+		bool open(const char * fn);	// starts the writer, even if fn can't be opened
+		void close();	// once per open(), from whichever thread gets there first
+
+		// from any thread, e.g. with clients_mutex held
+		void add(const env_event_t & e);
+		void add(uint16_t type, int16_t id, uint32_t t, const double * pos = NULL, double value = 0.0, int16_t to = -1, uint8_t code = 0, uint8_t result = 0);
+
+	private:
+		FILE * file;
+		env_event_t ring[EVENTS_RING_SIZE];
+		unsigned long head, tail;	// added & taken
+		unsigned long dropped;
+		bool running, quit;
+		bool closed;	// by close(), since the last open()
+
+		pthread_mutex_t mutex;
+		pthread_cond_t ring_cond;
+		pthread_t thread;
+
+		// writer thread only: last shown & counts since, by type & id
+		struct shown_t { timeval t; unsigned long n; };
+		std::map<uint32_t, shown_t> shown;
+
+		void show(const env_event_t & e, const timeval & now);
+		void show_counts();
+		static void * writer_thread(void * arg);
+
+		EventJournal(const EventJournal &);
+		EventJournal & operator=(const EventJournal &);
+};
+
+#endif // _env_events_h
@@ -2,9 +2,15 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <map>
 #include <cstdio>
 #include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <pthread.h>
 #include <stdint.h>
+#include <sys/time.h>
 #include <svl/SVL.h>
 
 #include "util-math.h"
@@ -12,12 +18,16 @@
 #include "sssim.h"
 #include "sssim-structs.h"
 #include "sea-data.h"
+#include "sea-layers.h"
 #include "env-time.h"
 #include "env-sea.h"
+#include "env-catalogue.h"
 #include "env-float.h"
+#include "env-events.h"
 
 extern simtime_t env_time;
-extern Sea *sea;
+extern SeaCatalogue *sea;
+extern EventJournal events;
 
 //-----------------------------------------------------------------------------
 template <class T>
@@ -39,7 +49,8 @@ SimFloat::SimFloat(int16_t _id, const FloatState &fs) : id(_id),
 														salinity(0.0),
 														temperature(0.0),
 														rho(1.0),
-														drift(vl_zero)
+														drift(vl_zero),
+														on_bottom(false)
 {
 	if (!pos[2])
 		pos[2] = DRIFTER_HALF_HEIGHT;
@@ -82,15 +93,19 @@ void SimFloat::RandomizeWithMapCenter(double x0, double y0, double xr, double yr
 }
 
 //-----------------------------------------------------------------------------
+void SimFloat::get_state(FloatState &f) const
+{
+	f.pos = pos;
+	f.vel = vel;
+	f.volume = volume;
+	f.bottom_depth = bottom_depth;
+	f.id = id;
+}
+
 void *SimFloat::get_info(size_t *len) const
 {
 	FloatState *f = typed_malloc<FloatState>();
-
-	f->pos = pos;
-	f->vel = vel;
-	f->volume = volume;
-	f->bottom_depth = bottom_depth;
-	f->id = id;
+	get_state(*f);
 
 	if (len != NULL)
 		*len = sizeof(*f);
@@ -237,14 +252,10 @@ void SimFloat::Update()
 	bool ok = UpdateEnvironment();
 
 	if (!ok)
-	{
-		print_timestr();
-		printf("float %i: stopped, out of area\n", id);
-	}
+		events.add(EVENT_OUT_OF_AREA, id, env_time, pos.Ref());
 	else if (bottom_depth < 2 * DRIFTER_HALF_HEIGHT)
 	{
-		print_timestr();
-		printf("float %i: stopped, beached (depth %.2fm)\n", id, bottom_depth);
+		events.add(EVENT_BEACHED, id, env_time, pos.Ref(), bottom_depth);
 		ok = false;
 	}
 	else
@@ -254,11 +265,7 @@ void SimFloat::Update()
 	}
 
 	if (!ok)
-	{
 		frozen = true;
-		print_timestr();
-		printf("\tat %.2f E, %.2f N, %.1f m\n", meters_east_to_degrees(pos[0]), meters_north_to_degrees(pos[1]), pos[2]);
-	}
 }
 
 void SimFloat::UpdateVolume(double dt)
@@ -278,10 +285,7 @@ void SimFloat::UpdateVolume(double dt)
 bool SimFloat::UpdateEnvironment()
 {
 	bottom_depth = sea->bottom(pos.Ref());
-	const bool on_map = sea->variables(pos.Ref(), env_time, &salinity, &temperature, drift.Ref());
-
-	if (on_map)
-		rho = density_from_STD(salinity, temperature, pressure_from_depth(pos[2]));
+	const bool on_map = sea->variables(pos.Ref(), env_time, &salinity, &temperature, drift.Ref(), &rho);
 
 	/*printf("%s: pos:%.4lf,%.4lf, depth:%.1lf, bottom:%.1lf, salt:%.3lf, temp:%.3lf, on_map:%d\n", __FUNCTION__, 
 		meters_east_to_degrees(pos[0]), meters_north_to_degrees(pos[1]), 
@@ -336,14 +340,18 @@ void SimFloat::StepRungeKutta4(double td)
 
 	if (pos[2] > bottom_depth - 0.01 - DRIFTER_HALF_HEIGHT)
 	{
-		print_timestr();
-		printf("float %i: hit bottom at %+.2fcm/s\n", id, vel[2] * 100);
-		print_timestr();
-		printf("at %.2f E, %.2f N, %.1f m\n", meters_east_to_degrees(pos[0]), meters_north_to_degrees(pos[1]), pos[2]);
+		if (!on_bottom)
+			events.add(EVENT_HIT_BOTTOM, id, env_time, pos.Ref(), vel[2]);
+		on_bottom = true;
 		pos[2] = bottom_depth - 0.02 - DRIFTER_HALF_HEIGHT;
 		if (vel[2] > 0.0)
 			vel[2] = 0.0;
 	}
+	else if (on_bottom && (pos[2] < bottom_depth - DRIFTER_HALF_HEIGHT - DRIFTER_LIFT_OFF_HEIGHT))
+	{
+		events.add(EVENT_LIFT_OFF, id, env_time, pos.Ref(), vel[2]);
+		on_bottom = false;
+	}
 	if (pos[2] < DRIFTER_HALF_HEIGHT)
 	{
 		pos[2] = DRIFTER_HALF_HEIGHT;
@@ -17,6 +17,10 @@
 #define  DRIFTER_MAX_VOLUME_NEAR_SURFACE  (DRIFTER_MASS / DRIFTER_MIN_DENSITY_NEAR_SURFACE)
 #define  DRIFTER_NEAR_SURFACE_DEPTH  (2 * DRIFTER_HALF_HEIGHT)
 
+// above the bottom, for EVENT_LIFT_OFF; resting on the bottom, a float hits it
+// on most steps
+#define  DRIFTER_LIFT_OFF_HEIGHT  0.5	// m
+
 class SimFloat {
 	public:
 		SimFloat(int16_t _id, const FloatState & fs);
@@ -30,6 +34,7 @@ class SimFloat {
 
 		bool at_surface() const { return (pos[3] < 1.2); }
 
+		void get_state(FloatState & f) const;
 		void * get_info(size_t * len) const; // FloatState
 		void * get_env(size_t * len) const; // T_EnvData
 		void * get_env(const double depth, size_t * len) const; // T_EnvData
@@ -46,9 +51,12 @@ class SimFloat {
 		void Update();
 
 	private:
+		friend class Bench;	// src/bench.cpp
+
 		double volume, volume_goal;
 		double bottom_depth, salinity, temperature, rho;
 		Vec3 drift;
+		bool on_bottom;	// since the last EVENT_HIT_BOTTOM
 
 		void RandomizeWithMapCenter(double x0, double y0, double xr, double yr);
 
@@ -2,13 +2,23 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <list>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
 #include <cstdio>
 #include <stdint.h>
+#include <pthread.h>
 #include <netcdfcpp.h>
 #include <svl/SVL.h>
 
 #include "sssim.h"
 #include "sea-data.h"
+#include "sea-layers.h"
+#include "sea-tiles.h"
 #include "env-sea.h"
 #include "util-math.h"
 #include "util-convert.h"
@@ -45,6 +55,17 @@ void verify_NcFile(NcFile *file, unsigned int level, const char *s)
 	}
 }
 
+//-----------------------------------------------------------------------------
+static sea_data_t *new_data()
+{
+	return reinterpret_cast<sea_data_t *>(new double[SEA_NT * SEA_NZ * SEA_NY * SEA_NX]);
+}
+
+static void delete_data(sea_data_t *data)
+{
+	delete[] reinterpret_cast<double *>(data);
+}
+
 //-----------------------------------------------------------------------------
 bool Sea::ReadVar(const char *var_name, const char *fn, sea_data_t &data)
 {
@@ -68,11 +89,13 @@ void Sea::ReadDimensions(const char *fn)
 	file.get_var(SEA_TVAR)->get(d, 2);
 	min.t = 0.0; //d[0];
 	step.t = d[1] - d[0];
-	max_loc.t = SEA_NT - 1.000001;
+	n_t = SEA_NT;
+	max_loc.t = n_t - 1.000001;
 
 	file.get_var(SEA_ZVAR)->get(depth_data, SEA_NZ);
 	for (unsigned int z = 0; z < SEA_NZ; ++z)
 		depth_data[z] *= -1;
+	layers.init(depth_data);
 	min.z = 0.0;  // unused
 	step.z = 0.0; // unused
 	max_loc.z = SEA_NZ - 2;
@@ -89,6 +112,41 @@ void Sea::ReadDimensions(const char *fn)
 	max_loc.x = SEA_NX - 1.000001;
 }
 
+// as ReadDimensions(), from the tile store header
+void Sea::ReadTileDimensions()
+{
+	const sea_tiles_header_t &h = tile_store->hdr;
+	if ((h.nz != SEA_NZ) || (h.ny != SEA_NY) || (h.nx != SEA_NX))
+	{
+		printf("Sea tiles are %u x %u x %u (z, y, x). Please recompile with the following in src/sea-data.h:\n\n", h.nz, h.ny, h.nx);
+		printf("\t#define  SEA_NZ  %u\n", h.nz);
+		printf("\t#define  SEA_NY  %u\n", h.ny);
+		printf("\t#define  SEA_NX  %u\n\n", h.nx);
+		exit(1);
+	}
+
+	n_t = h.nt;
+	min.t = 0.0;
+	step.t = h.step_t;
+	max_loc.t = n_t - 1.000001;
+
+	for (unsigned int z = 0; z < SEA_NZ; ++z)
+		depth_data[z] = -1 * tile_store->z[z];
+	layers.init(depth_data);
+	min.z = 0.0;
+	step.z = 0.0;
+	max_loc.z = SEA_NZ - 2;
+
+	min.y = h.y0;
+	step.y = h.step_y;
+	min.y -= step.y / 2; // HACK to better match bathymetry
+	max_loc.y = SEA_NY - 1.000001;
+
+	min.x = h.x0;
+	step.x = h.step_x;
+	max_loc.x = SEA_NX - 1.000001;
+}
+
 void Sea::AdjustRanges()
 {
 	min.x = degrees_east_to_meters(min.x);
@@ -143,22 +201,225 @@ bool Sea::ReadDepth(const char *fn)
 }
 
 //-----------------------------------------------------------------------------
-Sea::Sea() : min(), step(), max_loc(),
-			 bottom_min(), bottom_step()
+Sea::Sea(const char *tiles_fn, size_t tile_cache_bytes, const char *data_dir) : salt_data(NULL), temp_data(NULL),
+			 min(), step(), max_loc(), n_t(0),
+			 bottom_min(), bottom_step(),
+			 density_data(NULL), soundspeed_data(NULL),
+			 slice_step(0.0), slice(),
+			 tile_store(NULL), tile_cache(NULL)
 {
-	ReadVar("S", SEA_DATA_DIR SEA_DATA_FILE_SALT, salt_data);
-	ReadVar("TEMP", SEA_DATA_DIR SEA_DATA_FILE_TEMP, temp_data);
-	ReadVar("U", SEA_DATA_DIR SEA_DATA_FILE_U_VEL, flow_data[X]);
-	ReadVar("V", SEA_DATA_DIR SEA_DATA_FILE_V_VEL, flow_data[Y]);
-	ReadVar("W", SEA_DATA_DIR SEA_DATA_FILE_W_VEL, flow_data[Z]);
+	for (unsigned int i = X; i <= Z; ++i)
+		flow_data[i] = NULL;
 
-	ReadDimensions(SEA_DATA_DIR SEA_DATA_FILE_TEMP);
+	if (tiles_fn != NULL)
+	{
+		tile_store = new SeaTileStore();
+		if (!tile_store->open(tiles_fn))
+		{
+			printf("%s: bad sea tiles: %s\n", __FUNCTION__, tiles_fn);
+			exit(1);
+		}
+		ReadTileDimensions();
+		tile_cache = new SeaTileCache(*tile_store, tile_cache_bytes);
+	}
+	else
+	{
+		const std::string dir(data_dir);
+		salt_data = new_data();
+		temp_data = new_data();
+		for (unsigned int i = X; i <= Z; ++i)
+			flow_data[i] = new_data();
+
+		ReadVar("S", (dir + SEA_DATA_FILE_SALT).c_str(), *salt_data);
+		ReadVar("TEMP", (dir + SEA_DATA_FILE_TEMP).c_str(), *temp_data);
+		ReadVar("U", (dir + SEA_DATA_FILE_U_VEL).c_str(), *flow_data[X]);
+		ReadVar("V", (dir + SEA_DATA_FILE_V_VEL).c_str(), *flow_data[Y]);
+		ReadVar("W", (dir + SEA_DATA_FILE_W_VEL).c_str(), *flow_data[Z]);
+
+		ReadDimensions((dir + SEA_DATA_FILE_TEMP).c_str());
+	}
 
 	ReadDepth(SEA_DATA_FILEPATH_DEPTH);
 
 	AdjustRanges();
 }
 
+Sea::~Sea()
+{
+	derive(0);
+
+	delete tile_cache;
+	delete tile_store;
+
+	delete_data(salt_data);
+	delete_data(temp_data);
+	for (unsigned int i = X; i <= Z; ++i)
+		delete_data(flow_data[i]);
+}
+
+//-----------------------------------------------------------------------------
+// value of field at each node, at the node's depth; 0 where salt or temp is
+// missing, so that value() skips it like the source data
+sea_data_t *Sea::DeriveVar(sea_derived_t field) const
+{
+	sea_data_t *data = new_data();
+	unsigned int pressure[SEA_NY * SEA_NX];
+
+	for (unsigned int z = 0; z < SEA_NZ; ++z)
+	{
+		const unsigned int p = pressure_from_depth(depth_data[z]);
+		for (unsigned int i = 0; i < SEA_NY * SEA_NX; ++i)
+			pressure[i] = p;
+
+		for (unsigned int t = 0; t < SEA_NT; ++t)
+		{
+			const double *salt = &(*salt_data)[t][z][0][0], *temp = &(*temp_data)[t][z][0][0];
+			double *d = &(*data)[t][z][0][0];
+			if (field == SEA_DERIVED_DENSITY)
+				density_from_STD_n(salt, temp, pressure, d, SEA_NY * SEA_NX);
+			else
+				soundspeed_from_STD_n(salt, temp, pressure, d, SEA_NY * SEA_NX);
+			for (unsigned int i = 0; i < SEA_NY * SEA_NX; ++i)
+				if ((salt[i] == 0.0) || (temp[i] == 0.0))
+					d[i] = 0.0;
+		}
+	}
+
+	return data;
+}
+
+void Sea::derive(unsigned int fields)
+{
+	if (tile_cache)
+		fields = 0; // would need all of the data in memory
+
+	std::atomic_store(&slice, sea_slice_ptr()); // rebuilt with the new fields on the next update_slice()
+
+	if ((fields & SEA_DERIVED_DENSITY) && !density_data)
+		density_data = DeriveVar(SEA_DERIVED_DENSITY);
+	else if (!(fields & SEA_DERIVED_DENSITY) && density_data)
+	{
+		delete_data(density_data);
+		density_data = NULL;
+	}
+
+	if ((fields & SEA_DERIVED_SOUNDSPEED) && !soundspeed_data)
+		soundspeed_data = DeriveVar(SEA_DERIVED_SOUNDSPEED);
+	else if (!(fields & SEA_DERIVED_SOUNDSPEED) && soundspeed_data)
+	{
+		delete_data(soundspeed_data);
+		soundspeed_data = NULL;
+	}
+}
+
+unsigned int Sea::derived() const
+{
+	return (density_data ? SEA_DERIVED_DENSITY : 0) | (soundspeed_data ? SEA_DERIVED_SOUNDSPEED : 0);
+}
+
+//-----------------------------------------------------------------------------
+// grid = data at time t, interpolated the same way as value() does it
+void Sea::BlendVar(const sea_locdim_t t, const sea_data_t &data, sea_grid_t &grid) const
+{
+	const double *d0 = &data[t.cell][0][0][0], *d1 = &data[t.cell + 1][0][0][0];
+	double *g = &grid[0][0][0];
+	for (unsigned int i = 0; i < SEA_NZ * SEA_NY * SEA_NX; ++i)
+		g[i] = interpolate(t.frac, d0[i], d1[i]);
+}
+
+void Sea::BlendVar(const sea_locdim_t t, unsigned int var, sea_grid_t &grid) const
+{
+	if (!tile_cache)
+	{
+		const sea_data_t *data[SEA_VARS] = {salt_data, temp_data, flow_data[X], flow_data[Y], flow_data[Z]};
+		BlendVar(t, *data[var], grid);
+		return;
+	}
+
+	std::vector<double> d0(SEA_NZ * SEA_NY * SEA_NX), d1(SEA_NZ * SEA_NY * SEA_NX);
+	tile_cache->slice(var, t.cell, &d0[0]);
+	tile_cache->slice(var, t.cell + 1, &d1[0]);
+	double *g = &grid[0][0][0];
+	for (unsigned int i = 0; i < SEA_NZ * SEA_NY * SEA_NX; ++i)
+		g[i] = interpolate(t.frac, d0[i], d1[i]);
+}
+
+void Sea::set_slice_step(double step)
+{
+	slice_step = (step > 0.0) ? step : 0.0;
+	std::atomic_store(&slice, sea_slice_ptr());
+}
+
+void Sea::update_slice(double t)
+{
+	if (slice_step <= 0.0)
+		return;
+
+	sea_slice_ptr s = std::atomic_load(&slice);
+	if (s && (t >= s->t0) && (t < s->t1))
+		return;
+
+	double tc, tl = (t - min.t) / step.t;
+	if ((tl < 0.0) || (tl > max_loc.t))
+	{
+		std::atomic_store(&slice, sea_slice_ptr());
+		return;
+	}
+	sea_locdim_t loc_t;
+	loc_t.frac = modf(tl, &tc);
+	loc_t.cell = tc;
+
+	if (tile_cache)
+		tile_cache->prefetch(loc_t.cell, loc_t.cell + 1 + tile_store->hdr.tt, 0, SEA_NY - 1, 0, SEA_NX - 1);
+
+	// readers in other threads may still hold the old slice, so build a new one
+	sea_slice_t *ns = new sea_slice_t;
+	ns->t0 = t;
+	ns->t1 = t + slice_step;
+	BlendVar(loc_t, SEA_VAR_SALT, ns->salt);
+	BlendVar(loc_t, SEA_VAR_TEMP, ns->temp);
+	for (unsigned int i = X; i <= Z; ++i)
+		BlendVar(loc_t, SEA_VAR_FLOW_X + i, ns->flow[i]);
+	if (density_data)
+		BlendVar(loc_t, *density_data, ns->density);
+	if (soundspeed_data)
+		BlendVar(loc_t, *soundspeed_data, ns->soundspeed);
+
+	std::atomic_store(&slice, sea_slice_ptr(ns));
+}
+
+sea_slice_ptr Sea::slice_at(const double t) const
+{
+	if (slice_step <= 0.0)
+		return sea_slice_ptr();
+
+	sea_slice_ptr s = std::atomic_load(&slice);
+	if (s && ((t < s->t0) || (t >= s->t1)))
+		s.reset();
+	return s;
+}
+
+//-----------------------------------------------------------------------------
+void Sea::prefetch(const double *lo, const double *hi, double t)
+{
+	if (!tile_cache)
+		return;
+
+	const double tl = (t - min.t) / step.t;
+	if ((tl < 0.0) || (tl > max_loc.t))
+		return;
+	const unsigned int t0 = tl;
+
+	const double
+		y0 = CLAMP((lo[Y] - min.y) / step.y, 0.0, SEA_NY - 1.0),
+		y1 = CLAMP((hi[Y] - min.y) / step.y + 1.0, 0.0, SEA_NY - 1.0),
+		x0 = CLAMP((lo[X] - min.x) / step.x, 0.0, SEA_NX - 1.0),
+		x1 = CLAMP((hi[X] - min.x) / step.x + 1.0, 0.0, SEA_NX - 1.0);
+
+	// the current time window and the next one
+	tile_cache->prefetch(t0, t0 + 1 + tile_store->hdr.tt, y0, y1, x0, x1);
+}
+
 //-----------------------------------------------------------------------------
 double Sea::bottom(const double *pos) const
 {
@@ -190,25 +451,7 @@ bool Sea::map(const double *pos, const double t, sea_loc_t &loc) const
 	loc.t.frac = modf(tl, &tc);
 	loc.t.cell = tc;
 
-	if (pos[Z] >= depth_data[0])
-	{
-		loc.z.cell = 0;
-		loc.z.frac = 0.0;
-	}
-	else if (pos[Z] <= depth_data[SEA_NZ - 1])
-	{
-		loc.z.cell = SEA_NZ - 2;
-		loc.z.frac = 0.999999;
-	}
-	else
-	{
-		unsigned int zi;
-		for (zi = SEA_NZ - 2; zi > 0; --zi)
-			if (pos[Z] <= depth_data[zi])
-				break;
-		loc.z.cell = zi;
-		loc.z.frac = (pos[Z] - depth_data[zi]) / (depth_data[zi + 1] - depth_data[zi]);
-	}
+	layers.locate(pos[Z], loc.z.cell, loc.z.frac);
 
 	double yc, y = (pos[Y] - min.y) / step.y;
 	if ((y < 0.0) || (y > max_loc.y))
@@ -247,6 +490,44 @@ double Sea::value(const sea_loc_t loc, const sea_data_t &data) const
 		d[i] = interpolate(loc.t.frac, data[t][z][y][x], data[t + 1][z][y][x]);
 	}
 
+	return value_xyz(loc, d);
+}
+
+double Sea::raw(const sea_loc_t loc, unsigned int var) const
+{
+	if (!tile_cache)
+	{
+		const sea_data_t *data[SEA_VARS] = {salt_data, temp_data, flow_data[X], flow_data[Y], flow_data[Z]};
+		return value(loc, *data[var]);
+	}
+
+	double c[16], d[8];
+	tile_cache->corners(var, loc.t.cell, loc.z.cell, loc.y.cell, loc.x.cell, c);
+	for (unsigned int i = 0; i < 8; ++i)
+		d[i] = interpolate(loc.t.frac, c[i], c[i + 8]);
+
+	return value_xyz(loc, d);
+}
+
+double Sea::value(const sea_loc_t loc, const sea_grid_t &grid) const
+{
+	double d[8];
+
+	for (unsigned int i = 0; i < 8; ++i)
+	{
+		const unsigned int
+			z = loc.z.cell + (i >> 2),
+			y = loc.y.cell + ((i & 2) >> 1),
+			x = loc.x.cell + (i & 1);
+		d[i] = grid[z][y][x];
+	}
+
+	return value_xyz(loc, d);
+}
+
+// interpolates the 8 corner values in d over x, y & z, skipping zeroes
+double Sea::value_xyz(const sea_loc_t &loc, double *d) const
+{
 	// x
 	for (unsigned int i = 0; i < 8; i += 2)
 	{
@@ -277,21 +558,42 @@ double Sea::value(const sea_loc_t loc, const sea_data_t &data) const
 }
 
 //-----------------------------------------------------------------------------
-bool Sea::variables(const double *pos, const double t, double *salinity, double *temperature, double *drift) const
+bool Sea::variables(const double *pos, const double t, double *salinity, double *temperature, double *drift, double *density) const
 {
 	sea_loc_t loc;
 	if (!map(pos, t, loc))
 		return false;
 
+	const sea_slice_ptr s = slice_at(t);
+
 	if (salinity != NULL)
-		*salinity = value(loc, salt_data);
+		*salinity = s ? value(loc, s->salt) : raw(loc, SEA_VAR_SALT);
 	if (temperature != NULL)
-		*temperature = value(loc, temp_data);
+		*temperature = s ? value(loc, s->temp) : raw(loc, SEA_VAR_TEMP);
+	if (density != NULL)
+	{
+		if (density_data)
+			*density = s ? value(loc, s->density) : value(loc, *density_data);
+		else
+			*density = density_from_STD(
+				salinity ? *salinity : (s ? value(loc, s->salt) : raw(loc, SEA_VAR_SALT)),
+				temperature ? *temperature : (s ? value(loc, s->temp) : raw(loc, SEA_VAR_TEMP)),
+				pressure_from_depth(pos[Z]));
+	}
 	if (drift != NULL)
 	{
-		drift[X] = value(loc, flow_data[X]);
-		drift[Y] = value(loc, flow_data[Y]);
-		drift[Z] = value(loc, flow_data[Z]) * -1;
+		if (s)
+		{
+			drift[X] = value(loc, s->flow[X]);
+			drift[Y] = value(loc, s->flow[Y]);
+			drift[Z] = value(loc, s->flow[Z]) * -1;
+		}
+		else
+		{
+			drift[X] = raw(loc, SEA_VAR_FLOW_X);
+			drift[Y] = raw(loc, SEA_VAR_FLOW_Y);
+			drift[Z] = raw(loc, SEA_VAR_FLOW_Z) * -1;
+		}
 	}
 
 	return true;
@@ -299,28 +601,22 @@ bool Sea::variables(const double *pos, const double t, double *salinity, double
 
 bool Sea::driftvals(const double *pos, const double t, double *drift) const
 {
-	sea_loc_t loc;
-	
-	if (!map(pos, t, loc))
-		return false;
-	
-	if (drift != NULL)
-	{
-		drift[X] = value(loc, flow_data[X]);
-		drift[Y] = value(loc, flow_data[Y]);
-		drift[Z] = value(loc, flow_data[Z]) * -1;
-	}
-
-	return true;
+	return variables(pos, t, NULL, NULL, drift);
 }
 
 //-----------------------------------------------------------------------------
-double Sea::soundspeed(const sea_loc_t loc, double z) const
+double Sea::soundspeed(const sea_loc_t loc, double z, const sea_slice_t *s) const
 {
-	const double salt = value(loc, salt_data);
+	if (soundspeed_data)
+	{
+		const double ss = s ? value(loc, s->soundspeed) : value(loc, *soundspeed_data);
+		return (ss == 0.0) ? -1.0 : ss;
+	}
+
+	const double salt = s ? value(loc, s->salt) : raw(loc, SEA_VAR_SALT);
 	if (salt == 0.0)
 		return -1.0;
-	const double temp = value(loc, temp_data);
+	const double temp = s ? value(loc, s->temp) : raw(loc, SEA_VAR_TEMP);
 	if (temp == 0.0)
 		return -1.0;
 
@@ -333,26 +629,22 @@ double Sea::soundspeed(const double *pos, const double t) const
 	if (!map(pos, t, loc))
 		return -1.0;
 
-	return soundspeed(loc, pos[Z]);
+	return soundspeed(loc, pos[Z], slice_at(t).get());
 }
 
 //-----------------------------------------------------------------------------
-double Sea::min_soundspeed(const double *pos, const double t, double max_depth, double *min_soundspeed_depth) const
+double Sea::min_soundspeed_derived(sea_loc_t loc, double max_depth, double *min_soundspeed_depth, const sea_slice_t *s) const
 {
-	sea_loc_t loc;
-	if (!map(pos, t, loc))
-		return -1.0;
-
 	loc.z.cell = SEA_NZ - 2;
 
 	loc.z.frac = 0.999999;
 	double ss_min_z = depth_data[SEA_NZ - 1];
-	double ss_min = soundspeed(loc, ss_min_z);
+	double ss_min = soundspeed(loc, ss_min_z, s);
 
 	loc.z.frac = 0.0;
 	for (double z = depth_data[loc.z.cell]; z < max_depth; z = depth_data[--loc.z.cell])
 	{
-		const double ss = soundspeed(loc, z);
+		const double ss = soundspeed(loc, z, s);
 		if (ss <= 0.0)
 			break;
 		if (ss < ss_min)
@@ -368,3 +660,60 @@ double Sea::min_soundspeed(const double *pos, const double t, double max_depth,
 		*min_soundspeed_depth = ss_min_z;
 	return ss_min;
 }
+
+double Sea::min_soundspeed(const double *pos, const double t, double max_depth, double *min_soundspeed_depth) const
+{
+	sea_loc_t loc;
+	if (!map(pos, t, loc))
+		return -1.0;
+
+	const sea_slice_ptr s = slice_at(t);
+	if (soundspeed_data)
+		return min_soundspeed_derived(loc, max_depth, min_soundspeed_depth, s.get());
+
+	// gather the column from the surface down, then compute all at once
+	double salt[SEA_NZ], temp[SEA_NZ], depth[SEA_NZ], ss[SEA_NZ];
+	unsigned int pressure[SEA_NZ];
+	unsigned int n = 0;
+
+	loc.z.cell = SEA_NZ - 2;
+
+	loc.z.frac = 0.999999;
+	depth[n] = depth_data[SEA_NZ - 1];
+	salt[n] = s ? value(loc, s->salt) : raw(loc, SEA_VAR_SALT);
+	temp[n] = s ? value(loc, s->temp) : raw(loc, SEA_VAR_TEMP);
+	++n;
+
+	loc.z.frac = 0.0;
+	for (double z = depth_data[loc.z.cell]; z < max_depth; z = depth_data[--loc.z.cell])
+	{
+		depth[n] = z;
+		salt[n] = s ? value(loc, s->salt) : raw(loc, SEA_VAR_SALT);
+		temp[n] = s ? value(loc, s->temp) : raw(loc, SEA_VAR_TEMP);
+		if ((++n >= SEA_NZ) || (salt[n - 1] == 0.0) || (temp[n - 1] == 0.0))
+			break;
+		if (loc.z.cell == 0)
+			break;
+	}
+
+	for (unsigned int i = 0; i < n; ++i)
+		pressure[i] = pressure_from_depth(depth[i]);
+	soundspeed_from_STD_n(salt, temp, pressure, ss, n);
+
+	double ss_min_z = depth[0];
+	double ss_min = ((salt[0] == 0.0) || (temp[0] == 0.0)) ? -1.0 : ss[0];
+	for (unsigned int i = 1; i < n; ++i)
+	{
+		if ((salt[i] == 0.0) || (temp[i] == 0.0))
+			break;
+		if (ss[i] < ss_min)
+		{
+			ss_min = ss[i];
+			ss_min_z = depth[i];
+		}
+	}
+
+	if (min_soundspeed_depth != NULL)
+		*min_soundspeed_depth = ss_min_z;
+	return ss_min;
+}
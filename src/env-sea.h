@@ -12,38 +12,99 @@ struct sea_loc_t { sea_locdim_t t, z, y, x; };
 
 typedef double bottom_data_t[SEA_DEPTH_NY][SEA_DEPTH_NX];
 typedef double sea_data_t[SEA_NT][SEA_NZ][SEA_NY][SEA_NX];
+typedef double sea_grid_t[SEA_NZ][SEA_NY][SEA_NX];
+
+// optional grids derived from salt & temp at each node, see Sea::derive()
+enum sea_derived_t {
+	SEA_DERIVED_DENSITY    = 0x1,
+	SEA_DERIVED_SOUNDSPEED = 0x2
+};
+
+// the sea data blended to a single point in time, see Sea::update_slice()
+struct sea_slice_t {
+	double t0, t1;  // used for lookups at t0 <= t < t1
+	sea_grid_t salt, temp, flow[3];
+	sea_grid_t density, soundspeed;  // only if derived
+};
+
+typedef std::shared_ptr<const sea_slice_t> sea_slice_ptr;
+
+class SeaTileStore;
+class SeaTileCache;
+
+#define  SEA_TILE_CACHE_DEFAULT  (256 << 20)  // bytes
 
 
 class Sea {
 	enum Vec3_dims_t { X, Y, Z };
 
 	public:
-		sea_data_t salt_data, temp_data, flow_data[3];
+		sea_data_t * salt_data, * temp_data, * flow_data[3];  // NULL with a tile store
 		sea_lim_t min, step, max_loc;
+		unsigned int n_t;  // time steps
 
 		bottom_data_t bottom_data;
 		sea_lim_t bottom_min, bottom_step;
 
 		double depth_data[SEA_NZ];	// 0: deepest, SEA_NZ-1: shallowest
+		SeaLayerIndex layers;
+
+		// with tiles_fn, the data is read on demand from a tile file made by
+		// bin/sea-convert, keeping at most tile_cache bytes of it in memory;
+		// else the netCDF files in data_dir are read whole
+		Sea(const char * tiles_fn = NULL, size_t tile_cache = SEA_TILE_CACHE_DEFAULT, const char * data_dir = SEA_DATA_DIR);
+		~Sea();
 
-		Sea();
+		void derive(unsigned int fields);  // sea_derived_t flags; others are dropped; none with tiles
+		unsigned int derived() const;
+
+		// with step > 0, update_slice(t) keeps a time slice of the data for
+		// [t, t + step) that lookups within that range use instead of the
+		// raw data; call it once per tick, from the thread that advances t
+		void set_slice_step(double step);
+		void update_slice(double t);
+
+		// with a tile store, start loading the tiles for positions lo..hi
+		// from time t on in the background
+		void prefetch(const double * lo, const double * hi, double t);
 
 		double bottom(const double * pos) const;
-		bool variables(const double * pos, const double t, double * salinity, double * temperature, double * drift) const;
+		bool variables(const double * pos, const double t, double * salinity, double * temperature, double * drift, double * density = NULL) const;
 		bool driftvals(const double * pos, const double t, double *drift) const;
 
 		double soundspeed(const double * pos, const double t) const;
 		double min_soundspeed(const double * pos, const double t, double max_depth, double * min_soundspeed_depth = NULL) const;
 
 	private:
+		friend class Bench;  // src/bench.cpp
+
+		sea_data_t * density_data;     // NULL unless derived
+		sea_data_t * soundspeed_data;
+
+		double slice_step;         // 0: no slicing
+		sea_slice_ptr slice;       // atomic_load/store only
+
+		SeaTileStore * tile_store;
+		SeaTileCache * tile_cache;
+
 		bool ReadVar(const char * var_name, const char * fn, sea_data_t & data);
+		sea_data_t * DeriveVar(sea_derived_t field) const;
 		void ReadDimensions(const char * fn);
+		void ReadTileDimensions();
 		void AdjustRanges();
 		bool ReadDepth(const char * fn);
 
 		bool map(const double * pos, const double t, sea_loc_t & loc) const;
+		sea_slice_ptr slice_at(const double t) const;
+		void BlendVar(const sea_locdim_t t, const sea_data_t & data, sea_grid_t & grid) const;
+		void BlendVar(const sea_locdim_t t, unsigned int var, sea_grid_t & grid) const;
+
+		double raw(const sea_loc_t loc, unsigned int var) const;  // sea_var_t
 		double value(const sea_loc_t loc, const sea_data_t & data) const;
-		double soundspeed(const sea_loc_t loc, double z) const;
+		double value(const sea_loc_t loc, const sea_grid_t & grid) const;
+		double value_xyz(const sea_loc_t & loc, double * d) const;
+		double soundspeed(const sea_loc_t loc, double z, const sea_slice_t * s) const;
+		double min_soundspeed_derived(sea_loc_t loc, double max_depth, double * min_soundspeed_depth, const sea_slice_t * s) const;
 };
 
 #endif
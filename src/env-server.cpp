@@ -3,9 +3,14 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include <list>
+#include <map>
+#include <string>
+#include <atomic>
 #include <vector>
 #include <cstdio>
 #include <cstring>
+#include <time.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <svl/SVL.h>
 
@@ -24,11 +29,15 @@
 #include "env-time.h"
 #include "env-server.h"
 #include "env-clients.h"
+#include "env-events.h"
+#include "env-stats.h"
 
 extern pthread_mutex_t clients_mutex;
 extern T_env_client_vector clients;
 extern simtime_t env_time;
 extern trigger_t runtime;
+extern EventJournal events;
+extern EnvStats stats;
 
 void show_timerate(bool end);
 
@@ -83,15 +92,26 @@ void ctrl_timestate(char state)
 	fflush(stdout);
 }
 
+//-----------------------------------------------------------------------------
+// the report as text, in one datagram
+void ctrl_stats(const sockaddr_in *addr)
+{
+	std::string s;
+	stats.report(s, env_time);
+	if (s.size() > STATS_MAX_REPLY)
+	{
+		s.resize(STATS_MAX_REPLY);
+		s += "# ...\n";
+	}
+	udp->sendto(addr, MSG_GET_STATS | MSG_ACK_MASK, s.data(), s.size());
+}
+
 //-----------------------------------------------------------------------------
 void ctrl_new_client(const sockaddr_in *addr, char type, size_t csize, const char *cdata)
 {
 	int16_t id_n = new_client(addr, type);
 	udp->sendto(addr, &id_n, sizeof(id_n));
 
-	print_timestr();
-	printf("%s #%i: %s\n", msg_name(type), id_n, inet(*addr).str);
-
 	if (type == MSG_NEW_FLOAT)
 	{
 		FloatState fs;
@@ -100,18 +120,12 @@ void ctrl_new_client(const sockaddr_in *addr, char type, size_t csize, const cha
 
 		pthread_mutex_lock(&clients_mutex);
 		clients[id_n].simfloat = new SimFloat(id_n, fs);
-		print_timestr();
-		printf("at %.4f E, %.4f N\n",
-			   meters_east_to_degrees(clients[id_n].simfloat->pos[0]),
-			   meters_north_to_degrees(clients[id_n].simfloat->pos[1]));
-		if (clients[id_n].simfloat->pos[2] != DRIFTER_HALF_HEIGHT)
-		{
-			print_timestr();
-			printf("depth %.2f m\n", clients[id_n].simfloat->pos[2]);
-		}
+		events.add(EVENT_CLIENT_NEW, id_n, env_time, clients[id_n].simfloat->pos.Ref(), 0.0, -1, type);
 		clients[id_n].wakeup();
 		pthread_mutex_unlock(&clients_mutex);
 	}
+	else
+		events.add(EVENT_CLIENT_NEW, id_n, env_time, NULL, 0.0, -1, type);
 
 	gui_force_update();
 }
@@ -210,24 +224,23 @@ void handle_satmsg(const sockaddr_in *addr, int16_t id, size_t csize, const char
 	{
 	};
 
+	int16_t to = -1;
+	unsigned char type = 0;
 	try
 	{
 		SatMsg msg(cdata, csize);
 
 		if (msg.to < 0)
 			msg.to = base_client_id();
-		{
-			char type_str[32];
-			print_timestr();
-			printf("msg #%d > #%d: %s [%zdc]: ", id, msg.to, satmsg_type2str(msg.type, type_str, 32), csize);
-		}
+		to = msg.to;
+		type = msg.type;
 		if (!valid_client(msg.to))
 			throw bad_id();
 		if ((clients[id].type == FLOAT) && (!clients[id].simfloat || !clients[id].simfloat->at_surface()))
 			throw no_signal();
 
 		udp->sendto(addr, SATMSG__OK);
-		printf("ok\n");
+		events.add(EVENT_SATMSG, id, env_time, NULL, csize, to, type, SATMSG__OK);
 
 		msg.from = id;
 		msg.tx_time = env_time;
@@ -237,17 +250,17 @@ void handle_satmsg(const sockaddr_in *addr, int16_t id, size_t csize, const char
 	catch (SatMsg::data_err x)
 	{
 		udp->sendto(addr, SATMSG__ERROR_BAD_DATA);
-		printf("satmsg: bad data\n");
+		events.add(EVENT_SATMSG, id, env_time, NULL, csize, to, type, SATMSG__ERROR_BAD_DATA);
 	}
 	catch (bad_id x)
 	{
 		udp->sendto(addr, SATMSG__ERROR_BAD_ID);
-		printf("satmsg: bad rx id\n");
+		events.add(EVENT_SATMSG, id, env_time, NULL, csize, to, type, SATMSG__ERROR_BAD_ID);
 	}
 	catch (no_signal x)
 	{
 		udp->sendto(addr, SATMSG__ERROR_NO_SIGNAL);
-		printf("satmsg: no signal\n");
+		events.add(EVENT_SATMSG, id, env_time, NULL, csize, to, type, SATMSG__ERROR_NO_SIGNAL);
 	}
 }
 
@@ -395,6 +408,7 @@ void *udp_server(void *unused)
 
 		//printf(VT_SET(VT_CYAN) "<< %u %s" VT_SET(VT_DIM) " [%zu]\n" VT_RESET, ntohs(addr.sin_port), msg_name(msg_type), msg_len);
 
+		StatsTimer st(stats.msg[(unsigned char)msg_type]);
 		switch (msg_type)
 		{
 		case MSG_PLAY:
@@ -441,11 +455,16 @@ void *udp_server(void *unused)
 			set_data(&addr, msg_sender, msg_type, msg_len, msg_body);
 			break;
 
+		case MSG_GET_STATS:
+			ctrl_stats(&addr);
+			break;
+
 		case MSG_QUIT:
 			runtime.set(false);
 			udp_broadcast(MSG_QUIT);
 
 			printf(VT_ERASE_BELOW "\n|| quitting on command.\n");
+			events.close();
 			show_timerate(true);
 			exit(EXIT_SUCCESS);
 			break;
@@ -9,4 +9,7 @@ inline void udp_broadcast(const char byte) { udp_broadcast(&byte, 1); }
 
 void udp_init();
 
+class SimFloat;
+double msg_travel_time(const SimFloat * d0, const SimFloat * d1);  // s; 0.0 if not delivered
+
 #endif
@@ -0,0 +1,88 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <string>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "sssim.h"
+#include "env-stats.h"
+
+
+static const char * phase_names[STATS_PHASES] = {
+	"tick", "sea_update", "messages", "float_update", "wakeup", "barrier", "prefetch"
+};
+
+//-----------------------------------------------------------------------------
+void StatsHist::report(std::string & s, const char * kind, const char * name) const {
+	uint32_t b[STATS_BUCKETS];
+	uint64_t nb = 0;
+	for (unsigned int i = 0; i < STATS_BUCKETS; ++i) nb += (b[i] = bucket[i].load(std::memory_order_relaxed));
+	if (nb == 0) return;
+
+	// the upper bound of the bucket with the q:th of the durations
+	double pct[2] = { 0.0, 0.0 };
+	const double q[2] = { 0.5, 0.99 };
+	for (unsigned int k = 0; k < 2; ++k) {
+		uint64_t c = 0;
+		for (unsigned int i = 0; i < STATS_BUCKETS; ++i) {
+			c += b[i];
+			if (c >= q[k] * nb) {
+				pct[k] = (2ULL << i) * 1.0e-3;
+				break;
+			}
+		}
+	}
+
+	const uint64_t ns_max = max.load(std::memory_order_relaxed);
+	for (unsigned int k = 0; k < 2; ++k)
+		if (pct[k] > 1.0e-3 * ns_max) pct[k] = 1.0e-3 * ns_max;
+
+	char line[256];
+	snprintf(line, sizeof(line), "%s\t%s\t%llu\t%.3f\t%.3f\t%.3f\t%.3f\n", kind, name,
+		(unsigned long long)nb,
+		1.0e-3 * sum.load(std::memory_order_relaxed) / nb,
+		pct[0], pct[1],
+		1.0e-3 * ns_max);
+	s += line;
+}
+
+
+//-----------------------------------------------------------------------------
+void EnvStats::report(std::string & s, uint32_t t) const {
+	char line[256];
+	char * timestr = time2str(t);
+	snprintf(line, sizeof(line), "# env_time %u (%s), %.3f s of wall-clock time\n", t, timestr ? timestr : "", 1.0e-9 * (stats_now() - t0));
+	free(timestr);
+	s += line;
+	s += "# kind\tname\tn\tmean_us\tp50_us\tp99_us\tmax_us\n";
+
+	for (unsigned int i = 0; i < STATS_PHASES; ++i) phase[i].report(s, "phase", phase_names[i]);
+	for (unsigned int i = 0; i < 256; ++i) {
+		char name[32];
+		snprintf(name, sizeof(name), "%s", msg_name(i));
+		if (name[0] == '[') snprintf(name, sizeof(name), "%02X", i);
+		msg[i].report(s, "msg", name);
+	}
+	for (unsigned int i = 0; i < STATS_MAX_CLIENTS; ++i) {
+		char name[8];
+		snprintf(name, sizeof(name), "%u", i);
+		update[i].report(s, "update", name);
+		response[i].report(s, "response", name);
+	}
+}
+
+bool EnvStats::append(const char * fn, uint32_t t) const {
+	std::string s;
+	report(s, t);
+
+	FILE * f = fopen(fn, "a");
+	if (f == NULL) return false;
+	const bool ok = (fwrite(s.data(), 1, s.size(), f) == s.size());
+	return !fclose(f) && ok;
+}
@@ -0,0 +1,102 @@
+#ifndef _env_stats_h
+#define _env_stats_h
+
+/* requires:
+	#include <string>
+	#include <atomic>
+	#include <stdint.h>
+	#include <time.h>
+*/
+
+/**
+ * Timings of the env tick loop & the UDP server
+ *
+ * Each StatsHist is written by one thread only, so adding to one is a few
+ * relaxed stores; the report may be made from any thread, and is then only
+ * about as consistent as the moment allows. Durations are kept as counts in
+ * power-of-two buckets of nanoseconds.
+ *
+ * Reported by MSG_GET_STATS (bin/cli stats) and every $SSSIM_STATS_STEP
+ * seconds of env_time in logs/latest/env.stats, one line per timing:
+ *   kind<TAB>name<TAB>n<TAB>mean_us<TAB>p50_us<TAB>p99_us<TAB>max_us
+ * with "#" comment lines between reports; the percentiles are bucket bounds.
+ */
+
+#define  STATS_BUCKETS       40	// 1 ns .. 9 min
+#define  STATS_MAX_CLIENTS   128
+#define  STATS_STEP_DEFAULT  3600	// s
+#define  STATS_MAX_REPLY     60000	// bytes of MSG_GET_STATS reply
+
+enum env_stats_phase {
+	STATS_TICK,	// all of a tick but waiting while paused
+	STATS_SEA_UPDATE,
+	STATS_MESSAGES,	// T_env_client::handle_messages, for all clients
+	STATS_FLOAT_UPDATE,	// SimFloat::Update, for all floats
+	STATS_WAKEUP,	// T_env_client::wakeup, for all clients woken
+	STATS_BARRIER,	// waiting for the clients to sleep
+	STATS_PREFETCH,
+	STATS_PHASES
+};
+
+inline uint64_t stats_now() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+//-----------------------------------------------------------------------------
+class StatsHist {
+	public:
+		StatsHist() : n(0), sum(0), max(0) { for (unsigned int i = 0; i < STATS_BUCKETS; ++i) bucket[i] = 0; }
+
+		void add(uint64_t ns) {	// from one thread only
+			unsigned int b = 63 - __builtin_clzll(ns | 1);	// floor(log2(ns))
+			if (b >= STATS_BUCKETS) b = STATS_BUCKETS - 1;
+			bucket[b].store(bucket[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			sum.store(sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+			if (ns > max.load(std::memory_order_relaxed)) max.store(ns, std::memory_order_relaxed);
+			n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		uint64_t count() const { return n.load(std::memory_order_relaxed); }
+		void report(std::string & s, const char * kind, const char * name) const;
+
+	private:
+		std::atomic<uint64_t> n, sum, max;
+		std::atomic<uint32_t> bucket[STATS_BUCKETS];
+
+		StatsHist(const StatsHist &);
+		StatsHist & operator=(const StatsHist &);
+};
+
+// adds the time from construction to destruction
+class StatsTimer {
+	public:
+		StatsTimer(StatsHist & _h) : h(_h), t0(stats_now()) {}
+		~StatsTimer() { h.add(stats_now() - t0); }
+
+	private:
+		StatsHist & h;
+		const uint64_t t0;
+};
+
+
+//-----------------------------------------------------------------------------
+class EnvStats {
+	public:
+		StatsHist phase[STATS_PHASES];	// main thread
+		StatsHist msg[256];	// by message type; UDP server thread
+		StatsHist update[STATS_MAX_CLIENTS];	// SimFloat::Update; main thread
+		StatsHist response[STATS_MAX_CLIENTS];	// from MSG_TIME to MSG_SLEEP; with clients_mutex
+
+		EnvStats() : t0(stats_now()) {}
+
+		void report(std::string & s, uint32_t t) const;	// appends to s
+		bool append(const char * fn, uint32_t t) const;
+
+	private:
+		const uint64_t t0;
+};
+
+#endif // _env_stats_h
@@ -41,7 +41,9 @@ void print_timestr() {
 
 //-----------------------------------------------------------------------------
 simtime_t time_init(int argc, char **argv) {
-	srand48(time(NULL));
+	// e.g. SSSIM_SEED=1 for the same floats & noise on each run, as by bin/swarm-scale
+	const char *seed = getenv("SSSIM_SEED");
+	srand48(seed ? atol(seed) : time(NULL));
 
 	// command line arguments
 	if ((argc > 1) && ((argv[1][0] == '?') || (argv[1][1] == '?'))) {
@@ -3,10 +3,21 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include <list>
+#include <map>
+#include <deque>
+#include <memory>
+#include <string>
+#include <atomic>
 #include <vector>
+#include <cmath>
 #include <cstdio>
 #include <csignal>
 #include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <netinet/in.h>
@@ -22,18 +33,30 @@
 #include "sssim-structs.h"
 #include "util-convert.h"
 #include "sea-data.h"
+#include "sea-layers.h"
 #include "env-sea.h"
+#include "env-catalogue.h"
 #include "env-float.h"
 #include "env-server.h"
 #include "env-time.h"
 #include "env-clients.h"
+#include "traj-log.h"
+#include "env-events.h"
+#include "env-stats.h"
+#include "util-trace.h"
 #include "vt100.h"
 
 const simtime_t gui_sleep_time = 10;
 
+#define SEA_PREFETCH_INTERVAL 60 // s
+#define TRAJ_STEP_DEFAULT 60 // s
+
 trigger_t runtime(false);
 simtime_t env_time = 0;
-Sea *sea;
+SeaCatalogue *sea;
+TrajWriter trajectories;
+EventJournal events;
+EnvStats stats;
 
 T_env_client_vector clients;
 int clients_awake = 0;
@@ -137,6 +160,25 @@ void init_logs(const simtime_t start_time)
 	r = symlink(logname, LOGDIR_SYMLINK);
 }
 
+//-----------------------------------------------------------------------------
+void log_trajectory(const SimFloat &f)
+{
+	FloatState fs;
+	f.get_state(fs);
+
+	traj_record_t r;
+	r.t = env_time;
+	r.id = fs.id;
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		r.pos[i] = fs.pos[i];
+		r.vel[i] = fs.vel[i];
+	}
+	r.volume = fs.volume;
+	r.bottom_depth = fs.bottom_depth;
+	trajectories.add(r);
+}
+
 //-----------------------------------------------------------------------------
 void show_timerate(bool end)
 {
@@ -148,6 +190,7 @@ void show_timerate(bool end)
 		gettimeofday(&rt0, NULL);
 
 		printf("|| start time %u: %s\n", env_time, time2str(env_time));
+		fflush(stdout); // bin/swarm-scale waits for this line
 	}
 	else
 	{
@@ -161,6 +204,14 @@ void show_timerate(bool end)
 	}
 }
 
+//-----------------------------------------------------------------------------
+static uint32_t trace_env_time() { return env_time; }
+
+static void trace_phase(const char *name, uint64_t t0, uint64_t t1)
+{
+	trace_span(name, "env", t0, t1, env_time, env_time);
+}
+
 //-----------------------------------------------------------------------------
 int main(int argc, char **argv)
 {
@@ -172,14 +223,82 @@ int main(int argc, char **argv)
 
 	env_time = time_init(argc, argv);
 	init_logs(env_time);
+	if (!events.open(LOGDIR_SYMLINK "/" LOGFILE_EVENTS))
+		perror("events: " LOGDIR_SYMLINK "/" LOGFILE_EVENTS);
+	// e.g. SSSIM_TRACE=1 for a timeline of env & the clients; see bin/trace-merge
+	if (trace_open(LOGDIR_SYMLINK "/env" TRACE_SUFFIX, "env", trace_env_time))
+	{
+		printf("|| trace to " LOGDIR_SYMLINK "/env" TRACE_SUFFIX "\n");
+		trace_thread_name(-1, "tick");
+	}
 	udp_init();
 
-	sea = new Sea();
+	// e.g. SSSIM_SEA_TILES=data/2008_08.sst to read the sea data on demand
+	const char *tiles = getenv("SSSIM_SEA_TILES");
+	const char *tile_cache = getenv("SSSIM_SEA_TILE_CACHE"); // MB
+	sea = new SeaCatalogue(tile_cache ? atof(tile_cache) * (1 << 20) : SEA_TILE_CACHE_DEFAULT);
+
+	// e.g. SSSIM_SEA_CATALOGUE=data/catalogue.txt for runs over several periods
+	const char *catalogue = getenv("SSSIM_SEA_CATALOGUE");
+	if (catalogue != NULL)
+	{
+		if (!sea->read(catalogue))
+		{
+			printf("|| bad sea catalogue %s\n", catalogue);
+			exit(EXIT_FAILURE);
+		}
+		printf("|| sea catalogue %s: %u periods\n", catalogue, sea->size());
+	}
+	else
+	{
+		if (tiles != NULL)
+			printf("|| sea tiles from %s\n", tiles);
+		sea->add(0.0, tiles ? tiles : SEA_DATA_DIR);
+	}
+	sea->start(env_time);
+
+	// e.g. SSSIM_SEA_DERIVED=density,soundspeed to use precomputed grids
+	const char *derived = getenv("SSSIM_SEA_DERIVED");
+	if (derived != NULL)
+	{
+		sea->derive((strstr(derived, "density") ? SEA_DERIVED_DENSITY : 0) | (strstr(derived, "soundspeed") ? SEA_DERIVED_SOUNDSPEED : 0));
+		printf("|| derived grids:%s%s\n",
+			   (sea->derived() & SEA_DERIVED_DENSITY) ? " density" : "",
+			   (sea->derived() & SEA_DERIVED_SOUNDSPEED) ? " soundspeed" : "");
+	}
+
+	// e.g. SSSIM_SEA_SLICE=60 to blend the sea data to env_time once a minute
+	const char *slice_step = getenv("SSSIM_SEA_SLICE");
+	if ((slice_step != NULL) && (atof(slice_step) > 0.0))
+	{
+		sea->set_slice_step(atof(slice_step));
+		printf("|| sea time slice step %g s\n", atof(slice_step));
+	}
+
+	// e.g. SSSIM_TRAJ_STEP=10 to log the float trajectories every 10 s; 0 for none
+	const char *traj_step_s = getenv("SSSIM_TRAJ_STEP");
+	const simtime_t traj_step = traj_step_s ? atoi(traj_step_s) : TRAJ_STEP_DEFAULT;
+	if (traj_step > 0)
+	{
+		if (trajectories.open(LOGDIR_SYMLINK "/" LOGFILE_TRAJECTORIES, traj_step))
+			printf("|| trajectories every %u s to " LOGDIR_SYMLINK "/" LOGFILE_TRAJECTORIES "\n", traj_step);
+		else
+			perror("trajectories: " LOGDIR_SYMLINK "/" LOGFILE_TRAJECTORIES);
+	}
+
+	// e.g. SSSIM_STATS_STEP=600 to write the timings every 10 min of env_time; 0 for none
+	const char *stats_step_s = getenv("SSSIM_STATS_STEP");
+	const simtime_t stats_step = stats_step_s ? atoi(stats_step_s) : STATS_STEP_DEFAULT;
 
 	show_timerate(false);
 
 	timeval tv0 = {0, 0};
-	const simtime_t env_end_time = sea->min.t + SEA_NT * sea->step.t/3; // limiting simulation?
+	// with a catalogue, run to the end of the last period once that's known
+	simtime_t env_end_time = catalogue ? ~(simtime_t)0 : sea->min.t + sea->last_length() / 3; // limiting simulation?
+	// e.g. SSSIM_RUN_TIME=3600 to stop after an hour of env_time, as for bin/swarm-scale
+	const char *run_time = getenv("SSSIM_RUN_TIME");
+	if ((run_time != NULL) && (atol(run_time) > 0) && (env_time + atol(run_time) < env_end_time))
+		env_end_time = env_time + atol(run_time);
 	printf("-----------------> endtime: %d \n", env_end_time);
 	while (++env_time < env_end_time)
 	{
@@ -200,23 +319,68 @@ int main(int argc, char **argv)
 		//print_timestr(); putchar('\n');
 
 		runtime.wait_for(true);
+		const uint64_t tick_t0 = stats_now();
 
+		{
+			const uint64_t t0 = stats_now();
+			sea->update(env_time);
+			const uint64_t t1 = stats_now();
+			stats.phase[STATS_SEA_UPDATE].add(t1 - t0);
+			trace_phase("sea_update", t0, t1);
+		}
+		if (catalogue && (sea->end_time() < env_end_time))
+			env_end_time = sea->end_time();
+
+		const bool prefetch = !(env_time % SEA_PREFETCH_INTERVAL);
+		const bool log_traj = trajectories.is_open() && !(env_time % traj_step);
+		double swarm_lo[2] = {HUGE_VAL, HUGE_VAL}, swarm_hi[2] = {-HUGE_VAL, -HUGE_VAL};
+
+		uint64_t t_messages = 0, t_update = 0, t_wakeup = 0;
 		pthread_mutex_lock(&clients_mutex);
+		const uint64_t clients_t0 = stats_now();
 		FOREACH(it, clients)
 		{
+			uint64_t t0 = stats_now(), t1;
 			it->handle_messages();
+			t1 = stats_now();
+			t_messages += t1 - t0;
 			if (it->type == BASE)
 				continue;
 			if (it->simfloat)
+			{
+				t0 = t1;
 				it->simfloat->Update();
+				t1 = stats_now();
+				t_update += t1 - t0;
+				if (it->id < STATS_MAX_CLIENTS)
+					stats.update[it->id].add(t1 - t0);
+				if (log_traj)
+					log_trajectory(*it->simfloat);
+				if (prefetch)
+					for (unsigned int i = 0; i < 2; ++i)
+					{
+						if (it->simfloat->pos[i] < swarm_lo[i])
+							swarm_lo[i] = it->simfloat->pos[i];
+						if (it->simfloat->pos[i] > swarm_hi[i])
+							swarm_hi[i] = it->simfloat->pos[i];
+					}
+			}
 			if (it->wakeup_time <= env_time)
 			{
+				t0 = stats_now();
 				__sync_add_and_fetch(&clients_awake, 1);
 				it->wakeup();
+				t_wakeup += stats_now() - t0;
 			}
 			//else printf(VT_SET2(VT_DIM, VT_GREEN) "%u: still sleeping for %is\n" VT_RESET, ntohs(it->addr.sin_port), it->wakeup_time - env_time);
 		}
 
+		stats.phase[STATS_MESSAGES].add(t_messages);
+		stats.phase[STATS_FLOAT_UPDATE].add(t_update);
+		stats.phase[STATS_WAKEUP].add(t_wakeup);
+
+		const uint64_t barrier_t0 = stats_now();
+		trace_phase("clients", clients_t0, barrier_t0);
 		while (clients_awake > 0)
 		{
 			//printf(VT_SET(VT_DIM) "clients_awake: %i\n" VT_RESET, clients_awake);
@@ -224,9 +388,32 @@ int main(int argc, char **argv)
 			//if (clients_awake < 0) printf("clients_awake: %i\n", clients_awake);
 		}
 		pthread_mutex_unlock(&clients_mutex);
+		const uint64_t barrier_t1 = stats_now();
+		stats.phase[STATS_BARRIER].add(barrier_t1 - barrier_t0);
+		trace_phase("barrier", barrier_t0, barrier_t1);
+
+		if (prefetch && (swarm_lo[0] <= swarm_hi[0]))
+		{
+			const uint64_t t0 = stats_now();
+			sea->prefetch(swarm_lo, swarm_hi, env_time);
+			const uint64_t t1 = stats_now();
+			stats.phase[STATS_PREFETCH].add(t1 - t0);
+			trace_phase("prefetch", t0, t1);
+		}
+
+		const uint64_t tick_t1 = stats_now();
+		stats.phase[STATS_TICK].add(tick_t1 - tick_t0);
+		trace_phase("tick", tick_t0, tick_t1);
+		if (stats_step && !(env_time % stats_step))
+			stats.append(LOGDIR_SYMLINK "/" LOGFILE_STATS, env_time);
 	}
 
 	udp_broadcast(MSG_QUIT);
+	trajectories.close();
+	events.close();
+	trace_close();
+	if (stats_step)
+		stats.append(LOGDIR_SYMLINK "/" LOGFILE_STATS, env_time);
 
 	printf(VT_ERASE_BELOW "\n|| done.\n");
 	show_timerate(true);
@@ -0,0 +1,124 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Lists the events of an env event journal (see src/env-events.h), one per
+ * line as "t<TAB>time<TAB>id<TAB>type<TAB>details", or with -c just their
+ * counts by client & type. Without an input, reads logs/latest/env.events.
+ *
+ * usage: event-query [-t from,to] [-i id,..] [-e type,..] [-c] [input]
+ *
+ * -t limits the events to simulation times from..to (s), inclusive; -i to the
+ * given clients, as sender or receiver; -e to the given types, e.g.
+ * hit_bottom,satmsg.
+ */
+
+#include <map>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include "sssim.h"
+#include "env-events.h"
+
+#define USAGE "usage: %s [-t from,to] [-i id,..] [-e type,..] [-c] [input]\n"
+
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	uint32_t t0 = 0, t1 = ~(uint32_t)0;
+	std::set<int> ids, types;
+	bool counts = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:i:e:ch")) != -1)
+		switch (opt)
+		{
+		case 't':
+			if (sscanf(optarg, "%u,%u", &t0, &t1) != 2)
+			{
+				fprintf(stderr, "%s: bad time range %s\n", argv[0], optarg);
+				exit(1);
+			}
+			break;
+		case 'i':
+			for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ","))
+				ids.insert(atoi(s));
+			break;
+		case 'e':
+			for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ","))
+			{
+				const int type = event_type_from_name(s);
+				if (type == EVENT_NONE)
+				{
+					fprintf(stderr, "%s: unknown event type %s\n", argv[0], s);
+					exit(1);
+				}
+				types.insert(type);
+			}
+			break;
+		case 'c':
+			counts = true;
+			break;
+		default:
+			fprintf(stderr, USAGE, argv[0]);
+			exit(1);
+		}
+	if (optind < argc - 1)
+	{
+		fprintf(stderr, USAGE, argv[0]);
+		exit(1);
+	}
+	const char *fn = (optind < argc) ? argv[optind] : LOGDIR_SYMLINK "/" LOGFILE_EVENTS;
+
+	FILE *f = fopen(fn, "rb");
+	char magic[8];
+	if (!f || (fread(magic, sizeof(magic), 1, f) != 1) || memcmp(magic, EVENTS_MAGIC, sizeof(magic)))
+	{
+		fprintf(stderr, "%s: not an event journal\n", fn);
+		exit(1);
+	}
+
+	std::map<std::pair<int, int>, unsigned long> n_by_type;
+	unsigned long n = 0, n_total = 0;
+	env_event_t e[1024];
+	size_t len;
+	while ((len = fread(e, sizeof(env_event_t), 1024, f)) > 0)
+		for (size_t i = 0; i < len; ++i)
+		{
+			++n_total;
+			if ((e[i].t < t0) || (e[i].t > t1))
+				continue;
+			if (!ids.empty() && !ids.count(e[i].id) && !ids.count(e[i].to))
+				continue;
+			if (!types.empty() && !types.count(e[i].type))
+				continue;
+
+			++n;
+			if (counts)
+			{
+				++n_by_type[std::make_pair((int)e[i].id, (int)e[i].type)];
+				continue;
+			}
+
+			char str[256];
+			event_str(str, sizeof(str), e[i]);
+			char *timestr = time2str(e[i].t);
+			printf("%u\t%s\t%d\t%s\t%s\n", e[i].t, timestr ? timestr : "", e[i].id, event_type_name(e[i].type), str);
+			free(timestr);
+		}
+	fclose(f);
+
+	for (std::map<std::pair<int, int>, unsigned long>::const_iterator it = n_by_type.begin(); it != n_by_type.end(); ++it)
+		printf("%d\t%s\t%lu\n", it->first.first, event_type_name(it->first.second), it->second);
+
+	fprintf(stderr, "%lu of %lu events\n", n, n_total);
+	return 0;
+}
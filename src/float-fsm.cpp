@@ -8,6 +8,8 @@
 #include <map>
 #include <netinet/in.h>
 #include <svl/SVL.h>
+#include <atomic>
+#include <memory>
 
 class Seafloat;
 
@@ -164,8 +166,7 @@ void group_talk_pre_comms(Seafloat *seafloat)
 	putchar('\n');
 	dprint("## cycle %i\n", cn);
 	//
-	seafloat->floatDistances.clear(); // empty distance list
-	seafloat->floatPositions.clear();
+	seafloat->clearKalmanData(); // empty distance & position lists
 	seafloat->read_snd_msgs();
 	// send gps data
 	gps_data_t gps_pos;
@@ -9,6 +9,8 @@
 #include <algorithm>
 #include <netinet/in.h>
 #include <svl/SVL.h>
+#include <atomic>
+#include <memory>
 
 #include "sssim.h"
 #include "udp.h"
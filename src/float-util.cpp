@@ -7,6 +7,7 @@
 #include <netinet/in.h>
 #include <svl/SVL.h>
 #include <deque>
+#include <memory>
 
 #include "util-leastsquares.h"
 #include "util-convert.h"
@@ -9,6 +9,8 @@
 #include <algorithm>
 #include <netinet/in.h>
 #include <svl/SVL.h>
+#include <atomic>
+#include <memory>
 
 class Seafloat;
 
@@ -40,10 +42,8 @@ class Seafloat;
 // ADD JTE
 #include "sea-data.h"
 #include "kalman_filter.h"
-#include <chrono>
-#include <thread>
-#include <functional>
-#include <semaphore.h>
+#include "client-timer.h"
+#include "util-trace.h"
 // END ADD
 
 extern msg_queue satmsg_rx_queue, soundmsg_rx_queue;
@@ -56,17 +56,15 @@ SimSocket *gui_socket = NULL;
 SimTime sim_time;
 
 // ADD JTE
-kalman_data Kalman; // for estimating positions with kalman
-bool kalmanInitDone = false; // for checking if kalman init is done
-Seafloat *sfloat;
 //char est_buffer[32768]; // 32kBytes
 
 #define SWARM_NUM_OF_UNITS_IN_GROUP 6 	// in kalman-filter.cpp also
 #define kalman_sampling_interval 900  	// 15 min = 900 sec  -> 1 h acoustic comm.
 #define kalman_calc_interval 7200		// 2 h must be enough
-uint32_t simTimeStamp = 0;
-uint32_t simCalcTimeStamp = 0;
-sem_t kalman_sem;	// for timers 
+#define multilat_gps_sigma 5.0			// m
+#define multilat_range_sigma 2.5		// m
+#define multilat_drift_speed 0.1		// m/s, growth of GPS prior sigma with fix age
+SimTimer kalman_timer; // for the kalman jobs of all the Seafloats of the process
 // END ADD
 
 //-----------------------------------------------------------------------------
@@ -77,8 +75,14 @@ Seafloat::Seafloat(msg_queue *_satmsg_rx_queue, msg_queue *_soundmsg_rx_queue) :
 																				 latest_sat_contact(0),
 																				 sat_modem(_satmsg_rx_queue),
 																				 snd_modem(),
-																				 gps()
+																				 gps(),
+																				 multilat(SWARM_NUM_OF_UNITS_IN_GROUP),
+																				 multilat_valid(false),
+																				 kalman(),
+																				 initkalmandone(false),
+																				 kalman_mutex()
 {
+	pthread_mutex_init(&kalman_mutex, NULL);
 	group[client_id] = groupfloat();
 	self_in_group = &group.begin()->second;
 }
@@ -87,14 +91,7 @@ Seafloat::Seafloat(msg_queue *_satmsg_rx_queue, msg_queue *_soundmsg_rx_queue) :
 double Seafloat::soundspeed_in_sc() const
 {
 	const int z_bottom = round(bottom_depth.get());
-	int z_sc = -1;
-	estimate_soundchannel(z_bottom, &z_sc);
-	if (z_sc <= 0)
-		return -1.0;
-	const double temp = estimate_temperature(z_sc);
-	const double salt = estimate_salinity(z_sc);
-	const double pressure = pressure_from_depth(z_sc);
-	return soundspeed_from_STD(salt, temp, pressure);
+	return estimate_soundchannel_soundspeed(z_bottom);
 }
 
 //-----------------------------------------------------------------------------
@@ -313,6 +310,7 @@ void Seafloat::read_snd_msg(const SoundMsg *msg)
 			getchar();
 			break;
 		}
+		std::vector<distance_float> pong_dist;
 		dprint("AC ping(m):");
 		for (unsigned int i = 0; i < n_pong; ++i)
 			if (rx_pong[i])
@@ -320,9 +318,13 @@ void Seafloat::read_snd_msg(const SoundMsg *msg)
 				const unsigned int dist = round(rx_pong[i] * ss);
 				printf(" %u:%u", i, dist);
 				distance_float dst(dist, sim_time.now(), i);
+				pthread_mutex_lock(&kalman_mutex);
 				floatDistances.push_back(dst); // push distances to a list
+				pthread_mutex_unlock(&kalman_mutex);
+				pong_dist.push_back(dst);
 			}
 		putchar('\n');
+		solveMultilat(pong_dist);
 		initkalman();
 	}
 	break;
@@ -337,7 +339,9 @@ void Seafloat::read_snd_msg(const SoundMsg *msg)
 				   pos->y, pos->x);
 			// real gps fix -> used as is as fix new enough -  that is checked when the message is sent
 			pos_xyzt p(pos->x, pos->y, 0.0, pos->t, msg->from);
+			pthread_mutex_lock(&kalman_mutex);
 			floatPositions.push_back(p);
+			pthread_mutex_unlock(&kalman_mutex);
 		}
 		else
 		{
@@ -355,7 +359,10 @@ void Seafloat::read_snd_msg(const SoundMsg *msg)
 				   pos->y, pos->x, pos->z);
 			// estimate -> only depth is used as z is <> 0.0
 			pos_xyzt p(pos->x, pos->y, pos->z, pos->time, pos->floatId);
+			pthread_mutex_lock(&kalman_mutex);
 			floatPositions.push_back(p);
+			pthread_mutex_unlock(&kalman_mutex);
+			group[msg->from].add_gps_estimate(pos->time, pos->x, pos->y, pos->z, this);
 		}
 		else
 		{
@@ -401,10 +408,56 @@ void Seafloat::updatePositions()
 
 void Seafloat::updateKalmanWithData()
 {
-	if(kalmanInitDone) {
+	pthread_mutex_lock(&kalman_mutex);
+	if(initkalmandone) {
 		updatePositions();
 		updateDistances();
 	}
+	pthread_mutex_unlock(&kalman_mutex);
+}
+
+void Seafloat::clearKalmanData()
+{
+	pthread_mutex_lock(&kalman_mutex);
+	floatDistances.clear();
+	floatPositions.clear();
+	pthread_mutex_unlock(&kalman_mutex);
+}
+
+//-----------------------------------------------------------------------------
+// Batch fix of the whole group from one pong table. GPS fixes become priors
+// that loosen with age; the solver keeps its previous solution as the
+// starting point for the next cycle.
+void Seafloat::solveMultilat(const std::vector<distance_float> &dist)
+{
+	const int self = client_id - 1;
+	if (dist.empty() || (group.size() != SWARM_NUM_OF_UNITS_IN_GROUP) || (self < 0) || (self >= SWARM_NUM_OF_UNITS_IN_GROUP))
+		return;
+
+	const simtime_t now = sim_time.now();
+	FOREACH(it, group)
+	{
+		const int i = it->first - 1;
+		if ((i < 0) || (i >= SWARM_NUM_OF_UNITS_IN_GROUP))
+			continue;
+		const pos_xyt_conf &fix = it->second.gps_pos;
+		if (!multilat_valid)
+			multilat.set_position(i, fix.x, fix.y);
+		const double age = (now > fix.time) ? now - fix.time : 0.0;
+		multilat.set_prior(i, fix.x, fix.y, multilat_gps_sigma + multilat_drift_speed * age);
+		multilat.set_depth(i, it->second.gps_est.z);
+	}
+	multilat.set_depth(self, ctd.get_depth_state().depth_now);
+
+	multilat.clear_ranges();
+	FOREACH_CONST(it, dist)
+		multilat.set_range(self, it->floatId - 1, it->d, multilat_range_sigma);
+
+	const MultilatSolver::result_t res = multilat.solve();
+	if (res.iterations < 0)
+		return;
+	multilat_valid = true;
+	dprint("AC multilat(m): %.0f N, %.0f E, rms %.1f, %d it\n", multilat.get_y(self), multilat.get_x(self), res.rms_residual, res.iterations);
 }
 
 //-----------------------------------------------------------------------------
@@ -440,8 +493,9 @@ pos_xyzt Seafloat::getKalmanEstimation(int drifter)
 {
 	pos_xyzt estimate;
 	kalman_position_data position_vector[SWARM_NUM_OF_UNITS_IN_GROUP]; // Pointer to array of position_vector elements
-	if (kalmanInitDone) {
-		read_kalman_positions(&Kalman, position_vector);
+	pthread_mutex_lock(&kalman_mutex);
+	if (initkalmandone) {
+		read_kalman_positions(&kalman, position_vector);
 		estimate.x = position_vector[drifter - 1].x;
 		estimate.y = position_vector[drifter - 1].y;
 		estimate.z = position_vector[drifter - 1].z;
@@ -453,127 +507,107 @@ pos_xyzt Seafloat::getKalmanEstimation(int drifter)
 		estimate.y = 0.0;
 		estimate.z = 0.0;
 	}
+	pthread_mutex_unlock(&kalman_mutex);
 	return estimate;
 }
 
 void Seafloat::initkalman()
 {
-	if (kalmanInitDone == false)
+	pthread_mutex_lock(&kalman_mutex);
+	if ((initkalmandone == false) && (group.size() == SWARM_NUM_OF_UNITS_IN_GROUP)) // magix number to test with normal
 	{
-		if (group.size() == SWARM_NUM_OF_UNITS_IN_GROUP) // magix number to test with normal
+		// Initialization of the Kalman-filter
+		initialize_kalman(&kalman, SWARM_NUM_OF_UNITS_IN_GROUP, kalman_sampling_interval);
+		// Set the amount of noise in measurements
+		set_measurement_noise(&kalman, client_id - 1, 10, 0.001, 5, 10000, 0.0001);
+		// Set the inaccuracy of the state-space model (treated as white noise)
+		set_model_noise(&kalman, 10, 1, 0.5, 0.0001);
+		// Initialize the positions of the units, from the latest
+		// multilateration fix if there is one, else from GPS
+		if (multilat_valid)
 		{
-			// Initialization of the Kalman-filter
-			initialize_kalman(&Kalman, SWARM_NUM_OF_UNITS_IN_GROUP, kalman_sampling_interval);
-			// Set the amount of noise in measurements
-			set_measurement_noise(&Kalman, client_id - 1, 10, 0.001, 5, 10000, 0.0001);
-			// Set the inaccuracy of the state-space model (treated as white noise)
-			set_model_noise(&Kalman, 10, 1, 0.5, 0.0001);
-			// Initialize the positions of the units
-			set_unit_position(&Kalman, 0, group[1].gps_pos.x, group[1].gps_pos.y, 0.0);
-			set_unit_position(&Kalman, 1, group[2].gps_pos.x, group[2].gps_pos.y, 0.0);
-			set_unit_position(&Kalman, 2, group[3].gps_pos.x, group[3].gps_pos.y, 0.0);
-			set_unit_position(&Kalman, 3, group[4].gps_pos.x, group[4].gps_pos.y, 0.0);
-			set_unit_position(&Kalman, 4, group[5].gps_pos.x, group[5].gps_pos.y, 0.0);
-			set_unit_position(&Kalman, 5, group[6].gps_pos.x, group[6].gps_pos.y, 0.0);
-			// Initialize the sea currents
-			// this info is from env. data. to be checked how to to update
-			set_current(&Kalman, 0, 0.0, 0.0, 0.0);
-			set_current(&Kalman, 1, 0.0, 0.0, 0.0);
-			set_current(&Kalman, 2, 0.0, 0.0, 0.0);
-			set_current(&Kalman, 3, 0.0, 0.0, 0.0);
-			set_current(&Kalman, 4, 0.0, 0.0, 0.0);
-			set_current(&Kalman, 5, 0.0, 0.0, 0.0);
-			kalmanInitDone = true;
-			return;
+			for (int i = 0; i < SWARM_NUM_OF_UNITS_IN_GROUP; ++i)
+				set_unit_position(&kalman, i, multilat.get_x(i), multilat.get_y(i), multilat.get_z(i));
 		}
 		else
 		{
-			return;
+			set_unit_position(&kalman, 0, group[1].gps_pos.x, group[1].gps_pos.y, 0.0);
+			set_unit_position(&kalman, 1, group[2].gps_pos.x, group[2].gps_pos.y, 0.0);
+			set_unit_position(&kalman, 2, group[3].gps_pos.x, group[3].gps_pos.y, 0.0);
+			set_unit_position(&kalman, 3, group[4].gps_pos.x, group[4].gps_pos.y, 0.0);
+			set_unit_position(&kalman, 4, group[5].gps_pos.x, group[5].gps_pos.y, 0.0);
+			set_unit_position(&kalman, 5, group[6].gps_pos.x, group[6].gps_pos.y, 0.0);
 		}
-	}
-	return;
+		// Initialize the sea currents
+		// this info is from env. data. to be checked how to to update
+		set_current(&kalman, 0, 0.0, 0.0, 0.0);
+		set_current(&kalman, 1, 0.0, 0.0, 0.0);
+		set_current(&kalman, 2, 0.0, 0.0, 0.0);
+		set_current(&kalman, 3, 0.0, 0.0, 0.0);
+		set_current(&kalman, 4, 0.0, 0.0, 0.0);
+		set_current(&kalman, 5, 0.0, 0.0, 0.0);
+		initkalmandone = true;
+	}
+	pthread_mutex_unlock(&kalman_mutex);
 }
 void Seafloat::updateKalmanPos(int drifter, double x, double y, double z) 
 {
 	double value_x = x, value_y = y, value_z = z;
-	if (kalmanInitDone) {
-		if (value_z == 0.0) {
-			position_measurement(&Kalman, drifter-1, 1, value_x, value_y, value_z);
-		}
-		else {
-			position_measurement(&Kalman, drifter-1, 0, value_x, value_y, value_z);
-		} 
+	if (value_z == 0.0) {
+		position_measurement(&kalman, drifter-1, 1, value_x, value_y, value_z);
 	}
+	else {
+		position_measurement(&kalman, drifter-1, 0, value_x, value_y, value_z);
+	} 
 }
 
 void Seafloat::updateKalmanDist(int drifter, int float_i, double distance) 
 {
-	if (kalmanInitDone) {
-		distance_measurement(&Kalman, drifter-1, float_i-1, distance);
-	}
+	distance_measurement(&kalman, drifter-1, float_i-1, distance);
 }
 
 void Seafloat::runKalman() 
 {
-	if (kalmanInitDone) {
-		run_kalman(&Kalman);
+	pthread_mutex_lock(&kalman_mutex);
+	if (initkalmandone) {
+		TraceScope trace("run_kalman", "kalman");
+		run_kalman(&kalman);
 	}
+	pthread_mutex_unlock(&kalman_mutex);
 }
 
 void Seafloat::killKalman() 
 {
-	if (kalmanInitDone) {
-		end_kalman(&Kalman);
+	pthread_mutex_lock(&kalman_mutex);
+	if (initkalmandone) {
+		end_kalman(&kalman);
+		initkalmandone = false;
 	}
+	pthread_mutex_unlock(&kalman_mutex);
 }
 
-void doKalman()
+// both run from kalman_timer, one after the other, every kalman_calc_interval
+void Seafloat::kalman_run_job(void *seafloat)
 {
-	uint32_t simtimenow = sim_time.now();
-	if ((simtimenow - simTimeStamp) > ((uint32_t)kalman_calc_interval)) {
-		if (kalmanInitDone)
-		{
-			//sem_init(&kalman_sem, 0, 0);
-			// input measurement data to Kalman
-			//sfloat->updateKalmanWithData();
-			// and run kalman filter after this
-			run_kalman(&Kalman);
-
-		}
-		simTimeStamp = simtimenow;
-	}
+	// input measurement data to Kalman
+	//sfloat->updateKalmanWithData();
+	// and run kalman filter after this
+	static_cast<Seafloat *>(seafloat)->runKalman();
 }
 
-void doKalmanCalc()
+void Seafloat::kalman_calc_job(void *seafloat)
 {
-	uint32_t simtimenow = sim_time.now();
-	if ((simtimenow - simCalcTimeStamp) > ((uint32_t)kalman_calc_interval)) {
-		if (kalmanInitDone)
-		{
-			pos_xyzt estimate;
-			estimate = sfloat->getKalmanEstimation(client_id); // get right one from kalman filter
-			if (estimate.x != 0.0) { // writing to file is lame
-				//sprintf(est_buffer, "%d  ,pretalk:  est: %.1fm N, %.1fm E, %.1f, %d, id:%d\n", estimate.time, estimate.y, estimate.x, estimate.z, estimate.time, estimate.floatId);
-				dprint("kalman, est: %.1fm N, %.1fm E, %.1f, %d, id:%d\n", estimate.y, estimate.x, estimate.z, estimate.time, estimate.floatId);
-			}
-			// calc measurement data to Kalman
-			sfloat->updateKalmanWithData();
-			// and run kalman filter after this
-			run_kalman(&Kalman);
-		}
-		simCalcTimeStamp = simtimenow;
-	}
-}
-
-void timer_start(std::function<void(void)> func, unsigned int interval)
-{
-    std::thread([func, interval]() {
-        while (true)
-        {
-            func();
-            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
-        }
-    }).detach();
+	Seafloat *sfloat = static_cast<Seafloat *>(seafloat);
+	pos_xyzt estimate;
+	estimate = sfloat->getKalmanEstimation(client_id); // get right one from kalman filter
+	if (estimate.x != 0.0) { // writing to file is lame
+		//sprintf(est_buffer, "%d  ,pretalk:  est: %.1fm N, %.1fm E, %.1f, %d, id:%d\n", estimate.time, estimate.y, estimate.x, estimate.z, estimate.time, estimate.floatId);
+		dprint("kalman, est: %.1fm N, %.1fm E, %.1f, %d, id:%d\n", estimate.y, estimate.x, estimate.z, estimate.time, estimate.floatId);
+	}
+	// calc measurement data to Kalman
+	sfloat->updateKalmanWithData();
+	// and run kalman filter after this
+	sfloat->runKalman();
 }
 
 #define handle_error(msg) \
@@ -588,15 +622,13 @@ int main(int argc, char **argv)
 	init_float_client(argc, argv);
 	state_t cur_state = STATE_FAIL;
 	Seafloat seafloat(&satmsg_rx_queue, &soundmsg_rx_queue);
-	seafloat.initkalmandone = false;
-	simTimeStamp = sim_time.now();
-	simCalcTimeStamp = sim_time.now();
-	sfloat = &seafloat;
-	timer_start(doKalman, 50);
-	timer_start(doKalmanCalc, 100);
+	kalman_timer.add(Seafloat::kalman_calc_job, &seafloat, kalman_calc_interval);
+	kalman_timer.add(Seafloat::kalman_run_job, &seafloat, kalman_calc_interval);
+	kalman_timer.start();
 
 	while (true)
 	{
+		TraceScope trace(state_names[cur_state], "fsm");
 		state_t new_state = state_table[cur_state](&seafloat);
 		// printf("sim time %d \n", sim_time.now());
 		cur_state = new_state;
@@ -3,6 +3,7 @@
 
 #include <list>
 #include "kalman_filter.h"
+#include "util-multilat.h"
 // ADD JTE
 // struct distance list
 struct distance_float {
@@ -53,8 +54,8 @@ public:
 	GPSclient gps;
 	void setEstimatedPosition(simtime_t, double, double, double);
 	
-	std::list<distance_float> floatDistances;	
-	std::list<pos_xyzt> floatPositions; // list for fixes
+	std::list<distance_float> floatDistances;	// with kalman_mutex
+	std::list<pos_xyzt> floatPositions; // list for fixes, with kalman_mutex
 	
 	// ADD JTE
 	// stream info: array of [3][1024] vect_3 e.g. 10 km area around last fix
@@ -68,20 +69,34 @@ public:
 	int read_snd_msgs();
 	void read_snd_msg(const SoundMsg * msg);
 
-	// kalman filter handling
+	// kalman filter handling, from the FSM & kalman_timer threads; the public
+	// calls take kalman_mutex, the update* ones below expect it taken
 	void initkalman(); // 
-	void updateKalmanPos(int float_nro, double, double, double);
-	void updateKalmanDist(int this_unit, int float_i, double distance);
 	void updateKalmanWithData();
-	void updateDistances();
-	void updatePositions();
+	void clearKalmanData();
 	pos_xyzt getKalmanEstimation(int);
+
+	// batch multilateration from pong tables; also seeds the kalman state
+	MultilatSolver multilat;
+	bool multilat_valid;
+	void solveMultilat(const std::vector<distance_float> & dist);
     void runKalman();
 	void readKalman();
 	void killKalman();
-	bool initkalmandone;	
+	static void kalman_run_job(void * seafloat);
+	static void kalman_calc_job(void * seafloat);
 
 	void update_gui_predictions();
+
+private:
+	kalman_data kalman;
+	bool initkalmandone;
+	pthread_mutex_t kalman_mutex;
+
+	void updateKalmanPos(int float_nro, double, double, double);
+	void updateKalmanDist(int this_unit, int float_i, double distance);
+	void updateDistances();
+	void updatePositions();
 };
 
 // states
@@ -114,4 +129,13 @@ state_func_t * const state_table[NUM_STATES] = {
 	do_profile
 };
 
+const char * const state_names[NUM_STATES] = {
+	"fail",
+	"base_talk",
+	"init_dive",
+	"group_talk",
+	"drift",
+	"profile"
+};
+
 #endif
@@ -0,0 +1,338 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "gui-export.h"
+#include "util-mkdirp.h"
+
+
+//-----------------------------------------------------------------------------
+static void put_be32( unsigned char * b, uint32_t v ) {
+	b[0] = v >> 24; b[1] = v >> 16; b[2] = v >> 8; b[3] = v;
+}
+
+static void png_chunk( FILE * f, const char * type, const unsigned char * data, uint32_t len ) {
+	unsigned char b[4];
+	put_be32( b, len );
+	fwrite( b, 1, 4, f );
+	fwrite( type, 1, 4, f );
+	if ( len ) fwrite( data, 1, len, f );
+
+	uLong crc = crc32( 0, reinterpret_cast<const Bytef *>(type), 4 );
+	if ( len ) crc = crc32( crc, data, len );
+	put_be32( b, crc );
+	fwrite( b, 1, 4, f );
+}
+
+// 8-bit RGB, no filtering; rows come bottom first, as read from GL
+static bool write_png( const char * fn, unsigned int w, unsigned int h, const unsigned char * px ) {
+	FILE * f = fopen( fn, "wb" );
+	if ( !f ) return false;
+
+	static const unsigned char sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	fwrite( sig, 1, 8, f );
+
+	unsigned char ihdr[13] = { 0 };
+	put_be32( ihdr, w );
+	put_be32( ihdr + 4, h );
+	ihdr[8] = 8;	// bits per channel
+	ihdr[9] = 2;	// RGB
+	png_chunk( f, "IHDR", ihdr, 13 );
+
+	z_stream zs;
+	memset( &zs, 0, sizeof(zs) );
+	bool ok = ( deflateInit( &zs, Z_BEST_SPEED ) == Z_OK );
+
+	const size_t stride = 3 * w;
+	std::vector<unsigned char> row( 1 + stride, 0 ), out( 1 << 16 );
+	for ( unsigned int y = h; ok && ( y-- > 0 ); ) {
+		memcpy( &row[1], px + y * stride, stride );
+		zs.next_in = &row[0];
+		zs.avail_in = row.size();
+		const int flush = y ? Z_NO_FLUSH : Z_FINISH;
+		do {
+			zs.next_out = &out[0];
+			zs.avail_out = out.size();
+			if ( deflate( &zs, flush ) == Z_STREAM_ERROR ) { ok = false; break; }
+			const uint32_t n = out.size() - zs.avail_out;
+			if ( n ) png_chunk( f, "IDAT", &out[0], n );
+		} while ( zs.avail_out == 0 );
+	}
+	deflateEnd( &zs );
+
+	png_chunk( f, "IEND", NULL, 0 );
+	return ( fclose( f ) == 0 ) && ok;
+}
+
+
+//-----------------------------------------------------------------------------
+GuiExport::GuiExport( const char * target, unsigned int threads ) :
+	dir(), pipe(NULL), pipe_w(0), pipe_h(0),
+	next_readback(0),
+	queue(), spare(), writers(), writing(0), quit(false), written(0)
+{
+	memset( readbacks, 0, sizeof(readbacks) );
+	pthread_mutex_init( &mutex, NULL );
+	pthread_cond_init( &queue_cond, NULL );
+	pthread_cond_init( &done_cond, NULL );
+
+	if ( target[0] == '|' ) {
+		signal( SIGPIPE, SIG_IGN );	// a write error rather than an exit when the command quits
+		pipe = popen( target + 1, "w" );
+		if ( !pipe ) {
+			printf( "|| export: cannot run \"%s\"\n", target + 1 );
+			return;
+		}
+		threads = 1;	// frames must go in order
+	} else {
+		if ( mkdirp( target, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH ) && ( errno != EEXIST ) ) {
+			printf( "|| export: cannot create directory %s\n", target );
+			return;
+		}
+		dir = target;
+	}
+
+	if ( threads < 1 ) threads = 1;
+	if ( threads > GUI_EXPORT_THREADS ) threads = GUI_EXPORT_THREADS;
+	for ( unsigned int i = 0; i < threads; ++i ) {
+		pthread_t th;
+		if ( pthread_create( &th, NULL, &WriterThread, this ) == 0 ) writers.push_back( th );
+	}
+}
+
+GuiExport::~GuiExport() {
+	// pending readbacks are dropped, as the GL context may be gone; the pixel
+	// buffers go with it
+	pthread_mutex_lock( &mutex );
+	quit = true;
+	pthread_cond_broadcast( &queue_cond );
+	pthread_mutex_unlock( &mutex );
+	for ( unsigned int i = 0; i < writers.size(); ++i ) pthread_join( writers[i], NULL );
+
+	for ( unsigned int i = 0; i < spare.size(); ++i ) delete spare[i];
+	if ( pipe ) pclose( pipe );
+
+	pthread_cond_destroy( &done_cond );
+	pthread_cond_destroy( &queue_cond );
+	pthread_mutex_destroy( &mutex );
+}
+
+
+//-----------------------------------------------------------------------------
+void GuiExport::Capture( unsigned int w, unsigned int h, uint32_t t ) {
+	if ( !Ok() || !w || !h ) return;
+	if ( pipe ) {
+		if ( !pipe_w ) { pipe_w = w; pipe_h = h; }
+		else if ( ( w != pipe_w ) || ( h != pipe_h ) ) {
+			printf( "|| export: frame %ux%u at %u s skipped, piping %ux%u\n", w, h, t, pipe_w, pipe_h );
+			return;
+		}
+	}
+
+	readback_t & rb = readbacks[next_readback];
+	next_readback = ( next_readback + 1 ) % GUI_EXPORT_PBOS;
+	if ( rb.busy ) Retire( rb );
+
+	const size_t size = 3 * w * h;
+	if ( !rb.pbo ) glGenBuffers( 1, &rb.pbo );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, rb.pbo );
+	if ( rb.size != size ) {
+		glBufferData( GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ );
+		rb.size = size;
+	}
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, 0 );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	rb.busy = true;
+	rb.w = w;
+	rb.h = h;
+	rb.t = t;
+}
+
+void GuiExport::Retire( readback_t & rb ) {
+	frame_t * f;
+	pthread_mutex_lock( &mutex );
+	while ( queue.size() >= GUI_EXPORT_QUEUE ) pthread_cond_wait( &done_cond, &mutex );
+	if ( spare.empty() ) f = new frame_t;
+	else {
+		f = spare.back();
+		spare.pop_back();
+	}
+	pthread_mutex_unlock( &mutex );
+
+	f->w = rb.w;
+	f->h = rb.h;
+	f->t = rb.t;
+	f->px.resize( rb.size );
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, rb.pbo );
+	const void * p = glMapBuffer( GL_PIXEL_PACK_BUFFER, GL_READ_ONLY );
+	if ( p ) {
+		memcpy( &f->px[0], p, rb.size );
+		glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+	} else printf( "|| export: frame at %u s lost, cannot map its pixels\n", rb.t );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	rb.busy = false;
+
+	pthread_mutex_lock( &mutex );
+	if ( p ) {
+		queue.push_back( f );
+		pthread_cond_signal( &queue_cond );
+	} else spare.push_back( f );
+	pthread_mutex_unlock( &mutex );
+}
+
+void GuiExport::Finish() {
+	for ( unsigned int i = 0; i < GUI_EXPORT_PBOS; ++i ) {
+		readback_t & rb = readbacks[( next_readback + i ) % GUI_EXPORT_PBOS];
+		if ( rb.busy ) Retire( rb );
+	}
+
+	pthread_mutex_lock( &mutex );
+	while ( !queue.empty() || writing ) pthread_cond_wait( &done_cond, &mutex );
+	pthread_mutex_unlock( &mutex );
+
+	if ( pipe ) fflush( pipe );
+}
+
+
+//-----------------------------------------------------------------------------
+bool GuiExport::Write( const frame_t & f ) {
+	if ( pipe ) {
+		// top row first
+		const size_t stride = 3 * f.w;
+		for ( unsigned int y = f.h; y-- > 0; )
+			if ( fwrite( &f.px[y * stride], 1, stride, pipe ) != stride ) {
+				printf( "|| export: frame at %u s lost, write to pipe failed\n", f.t );
+				return false;
+			}
+		return true;
+	}
+
+	char fn[16];
+	snprintf( fn, sizeof(fn), "/%08u.png", f.t );
+	if ( !write_png( ( dir + fn ).c_str(), f.w, f.h, &f.px[0] ) ) {
+		printf( "|| export: cannot write %s%s\n", dir.c_str(), fn );
+		return false;
+	}
+	return true;
+}
+
+void * GuiExport::WriterThread( void * arg ) {
+	GuiExport * e = reinterpret_cast<GuiExport *>(arg);
+
+	pthread_mutex_lock( &e->mutex );
+	for ( ;; ) {
+		while ( e->queue.empty() && !e->quit ) pthread_cond_wait( &e->queue_cond, &e->mutex );
+		if ( e->queue.empty() ) break;
+
+		frame_t * f = e->queue.front();
+		e->queue.pop_front();
+		++e->writing;
+		pthread_mutex_unlock( &e->mutex );
+
+		const bool ok = e->Write( *f );
+
+		pthread_mutex_lock( &e->mutex );
+		--e->writing;
+		if ( ok ) ++e->written;
+		e->spare.push_back( f );
+		pthread_cond_broadcast( &e->done_cond );
+	}
+	pthread_mutex_unlock( &e->mutex );
+
+	return NULL;
+}
+
+
+//=============================================================================
+bool GuiOffscreen::Open( unsigned int w, unsigned int h ) {
+	Close();
+
+	display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+	if ( ( display == EGL_NO_DISPLAY ) || !eglInitialize( display, NULL, NULL ) ) {
+		display = eglGetPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, NULL, NULL );
+		if ( ( display == EGL_NO_DISPLAY ) || !eglInitialize( display, NULL, NULL ) ) {
+			printf( "|| offscreen: no EGL display\n" );
+			display = EGL_NO_DISPLAY;
+			return false;
+		}
+	}
+
+	static const EGLint config_attr[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, EGL_DONT_CARE,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint n = 0;
+	if ( !eglBindAPI( EGL_OPENGL_API ) || !eglChooseConfig( display, config_attr, &config, 1, &n ) || !n ) {
+		printf( "|| offscreen: no EGL config for OpenGL\n" );
+		Close();
+		return false;
+	}
+	context = eglCreateContext( display, config, EGL_NO_CONTEXT, NULL );
+	if ( ( context == EGL_NO_CONTEXT ) || !eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ) ) {
+		printf( "|| offscreen: cannot create a surfaceless OpenGL context\n" );
+		Close();
+		return false;
+	}
+
+	glGenRenderbuffers( 1, &color_rb );
+	glBindRenderbuffer( GL_RENDERBUFFER, color_rb );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, w, h );
+	glGenRenderbuffers( 1, &depth_rb );
+	glBindRenderbuffer( GL_RENDERBUFFER, depth_rb );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h );
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+	glGenFramebuffers( 1, &fbo );
+	glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rb );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rb );
+	if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE ) {
+		printf( "|| offscreen: %ux%u framebuffer incomplete\n", w, h );
+		Close();
+		return false;
+	}
+	glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+	glReadBuffer( GL_COLOR_ATTACHMENT0 );
+	glViewport( 0, 0, w, h );	// no surface to take it from
+
+	return true;
+}
+
+void GuiOffscreen::Close() {
+	if ( context != EGL_NO_CONTEXT ) {
+		glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+		if ( fbo ) glDeleteFramebuffers( 1, &fbo );
+		if ( depth_rb ) glDeleteRenderbuffers( 1, &depth_rb );
+		if ( color_rb ) glDeleteRenderbuffers( 1, &color_rb );
+		eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+		eglDestroyContext( display, context );
+	}
+	if ( display != EGL_NO_DISPLAY ) eglTerminate( display );
+
+	display = EGL_NO_DISPLAY;
+	context = EGL_NO_CONTEXT;
+	fbo = color_rb = depth_rb = 0;
+}
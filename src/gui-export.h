@@ -0,0 +1,109 @@
+#ifndef _gui_export_h
+#define _gui_export_h
+
+/* requires:
+	#include <deque>
+	#include <vector>
+	#include <string>
+	#include <cstdio>
+	#include <stdint.h>
+	#include <pthread.h>
+	#include <EGL/egl.h>
+	#include <GL/gl.h>
+*/
+
+#define  GUI_EXPORT_PBOS     3	// readbacks in flight before the oldest is waited for
+#define  GUI_EXPORT_QUEUE    8	// frames waiting for the writers before Capture() blocks
+#define  GUI_EXPORT_THREADS  16	// max writers
+
+
+/**
+ * Frame export: asynchronous readback & threaded writing of rendered frames
+ *
+ * Capture() starts reading the frame into a pixel buffer object and returns;
+ * the pixels are only mapped GUI_EXPORT_PBOS captures later, by when the GPU
+ * is long done with them. The frames are then written by a pool of threads,
+ * either as <dir>/<time>.png or, for a target starting with '|', as raw RGB24
+ * frames to the stdin of that command, e.g.
+ *
+ *   |ffmpeg -f rawvideo -pix_fmt rgb24 -s 1280x720 -r 25 -i - run.mp4
+ *
+ * Frames are piped in order by a single writer, so all must be the same size.
+ * Requires a current GL context for Capture() & Finish().
+ */
+class GuiExport {
+	public:
+		GuiExport( const char * target, unsigned int threads );
+		~GuiExport();
+
+		bool Ok() const { return pipe || !dir.empty(); }
+
+		// the current read buffer, w x h from the lower left corner, at
+		// simulation time t
+		void Capture( unsigned int w, unsigned int h, uint32_t t );
+		void Finish();	// waits until all captured frames are written
+
+		unsigned long Written() const { return written; }
+
+	private:
+		struct frame_t {
+			unsigned int w, h;
+			uint32_t t;
+			std::vector<unsigned char> px;	// RGB, bottom row first
+		};
+
+		struct readback_t {
+			GLuint pbo;
+			size_t size;
+			bool busy;
+			unsigned int w, h;
+			uint32_t t;
+		};
+
+		std::string dir;
+		FILE * pipe;
+		unsigned int pipe_w, pipe_h;
+
+		readback_t readbacks[GUI_EXPORT_PBOS];
+		unsigned int next_readback;
+
+		pthread_mutex_t mutex;
+		pthread_cond_t queue_cond, done_cond;
+		std::deque<frame_t *> queue;
+		std::vector<frame_t *> spare;
+		std::vector<pthread_t> writers;
+		unsigned int writing;
+		bool quit;
+		unsigned long written;
+
+		void Retire( readback_t & rb );
+		bool Write( const frame_t & f );
+		static void * WriterThread( void * arg );
+
+		GuiExport( const GuiExport & );
+		GuiExport & operator=( const GuiExport & );
+};
+
+
+//-----------------------------------------------------------------------------
+// A GL context without a window, rendering into a framebuffer object; EGL on
+// the default display, or Mesa's surfaceless platform when there's no window
+// system, as on a build server
+class GuiOffscreen {
+	public:
+		GuiOffscreen() : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT), fbo(0), color_rb(0), depth_rb(0) {}
+		~GuiOffscreen() { Close(); }
+
+		bool Open( unsigned int w, unsigned int h );
+		void Close();
+
+	private:
+		EGLDisplay display;
+		EGLContext context;
+		GLuint fbo, color_rb, depth_rb;
+
+		GuiOffscreen( const GuiOffscreen & );
+		GuiOffscreen & operator=( const GuiOffscreen & );
+};
+
+#endif // _gui_export_h
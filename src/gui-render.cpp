@@ -0,0 +1,381 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <atomic>
+#include <vector>
+#include <set>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <netcdfcpp.h>
+#ifdef FREEGLUT
+#include <GL/freeglut.h>
+#else
+#include <GL/glut.h>
+#endif
+#include <svl/SVL.h>
+
+#include "sssim.h"
+#include "sea-data.h"
+#include "sea-layers.h"
+#include "util-triplebuf.h"
+#include "gui-sea.h"
+#include "util-gl.h"
+#include "gui-render.h"
+
+
+#define  GRIDCOLOR_GREEN2  0.10, 0.40, 0.10, 0.6
+#define  GRIDCOLOR_BLUE    0.10, 0.30, 0.20, 0.4
+
+static const GLvoid * buffer_offset( size_t i ) { return reinterpret_cast<const GLvoid *>( i ); }
+
+static void set_color( GLubyte * c, const GLdouble * rgba ) {
+	for ( unsigned int i = 0; i < 4; ++i ) {
+		const GLdouble v = ( rgba[i] < 0.0 ) ? 0.0 : ( rgba[i] > 1.0 ) ? 1.0 : rgba[i];
+		c[i] = static_cast<GLubyte>( v * 255.0 + 0.5 );
+	}
+}
+
+// as glColor_depth()
+static void depth_color( GLubyte * c, double depth, double surface_value, double opac ) {
+	GLdouble rgba[4] = { surface_value, surface_value, surface_value, opac };
+	if ( depth >= 1.05 ) util_HSL_to_RGB( rgba, depth / 150.0, 1.0, 0.5 );
+	set_color( c, rgba );
+}
+
+// trail pushes s to e as a line strip; wraps around the ring buffer
+static void draw_ring_strip( unsigned long s, unsigned long e ) {
+	static const GLuint seam[] = { HISTORY_SIZE - 1, 0 };
+
+	if ( e - s < 2 ) return;
+	const GLint a = s % HISTORY_SIZE, b = ( e - 1 ) % HISTORY_SIZE;
+	if ( a <= b ) {
+		glDrawArrays( GL_LINE_STRIP, a, e - s );
+	} else {
+		glDrawArrays( GL_LINE_STRIP, a, HISTORY_SIZE - a );
+		glDrawElements( GL_LINES, 2, GL_UNSIGNED_INT, seam );
+		glDrawArrays( GL_LINE_STRIP, 0, b + 1 );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+GuiRenderer::GuiRenderer( const GuiSea & _sea ):
+	sea (_sea),
+	bottom_vbo (0), bottom_ibo (0),
+	layer_vbo (0), layer_cbo (0), layer_ibo (0),
+	flow_vbo (0)
+{
+	memset( layer_strips, 0, sizeof(layer_strips) );
+	for ( unsigned int i = 0; i < DRIFTER_MAX_COUNT; ++i ) {
+		trails[i].vbo = 0;
+		trails[i].pushed = 0;
+	}
+
+	CreateBottom();
+	CreateLayers();
+	glGenBuffers( 1, &flow_vbo );
+}
+
+GuiRenderer::~GuiRenderer() {
+	GLuint b[] = { bottom_vbo, bottom_ibo, layer_vbo, layer_cbo, layer_ibo, flow_vbo };
+	glDeleteBuffers( 6, b );
+	for ( unsigned int i = 0; i < DRIFTER_MAX_COUNT; ++i )
+		if ( trails[i].vbo ) glDeleteBuffers( 1, &trails[i].vbo );
+}
+
+
+//-----------------------------------------------------------------------------
+void GuiRenderer::CreateBottom() {
+	static const GLdouble
+		plain_surface_color[] = { GRIDCOLOR_GREEN2 },
+		plain_depth_color[] = { GRIDCOLOR_BLUE },
+		rainbow_surface_color[] = { 1.0, 1.0, 1.0, 0.5 };
+	const unsigned int n = SEA_DEPTH_NY * SEA_DEPTH_NX;
+
+	std::vector<vertex_t> v( 2 * n );
+	for ( unsigned int y = 0; y < SEA_DEPTH_NY; ++y ) for ( unsigned int x = 0; x < SEA_DEPTH_NX; ++x ) {
+		const unsigned int i = y * SEA_DEPTH_NX + x;
+		const double z = -1 * sea.bottom[y][x];
+
+		v[i].pos[0] = x * sea.bottom_pos[0][1];
+		v[i].pos[1] = z;
+		v[i].pos[2] = y * sea.bottom_pos[1][1];
+		v[n + i] = v[i];
+
+		set_color( v[i].color, ( z > 0 ) ? plain_depth_color : plain_surface_color );
+		if ( z > 0 ) depth_color( v[n + i].color, z, 1.0, 0.5 );
+		else set_color( v[n + i].color, rainbow_surface_color );
+	}
+
+	// a quad strip per row, between y and y+1
+	std::vector<GLuint> index;
+	for ( unsigned int y = 0; y < SEA_DEPTH_NY - 1; ++y ) {
+		bottom_count.push_back( 2 * SEA_DEPTH_NX );
+		bottom_north.push_back( buffer_offset( index.size() * sizeof(GLuint) ) );
+		for ( unsigned int x = 0; x < SEA_DEPTH_NX; ++x ) {
+			index.push_back( y * SEA_DEPTH_NX + x );
+			index.push_back( ( y + 1 ) * SEA_DEPTH_NX + x );
+		}
+	}
+	bottom_south.assign( bottom_north.rbegin(), bottom_north.rend() );
+
+	glGenBuffers( 1, &bottom_vbo );
+	glBindBuffer( GL_ARRAY_BUFFER, bottom_vbo );
+	glBufferData( GL_ARRAY_BUFFER, v.size() * sizeof(vertex_t), &v[0], GL_STATIC_DRAW );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	glGenBuffers( 1, &bottom_ibo );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, bottom_ibo );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, index.size() * sizeof(GLuint), &index[0], GL_STATIC_DRAW );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+}
+
+// from_south: rows from the south first, for a view from the north
+void GuiRenderer::DrawBottom( bool rainbow, bool from_south ) {
+	const size_t base = rainbow ? SEA_DEPTH_NY * SEA_DEPTH_NX * sizeof(vertex_t) : 0;
+
+	glDisable( GL_CULL_FACE );
+	glPushMatrix();
+	glTranslated( sea.bottom_pos[0][0], 0.0, sea.bottom_pos[1][0] );
+
+	glBindBuffer( GL_ARRAY_BUFFER, bottom_vbo );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, bottom_ibo );
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glEnableClientState( GL_COLOR_ARRAY );
+	glVertexPointer( 3, GL_FLOAT, sizeof(vertex_t), buffer_offset( base + offsetof(vertex_t, pos) ) );
+	glColorPointer( 4, GL_UNSIGNED_BYTE, sizeof(vertex_t), buffer_offset( base + offsetof(vertex_t, color) ) );
+
+	glMultiDrawElements( GL_QUAD_STRIP, &bottom_count[0], GL_UNSIGNED_INT,
+		from_south ? &bottom_south[0] : &bottom_north[0], bottom_count.size() );
+
+	glDisableClientState( GL_COLOR_ARRAY );
+	glDisableClientState( GL_VERTEX_ARRAY );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glPopMatrix();
+}
+
+
+//-----------------------------------------------------------------------------
+void GuiRenderer::CreateLayers() {
+	std::vector<GLfloat> v;
+	v.reserve( 3 * SEA_NZ * SEA_NY * SEA_NX );
+	for ( unsigned int z = 0; z < SEA_NZ; ++z )
+		for ( unsigned int y = 0; y < SEA_NY; ++y )
+			for ( unsigned int x = 0; x < SEA_NX; ++x ) {
+				v.push_back( x * sea.var_pos[0][1] );
+				v.push_back( sea.depth[z] );
+				v.push_back( y * sea.var_pos[1][1] );
+			}
+
+	glGenBuffers( 1, &layer_vbo );
+	glBindBuffer( GL_ARRAY_BUFFER, layer_vbo );
+	glBufferData( GL_ARRAY_BUFFER, v.size() * sizeof(GLfloat), &v[0], GL_STATIC_DRAW );
+
+	layer_color.assign( 4 * SEA_NZ * SEA_NY * SEA_NX, 0 );
+	glGenBuffers( 1, &layer_cbo );
+	glBindBuffer( GL_ARRAY_BUFFER, layer_cbo );
+	glBufferData( GL_ARRAY_BUFFER, layer_color.size(), &layer_color[0], GL_DYNAMIC_DRAW );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	glGenBuffers( 1, &layer_ibo );
+}
+
+// nodes without data (0) are left out, so each row of a layer may take a few
+// quad strips
+void GuiRenderer::SetLayers( const SeaData & data, double var_min, double var_range ) {
+	GLdouble rgba[4] = { 1.0, 1.0, 1.0, 0.08 };
+
+	strip_index.clear();
+	strip_count.clear();
+	strip_offset.clear();
+
+	for ( unsigned int z = 0; z < SEA_NZ; ++z ) {
+		layer_strips[z] = strip_count.size();
+
+		for ( unsigned int y = 0; y < SEA_NY; ++y ) for ( unsigned int x = 0; x < SEA_NX; ++x ) {
+			GLubyte * c = &layer_color[4 * ( ( z * SEA_NY + y ) * SEA_NX + x )];
+			if ( !data[z][y][x] ) {
+				memset( c, 0, 4 );
+				continue;
+			}
+			double h = ( data[z][y][x] - var_min ) / var_range;
+			while ( h > 1.0 ) --h;
+			util_HSL_to_RGB( rgba, h, 0.7, 0.5 );
+			set_color( c, rgba );
+		}
+
+		for ( unsigned int y = 0; y < SEA_NY - 1; ++y ) {
+			size_t first = strip_index.size();
+			for ( unsigned int x = 0; x <= SEA_NX; ++x ) {
+				if ( ( x < SEA_NX ) && data[z][y][x] && data[z][y + 1][x] ) {
+					strip_index.push_back( ( z * SEA_NY + y ) * SEA_NX + x );
+					strip_index.push_back( ( z * SEA_NY + y + 1 ) * SEA_NX + x );
+					continue;
+				}
+				if ( strip_index.size() - first >= 4 ) {
+					strip_count.push_back( strip_index.size() - first );
+					strip_offset.push_back( buffer_offset( first * sizeof(GLuint) ) );
+				} else {
+					strip_index.resize( first );
+				}
+				first = strip_index.size();
+			}
+		}
+	}
+	layer_strips[SEA_NZ] = strip_count.size();
+
+	glBindBuffer( GL_ARRAY_BUFFER, layer_cbo );
+	glBufferSubData( GL_ARRAY_BUFFER, 0, layer_color.size(), &layer_color[0] );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, layer_ibo );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, strip_index.size() * sizeof(GLuint), strip_index.empty() ? NULL : &strip_index[0], GL_DYNAMIC_DRAW );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+}
+
+void GuiRenderer::DrawLayer( unsigned int z ) {
+	const unsigned int first = layer_strips[z], n = layer_strips[z + 1] - first;
+	if ( !n ) return;
+
+	glDisable( GL_CULL_FACE );
+	glPushMatrix();
+	glTranslated( sea.var_pos[0][0], 0.0, sea.var_pos[1][0] );
+
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glEnableClientState( GL_COLOR_ARRAY );
+	glBindBuffer( GL_ARRAY_BUFFER, layer_vbo );
+	glVertexPointer( 3, GL_FLOAT, 0, buffer_offset( 0 ) );
+	glBindBuffer( GL_ARRAY_BUFFER, layer_cbo );
+	glColorPointer( 4, GL_UNSIGNED_BYTE, 0, buffer_offset( 0 ) );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, layer_ibo );
+
+	glMultiDrawElements( GL_QUAD_STRIP, &strip_count[first], GL_UNSIGNED_INT, &strip_offset[first], n );
+
+	glDisableClientState( GL_COLOR_ARRAY );
+	glDisableClientState( GL_VERTEX_ARRAY );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glPopMatrix();
+}
+
+
+//-----------------------------------------------------------------------------
+// the dots move with anim_scale, so they're streamed every frame; in the
+// current colour, rows from the north first if reverse
+void GuiRenderer::DrawFlowDots( const GuiSeaGrid & grid, unsigned int z, double anim_scale, bool reverse ) {
+	const double x_d = sea.var_pos[0][1], y_d = sea.var_pos[1][1];
+
+	flow_points.clear();
+	for ( unsigned int i = 0; i < SEA_NY; ++i ) {
+		const unsigned int y = reverse ? SEA_NY - 1 - i : i;
+		for ( unsigned int x = 0; x < SEA_NX; ++x ) {
+			const double u = grid.flow[0][z][y][x], v = grid.flow[1][z][y][x];
+			if ( u == 0.0 && v == 0.0 ) continue;
+			flow_points.push_back( x * x_d + u * anim_scale );
+			flow_points.push_back( grid.flow[2][z][y][x] * anim_scale );
+			flow_points.push_back( y * y_d + v * anim_scale );
+		}
+	}
+	if ( flow_points.empty() ) return;
+
+	glPointSize( 2.0 );
+	glPushMatrix();
+	glTranslated( sea.var_pos[0][0], sea.depth[z], sea.var_pos[1][0] );
+
+	glBindBuffer( GL_ARRAY_BUFFER, flow_vbo );
+	glBufferData( GL_ARRAY_BUFFER, flow_points.size() * sizeof(GLfloat), &flow_points[0], GL_STREAM_DRAW );
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glVertexPointer( 3, GL_FLOAT, 0, buffer_offset( 0 ) );
+
+	glDrawArrays( GL_POINTS, 0, flow_points.size() / 3 );
+
+	glDisableClientState( GL_VERTEX_ARRAY );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glPopMatrix();
+}
+
+
+//-----------------------------------------------------------------------------
+// uploads the positions not yet uploaded; trail holds pushes end - size to
+// end - 1, and a gap since the last update is drawn as a break
+void GuiRenderer::UpdateTrail( unsigned int i, const std::vector<Vec3> & trail, unsigned long end ) {
+	trail_t & tr = trails[i];
+	if ( end <= tr.pushed ) return;
+
+	if ( !tr.vbo ) {
+		glGenBuffers( 1, &tr.vbo );
+		glBindBuffer( GL_ARRAY_BUFFER, tr.vbo );
+		glBufferData( GL_ARRAY_BUFFER, HISTORY_SIZE * sizeof(vertex_t), NULL, GL_DYNAMIC_DRAW );
+	} else {
+		glBindBuffer( GL_ARRAY_BUFFER, tr.vbo );
+	}
+
+	const unsigned long first = ( end > HISTORY_SIZE ) ? end - HISTORY_SIZE : 0;
+	const unsigned long given = end - trail.size();
+	unsigned long from = ( tr.pushed > first ) ? tr.pushed : first;
+	if ( given > from ) from = given;
+	tr.breaks.erase( tr.breaks.begin(), tr.breaks.lower_bound( first + 1 ) );
+
+	const double ox = sea.var_pos[0][0], oy = sea.var_pos[1][0];
+	Vec3 prev = tr.last;
+	trail_staging.resize( end - from );
+	for ( unsigned long k = from; k < end; ++k ) {
+		const Vec3 & pt = trail[k - given];
+		const bool far = sqrlen( prev - pt ) > GUI_TRAIL_BREAK;
+		if ( ( k > from ) ? far : ( k && ( ( k != tr.pushed ) || far ) ) )
+			tr.breaks.insert( k );
+		prev = pt;
+
+		vertex_t & v = trail_staging[k - from];
+		v.pos[0] = pt[0] - ox;
+		v.pos[1] = pt[2];
+		v.pos[2] = pt[1] - oy;
+		depth_color( v.color, pt[2], 1.0, 0.5 );
+	}
+	tr.last = prev;
+	tr.pushed = end;
+
+	const unsigned long s = from % HISTORY_SIZE, n = end - from;
+	const unsigned long n0 = ( n < HISTORY_SIZE - s ) ? n : HISTORY_SIZE - s;
+	glBufferSubData( GL_ARRAY_BUFFER, s * sizeof(vertex_t), n0 * sizeof(vertex_t), &trail_staging[0] );
+	if ( n > n0 ) glBufferSubData( GL_ARRAY_BUFFER, 0, ( n - n0 ) * sizeof(vertex_t), &trail_staging[n0] );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+// depth_colors: else in black, for the Paper display mode
+void GuiRenderer::DrawTrail( unsigned int i, bool depth_colors ) {
+	const trail_t & tr = trails[i];
+	if ( !tr.vbo || ( tr.pushed < 2 ) ) return;
+
+	glPushMatrix();
+	glTranslated( sea.var_pos[0][0], 0.0, sea.var_pos[1][0] );
+
+	glBindBuffer( GL_ARRAY_BUFFER, tr.vbo );
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glVertexPointer( 3, GL_FLOAT, sizeof(vertex_t), buffer_offset( offsetof(vertex_t, pos) ) );
+	if ( depth_colors ) {
+		glEnableClientState( GL_COLOR_ARRAY );
+		glColorPointer( 4, GL_UNSIGNED_BYTE, sizeof(vertex_t), buffer_offset( offsetof(vertex_t, color) ) );
+	} else {
+		glColor4d( 0.0, 0.0, 0.0, 0.8 );
+	}
+
+	// a strip between each break
+	unsigned long s = ( tr.pushed > HISTORY_SIZE ) ? tr.pushed - HISTORY_SIZE : 0;
+	for ( std::set<unsigned long>::const_iterator b = tr.breaks.upper_bound( s ); b != tr.breaks.end(); ++b ) {
+		draw_ring_strip( s, *b );
+		s = *b;
+	}
+	draw_ring_strip( s, tr.pushed );
+
+	glDisableClientState( GL_COLOR_ARRAY );
+	glDisableClientState( GL_VERTEX_ARRAY );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glPopMatrix();
+}
@@ -0,0 +1,87 @@
+#ifndef _gui_render_h
+#define _gui_render_h
+
+/* requires:
+	#include <vector>
+	#include <set>
+	#include <GL/gl.h>
+	#include <svl/SVL.h>
+
+	#include "sssim.h"
+	#include "sea-data.h"
+	#include "sea-layers.h"
+	#include "gui-sea.h"
+	#include "util-gl.h"
+*/
+
+#define  GUI_TRAIL_BREAK  1000000.0	// m^2; longer steps between positions aren't drawn
+
+
+/**
+ * Retained-mode drawing of the GUI scene from vertex buffer objects
+ *
+ * The sea bottom and the layer node positions are uploaded once; the layer
+ * colours only when SetLayers() is called for a new grid or variable, and
+ * each float trail only with the positions pushed since the last update, into
+ * a ring buffer of the last HISTORY_SIZE positions. A frame is then a
+ * handful of draw calls per layer and trail rather than one call per vertex.
+ *
+ * Positions are stored relative to the sea data origin, as floats would lose
+ * too much at the absolute map coordinates. Requires a current GL context
+ * with OpenGL 1.5 for the constructor and all drawing.
+ */
+class GuiRenderer {
+	public:
+		GuiRenderer( const GuiSea & _sea );
+		~GuiRenderer();
+
+		void DrawBottom( bool rainbow, bool from_south );
+
+		// colour the layers by value, hue from var_min to var_min + var_range
+		void SetLayers( const SeaData & data, double var_min, double var_range );
+		void DrawLayer( unsigned int z );
+		void DrawFlowDots( const GuiSeaGrid & grid, unsigned int z, double anim_scale, bool reverse );
+
+		void UpdateTrail( unsigned int i, const std::vector<Vec3> & trail, unsigned long end );
+		void DrawTrail( unsigned int i, bool depth_colors );
+
+	private:
+		struct vertex_t {
+			GLfloat pos[3];
+			GLubyte color[4];
+		};
+
+		struct trail_t {
+			GLuint vbo;	// HISTORY_SIZE vertices, 0 until first updated
+			unsigned long pushed;	// positions uploaded, the last in [(pushed - 1) % HISTORY_SIZE]
+			Vec3 last;
+			std::set<unsigned long> breaks;	// pushes too far from the one before
+		};
+
+		const GuiSea & sea;
+
+		GLuint bottom_vbo, bottom_ibo;	// vertices with plain colours, then rainbow colours
+		std::vector<GLsizei> bottom_count;
+		std::vector<const GLvoid *> bottom_south, bottom_north;	// index offsets of the rows
+
+		GLuint layer_vbo, layer_cbo, layer_ibo;	// positions, colours, strip indices
+		std::vector<GLsizei> strip_count;
+		std::vector<const GLvoid *> strip_offset;
+		unsigned int layer_strips[SEA_NZ + 1];	// first strip of each layer
+		std::vector<GLuint> strip_index;
+		std::vector<GLubyte> layer_color;
+
+		GLuint flow_vbo;
+		std::vector<GLfloat> flow_points;
+
+		trail_t trails[DRIFTER_MAX_COUNT];
+		std::vector<vertex_t> trail_staging;
+
+		void CreateBottom();
+		void CreateLayers();
+
+		GuiRenderer( const GuiRenderer & );
+		GuiRenderer & operator=( const GuiRenderer & );
+};
+
+#endif // _gui_render_h
@@ -2,14 +2,26 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <atomic>
+#include <list>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <limits>
 #include <cstdio>
+#include <cstring>
 #include <stdint.h>
+#include <pthread.h>
 #include <netcdfcpp.h>
 #include <svl/SVL.h>
 
 #include "sssim.h"
 #include "sea-data.h"
+#include "sea-layers.h"
+#include "sea-tiles.h"
+#include "util-triplebuf.h"
 #include "gui-sea.h"
 
 
@@ -76,16 +88,17 @@ void GuiSea::ReadDepthInfo() {
 
 
 //-----------------------------------------------------------------------------
-GuiSea::GuiSea():
+GuiSea::GuiSea( const char * tiles_fn ):
 	t_now(0.0),
 	
 	//Read the data from the data files, and use respective file pointers to point to them
+	//  (only the bathymetry with a tile file)
 	pfDepth (new NcFile(SEA_DATA_FILEPATH_DEPTH, NcFile::ReadOnly)),
-	pfS     (new NcFile(SEA_DATA_DIR SEA_DATA_FILE_SALT, NcFile::ReadOnly)),
-	pfTemp  (new NcFile(SEA_DATA_DIR SEA_DATA_FILE_TEMP, NcFile::ReadOnly)),
-	pfU     (new NcFile(SEA_DATA_DIR SEA_DATA_FILE_U_VEL, NcFile::ReadOnly)),
-	pfV     (new NcFile(SEA_DATA_DIR SEA_DATA_FILE_V_VEL, NcFile::ReadOnly)),
-	pfW     (new NcFile(SEA_DATA_DIR SEA_DATA_FILE_W_VEL, NcFile::ReadOnly)),
+	pfS     (tiles_fn ? NULL : new NcFile(SEA_DATA_DIR SEA_DATA_FILE_SALT, NcFile::ReadOnly)),
+	pfTemp  (tiles_fn ? NULL : new NcFile(SEA_DATA_DIR SEA_DATA_FILE_TEMP, NcFile::ReadOnly)),
+	pfU     (tiles_fn ? NULL : new NcFile(SEA_DATA_DIR SEA_DATA_FILE_U_VEL, NcFile::ReadOnly)),
+	pfV     (tiles_fn ? NULL : new NcFile(SEA_DATA_DIR SEA_DATA_FILE_V_VEL, NcFile::ReadOnly)),
+	pfW     (tiles_fn ? NULL : new NcFile(SEA_DATA_DIR SEA_DATA_FILE_W_VEL, NcFile::ReadOnly)),
 
 	//Use the variable pointer to point to the respective variables:
 		// dDepth  -> depth
@@ -96,14 +109,36 @@ GuiSea::GuiSea():
 		// dW      ->
 
 	dDepth (pfDepth->get_var("BALDEP")),
-	dS (pfS->get_var("S")),
-	dTemp (pfTemp->get_var("TEMP")),
-	dU (pfU->get_var("U")),
-	dV (pfV->get_var("V")),
-	dW (pfW->get_var("W")),
+	dS (pfS ? pfS->get_var("S") : NULL),
+	dTemp (pfTemp ? pfTemp->get_var("TEMP") : NULL),
+	dU (pfU ? pfU->get_var("U") : NULL),
+	dV (pfV ? pfV->get_var("V") : NULL),
+	dW (pfW ? pfW->get_var("W") : NULL),
+	tile_store (NULL), tile_cache (NULL),
 
-	t0 (0), time_stepsize (1), t_now_int(0), t_now_frac(0.0)  // Initialize the time constants
+	raw_now (&raw[0]), raw_next (&raw[1]),
+	want_ti (GUI_SLICES_NONE), next_ti (GUI_SLICES_NONE), loader_quit (false),
+
+	t0 (0), time_stepsize (1), n_t (SEA_NT), t_now_int(0), t_now_frac(0.0)  // Initialize the time constants
 {
+	raw_now->ti = raw_next->ti = GUI_SLICES_NONE;
+
+	pthread_mutex_init(&loader_mutex, NULL);
+	pthread_cond_init(&loader_cond, NULL);
+
+	if ( tiles_fn ) {
+		tile_store = new SeaTileStore();
+		if ( !tile_store->open(tiles_fn) ) {
+			printf("%s: bad sea tiles: %s\n", __FUNCTION__, tiles_fn);
+			exit(1);
+		}
+		tile_cache = new SeaTileCache(*tile_store, SEA_TILES_GUI_CACHE);
+		ReadTileInfo();
+		pthread_create(&loader, NULL, &LoaderThread, this);
+		SetTime(0, true);
+		return;
+	}
+
 	VerifyNetCDF(pfS, 3, "S");
 	VerifyNetCDF(pfTemp, 3, "Temp");
 	VerifyNetCDF(pfU, 3, "U");
@@ -129,16 +164,58 @@ GuiSea::GuiSea():
 
 	pf->get_var("Z")->get( &depth[0], SEA_NZ );
 	for (unsigned int z = 0; z < SEA_NZ; ++z) depth[z] *= -1;
+	layers.init(depth);
 
 	int at[2];
 	pf->get_var("T")->get(at, 2);
 	t0 = at[0];
 	time_stepsize = at[1] - at[0];
-	t_now_int = SEA_NT * time_stepsize + 1;
 
+	pthread_create(&loader, NULL, &LoaderThread, this);
 	SetTime(0, true);
 }
 
+GuiSea::~GuiSea() {
+	pthread_mutex_lock(&loader_mutex);
+	loader_quit = true;
+	pthread_cond_broadcast(&loader_cond);
+	pthread_mutex_unlock(&loader_mutex);
+	pthread_join(loader, NULL);
+
+	pthread_cond_destroy(&loader_cond);
+	pthread_mutex_destroy(&loader_mutex);
+}
+
+
+// as the constructor, from the tile store header
+void GuiSea::ReadTileInfo() {
+	const sea_tiles_header_t & h = tile_store->hdr;
+	if ( ( h.nz != SEA_NZ ) || ( h.ny != SEA_NY ) || ( h.nx != SEA_NX ) ) {
+		printf("Sea tiles are %u x %u x %u (z, y, x), not %u x %u x %u :: exiting\n", h.nz, h.ny, h.nx, SEA_NZ, SEA_NY, SEA_NX);
+		exit(1);
+	}
+
+	var_pos[1][0] = h.y0;
+	var_pos[1][1] = h.step_y;
+	var_pos[0][0] = h.x0;
+	var_pos[0][1] = h.step_x;
+	var_pos[1][0] -= var_pos[1][1]/2; // DEBUG to better match bathymetry
+
+	ReadDepthInfo();
+
+	var_pos[0][0] = degrees_east_to_meters(var_pos[0][0]);
+	var_pos[1][0] = degrees_north_to_meters(var_pos[1][0]);
+	var_pos[0][1] *= METERS_PER_DEGREE_EAST;
+	var_pos[1][1] *= METERS_PER_DEGREE_NORTH;
+
+	for (unsigned int z = 0; z < SEA_NZ; ++z) depth[z] = -1 * tile_store->z[z];
+	layers.init(depth);
+
+	t0 = h.t0;
+	time_stepsize = h.step_t;
+	n_t = h.nt;
+}
+
 
 //-----------------------------------------------------------------------------
 void GuiSea::UpdateDataToTime( SeaData & tgt, SeaData * raw ) {
@@ -149,38 +226,115 @@ void GuiSea::UpdateDataToTime( SeaData & tgt, SeaData * raw ) {
 
 
 //-----------------------------------------------------------------------------
-void GuiSea::SetTime( double t, bool update_grid ) {
-	static NcVar * v[] = { dS, dTemp, dU, dV, dW };
-	static SeaData * dr[] = { &raw_salt[0], &raw_temp[0], &raw_flow[0][0], &raw_flow[1][0], &raw_flow[2][0] };
-	static SeaData * di[] = { &salt, &temp, &flow[0], &flow[1], &flow[2] };
+// the netCDF library isn't thread-safe, so after the constructor all reads
+// are done here
+void GuiSea::ReadSlices( uint32_t ti, GuiSeaSlices & s ) {
+	SeaData * dr[] = { &s.salt[0], &s.temp[0], &s.flow[0][0], &s.flow[1][0], &s.flow[2][0] };
+
+	if ( tile_cache ) {
+		for ( unsigned int i = 0; i < 5; ++i ) {
+			tile_cache->slice( i, ti, &dr[i][0][0][0][0] );
+			tile_cache->slice( i, ti + 1, &dr[i][1][0][0][0] );
+		}
+		tile_cache->prefetch( ti + 2, ti + 2 + tile_store->hdr.tt, 0, SEA_NY - 1, 0, SEA_NX - 1 );
+	} else {
+		NcVar * v[] = { dS, dTemp, dU, dV, dW };
+		for ( unsigned int i = 0; i < 5; ++i ) {
+			v[i]->set_cur( ti, 0, SEA_IY, SEA_IX );
+			v[i]->get( &dr[i][0][0][0][0], 2, SEA_NZ, SEA_NY, SEA_NX );
+		}
+	}
+	s.ti = ti;
+}
+
+void * GuiSea::LoaderThread( void * arg ) {
+	GuiSea * sea = reinterpret_cast<GuiSea *>(arg);
+
+	pthread_mutex_lock(&sea->loader_mutex);
+	for (;;) {
+		while ( !sea->loader_quit && ( ( sea->want_ti == sea->next_ti ) || ( sea->want_ti == GUI_SLICES_NONE ) ) )
+			pthread_cond_wait(&sea->loader_cond, &sea->loader_mutex);
+		if ( sea->loader_quit ) break;
+
+		const uint32_t ti = sea->want_ti;
+		sea->next_ti = GUI_SLICES_NONE;	// raw_next is being written
+		pthread_mutex_unlock(&sea->loader_mutex);
+
+		sea->ReadSlices( ti, *sea->raw_next );
+
+		pthread_mutex_lock(&sea->loader_mutex);
+		sea->next_ti = ti;
+		pthread_cond_broadcast(&sea->loader_cond);
+	}
+	pthread_mutex_unlock(&sea->loader_mutex);
+
+	return NULL;
+}
 
+// make raw_now the slices for ti, normally already prefetched; then start
+// on the ones after
+void GuiSea::SwapSlices( uint32_t ti ) {
+	pthread_mutex_lock(&loader_mutex);
+	if ( want_ti != ti ) {
+		want_ti = ti;
+		pthread_cond_broadcast(&loader_cond);
+	}
+	while ( next_ti != ti ) pthread_cond_wait(&loader_cond, &loader_mutex);
+
+	GuiSeaSlices * s = raw_now;
+	raw_now = raw_next;
+	raw_next = s;
+
+	next_ti = raw_next->ti;
+	want_ti = ( ti + 1 < n_t - 1 ) ? ti + 1 : 0;
+	pthread_cond_broadcast(&loader_cond);
+	pthread_mutex_unlock(&loader_mutex);
+}
+
+
+//-----------------------------------------------------------------------------
+void GuiSea::SetTime( double t, bool update_grid ) {
 	double ti_d;
 	double tf = modf( t / time_stepsize, &ti_d );
 	uint32_t ti = static_cast<uint32_t>( ti_d );
 
-	if ( ti >= SEA_NT-1 ) {
+	if ( ti >= n_t-1 ) {
 		t = 0.0;
 		ti = 0;
 		tf = 0.0;
 	}
 
-	if ( ti != t_now_int ) {
-		for ( unsigned int i = 0; i < 5; ++i ) {
-			v[i]->set_cur( ti, 0, SEA_IY, SEA_IX );
-			v[i]->get( &dr[i][0][0][0][0], 2, SEA_NZ, SEA_NY, SEA_NX );
-		}
-	}
+	if ( ti != raw_now->ti ) SwapSlices( ti );
 
 	t_now = t;
 	t_now_int = ti;
 	t_now_frac = tf;
 
-	if (update_grid) for (unsigned int i = 0; i < 5; ++i) UpdateDataToTime(*(di[i]), dr[i]);
+	if (update_grid) {
+		GuiSeaGrid & g = grids.back();
+		UpdateDataToTime( g.salt, raw_now->salt );
+		UpdateDataToTime( g.temp, raw_now->temp );
+		for ( unsigned int i = 0; i < 3; ++i ) UpdateDataToTime( g.flow[i], raw_now->flow[i] );
+
+		grids.publish();
+	}
+}
+
+const GuiSeaGrid & GuiSea::AcquireGrid( bool * fresh ) {
+	const bool is_fresh = grids.acquire();
+	if ( fresh ) *fresh = is_fresh;
+	return grids.front();
 }
 
 
 //-----------------------------------------------------------------------------
 void GuiSea::PrintInfo() {
+	if ( tile_store ) {
+		const sea_tiles_header_t & h = tile_store->hdr;
+		printf("\n// tile file: %u x %u x %u x %u (t, z, y, x), tiles of %u x %u x %u x %u\n", h.nt, h.nz, h.ny, h.nx, h.tt, h.tz, h.ty, h.tx);
+		return;
+	}
+
 	NcFile * pf = pfTemp;	// use data from Temp variable for global settings -- assumed same for all variables
 
 	unsigned int
@@ -236,3 +390,18 @@ void GuiSea::PrintInfo() {
 
 	std::cout << '\n';
 }
+
+
+//-----------------------------------------------------------------------------
+bool GuiSea::MapPosition(const double pos[], unsigned int map_cell[], double cell_frac[]) const {
+	for (unsigned int i = 0; i < 2; ++i) {
+		const double max_loc = ((i == 0) ? SEA_NX : SEA_NY) - 1.000001;
+		double c, l = (pos[i] - var_pos[i][0]) / var_pos[i][1];
+		if ((l < 0.0) || (l > max_loc)) return false;
+		cell_frac[i] = modf(l, &c);
+		map_cell[i] = c;
+	}
+
+	layers.locate(pos[2], map_cell[2], cell_frac[2]);
+	return true;
+}
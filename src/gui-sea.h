@@ -1,42 +1,89 @@
 #ifndef _gui_sea_h
 #define _gui_sea_h
 
+/* requires:
+	#include <atomic>
+	#include <pthread.h>
+
+	#include "util-triplebuf.h"
+*/
+
 
 #define  SEA_CLIP_MIN  30
 #define  SEA_CLIP_MAX  300000
 
+#define  SEA_TILES_GUI_CACHE  (64 << 20)	// bytes
+
+#define  GUI_SLICES_NONE  0xFFFFFFFF
+
 
 typedef double SeaBottomData[SEA_DEPTH_NY][SEA_DEPTH_NX];
 typedef double SeaLayerData[SEA_NY][SEA_NX];
 typedef SeaLayerData SeaData[SEA_NZ];
 
+class SeaTileStore;
+class SeaTileCache;
+
+// raw data of time steps ti & ti+1
+struct GuiSeaSlices {
+	uint32_t ti;
+	SeaData salt[2], temp[2], flow[3][2];
+};
+
+// data interpolated to a point in time
+struct GuiSeaGrid {
+	SeaData salt, temp, flow[3];
+};
+
 class GuiSea {
 	public:
 		double t_now;
 
 		SeaBottomData bottom;
-		SeaData salt, temp, flow[3];
 
 		double depth[SEA_NZ];	// 0: deepest, SEA_NZ-1: shallowest
+		SeaLayerIndex layers;
 		double bottom_pos[2][2], var_pos[2][2];	// 0,0: x-offset, 0,1:x-scale 1,0: y-offset, 1,1:y-scale
 
-		GuiSea();
+		GuiSea( const char * tiles_fn = NULL );	// tiles_fn: read the data from a tile file instead, see sea-tiles.h
+		~GuiSea();
+
+		// SetTime() from one thread, AcquireGrid() & Grid() from another: the
+		// grids are triple buffered, so neither waits for the other
 		void SetTime( double t, bool update_grid );
+		const GuiSeaGrid & AcquireGrid( bool * fresh = NULL );	// latest grid set by SetTime(); once per frame
+		const GuiSeaGrid & Grid() const { return grids.front(); }	// as of the last AcquireGrid()
+
 		void PrintInfo();
 
 	private:
 		NcFile *pfDepth, *pfS, *pfTemp, *pfU, *pfV, *pfW;
 		NcVar *dDepth, *dS, *dTemp, *dU, *dV, *dW;
+		SeaTileStore *tile_store;
+		SeaTileCache *tile_cache;
+
+		// raw_now is used by SetTime(); raw_next is filled by the loader
+		// thread with the slices for want_ti, next_ti once they're there
+		GuiSeaSlices raw[2], *raw_now, *raw_next;
+		uint32_t want_ti, next_ti;
+		bool loader_quit;
+		pthread_t loader;
+		pthread_mutex_t loader_mutex;
+		pthread_cond_t loader_cond;
 
-		SeaData raw_salt[2], raw_temp[2], raw_flow[3][2];
+		TripleBuffer<GuiSeaGrid> grids;
 
-		uint32_t t0, time_stepsize;
+		uint32_t t0, time_stepsize, n_t;
 		uint32_t t_now_int;
 		double t_now_frac;
 
 		void ReadDepthInfo();
+		void ReadTileInfo();
 		void VerifyNetCDF( NcFile * pf, unsigned int level, std::string s );
 		void UpdateDataToTime( SeaData & tgt, SeaData * raw );
+		void ReadSlices( uint32_t ti, GuiSeaSlices & s );
+		void SwapSlices( uint32_t ti );
+		static void * LoaderThread( void * arg );
 
 		bool MapPosition(const double pos[], unsigned int map_cell[], double cell_frac[]) const; // false if out of bounds
 		double ValueAt(const unsigned int map_cell[], const double cell_frac[], const SeaData data[]) const;
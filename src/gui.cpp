@@ -3,11 +3,21 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <atomic>
 #include <vector>
+#include <set>
 #include <map>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <netinet/in.h>
 #include <netcdfcpp.h>
+#include <EGL/egl.h>
 #ifdef FREEGLUT
 #include <GL/freeglut.h>
 #else
@@ -19,18 +29,18 @@
 #include "sssim-structs.h"
 #include "udp.h"
 #include "sea-data.h"
+#include "sea-layers.h"
+#include "util-triplebuf.h"
 #include "gui-sea.h"
 #include "util-gl.h"
+#include "gui-render.h"
+#include "gui-export.h"
 
-
-
-#ifdef INC_LIBGD
-#include "gd.h"
+GuiExport *exporter = NULL;
 uint32_t ss_time = 0;
 bool ss_record = false;
-#endif
 
-FILE * drifterLogFile;
+#define GUI_FRAME_INTERVAL 16 // ms, ~60 Hz
 
 unsigned int DEPTH_SCALE = 20;
 
@@ -39,9 +49,7 @@ int16_t client_id;
 sockaddr_in env_addr;
 
 GuiSea *baltic;
-
-unsigned int drifter_count = 0;
-FloatState drifters[DRIFTER_MAX_COUNT];
+GuiRenderer *renderer;
 
 struct T_pos_est
 {
@@ -49,9 +57,28 @@ struct T_pos_est
 	Vec2 err;
 };
 
-std::map<int, std::vector<T_pos_est> > pred;
+// the floats as last received, & the predictions of each float index;
+// trail[i] holds the positions not yet known to have reached the renderer,
+// the last of them being push number trail_end[i] - 1 of float i
+struct GuiSwarm
+{
+	uint32_t time;
+	unsigned int count;
+	FloatState floats[DRIFTER_MAX_COUNT];
+	std::map<int, std::vector<T_pos_est> > pred;
+	std::vector<Vec3> trail[DRIFTER_MAX_COUNT];
+	unsigned long trail_end[DRIFTER_MAX_COUNT];
+
+	GuiSwarm() : time(0), count(0) { std::fill(trail_end, trail_end + DRIFTER_MAX_COUNT, 0); }
+};
+
+GuiSwarm swarm_rx;			  // UDP thread only, published to swarm
+TripleBuffer<GuiSwarm> swarm; // acquired once per frame in drawScene()
 
-static GLuint seabottom_south, seabottom_north;
+// UDP thread only: the positions pushed since the last publish the renderer
+// acquired, & trail_end[i] as last published
+std::deque<Vec3> trail_pending[DRIFTER_MAX_COUNT];
+unsigned long trail_sent[DRIFTER_MAX_COUNT];
 
 static GLdouble pov_zoom = 1.0;
 static Vec3 pov_tgt(vl_zero), pov_tgt0(vl_zero);
@@ -103,122 +130,46 @@ bool
 unsigned int anim_step = 0;
 unsigned int drifter_i = 0;
 
-HistoryBuffer<Vec3> drifter_pos_history[DRIFTER_MAX_COUNT];
 HistoryBuffer<Vec3> drifter_pos_pred_history[DRIFTER_MAX_COUNT];
 
-//-----------------------------------------------------------------------------
-void take_screenshot(const char *ss_filename = NULL)
-{
-#ifdef INC_LIBGD
-	char fn[64];
-	if (!ss_filename || !ss_filename[0])
-		sprintf(fn, "screenshots/%08u.png", static_cast<unsigned int>(baltic->t_now));
-	else
-		strncpy(fn, ss_filename, 64);
-	unsigned char *px_buf = new unsigned char[window_w * window_h * 3];
-	glReadBuffer(GL_BACK);
-	glReadPixels(0, 0, window_w, window_h, GL_RGB, GL_UNSIGNED_BYTE, px_buf);
-
-	gdImagePtr img = gdImageCreateTrueColor(window_w, window_h);
-	for (int y = 0; y < window_h; ++y)
-	{
-		int yw = (window_h - y - 1) * window_w;
-		for (int x = 0; x < window_w; ++x)
-		{
-			int color = gdTrueColor(
-				px_buf[3 * (yw + x)],
-				px_buf[3 * (yw + x) + 1],
-				px_buf[3 * (yw + x) + 2]);
-			gdImageSetPixel(img, x, y, color);
-		}
-	}
-
-	delete[] px_buf;
-
-	FILE *ss_file;
-	if ((ss_file = fopen(fn, "wb")))
-	{
-		gdImagePng(img, ss_file);
-		fclose(ss_file);
-	}
-
-	gdImageDestroy(img);
-
-	char *ti_s = time2str(baltic->t_now);
-	std::cout << ti_s << "  saved PNG screenshot (" << window_w << 'x' << window_h << ") as " << fn << '\n';
-	free(ti_s);
-#endif
-}
+// headless: the latest state time & float count, & quit from the UDP thread
+bool headless = false, headless_quit = false;
+uint32_t state_time = 0;
+unsigned int state_count = 0;
+pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t state_cond = PTHREAD_COND_INITIALIZER;
 
 //-----------------------------------------------------------------------------
-#define GRIDCOLOR_GREEN1 0.08f, 0.45f, 0.30f, 0.6f
-#define GRIDCOLOR_GREEN2 0.10f, 0.40f, 0.10f, 0.6f
-#define GRIDCOLOR_BLUE 0.10f, 0.30f, 0.20f, 0.4f
-#define GRIDCOLOR_BROWN 0.45f, 0.30f, 0.08f, 0.4f
-//#define GRIDCOLOR_GREEN2 0.06f, 0.24f, 0.06f, 1.0f
-//#define GRIDCOLOR_BLUE   0.04f, 0.12f, 0.08f, 1.0f
-
-void bottomVertex(double x, double y, double z)
+// e.g. SSSIM_GUI_EXPORT=frames/ for PNG files, or a command to pipe raw RGB24
+// frames to, as in src/gui-export.h
+const char *export_target()
 {
-	static GLfloat
-		plain_surface_color[] = {GRIDCOLOR_GREEN2},
-		rainbow_surface_color[] = {1.0f, 1.0f, 1.0f, 0.5f},
-		plain_depth_color[] = {GRIDCOLOR_BLUE};
-
-	if (bg_color_mode == Plain)
-	{
-		if (z > 0)
-			glColor4fv(plain_depth_color);
-		else
-			glColor4fv(plain_surface_color);
-	}
-	else
-	{
-		if (z > 0)
-			glColor_depth(z, 1.0, 0.5);
-		else
-			glColor4fv(rainbow_surface_color);
-	}
-	glVertex3d(x, z, y);
+	const char *target = getenv("SSSIM_GUI_EXPORT");
+	return (target && target[0]) ? target : "screenshots";
 }
-void drawSeabottomStrip(int y)
+
+void export_init()
 {
-	GLdouble
-		x_d = baltic->bottom_pos[0][1],
-		x_pos = baltic->bottom_pos[0][0],
-		y_d = baltic->bottom_pos[1][1],
-		y_pos = baltic->bottom_pos[1][0] + y * y_d;
-	glBegin(GL_QUAD_STRIP);
-	for (unsigned int x = 0; x < SEA_DEPTH_NX; ++x)
-	{
-		bottomVertex(x_pos, y_pos, -1 * baltic->bottom[y][x]);
-		bottomVertex(x_pos, y_pos + y_d, -1 * baltic->bottom[y + 1][x]);
-		x_pos += x_d;
-	}
-	glEnd();
+	const char *threads = getenv("SSSIM_GUI_EXPORT_THREADS");
+	const long n = threads ? atol(threads) : sysconf(_SC_NPROCESSORS_ONLN);
+	exporter = new GuiExport(export_target(), n > 0 ? n : 1);
+	if (!exporter->Ok())
+		exit(EXIT_FAILURE);
 }
 
-void createSeabottomDLs()
+void take_screenshot()
 {
-	seabottom_south = glGenLists(1);
-	glNewList(seabottom_south, GL_COMPILE);
-	glDisable(GL_CULL_FACE);
-	for (int y = SEA_DEPTH_NY - 2; y >= 0; --y)
-		drawSeabottomStrip(y);
-	glEndList();
-
-	seabottom_north = glGenLists(1);
-	glNewList(seabottom_north, GL_COMPILE);
-	glDisable(GL_CULL_FACE);
-	for (unsigned int y = 0; y < SEA_DEPTH_NY - 1; ++y)
-		drawSeabottomStrip(y);
-	glEndList();
+	if (!exporter)
+		export_init();
+	glReadBuffer(GL_BACK);
+	exporter->Capture(window_w, window_h, swarm.front().time);
 }
 
 //-----------------------------------------------------------------------------
 void drawTextStatus()
 {
 	static int frame = 0, timebase = 0;
+	const GuiSwarm &sw = swarm.front();
 	static char
 		time_s[18] = "time: ",
 		depth_s[12] = "depth: ",
@@ -226,7 +177,7 @@ void drawTextStatus()
 		fps_s[12] = "FPS: ",
 		id_s[16] = "ID: ";
 
-	char *ti_s = time2str(baltic->t_now);
+	char *ti_s = time2str(sw.time);
 	strcpy(&time_s[6], ti_s);
 	free(ti_s);
 
@@ -254,8 +205,8 @@ void drawTextStatus()
 		frame = 0;
 	}
 
-	if (drifter_i < drifter_count)
-		sprintf(&id_s[4], "%i (%i)", drifter_i, drifters[drifter_i].id);
+	if (drifter_i < sw.count)
+		sprintf(&id_s[4], "%i (%i)", drifter_i, sw.floats[drifter_i].id);
 	else
 		sprintf(&id_s[4], "-");
 
@@ -288,101 +239,44 @@ void drawTextStatus()
 }
 
 //-----------------------------------------------------------------------------
-void drawDataLayer(GLdouble z_offset, SeaLayerData *ptr_layer, GLdouble var_min, GLdouble var_range)
+void drawFlowDots(unsigned int z)
 {
-	GLdouble
-		rgba[4] = {1.0, 1.0, 1.0, 0.08},
-		x_d = baltic->var_pos[0][1],
-		x_pos = baltic->var_pos[0][0],
-		y_d = baltic->var_pos[1][1],
-		y_pos = baltic->var_pos[1][0],
-		h;
-
-	glDisable(GL_CULL_FACE);
-	for (unsigned int y = 0; y < SEA_NY - 1; ++y)
-	{
-		glBegin(GL_QUAD_STRIP);
-		x_pos = baltic->var_pos[0][0];
-		for (unsigned int x = 0; x < SEA_NX; ++x)
-		{
-			if (!(*ptr_layer)[y][x] || !(*ptr_layer)[y + 1][x])
-				continue;
-
-			for (unsigned int i = 0; i < 2; ++i)
-			{
-				h = ((*ptr_layer)[y + i][x] - var_min) / var_range;
-				while (h > 1.0)
-					--h;
-				util_HSL_to_RGB(rgba, h, 0.7, 0.5);
-				glColor4dv(rgba);
-				glVertex3d(x_pos, z_offset, y_pos + i * y_d);
-			}
-
-			x_pos += x_d;
-		}
-		glEnd();
-		y_pos += y_d;
-	}
+	glColor_depth(baltic->depth[z], 1.0 - display_mode, 0.5);
+	renderer->DrawFlowDots(baltic->Grid(), z, 500.0 * anim_step, fabs(pov_rot[0]) > vl_pi / 2);
 }
 
-void drawFlowDots(unsigned int z)
+//-----------------------------------------------------------------------------
+void focusFloat()
 {
-	GLdouble
-		x_d = baltic->var_pos[0][1],
-		y_d = baltic->var_pos[1][1],
-		anim_scale = 500.0 * anim_step;
-	double w_max = -SEA_FLOW_W_MAX < SEA_FLOW_W_MIN ? SEA_FLOW_W_MAX : -1 * SEA_FLOW_W_MIN;
-	if (w_max <= 0)
-		w_max = 1.0;
-
-	int
-		y = 0,
-		y_inc = 1,
-		y_lim = SEA_NY;
-
-	if (fabs(pov_rot[0]) > vl_pi / 2)
-	{
-		y = SEA_NY - 1;
-		y_inc = -1;
-		y_lim = -1;
-	}
-
-	glPointSize(2.0);
-
-	glPushMatrix();
-	glTranslated(baltic->var_pos[0][0], baltic->depth[z], baltic->var_pos[1][0]);
-	glBegin(GL_POINTS);
-	while (y != y_lim)
-	{
-		for (unsigned int x = 0; x < SEA_NX; ++x)
-		{
-			GLdouble &u = baltic->flow[0][z][y][x];
-			GLdouble &v = baltic->flow[1][z][y][x];
-			if (u == 0.0 && v == 0.0)
-				continue;
-			glColor_depth(baltic->depth[z], 1.0 - display_mode, 0.5);
-			glVertex3d(
-				x * x_d + u * anim_scale,
-				baltic->flow[2][z][y][x] * anim_scale,
-				y * y_d + v * anim_scale);
-		}
-		y += y_inc;
-	}
-	glEnd();
-	glPopMatrix();
+	const GuiSwarm &sw = swarm.front();
+	if (drifter_i < sw.count)
+		pov_tgt = Vec3(sw.floats[drifter_i].pos[0], sw.floats[drifter_i].pos[2] * DEPTH_SCALE, sw.floats[drifter_i].pos[1]);
 }
 
-//-----------------------------------------------------------------------------
-void renderScene()
+void drawScene()
 {
 	//static unsigned int anim_step = 0;
 	if (++anim_step > 100)
 		anim_step = 0;
 
+	// the latest grid & swarm from the UDP thread stay put until the next frame
+	static Mode layer_mode = NoVariable; // of the layer colours
+	bool fresh_grid;
+	const GuiSeaGrid &grid = baltic->AcquireGrid(&fresh_grid);
+	if (fresh_grid)
+		layer_mode = NoVariable;
+
+	const bool had_floats = swarm.front().count;
+	swarm.acquire();
+	const GuiSwarm &sw = swarm.front();
+	const FloatState *drifters = sw.floats;
+	if (!had_floats && sw.count)
+		focusFloat();
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glLoadIdentity();
 
-	if (pov_tracking)
+	if (pov_tracking && (drifter_i < sw.count))
 		pov_tgt = Vec3(drifters[drifter_i].pos[0], pov_tgt[1] /*drifters[drifter_i].pos[2] * DEPTH_SCALE*/, drifters[drifter_i].pos[1]);
 
 	if (mouse_rb_down)
@@ -407,29 +301,12 @@ void renderScene()
 
 	// draw floats
 	glDisable(GL_CULL_FACE);
-	for (unsigned int i = 0; i < drifter_count; ++i)
+	for (unsigned int i = 0; i < sw.count; ++i)
 	{
 		if ((show_history == All) || ((show_history == One) && (i == drifter_i)))
 		{
-			Vec3 pt_prev = vl_zero;
-			int t_max = drifter_pos_history[i].maxlen();
-			glBegin(GL_LINE_STRIP);
-			for (int t = 0; t < t_max; ++t)
-			{
-				Vec3 pt = drifter_pos_history[i].at(t);
-				if (t && (sqrlen(pt_prev - pt) > 1000000.0))
-				{
-					glEnd();
-					glBegin(GL_LINE_STRIP);
-				}
-				if (display_mode == Screen)
-					glColor_depth(pt[2], 1.0, 0.5);
-				else
-					glColor4d(0.0, 0.0, 0.0, 0.8); //glColor_depth(pt[2], 0.0, 0.8);
-				glVertex3d(pt[0], pt[2], pt[1]);
-				pt_prev = pt;
-			}
-			glEnd();
+			renderer->UpdateTrail(i, sw.trail[i], sw.trail_end[i]);
+			renderer->DrawTrail(i, display_mode == Screen);
 
 			/*
 			int t_pred_max = drifter_pos_pred_history[i].maxlen();
@@ -447,9 +324,9 @@ void renderScene()
 			}*/
 		}
 
-		double &pos_x = drifters[i].pos[0];
-		double &pos_y = drifters[i].pos[1];
-		double &pos_z = drifters[i].pos[2];
+		const double &pos_x = drifters[i].pos[0];
+		const double &pos_y = drifters[i].pos[1];
+		const double &pos_z = drifters[i].pos[2];
 
 		if ((pos_markers == All) || ((pos_markers == One) && (i == drifter_i)))
 		{
@@ -477,16 +354,17 @@ void renderScene()
 		gluDisk(q, 0.0, cw, 8, 1);
 		glPopMatrix();
 
-		if (pred.count(drifter_i) && (i < pred[drifter_i].size()))
+		std::map<int, std::vector<T_pos_est> >::const_iterator pred = sw.pred.find(drifter_i);
+		if ((pred != sw.pred.end()) && (i < pred->second.size()))
 		{
-			Vec3 pred_pos = Vec3(pred[drifter_i][i].pos, pos_z);
+			Vec3 pred_pos = Vec3(pred->second[i].pos, pos_z);
 			if ((pred_pos[0] < 5e4) || (pred_pos[1] < 5e4))
 			{
 				pred_pos[0] += drifters[drifter_i].pos[0];
 				pred_pos[1] += drifters[drifter_i].pos[1];
 				//pred_pos[2] = 0.0;
 			}
-			Vec2 pred_err = 50 * pred[drifter_i][i].err;
+			Vec2 pred_err = 50 * pred->second[i].err;
 			if (pred_err != vl_zero)
 			{
 				if (i == drifter_i)
@@ -527,27 +405,32 @@ void renderScene()
 	{
 		glPushMatrix();
 		glPolygonMode(GL_FRONT_AND_BACK, bg_mode);
-		glCallList((pov[2] - pov_tgt[2] < 0) ? seabottom_south : seabottom_north);
+		renderer->DrawBottom(bg_color_mode == Rainbow, pov[2] - pov_tgt[2] < 0);
 		glPopMatrix();
 	}
 
 	// draw variable volume
-	SeaData *var_ptr = NULL;
+	const SeaData *var_ptr = NULL;
 	GLdouble var_max = 0.0;
 	switch (var_mode)
 	{
 	case Temperature:
-		var_ptr = &baltic->temp;
+		var_ptr = &grid.temp;
 		var_max = SEA_TEMP_MAX;
 		break;
 	case Salinity:
-		var_ptr = &baltic->salt;
+		var_ptr = &grid.salt;
 		var_max = SEA_SALT_MAX;
 		break;
 	case NoVariable:
 	default:
 		break;
 	}
+	if (var_ptr && (var_mode != layer_mode))
+	{
+		renderer->SetLayers(*var_ptr, 0.0, var_max);
+		layer_mode = var_mode;
+	}
 
 	int lz;
 	double
@@ -568,7 +451,7 @@ void renderScene()
 			((show_layers == TopLayers) && baltic->depth[lz] <= tgt_z))
 		{
 			if (var_mode == Temperature || var_mode == Salinity)
-				drawDataLayer(baltic->depth[lz], &(*var_ptr)[lz], 0.0, var_max);
+				renderer->DrawLayer(lz);
 			if (show_flow_vectors)
 				drawFlowDots(lz);
 		}
@@ -582,21 +465,24 @@ void renderScene()
 			((show_layers == TopLayers) && baltic->depth[z] <= tgt_z))
 		{
 			if (var_mode == Temperature || var_mode == Salinity)
-				drawDataLayer(baltic->depth[z], &(*var_ptr)[z], 0.0, var_max);
+				renderer->DrawLayer(z);
 			if (show_flow_vectors)
 				drawFlowDots(z);
 		}
 
 	if (show_text)
 		drawTextStatus();
+}
+
+void renderScene()
+{
+	drawScene();
 
-#ifdef INC_LIBGD
-	if (ss_record && (ss_time != static_cast<unsigned int>(baltic->t_now)))
+	if (ss_record && (ss_time != swarm.front().time))
 	{
 		take_screenshot();
-		ss_time = static_cast<uint32_t>(baltic->t_now);
+		ss_time = swarm.front().time;
 	}
-#endif
 
 	glutSwapBuffers();
 }
@@ -611,6 +497,8 @@ void keypressNormal(unsigned char key, int x, int y)
 		udp->sendto(&env_addr, MSG_QUIT);
 		// fallthrough
 	case 'Q':
+		if (exporter)
+			exporter->Finish();
 		exit(EXIT_SUCCESS);
 	case ' ':
 		udp->sendto(&env_addr, env_active ? MSG_PAUSE : MSG_PLAY);
@@ -621,12 +509,10 @@ void keypressNormal(unsigned char key, int x, int y)
 	//~ 	break;
 	//case '`':	show_text = !show_text;		break;
 	case '\t':
-		if (++drifter_i >= drifter_count)
+		if (++drifter_i >= swarm.front().count)
 			drifter_i = 0;
 	case '`':
-		if (!drifter_count)
-			break;
-		pov_tgt = Vec3(drifters[drifter_i].pos[0], drifters[drifter_i].pos[2] * DEPTH_SCALE, drifters[drifter_i].pos[1]);
+		focusFloat();
 		break;
 	case '~':
 		pov_tracking = !pov_tracking;
@@ -713,7 +599,6 @@ void keypressNormal(unsigned char key, int x, int y)
 			bg_color_mode = Plain;
 			break;
 		}
-		createSeabottomDLs();
 		break;
 	case 'p':
 		switch (pos_markers)
@@ -744,11 +629,16 @@ void keypressNormal(unsigned char key, int x, int y)
 	case 'f':
 		show_flow_vectors = !show_flow_vectors;
 		return;
-#ifdef INC_LIBGD
 	case '=':
 		ss_record = !ss_record;
+		if (ss_record)
+			printf("|| recording frames to %s\n", export_target());
+		else if (exporter)
+		{
+			exporter->Finish();
+			printf("|| recording stopped, %lu frames written\n", exporter->Written());
+		}
 		break;
-#endif
 	}
 }
 
@@ -861,31 +751,63 @@ void mouseMoveActive(int x, int y)
 }
 
 //-----------------------------------------------------------------------------
-void update_float_positions(const char *buf, unsigned int len, uint32_t time)
+// copies only the floats in use; the map & vectors keep their memory. A trail
+// position is forgotten once a publish carrying it has been acquired, so a
+// frame that skips publishes still gets all of them.
+void publish_swarm()
 {
-	static int timeCnt = 60;
+	GuiSwarm &sw = swarm.back();
+	sw.time = swarm_rx.time;
+	sw.count = swarm_rx.count;
+	std::copy(swarm_rx.floats, swarm_rx.floats + swarm_rx.count, sw.floats);
+	sw.pred = swarm_rx.pred;
+	for (unsigned int i = 0; i < swarm_rx.count; ++i)
+	{
+		sw.trail[i].assign(trail_pending[i].begin(), trail_pending[i].end());
+		sw.trail_end[i] = swarm_rx.trail_end[i];
+	}
+	const bool taken = swarm.publish(); // the one published before this one
+
+	for (unsigned int i = 0; i < DRIFTER_MAX_COUNT; ++i)
+	{
+		const unsigned long first = swarm_rx.trail_end[i] - trail_pending[i].size();
+		if (taken && (trail_sent[i] > first))
+			trail_pending[i].erase(trail_pending[i].begin(), trail_pending[i].begin() + (trail_sent[i] - first));
+		trail_sent[i] = (i < swarm_rx.count) ? swarm_rx.trail_end[i] : first; // sent none if not in use
+	}
+}
 
+void update_float_positions(const char *buf, unsigned int len, uint32_t time)
+{
 	if (len % sizeof(FloatState))
 	{
 		printf("RX bad status data! (%i %% %lu != 0)\n", len, sizeof(FloatState));
 		return;
 	}
 
-	drifter_count = len / sizeof(FloatState);
+	const unsigned int drifter_count = len / sizeof(FloatState);
+	FloatState *drifters = swarm_rx.floats;
 	if (drifter_count > 0)
 		memcpy(drifters, buf, len);
+	swarm_rx.time = time;
+	swarm_rx.count = drifter_count;
 
 	baltic->SetTime(time, show_flow_vectors || (var_mode != NoVariable));
-	for (unsigned int i = 0; i < drifter_count; ++i) {
-		drifter_pos_history[i].push(drifters[i].pos);
-		// JTE change: real simulated positions 
-		if (timeCnt == 60) {
-			fprintf(drifterLogFile,"%d, drifter_%d,%f,%f,%f,%f,%f,%f,%f,%f\n", time, i, drifters[i].pos[0], drifters[i].pos[1], drifters[i].pos[2], drifters[i].vel[0], drifters[i].vel[1], drifters[i].vel[2], drifters[i].volume, drifters[i].bottom_depth );
-			
-		}
+	for (unsigned int i = 0; i < drifter_count; ++i)
+	{
+		trail_pending[i].push_back(drifters[i].pos);
+		if (trail_pending[i].size() > HISTORY_SIZE) // the renderer keeps no more
+			trail_pending[i].pop_front();
+		++swarm_rx.trail_end[i];
 	}
-	if (++timeCnt > 60)
-		timeCnt = 0;
+
+	publish_swarm();
+
+	pthread_mutex_lock(&state_mutex);
+	state_time = time;
+	state_count = drifter_count;
+	pthread_cond_signal(&state_cond);
+	pthread_mutex_unlock(&state_mutex);
 }
 
 void update_float_predictions(const char *buf, unsigned int len, int16_t rx_id)
@@ -896,8 +818,8 @@ void update_float_predictions(const char *buf, unsigned int len, int16_t rx_id)
 		return;
 	}
 	int id = -1;
-	for (unsigned int i = 0; i < drifter_count; ++i)
-		if (drifters[i].id == rx_id)
+	for (unsigned int i = 0; i < swarm_rx.count; ++i)
+		if (swarm_rx.floats[i].id == rx_id)
 		{
 			id = i;
 			break;
@@ -906,9 +828,10 @@ void update_float_predictions(const char *buf, unsigned int len, int16_t rx_id)
 	{
 		const T_pos_est *pred0 = reinterpret_cast<const T_pos_est *>(buf);
 		const T_pos_est *pred1 = reinterpret_cast<const T_pos_est *>(buf + len);
-		pred[id] = std::vector<T_pos_est>(pred0, pred1);
+		swarm_rx.pred[id].assign(pred0, pred1);
 		//Vec3 pred_pos = Vec3(pred[id][id].pos[0], pred[id][id].pos[1], 0);
 		//drifter_pos_pred_history[id].push(pred_pos);
+		publish_swarm();
 	}
 }
 
@@ -923,10 +846,7 @@ void udp_state_msg(char msg_type, const char *msg_body, int msg_len, const socka
 		if (msg_len < hlen)
 			break;
 		uint32_t time = *reinterpret_cast<const uint32_t *>(msg_body);
-		bool first_env_state = (drifter_count == 0);
 		update_float_positions(msg_body + hlen, msg_len - hlen, time);
-		if (first_env_state)
-			keypressNormal('`', 0, 0);
 	}
 	break;
 	case MSG_FLOAT_STATE:
@@ -967,8 +887,13 @@ void *udp_listen(void *unused)
 			break;
 
 		case MSG_QUIT:
-			exit(EXIT_SUCCESS);
-			break;
+			if (!headless)
+				exit(EXIT_SUCCESS);
+			pthread_mutex_lock(&state_mutex);
+			headless_quit = true;
+			pthread_cond_signal(&state_cond);
+			pthread_mutex_unlock(&state_mutex);
+			return NULL;
 
 		case MSG_TIME:
 		case MSG_PLAY:
@@ -985,7 +910,7 @@ void *udp_listen(void *unused)
 //-----------------------------------------------------------------------------
 void refresh(int unused)
 {
-	glutTimerFunc(50, refresh, 0); // FPS ~20 Hz
+	glutTimerFunc(GUI_FRAME_INTERVAL, refresh, 0);
 	glutPostRedisplay();
 }
 
@@ -1010,13 +935,8 @@ void resizeWindow(int w, int h)
 }
 
 //-----------------------------------------------------------------------------
-void glut_init(int argc, char **argv)
+void gl_init()
 {
-	glutInit(&argc, argv);
-
-	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
-	glutCreateWindow("SeaSwarmSim :: Baltic");
-
 	//glEnable(GL_DEPTH_TEST);
 	glHint(GL_CLIP_VOLUME_CLIPPING_HINT_EXT, GL_FASTEST);
 	glCullFace(GL_BACK);
@@ -1027,7 +947,18 @@ void glut_init(int argc, char **argv)
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	//glBlendFunc( GL_ONE_MINUS_DST_ALPHA, GL_DST_ALPHA );
 
-	createSeabottomDLs();
+	renderer = new GuiRenderer(*baltic);
+}
+
+//-----------------------------------------------------------------------------
+void glut_init(int argc, char **argv)
+{
+	glutInit(&argc, argv);
+
+	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
+	glutCreateWindow("SeaSwarmSim :: Baltic");
+
+	gl_init();
 
 	glutDisplayFunc(renderScene);
 	glutReshapeFunc(resizeWindow);
@@ -1064,12 +995,73 @@ void udp_init()
 	pthread_create(&udp_thread, NULL, &udp_listen, NULL);
 }
 
+//-----------------------------------------------------------------------------
+// Rendering without a window into an offscreen framebuffer, a frame exported
+// every SSSIM_GUI_EXPORT_STEP seconds of simulation time (default 3600) at
+// SSSIM_GUI_EXPORT_SIZE (default 1280x720), until the environment quits.
+// Frames are rendered for the latest state received, so if the environment
+// runs faster than they can be rendered, the ones in between are skipped.
+void headless_run()
+{
+	const char *step_s = getenv("SSSIM_GUI_EXPORT_STEP");
+	const char *size_s = getenv("SSSIM_GUI_EXPORT_SIZE");
+	const uint32_t step = (step_s && (atol(step_s) > 0)) ? atol(step_s) : 3600;
+	int w = 1280, h = 720;
+	if (size_s && ((sscanf(size_s, "%dx%d", &w, &h) != 2) || (w <= 0) || (h <= 0)))
+	{
+		printf("|| bad SSSIM_GUI_EXPORT_SIZE %s\n", size_s);
+		exit(EXIT_FAILURE);
+	}
+
+	GuiOffscreen offscreen;
+	if (!offscreen.Open(w, h))
+		exit(EXIT_FAILURE);
+	gl_init();
+	resizeWindow(w, h);
+	show_text = false; // needs GLUT
+	export_init();
+	printf("|| headless, %dx%d frames every %u s to %s\n", w, h, step, export_target());
+
+	headless = true;
+	udp_init();
+	keypressNormal('r', 0, 0);
+	if (env_active)
+		udp->sendto(&env_addr, MSG_PLAY);
+
+	unsigned long frames = 0, skipped = 0;
+	uint32_t next_t = 0;
+	pthread_mutex_lock(&state_mutex);
+	for (;;)
+	{
+		while (!headless_quit && (!state_count || (state_time < next_t)))
+			pthread_cond_wait(&state_cond, &state_mutex);
+		if (headless_quit)
+			break;
+		pthread_mutex_unlock(&state_mutex);
+
+		drawScene();
+		const uint32_t t = swarm.front().time; // may be newer than state_time by now
+		exporter->Capture(w, h, t);
+
+		if (frames && (t >= next_t + step))
+			skipped += (t - next_t) / step;
+		next_t = t - t % step + step;
+		++frames;
+
+		pthread_mutex_lock(&state_mutex);
+	}
+	pthread_mutex_unlock(&state_mutex);
+
+	exporter->Finish();
+	printf("|| headless done: %lu frames rendered, %lu written, %lu skipped\n", frames, exporter->Written(), skipped);
+	delete exporter;
+	exporter = NULL;
+}
+
 //-----------------------------------------------------------------------------
 int main(int argc, char **argv)
 {
-	baltic = new GuiSea();
-	// JTE change to store simulated positions & timestamps for reference
-	drifterLogFile = fopen ("./logs/latest/drifterlog.csv","w"); // additional drifter log file for 
+	baltic = new GuiSea(getenv("SSSIM_SEA_TILES"));
 
 	if ((argc > 1) && !strcmp(argv[1], "info"))
 	{
@@ -1077,6 +1069,12 @@ int main(int argc, char **argv)
 		exit(0);
 	}
 
+	if ((argc > 1) && !strcmp(argv[1], "headless"))
+	{
+		headless_run();
+		return 0;
+	}
+
 	glut_init(argc, argv);
 	udp_init();
 
@@ -1086,6 +1084,5 @@ int main(int argc, char **argv)
 
 	glutMainLoop();
 
-	fclose(drifterLogFile);
 	return 0;
 }
@@ -57,7 +57,7 @@ void run_kalman(kalman_data *K)
 
 	swatrix_calculate_X_posteriori(K->X, K->K, K->Y, K->H, K->X_length, K->Y_length);
 
-	swatrix_calculate_PmKxCxP(K->temp_matrix, K->P, K->X_length, K->K, K->Y_length, K->temp_vector, K->C);
+	swatrix_calculate_PmKxCxP(K->temp_matrix, K->P, K->X_length, K->K, K->X_length, K->temp_vector, K->C);
 	swatrix_copy(K->temp_matrix, K->P, K->X_length * K->X_length);
 	//printf("kalman run done");
 }
@@ -97,14 +97,15 @@ void initialize_kalman(kalman_data *Kalm, int number_of_units, MTYP sampling_int
 	swatrix_allocate(number_of_units, &(Kalm->C), &(Kalm->X), &(Kalm->P), &(Kalm->K), &(Kalm->Q_vector),
 					 &(Kalm->R_vector), &(Kalm->Y), &(Kalm->H), &(Kalm->temp_matrix), &(Kalm->temp_vector),
 					 &(Kalm->X_length), &(Kalm->Y_length));
+	Kalm->IsOnSurface = (char *)calloc(number_of_units, 1);
 }
 
 void end_kalman(kalman_data *Kalm)
 {
-	/*
 	swatrix_free(&(Kalm->C), &(Kalm->X), &(Kalm->P), &(Kalm->K), &(Kalm->Q_vector), 
 				 &(Kalm->R_vector), &(Kalm->Y), &(Kalm->H), &(Kalm->temp_matrix), &(Kalm->temp_vector));
-*/
+	free(Kalm->IsOnSurface);
+	Kalm->IsOnSurface = NULL;
 }
 
 void position_measurement(kalman_data *K, int this_unit, int is_on_surface, MTYP x, MTYP y, MTYP z)
@@ -447,17 +448,19 @@ void swatrix_allocate(int num_units,
 {
 	int big_dimension = 6 * num_units;
 	int small_dimension = (num_units) * (num_units - 1) / 2 + 3 * num_units;
+	// K & temp_matrix hold C x P x CT + R on the way, larger than P from 8 units on
+	int temp_dimension = (small_dimension > big_dimension) ? small_dimension : big_dimension;
 
 	*X = (MTYP *)swatrix_malloc(big_dimension * sizeof(MTYP), "X");
 
 	*P = (MTYP *)swatrix_malloc(big_dimension * big_dimension * sizeof(MTYP), "P");
-	*K = (MTYP *)swatrix_malloc(big_dimension * small_dimension * sizeof(MTYP), "K");
+	*K = (MTYP *)swatrix_malloc(temp_dimension * small_dimension * sizeof(MTYP), "K");
 	*Q_vector = (MTYP *)swatrix_malloc(big_dimension * sizeof(MTYP), "Q");
 	*R_vector = (MTYP *)swatrix_malloc(small_dimension * sizeof(MTYP), "R");
 	*Y = (MTYP *)swatrix_malloc(small_dimension * sizeof(MTYP), "Y");
 	*H = (MTYP *)swatrix_malloc(small_dimension * sizeof(MTYP), "H");
-	*temp_matrix = (MTYP *)swatrix_malloc(big_dimension * big_dimension * sizeof(MTYP), "temp_matrix");
-	*temp_vector = (MTYP *)swatrix_malloc(big_dimension * sizeof(MTYP), "temp_vector");
+	*temp_matrix = (MTYP *)swatrix_malloc(temp_dimension * temp_dimension * sizeof(MTYP), "temp_matrix");
+	*temp_vector = (MTYP *)swatrix_malloc(temp_dimension * sizeof(MTYP), "temp_vector");
 
 	C->jacob_cols = 3 * num_units;
 	C->jacob_rows = (num_units) * (num_units - 1) / 2;
@@ -473,24 +476,24 @@ void swatrix_allocate(int num_units,
 	*Y_length = small_dimension;
 }
 
-/*
 void swatrix_free(C_matr * C, MTYP ** X, MTYP ** P, MTYP ** K, MTYP ** Q_vector, MTYP ** R_vector,
 				  MTYP ** Y, MTYP ** H, MTYP ** temp_matrix, MTYP ** temp_vector)
 {
-//	free(*X);
-//	free(*P);
-//	free(*K);
-//	free(*Q_vector);
-//	free(*R_vector);
-//	free(*Y);
-//	free(*H);
-//	free(*temp_matrix);
-//	free(*temp_vector);
-
-//	free(C->jacob_matrix);
-//	free(C->diag_vector);
+	free(*X);
+	free(*P);
+	free(*K);
+	free(*Q_vector);
+	free(*R_vector);
+	free(*Y);
+	free(*H);
+	free(*temp_matrix);
+	free(*temp_vector);
+	*X = *P = *K = *Q_vector = *R_vector = *Y = *H = *temp_matrix = *temp_vector = NULL;
+
+	free(C->jacob_matrix);
+	free(C->diag_vector);
+	C->jacob_matrix = C->diag_vector = NULL;
 }
-*/
 
 void swatrix_inverse(MTYP *source, MTYP *target,
 					 const int rows)
@@ -766,7 +769,7 @@ void swatrix_calculate_C_diagonal(kalman_data *K, C_matr C, MTYP *x)
 
 	for (unit = 0; unit < C.diag_length; unit += 3)
 	{
-		if (K->IsOnSurface[unit])
+		if (K->IsOnSurface[unit / 3])
 		{
 			C.diag_vector[unit] = 1;
 			C.diag_vector[unit + 1] = 1;
@@ -122,7 +122,7 @@ typedef struct {
 	int X_length,	// Length of state vector
 		Y_length;	// Length of measurement vector
 
-	char IsOnSurface[10];
+	char * IsOnSurface;	// num_units flags, set by position_measurement
 } kalman_data;
 
 
@@ -0,0 +1,666 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Offline replay of swarm navigation measurements.
+ *
+ * Reads the ground truth written by env (trajectories.sstj, or the gui's
+ * drifterlog.csv of older runs) and the float logs (float_NN) of one run,
+ * rebuilds the measurement stream each float saw (own & relayed GPS fixes,
+ * estimated positions, pong distances) and feeds it through a position
+ * estimator, once per float and parameter set. Reports position error
+ * against time and the wall-clock cost of each update.
+ *
+ * usage: nav-replay [-d logdir] [-j threads] [-o series.csv] [-e kalman|multilat]
+ *                   [-g gps_err,..] [-r dist_err,..] [-p pos_err,..]
+ *                   [-c current_err,..] [-i interval,..]
+ *
+ * Every comma-separated list is a sweep axis; all combinations are run.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include <map>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "sssim.h"
+#include "traj-log.h"
+#include "kalman_filter.h"
+#include "util-multilat.h"
+
+#define NAV_GPS_MAX_AGE (30 * 60) // as in Seafloat::updatePositions()
+
+//-----------------------------------------------------------------------------
+struct truth_sample_t
+{
+	uint32_t t;
+	double x, y, z;
+};
+
+typedef std::vector<truth_sample_t> truth_track_t;
+
+enum nav_event_type_t
+{
+	NAV_GPS_FIX,
+	NAV_POS_EST,
+	NAV_DISTANCE
+};
+
+struct nav_event_t
+{
+	uint32_t t;
+	nav_event_type_t type;
+	int unit; // 0-based; for distances, the other end
+	double x, y, z;
+
+	bool operator<(const nav_event_t &e) const { return t < e.t; }
+};
+
+struct nav_params_t
+{
+	double gps_err, depth_err, dist_err, unknown_err, meas_min;
+	double pos_err, model_depth_err, current_err, model_min;
+	uint32_t interval;
+
+	nav_params_t() : gps_err(10), depth_err(0.001), dist_err(5), unknown_err(10000), meas_min(0.0001),
+					 pos_err(10), model_depth_err(1), current_err(0.5), model_min(0.0001),
+					 interval(900) {}
+};
+
+struct err_sample_t
+{
+	uint32_t t;
+	double xy, z;
+};
+
+struct replay_result_t
+{
+	size_t n_updates;
+	double sum_sq_xy, max_xy, sum_sq_z;
+	double sum_ns, max_ns;
+	std::vector<err_sample_t> series;
+
+	replay_result_t() : n_updates(0), sum_sq_xy(0.0), max_xy(0.0), sum_sq_z(0.0), sum_ns(0.0), max_ns(0.0) {}
+};
+
+//-----------------------------------------------------------------------------
+// Estimator interface; anything that turns the measurement stream into
+// unit positions can be dropped in here.
+class NavEstimator
+{
+public:
+	virtual ~NavEstimator() {}
+	virtual void init(int n_units, int self, const nav_params_t &p, const std::vector<truth_sample_t> &start) = 0;
+	virtual void position(int unit, bool on_surface, double x, double y, double z) = 0;
+	virtual void distance(int unit, int other, double d) = 0;
+	virtual void update() = 0;
+	virtual void get_position(int unit, double *x, double *y, double *z) = 0;
+};
+
+class KalmanEstimator : public NavEstimator
+{
+	kalman_data K;
+	bool ok;
+
+public:
+	KalmanEstimator() : ok(false) { memset(&K, 0, sizeof(K)); }
+	~KalmanEstimator()
+	{
+		if (ok)
+			end_kalman(&K);
+	}
+
+	void init(int n_units, int self, const nav_params_t &p, const std::vector<truth_sample_t> &start)
+	{
+		initialize_kalman(&K, n_units, p.interval);
+		set_measurement_noise(&K, self, p.gps_err, p.depth_err, p.dist_err, p.unknown_err, p.meas_min);
+		set_model_noise(&K, p.pos_err, p.model_depth_err, p.current_err, p.model_min);
+		for (int i = 0; i < n_units; ++i)
+		{
+			set_unit_position(&K, i, start[i].x, start[i].y, 0.0);
+			set_current(&K, i, 0.0, 0.0, 0.0);
+		}
+		ok = true;
+	}
+	void position(int unit, bool on_surface, double x, double y, double z) { position_measurement(&K, unit, on_surface ? 1 : 0, x, y, z); }
+	void distance(int unit, int other, double d) { distance_measurement(&K, unit, other, d); }
+	void update() { run_kalman(&K); }
+	void get_position(int unit, double *x, double *y, double *z)
+	{
+		*x = K.X[unit * 3];
+		*y = K.X[unit * 3 + 1];
+		*z = K.X[unit * 3 + 2];
+	}
+};
+
+// Batch multilateration, one solve per update from that cycle's ranges.
+// Units without a fresh fix are held near their previous solution.
+class MultilatEstimator : public NavEstimator
+{
+	MultilatSolver ml;
+	std::vector<bool> fresh;
+	double gps_sigma, range_sigma, hold_sigma;
+
+public:
+	MultilatEstimator() : gps_sigma(0.0), range_sigma(0.0), hold_sigma(0.0) {}
+
+	void init(int n_units, int self, const nav_params_t &p, const std::vector<truth_sample_t> &start)
+	{
+		ml.resize(n_units);
+		fresh.assign(n_units, false);
+		for (int i = 0; i < n_units; ++i)
+			ml.set_position(i, start[i].x, start[i].y);
+		// error ranges are end to end, as in kalman_filter.h
+		gps_sigma = 0.5 * p.gps_err;
+		range_sigma = 0.5 * p.dist_err;
+		hold_sigma = 0.5 * p.pos_err;
+	}
+	void position(int unit, bool on_surface, double x, double y, double z)
+	{
+		if (on_surface)
+		{
+			ml.set_position(unit, x, y);
+			ml.set_prior(unit, x, y, gps_sigma);
+			ml.set_depth(unit, 0.0);
+			fresh[unit] = true;
+		}
+		else
+			ml.set_depth(unit, z);
+	}
+	void distance(int unit, int other, double d) { ml.set_range(unit, other, d, range_sigma); }
+	void update()
+	{
+		for (int i = 0; i < ml.size(); ++i)
+		{
+			if (!fresh[i])
+				ml.set_prior(i, ml.get_x(i), ml.get_y(i), hold_sigma);
+			fresh[i] = false;
+		}
+		if (ml.n_ranges())
+			ml.solve();
+		ml.clear_ranges();
+	}
+	void get_position(int unit, double *x, double *y, double *z)
+	{
+		*x = ml.get_x(unit);
+		*y = ml.get_y(unit);
+		*z = ml.get_z(unit);
+	}
+};
+
+//-----------------------------------------------------------------------------
+std::map<int, truth_track_t> truth;			   // by float id
+std::map<int, std::vector<nav_event_t> > events; // by float id, as seen by that float
+int drifter_id_offset = 1;						   // drifter_<i> in drifterlog.csv is float <i + offset>; trajectories have the ids
+std::string estimator_name = "kalman";
+
+NavEstimator *new_estimator()
+{
+	if (estimator_name == "multilat")
+		return new MultilatEstimator();
+	return new KalmanEstimator();
+}
+
+void sort_truth()
+{
+	FOREACH(it, truth)
+	{
+		std::stable_sort(it->second.begin(), it->second.end(),
+						 [](const truth_sample_t &a, const truth_sample_t &b) { return a.t < b.t; });
+	}
+}
+
+bool read_truth_traj(const char *path)
+{
+	TrajReader log;
+	std::vector<traj_record_t> records;
+	if (!log.open(path) || !log.read(0, ~(uint32_t)0, records))
+		return false;
+
+	FOREACH(it, records)
+	{
+		truth_sample_t s;
+		s.t = it->t;
+		s.x = it->pos[0];
+		s.y = it->pos[1];
+		s.z = it->pos[2];
+		truth[it->id].push_back(s);
+	}
+	sort_truth();
+	return !truth.empty();
+}
+
+bool read_truth(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return false;
+	}
+
+	char line[512];
+	while (fgets(line, sizeof(line), f))
+	{
+		truth_sample_t s;
+		int i;
+		if (sscanf(line, "%u, drifter_%d,%lf,%lf,%lf", &s.t, &i, &s.x, &s.y, &s.z) == 5)
+			truth[i + drifter_id_offset].push_back(s);
+	}
+	fclose(f);
+
+	sort_truth();
+	return !truth.empty();
+}
+
+bool truth_at(int id, uint32_t t, truth_sample_t *s)
+{
+	std::map<int, truth_track_t>::const_iterator it = truth.find(id);
+	if (it == truth.end() || it->second.empty())
+		return false;
+	const truth_track_t &tr = it->second;
+	if (t <= tr.front().t)
+	{
+		*s = tr.front();
+		return t == tr.front().t;
+	}
+	if (t >= tr.back().t)
+	{
+		*s = tr.back();
+		return t == tr.back().t;
+	}
+
+	size_t lo = 0, hi = tr.size() - 1;
+	while (hi - lo > 1)
+	{
+		const size_t mid = (lo + hi) / 2;
+		if (tr[mid].t <= t)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	const double f = (tr[hi].t > tr[lo].t) ? double(t - tr[lo].t) / (tr[hi].t - tr[lo].t) : 0.0;
+	s->t = t;
+	s->x = tr[lo].x + f * (tr[hi].x - tr[lo].x);
+	s->y = tr[lo].y + f * (tr[hi].y - tr[lo].y);
+	s->z = tr[lo].z + f * (tr[hi].z - tr[lo].z);
+	return true;
+}
+
+// log lines are "<simtime>\t<text>", as written by dprint_timestamp()
+bool read_float_log(const char *path, int self)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return false;
+	}
+
+	std::vector<nav_event_t> &ev = events[self];
+	char line[2048];
+	while (fgets(line, sizeof(line), f))
+	{
+		char *s = line;
+		if (*s == '@')
+			++s;
+		char *txt;
+		const unsigned long t = strtoul(s, &txt, 10);
+		if (txt == s || *txt != '\t')
+			continue;
+		++txt;
+
+		nav_event_t e;
+		e.t = t;
+		e.x = e.y = e.z = 0.0;
+		int id;
+		long lx, ly;
+		double min, x, y, z;
+		char *p;
+
+		if ((p = strstr(txt, "AC ping(m):")))
+		{
+			p += strlen("AC ping(m):");
+			unsigned int i, d;
+			int n;
+			while (sscanf(p, " %u:%u%n", &i, &d, &n) == 2)
+			{
+				p += n;
+				if (int(i) == self)
+					continue;
+				e.type = NAV_DISTANCE;
+				e.unit = i - 1;
+				e.x = d;
+				ev.push_back(e);
+			}
+		}
+		else if (sscanf(txt, "AC #%d gps pos (%lfmin): %ldm N, %ldm E", &id, &min, &ly, &lx) == 4)
+		{
+			e.type = NAV_GPS_FIX;
+			e.unit = id - 1;
+			e.t = std::max(0L, long(t) + lround(60.0 * min));
+			e.x = lx;
+			e.y = ly;
+			ev.push_back(e);
+		}
+		else if (sscanf(txt, "AC:#%d est_pos: (%lf min): %lf, N, %lf, E, %lf, Z", &id, &min, &y, &x, &z) == 5)
+		{
+			e.type = NAV_POS_EST;
+			e.unit = id - 1;
+			e.t = std::max(0L, long(t) + lround(60.0 * min));
+			e.x = x;
+			e.y = y;
+			e.z = z;
+			ev.push_back(e);
+		}
+		else if ((p = strstr(txt, "gps: ")) && (sscanf(p, "gps: %lfm N, %lfm E", &y, &x) == 2))
+		{
+			e.type = NAV_GPS_FIX;
+			e.unit = self - 1;
+			e.x = x;
+			e.y = y;
+			ev.push_back(e);
+		}
+	}
+	fclose(f);
+
+	std::stable_sort(ev.begin(), ev.end());
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+inline double elapsed_ns(const timespec &t0, const timespec &t1)
+{
+	return 1e9 * (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec);
+}
+
+void replay(int self, const nav_params_t &p, replay_result_t *res)
+{
+	const int n_units = truth.size();
+	const int u = self - 1;
+	const std::vector<nav_event_t> &ev = events[self];
+	if (ev.empty() || truth.rbegin()->first > n_units)
+		return;
+
+	// like Seafloat::initkalman(), wait for a GPS fix of every unit
+	std::vector<truth_sample_t> start(n_units);
+	std::vector<bool> seen(n_units, false);
+	int n_seen = 0;
+	size_t ei = 0;
+	uint32_t t = 0;
+	for (; ei < ev.size() && n_seen < n_units; ++ei)
+	{
+		const nav_event_t &e = ev[ei];
+		if (e.type != NAV_GPS_FIX || e.unit < 0 || e.unit >= n_units || seen[e.unit])
+			continue;
+		seen[e.unit] = true;
+		++n_seen;
+		start[e.unit].x = e.x;
+		start[e.unit].y = e.y;
+		t = e.t;
+	}
+	if (n_seen < n_units)
+		return;
+	ei = 0;
+
+	NavEstimator *nav = new_estimator();
+	NavEstimator &est = *nav;
+	est.init(n_units, u, p, start);
+
+	const uint32_t t_end = truth[self].back().t;
+	uint32_t last_own_fix = 0;
+	for (t += p.interval; t <= t_end; t += p.interval)
+	{
+		for (; ei < ev.size() && ev[ei].t <= t; ++ei)
+		{
+			const nav_event_t &e = ev[ei];
+			if (e.unit < 0 || e.unit >= n_units)
+				continue;
+			switch (e.type)
+			{
+			case NAV_GPS_FIX:
+				est.position(e.unit, true, e.x, e.y, 0.0);
+				if (e.unit == u)
+					last_own_fix = e.t;
+				break;
+			case NAV_POS_EST:
+				est.position(e.unit, e.z == 0.0, e.x, e.y, e.z);
+				break;
+			case NAV_DISTANCE:
+				est.distance(u, e.unit, e.x);
+				break;
+			}
+		}
+
+		truth_sample_t tru;
+		if (!truth_at(self, t, &tru))
+			continue;
+		if (t - last_own_fix > NAV_GPS_MAX_AGE)
+			est.position(u, false, 0.0, 0.0, tru.z); // own depth sensor
+
+		timespec t0, t1;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		est.update();
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		const double ns = elapsed_ns(t0, t1);
+
+		double x, y, z;
+		est.get_position(u, &x, &y, &z);
+		err_sample_t es;
+		es.t = t;
+		es.xy = hypot(x - tru.x, y - tru.y);
+		es.z = fabs(z - tru.z);
+		res->series.push_back(es);
+
+		++res->n_updates;
+		res->sum_sq_xy += es.xy * es.xy;
+		res->sum_sq_z += es.z * es.z;
+		res->max_xy = std::max(res->max_xy, es.xy);
+		res->sum_ns += ns;
+		res->max_ns = std::max(res->max_ns, ns);
+	}
+	delete nav;
+}
+
+//-----------------------------------------------------------------------------
+std::vector<nav_params_t> param_sets;
+std::vector<int> float_ids;
+std::vector<replay_result_t> results; // [set * float_ids.size() + float]
+
+size_t next_job = 0;
+pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void *replay_thread_function(void *arg)
+{
+	while (true)
+	{
+		pthread_mutex_lock(&job_mutex);
+		const size_t job = next_job++;
+		pthread_mutex_unlock(&job_mutex);
+		if (job >= results.size())
+			break;
+		replay(float_ids[job % float_ids.size()], param_sets[job / float_ids.size()], &results[job]);
+	}
+	return NULL;
+}
+
+std::vector<double> parse_list(const char *s)
+{
+	std::vector<double> v;
+	char *end;
+	while (*s)
+	{
+		const double d = strtod(s, &end);
+		if (end == s)
+			break;
+		v.push_back(d);
+		s = (*end == ',') ? end + 1 : end;
+	}
+	return v;
+}
+
+void usage(const char *cmd)
+{
+	printf("usage: %s [-d logdir] [-j threads] [-o series.csv] [-n id_offset] [-e kalman|multilat]\n"
+		   "\t[-g gps_err,..] [-r dist_err,..] [-p pos_err,..] [-c current_err,..] [-i interval,..]\n",
+		   cmd);
+	exit(EXIT_FAILURE);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	std::string logdir = LOGDIR_SYMLINK;
+	const char *series_path = NULL;
+	long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	nav_params_t def;
+	std::vector<double> gps(1, def.gps_err), dist(1, def.dist_err), pos(1, def.pos_err),
+		cur(1, def.current_err), dt(1, def.interval);
+
+	int opt;
+	while ((opt = getopt(argc, argv, "d:j:o:n:e:g:r:p:c:i:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'd': logdir = optarg; break;
+		case 'j': n_threads = atol(optarg); break;
+		case 'o': series_path = optarg; break;
+		case 'n': drifter_id_offset = atoi(optarg); break;
+		case 'e': estimator_name = optarg; break;
+		case 'g': gps = parse_list(optarg); break;
+		case 'r': dist = parse_list(optarg); break;
+		case 'p': pos = parse_list(optarg); break;
+		case 'c': cur = parse_list(optarg); break;
+		case 'i': dt = parse_list(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (gps.empty() || dist.empty() || pos.empty() || cur.empty() || dt.empty())
+		usage(argv[0]);
+	if (n_threads < 1)
+		n_threads = 1;
+	if (estimator_name != "kalman" && estimator_name != "multilat")
+		usage(argv[0]);
+
+	if (!read_truth_traj((logdir + "/" LOGFILE_TRAJECTORIES).c_str()) && !read_truth((logdir + "/drifterlog.csv").c_str()))
+	{
+		printf("no ground truth in %s\n", logdir.c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	DIR *dir = opendir(logdir.c_str());
+	if (!dir)
+	{
+		perror(logdir.c_str());
+		exit(EXIT_FAILURE);
+	}
+	while (dirent *de = readdir(dir))
+	{
+		int id;
+		char tail;
+		if (sscanf(de->d_name, "float_%d%c", &id, &tail) == 1 && truth.count(id))
+			if (read_float_log((logdir + "/" + de->d_name).c_str(), id))
+				float_ids.push_back(id);
+	}
+	closedir(dir);
+	std::sort(float_ids.begin(), float_ids.end());
+	if (float_ids.empty())
+	{
+		printf("no float logs matching the ground truth in %s\n", logdir.c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t g = 0; g < gps.size(); ++g)
+		for (size_t r = 0; r < dist.size(); ++r)
+			for (size_t p = 0; p < pos.size(); ++p)
+				for (size_t c = 0; c < cur.size(); ++c)
+					for (size_t i = 0; i < dt.size(); ++i)
+					{
+						nav_params_t ps;
+						ps.gps_err = gps[g];
+						ps.dist_err = dist[r];
+						ps.pos_err = pos[p];
+						ps.current_err = cur[c];
+						ps.interval = dt[i];
+						param_sets.push_back(ps);
+					}
+	results.resize(param_sets.size() * float_ids.size());
+
+	printf("%zu drifters, %zu float logs, %zu parameter sets, %ld threads, %s\n",
+		   truth.size(), float_ids.size(), param_sets.size(), n_threads, estimator_name.c_str());
+
+	timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	std::vector<pthread_t> threads(n_threads);
+	for (size_t i = 0; i < threads.size(); ++i)
+		pthread_create(&threads[i], NULL, &replay_thread_function, NULL);
+	for (size_t i = 0; i < threads.size(); ++i)
+		pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	// report: one line per parameter set, over all floats
+	printf("\n%4s %8s %8s %8s %8s %6s | %7s %9s %9s %9s | %9s %9s\n",
+		   "set", "gps", "dist", "pos", "current", "dt", "updates", "rms_xy", "max_xy", "rms_z", "us/upd", "max_us");
+	size_t best = 0;
+	double best_rms = HUGE_VAL;
+	for (size_t s = 0; s < param_sets.size(); ++s)
+	{
+		replay_result_t sum;
+		for (size_t f = 0; f < float_ids.size(); ++f)
+		{
+			const replay_result_t &r = results[s * float_ids.size() + f];
+			sum.n_updates += r.n_updates;
+			sum.sum_sq_xy += r.sum_sq_xy;
+			sum.sum_sq_z += r.sum_sq_z;
+			sum.max_xy = std::max(sum.max_xy, r.max_xy);
+			sum.sum_ns += r.sum_ns;
+			sum.max_ns = std::max(sum.max_ns, r.max_ns);
+		}
+		const nav_params_t &p = param_sets[s];
+		const double n = sum.n_updates ? sum.n_updates : 1;
+		const double rms_xy = sqrt(sum.sum_sq_xy / n);
+		printf("%4zu %8.3g %8.3g %8.3g %8.3g %6u | %7zu %9.1f %9.1f %9.2f | %9.1f %9.1f\n",
+			   s, p.gps_err, p.dist_err, p.pos_err, p.current_err, p.interval,
+			   sum.n_updates, rms_xy, sum.max_xy, sqrt(sum.sum_sq_z / n), 1e-3 * sum.sum_ns / n, 1e-3 * sum.max_ns);
+		if (sum.n_updates && rms_xy < best_rms)
+		{
+			best_rms = rms_xy;
+			best = s;
+		}
+	}
+	if (best_rms < HUGE_VAL)
+		printf("\nbest: set %zu, rms_xy %.1fm\n", best, best_rms);
+	printf("sweep took %.2fs\n", 1e-9 * elapsed_ns(t0, t1));
+
+	if (series_path)
+	{
+		FILE *f = fopen(series_path, "w");
+		if (!f)
+		{
+			perror(series_path);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(f, "set,float,time,err_xy,err_z\n");
+		for (size_t j = 0; j < results.size(); ++j)
+		{
+			const std::vector<err_sample_t> &series = results[j].series;
+			FOREACH_CONST(it, series)
+				fprintf(f, "%zu,%d,%u,%.2f,%.2f\n", j / float_ids.size(), float_ids[j % float_ids.size()], it->t, it->xy, it->z);
+		}
+		fclose(f);
+	}
+
+	exit(EXIT_SUCCESS);
+}
@@ -3,6 +3,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include <unistd.h>
+#include <ctime>
 #include <netinet/in.h>
 #include <svl/SVL.h>
 
@@ -121,7 +122,15 @@ bool SatClient::wait_for_connection(long timeout_ns)
 		sim_time.suspend_sleep();
 		if (timeout_ns > 0)
 		{
-			const timespec ts = {timeout_ns / 1e9l, timeout_ns};
+			timespec ts; // absolute deadline
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += timeout_ns / 1000000000L;
+			ts.tv_nsec += timeout_ns % 1000000000L;
+			if (ts.tv_nsec >= 1000000000L)
+			{
+				ts.tv_nsec -= 1000000000L;
+				++ts.tv_sec;
+			}
 			rv = pthread_cond_timedwait(&connect_cond, &connect_mutex, &ts);
 		}
 		else
@@ -8,6 +8,7 @@
 #include <queue>
 #include <map>
 #include <svl/SVL.h>
+#include <atomic>
 
 #include "sssim.h"
 #include "sssim-structs.h"
@@ -117,10 +118,12 @@ int SatModem::rx(SatMsg * msg, long timeout_ns) {
 
 		if (timeout_ns > 0) rx_queue->wait_for_msg(timeout_ns);
 
-		t_msg raw_msg = rx_queue->pop();
-		if (raw_msg.empty()) throw no_messages();
+		char raw_msg[MSGQUEUE_SLOT_SIZE];
+		const ssize_t raw_len = rx_queue->pop(raw_msg, sizeof(raw_msg));
+		if (raw_len == 0) throw no_messages();
+		if (raw_len < 0) throw SatMsg::data_err();
 
-		*msg = SatMsg(&raw_msg.front(), raw_msg.size()); 
+		*msg = SatMsg(raw_msg, raw_len);
 
 		const int16_t c_id = (msg->type & SATMSG_BASE_EMPTY) ? -1 : msg->from;
 		comms_log[c_id].rx_ack_id = msg->ack_id;
@@ -0,0 +1,213 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Converts the netCDF sea model output to a tile file, see src/sea-tiles.h.
+ *
+ * The grid area (SEA_NZ x SEA_NY x SEA_NX from SEA_IY, SEA_IX) is as in
+ * sea-data.h; the number of time steps is taken from the files, so runs
+ * longer than SEA_NT can be used. Each variable is read one time window at a
+ * time, so the whole run never needs to fit in memory.
+ *
+ * usage: sea-convert [-d datadir/] [-t steps] [-z nodes] [-y nodes] [-x nodes]
+ *                    [-c level] output
+ */
+
+#include <list>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netcdfcpp.h>
+
+#include "sea-data.h"
+#include "sea-tiles.h"
+
+static const char *var_files[SEA_VARS] = {SEA_DATA_FILE_SALT, SEA_DATA_FILE_TEMP, SEA_DATA_FILE_U_VEL, SEA_DATA_FILE_V_VEL, SEA_DATA_FILE_W_VEL};
+static const char *var_names[SEA_VARS] = {"S", "TEMP", "U", "V", "W"};
+
+//-----------------------------------------------------------------------------
+static NcFile *open_nc(const std::string &fn)
+{
+	NcFile *file = new NcFile(fn.c_str(), NcFile::ReadOnly);
+	if (!file->is_valid() || (file->get_dim(SEA_XVAR)->size() != SEA_NX_MAX) || (file->get_dim(SEA_YVAR)->size() != SEA_NY_MAX) || (file->get_dim(SEA_ZVAR)->size() != SEA_NZ))
+	{
+		fprintf(stderr, "%s: bad data\n", fn.c_str());
+		exit(1);
+	}
+	return file;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	std::string dir = SEA_DATA_DIR;
+	unsigned int tt = 8, tz = SEA_NZ, ty = 8, tx = 8;
+	int level = 6;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "d:t:z:y:x:c:h")) != -1)
+		switch (opt)
+		{
+		case 'd':
+			dir = optarg;
+			break;
+		case 't':
+			tt = atoi(optarg);
+			break;
+		case 'z':
+			tz = atoi(optarg);
+			break;
+		case 'y':
+			ty = atoi(optarg);
+			break;
+		case 'x':
+			tx = atoi(optarg);
+			break;
+		case 'c':
+			level = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-d datadir/] [-t steps] [-z nodes] [-y nodes] [-x nodes] [-c level] output\n", argv[0]);
+			return 1;
+		}
+	if ((optind != argc - 1) || !tt || !tz || !ty || !tx)
+	{
+		fprintf(stderr, "usage: %s [-d datadir/] [-t steps] [-z nodes] [-y nodes] [-x nodes] [-c level] output\n", argv[0]);
+		return 1;
+	}
+
+	NcFile *nc[SEA_VARS];
+	for (unsigned int v = 0; v < SEA_VARS; ++v)
+		nc[v] = open_nc(dir + var_files[v]);
+
+	// dimensions, from the temperature file as in Sea::ReadDimensions()
+	sea_tiles_header_t hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SEA_TILES_MAGIC, sizeof(hdr.magic));
+	hdr.nt = nc[SEA_VAR_TEMP]->get_dim(SEA_TVAR)->size();
+	hdr.nz = SEA_NZ;
+	hdr.ny = SEA_NY;
+	hdr.nx = SEA_NX;
+	hdr.tt = (tt < hdr.nt) ? tt : hdr.nt;
+	hdr.tz = (tz < hdr.nz) ? tz : hdr.nz;
+	hdr.ty = (ty < hdr.ny) ? ty : hdr.ny;
+	hdr.tx = (tx < hdr.nx) ? tx : hdr.nx;
+	hdr.n_vars = SEA_VARS;
+	for (unsigned int v = 0; v < SEA_VARS; ++v)
+		if (nc[v]->get_dim(SEA_TVAR)->size() != (long)hdr.nt)
+		{
+			fprintf(stderr, "%s: time steps differ from %s\n", var_files[v], var_files[SEA_VAR_TEMP]);
+			return 1;
+		}
+
+	double d[2];
+	nc[SEA_VAR_TEMP]->get_var(SEA_TVAR)->get(d, 2);
+	hdr.t0 = d[0];
+	hdr.step_t = d[1] - d[0];
+	nc[SEA_VAR_TEMP]->get_var(SEA_YVAR)->set_cur(SEA_IY);
+	nc[SEA_VAR_TEMP]->get_var(SEA_YVAR)->get(d, 2);
+	hdr.y0 = d[0];
+	hdr.step_y = d[1] - d[0];
+	nc[SEA_VAR_TEMP]->get_var(SEA_XVAR)->set_cur(SEA_IX);
+	nc[SEA_VAR_TEMP]->get_var(SEA_XVAR)->get(d, 2);
+	hdr.x0 = d[0];
+	hdr.step_x = d[1] - d[0];
+
+	std::vector<double> z(hdr.nz);
+	nc[SEA_VAR_TEMP]->get_var(SEA_ZVAR)->get(&z[0], hdr.nz);
+
+	const unsigned int
+		nt_t = (hdr.nt + hdr.tt - 1) / hdr.tt,
+		nt_z = (hdr.nz + hdr.tz - 1) / hdr.tz,
+		nt_y = (hdr.ny + hdr.ty - 1) / hdr.ty,
+		nt_x = (hdr.nx + hdr.tx - 1) / hdr.tx;
+	std::vector<sea_tiles_index_t> index(SEA_VARS * nt_t * nt_z * nt_y * nt_x);
+
+	FILE *out = fopen(argv[optind], "wb");
+	if (!out)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+	fwrite(&hdr, sizeof(hdr), 1, out);
+	fwrite(&z[0], sizeof(double), hdr.nz, out);
+	const long index_pos = ftell(out);
+	fwrite(&index[0], sizeof(sea_tiles_index_t), index.size(), out); // placeholder
+
+	// tiles in index order, one time window of a variable at a time
+	const size_t slice_n = hdr.nz * hdr.ny * hdr.nx;
+	std::vector<double> window(hdr.tt * slice_n), tile;
+	std::vector<unsigned char> packed;
+	uint64_t raw_bytes = 0, packed_bytes = 0;
+	unsigned int ti = 0;
+	for (unsigned int v = 0; v < SEA_VARS; ++v)
+	{
+		NcVar *var = nc[v]->get_var(var_names[v]);
+		for (unsigned int it = 0; it < nt_t; ++it)
+		{
+			const unsigned int t0 = it * hdr.tt, lt = (hdr.nt - t0 < hdr.tt) ? hdr.nt - t0 : hdr.tt;
+			if (!var->set_cur(t0, 0, SEA_IY, SEA_IX) || !var->get(&window[0], lt, hdr.nz, hdr.ny, hdr.nx))
+			{
+				fprintf(stderr, "%s: read failed at t %u\n", var_files[v], t0);
+				return 1;
+			}
+
+			for (unsigned int iz = 0; iz < nt_z; ++iz)
+				for (unsigned int iy = 0; iy < nt_y; ++iy)
+					for (unsigned int ix = 0; ix < nt_x; ++ix)
+					{
+						const unsigned int
+							z0 = iz * hdr.tz, lz = (hdr.nz - z0 < hdr.tz) ? hdr.nz - z0 : hdr.tz,
+							y0 = iy * hdr.ty, ly = (hdr.ny - y0 < hdr.ty) ? hdr.ny - y0 : hdr.ty,
+							x0 = ix * hdr.tx, lx = (hdr.nx - x0 < hdr.tx) ? hdr.nx - x0 : hdr.tx;
+
+						tile.clear();
+						for (unsigned int t = 0; t < lt; ++t)
+							for (unsigned int z = z0; z < z0 + lz; ++z)
+								for (unsigned int y = y0; y < y0 + ly; ++y)
+								{
+									const double *row = &window[((t * hdr.nz + z) * hdr.ny + y) * hdr.nx + x0];
+									tile.insert(tile.end(), row, row + lx);
+								}
+
+						SeaTileStore::pack(&tile[0], tile.size(), packed, level);
+						if (packed.empty())
+						{
+							fprintf(stderr, "compression failed\n");
+							return 1;
+						}
+						index[ti].offset = ftell(out);
+						index[ti].size = packed.size();
+						fwrite(&packed[0], 1, packed.size(), out);
+						raw_bytes += tile.size() * sizeof(double);
+						packed_bytes += packed.size();
+						++ti;
+					}
+		}
+	}
+
+	fseek(out, index_pos, SEEK_SET);
+	fwrite(&index[0], sizeof(sea_tiles_index_t), index.size(), out);
+	if (fclose(out) != 0)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+
+	printf("%u time steps, %u tiles of %ux%ux%ux%u per variable: %.1f MB -> %.1f MB\n",
+		   hdr.nt, ti / SEA_VARS, hdr.tt, hdr.tz, hdr.ty, hdr.tx, raw_bytes / 1e6, packed_bytes / 1e6);
+
+	for (unsigned int v = 0; v < SEA_VARS; ++v)
+		delete nc[v];
+	return 0;
+}
@@ -0,0 +1,48 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cmath>
+
+#include "sea-data.h"
+#include "sea-layers.h"
+
+
+//-----------------------------------------------------------------------------
+SeaLayerIndex::SeaLayerIndex(): z0(0.0), bin_scale(0.0), n_bins(1) {
+	for (unsigned int z = 0; z < SEA_NZ; ++z) depth[z] = 0.0;
+	lut[0] = 0;
+}
+
+// shallowest cell c <= SEA_NZ-2 with z <= depth[c], else 0
+unsigned int SeaLayerIndex::scan(double z) const {
+	unsigned int zi;
+	for (zi = SEA_NZ - 2; zi > 0; --zi)
+		if (z <= depth[zi]) break;
+	return zi;
+}
+
+void SeaLayerIndex::init(const double * layer_depth) {
+	double gap_min = HUGE_VAL;
+	for (unsigned int z = 0; z < SEA_NZ; ++z) {
+		depth[z] = layer_depth[z];
+		if ((z > 0) && (depth[z-1] - depth[z] < gap_min)) gap_min = depth[z-1] - depth[z];
+	}
+
+	z0 = depth[SEA_NZ - 1];
+	const double range = depth[0] - z0;
+	if ((range <= 0.0) || (gap_min <= 0.0)) {
+		bin_scale = 0.0;
+		n_bins = 1;
+		lut[0] = scan(z0);
+		return;
+	}
+
+	double bin_size = 0.5 * gap_min;
+	if (range / bin_size > SEA_LAYER_LUT_SIZE - 1) bin_size = range / (SEA_LAYER_LUT_SIZE - 1);
+	bin_scale = 1.0 / bin_size;
+	n_bins = ceil(range * bin_scale) + 1;
+	if (n_bins > SEA_LAYER_LUT_SIZE) n_bins = SEA_LAYER_LUT_SIZE;
+
+	for (unsigned int b = 0; b < n_bins; ++b) lut[b] = scan(z0 + b * bin_size);
+}
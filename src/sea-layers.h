@@ -0,0 +1,53 @@
+#ifndef _sea_layers_h
+#define _sea_layers_h
+
+/* requires:
+	#include "sea-data.h"
+*/
+
+#define  SEA_LAYER_LUT_SIZE  1024
+
+
+/**
+ * Constant-time vertical location in the irregular sea data layers
+ *
+ * The depth range is cut into equal bins no larger than half the thinnest
+ * layer, each holding the layer cell at its top, so that a lookup needs at
+ * most one step to the neighbouring cell. Results are the same as those of
+ * a linear scan of the layer depths.
+ *
+ * To use, init() with the layer depths (0: deepest, SEA_NZ-1: shallowest,
+ * positive down) & locate() depths.
+ */
+class SeaLayerIndex {
+	private:
+		double depth[SEA_NZ];
+		double z0, bin_scale;  // bin = (z - z0) * bin_scale
+		unsigned int n_bins;
+		unsigned char lut[SEA_LAYER_LUT_SIZE];
+
+		unsigned int scan(double z) const;
+
+	public:
+		SeaLayerIndex();
+
+		void init(const double * layer_depth);
+
+		// cell & frac for interpolation between depth[cell] & depth[cell+1];
+		// depths outside the layers are clamped as in Sea::map()
+		void locate(double z, unsigned int & cell, double & frac) const {
+			if (z >= depth[0]) { cell = 0; frac = 0.0; return; }
+			if (z <= depth[SEA_NZ - 1]) { cell = SEA_NZ - 2; frac = 0.999999; return; }
+
+			unsigned int b = (z - z0) * bin_scale;
+			if (b >= n_bins) b = n_bins - 1;
+			unsigned int c = lut[b];
+			while ((c > 0) && (z > depth[c])) --c;
+			while ((c < SEA_NZ - 2) && (z <= depth[c + 1])) ++c;
+
+			cell = c;
+			frac = (z - depth[c]) / (depth[c + 1] - depth[c]);
+		}
+};
+
+#endif // _sea_layers_h
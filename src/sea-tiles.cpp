@@ -0,0 +1,345 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <list>
+#include <deque>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "sea-tiles.h"
+
+
+static inline unsigned int div_up(unsigned int a, unsigned int b) { return (a + b - 1) / b; }
+static inline unsigned int min_u(unsigned int a, unsigned int b) { return (a < b) ? a : b; }
+
+static bool pread_all(int fd, void * buf, size_t len, off_t offset) {
+	char * p = reinterpret_cast<char *>(buf);
+	while (len > 0) {
+		const ssize_t r = pread(fd, p, len, offset);
+		if (r <= 0) return false;
+		p += r;
+		len -= r;
+		offset += r;
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+bool SeaTileStore::open(const char * fn) {
+	close();
+
+	fd = ::open(fn, O_RDONLY);
+	if (fd < 0) return false;
+
+	off_t pos = 0;
+	if (!pread_all(fd, &hdr, sizeof(hdr), pos)
+	    || memcmp(hdr.magic, SEA_TILES_MAGIC, sizeof(hdr.magic))
+	    || (hdr.n_vars != SEA_VARS)
+	    || !hdr.nt || !hdr.nz || !hdr.ny || !hdr.nx
+	    || !hdr.tt || !hdr.tz || !hdr.ty || !hdr.tx) {
+		close();
+		return false;
+	}
+	pos += sizeof(hdr);
+
+	z.resize(hdr.nz);
+	if (!pread_all(fd, &z[0], hdr.nz * sizeof(double), pos)) {
+		close();
+		return false;
+	}
+	pos += hdr.nz * sizeof(double);
+
+	nt_t = div_up(hdr.nt, hdr.tt);
+	nt_z = div_up(hdr.nz, hdr.tz);
+	nt_y = div_up(hdr.ny, hdr.ty);
+	nt_x = div_up(hdr.nx, hdr.tx);
+	n_tiles = nt_t * nt_z * nt_y * nt_x;
+
+	index.resize(SEA_VARS * n_tiles);
+	if (!pread_all(fd, &index[0], index.size() * sizeof(sea_tiles_index_t), pos)) {
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void SeaTileStore::close() {
+	if (fd >= 0) ::close(fd);
+	fd = -1;
+	n_tiles = 0;
+	index.clear();
+}
+
+
+//-----------------------------------------------------------------------------
+unsigned int SeaTileStore::tile(unsigned int var, unsigned int t, unsigned int z, unsigned int y, unsigned int x, unsigned int * offset) const {
+	const unsigned int
+		it = t / hdr.tt, iz = z / hdr.tz, iy = y / hdr.ty, ix = x / hdr.tx,
+		lz = min_u(hdr.tz, hdr.nz - iz * hdr.tz),
+		ly = min_u(hdr.ty, hdr.ny - iy * hdr.ty),
+		lx = min_u(hdr.tx, hdr.nx - ix * hdr.tx);
+
+	if (offset) *offset = (((t - it * hdr.tt) * lz + (z - iz * hdr.tz)) * ly + (y - iy * hdr.ty)) * lx + (x - ix * hdr.tx);
+	return (((var * nt_t + it) * nt_z + iz) * nt_y + iy) * nt_x + ix;
+}
+
+size_t SeaTileStore::tile_size(unsigned int tile) const {
+	const unsigned int
+		ix = tile % nt_x,
+		iy = (tile / nt_x) % nt_y,
+		iz = (tile / (nt_x * nt_y)) % nt_z,
+		it = (tile / (nt_x * nt_y * nt_z)) % nt_t;
+
+	return (size_t)min_u(hdr.tt, hdr.nt - it * hdr.tt)
+		* min_u(hdr.tz, hdr.nz - iz * hdr.tz)
+		* min_u(hdr.ty, hdr.ny - iy * hdr.ty)
+		* min_u(hdr.tx, hdr.nx - ix * hdr.tx);
+}
+
+bool SeaTileStore::read(unsigned int tile, std::vector<double> & data) const {
+	if ((fd < 0) || (tile >= index.size())) return false;
+
+	const sea_tiles_index_t & ti = index[tile];
+	std::vector<unsigned char> buf(ti.size);
+	if (!pread_all(fd, &buf[0], ti.size, ti.offset)) return false;
+
+	data.resize(tile_size(tile));
+	return unpack(&buf[0], buf.size(), &data[0], data.size());
+}
+
+
+//-----------------------------------------------------------------------------
+// byte k of value i goes to k * n + i before deflating: the exponent & high
+// mantissa bytes of neighbouring nodes are mostly equal, and compress far
+// better next to each other
+void SeaTileStore::pack(const double * data, size_t n, std::vector<unsigned char> & out, int level) {
+	const unsigned char * src = reinterpret_cast<const unsigned char *>(data);
+	std::vector<unsigned char> shuffled(n * sizeof(double));
+	for (size_t i = 0; i < n; ++i)
+		for (size_t k = 0; k < sizeof(double); ++k)
+			shuffled[k * n + i] = src[i * sizeof(double) + k];
+
+	uLongf len = compressBound(shuffled.size());
+	out.resize(len);
+	if (compress2(&out[0], &len, &shuffled[0], shuffled.size(), level) != Z_OK) len = 0;
+	out.resize(len);
+}
+
+bool SeaTileStore::unpack(const unsigned char * in, size_t in_size, double * data, size_t n) {
+	std::vector<unsigned char> shuffled(n * sizeof(double));
+	uLongf len = shuffled.size();
+	if ((uncompress(&shuffled[0], &len, in, in_size) != Z_OK) || (len != shuffled.size())) return false;
+
+	unsigned char * dst = reinterpret_cast<unsigned char *>(data);
+	for (size_t i = 0; i < n; ++i)
+		for (size_t k = 0; k < sizeof(double); ++k)
+			dst[i * sizeof(double) + k] = shuffled[k * n + i];
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+static std::atomic<unsigned int> cache_ids(1);
+
+SeaTileCache::SeaTileCache(const SeaTileStore & _store, size_t _max_bytes):
+	store(_store), max_bytes(_max_bytes), id(cache_ids++),
+	quit(false),
+	tiles(), lru(), queue(), queued(), st()
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&queue_cond, NULL);
+	pthread_create(&thread, NULL, &prefetch_thread, this);
+}
+
+SeaTileCache::~SeaTileCache() {
+	pthread_mutex_lock(&mutex);
+	quit = true;
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(thread, NULL);
+
+	pthread_cond_destroy(&queue_cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+SeaTileCache::stats_t SeaTileCache::stats() {
+	pthread_mutex_lock(&mutex);
+	const stats_t s = st;
+	pthread_mutex_unlock(&mutex);
+	return s;
+}
+
+
+//-----------------------------------------------------------------------------
+SeaTileCache::tile_ptr SeaTileCache::find(unsigned int tile) {
+	std::unordered_map<unsigned int, entry_t>::iterator it = tiles.find(tile);
+	if (it == tiles.end()) return tile_ptr();
+	lru.splice(lru.begin(), lru, it->second.lru);
+	return it->second.data;
+}
+
+SeaTileCache::tile_ptr SeaTileCache::load(unsigned int tile) {
+	std::vector<double> * data = new std::vector<double>;
+	if (!store.read(tile, *data)) {
+		printf("%s: bad sea tile %u\n", __FUNCTION__, tile);
+		exit(1);
+	}
+	return tile_ptr(data);
+}
+
+void SeaTileCache::insert(unsigned int tile, tile_ptr data) {
+	if (tiles.count(tile)) return;
+
+	lru.push_front(tile);
+	entry_t & e = tiles[tile];
+	e.data = data;
+	e.lru = lru.begin();
+	st.bytes += data->size() * sizeof(double);
+
+	while ((st.bytes > max_bytes) && (lru.size() > 1)) {
+		std::unordered_map<unsigned int, entry_t>::iterator old = tiles.find(lru.back());
+		st.bytes -= old->second.data->size() * sizeof(double);
+		tiles.erase(old);
+		lru.pop_back();
+		++st.evicted;
+	}
+}
+
+SeaTileCache::tile_ptr SeaTileCache::get(unsigned int tile) {
+	pthread_mutex_lock(&mutex);
+	tile_ptr data = find(tile);
+	if (data) ++st.hits;
+	else ++st.misses;
+	pthread_mutex_unlock(&mutex);
+	if (data) return data;
+
+	data = load(tile);
+
+	pthread_mutex_lock(&mutex);
+	tile_ptr prev = find(tile);  // the prefetcher may have beaten us to it
+	if (prev) data = prev;
+	else insert(tile, data);
+	pthread_mutex_unlock(&mutex);
+	return data;
+}
+
+// the last two tiles per variable, for cells on a tile edge; a tile held here
+// stays in memory even once evicted, until the thread moves on
+struct recent_tile_t {
+	unsigned int cache_id, tile;
+	SeaTileCache::tile_ptr data;
+};
+static thread_local recent_tile_t recent_tiles[SEA_VARS][2];
+
+const std::vector<double> & SeaTileCache::recent(unsigned int var, unsigned int tile) {
+	recent_tile_t * r = recent_tiles[var];
+	for (unsigned int i = 0; i < 2; ++i)
+		if ((r[i].cache_id == id) && (r[i].tile == tile) && r[i].data) return *r[i].data;
+
+	r[1] = r[0];
+	r[0].data = get(tile);
+	r[0].cache_id = id;
+	r[0].tile = tile;
+	return *r[0].data;
+}
+
+
+//-----------------------------------------------------------------------------
+double SeaTileCache::node(unsigned int var, unsigned int t, unsigned int z, unsigned int y, unsigned int x) {
+	unsigned int offset;
+	const unsigned int tile = store.tile(var, t, z, y, x, &offset);
+	return recent(var, tile)[offset];
+}
+
+void SeaTileCache::corners(unsigned int var, unsigned int t, unsigned int z, unsigned int y, unsigned int x, double * d) {
+	for (unsigned int i = 0; i < 16; ++i) {
+		unsigned int offset;
+		const unsigned int tile = store.tile(var,
+			t + (i >> 3), z + ((i >> 2) & 1), y + ((i >> 1) & 1), x + (i & 1), &offset);
+		d[i] = recent(var, tile)[offset];
+	}
+}
+
+void SeaTileCache::slice(unsigned int var, unsigned int t, double * d) {
+	const sea_tiles_header_t & h = store.hdr;
+	unsigned int last_tile = ~0u;
+	tile_ptr data;
+	for (unsigned int z = 0; z < h.nz; ++z)
+		for (unsigned int y = 0; y < h.ny; ++y)
+			for (unsigned int x = 0; x < h.nx; ++x) {
+				unsigned int offset;
+				const unsigned int tile = store.tile(var, t, z, y, x, &offset);
+				if (tile != last_tile) {
+					data = get(tile);
+					last_tile = tile;
+				}
+				*d++ = (*data)[offset];
+			}
+}
+
+
+//-----------------------------------------------------------------------------
+void SeaTileCache::prefetch(unsigned int t0, unsigned int t1, unsigned int y0, unsigned int y1, unsigned int x0, unsigned int x1) {
+	const sea_tiles_header_t & h = store.hdr;
+	if (t1 >= h.nt) t1 = h.nt - 1;
+	if (y1 >= h.ny) y1 = h.ny - 1;
+	if (x1 >= h.nx) x1 = h.nx - 1;
+	if ((t0 > t1) || (y0 > y1) || (x0 > x1)) return;
+
+	bool added = false;
+	pthread_mutex_lock(&mutex);
+	for (unsigned int var = 0; var < SEA_VARS; ++var)
+		for (unsigned int t = t0 - t0 % h.tt; t <= t1; t += h.tt)
+			for (unsigned int z = 0; z < h.nz; z += h.tz)
+				for (unsigned int y = y0 - y0 % h.ty; y <= y1; y += h.ty)
+					for (unsigned int x = x0 - x0 % h.tx; x <= x1; x += h.tx) {
+						const unsigned int tile = store.tile(var, t, z, y, x, NULL);
+						if (tiles.count(tile) || queued.count(tile)) continue;
+						queue.push_back(tile);
+						queued.insert(tile);
+						added = true;
+					}
+	if (added) pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+void * SeaTileCache::prefetch_thread(void * arg) {
+	SeaTileCache * c = reinterpret_cast<SeaTileCache *>(arg);
+
+	pthread_mutex_lock(&c->mutex);
+	for (;;) {
+		while (!c->quit && c->queue.empty()) pthread_cond_wait(&c->queue_cond, &c->mutex);
+		if (c->quit) break;
+
+		const unsigned int tile = c->queue.front();
+		c->queue.pop_front();
+		c->queued.erase(tile);
+		if (c->tiles.count(tile)) continue;
+
+		pthread_mutex_unlock(&c->mutex);
+		tile_ptr data = c->load(tile);
+		pthread_mutex_lock(&c->mutex);
+
+		if (!c->tiles.count(tile)) {
+			c->insert(tile, data);
+			++c->st.prefetched;
+		}
+	}
+	pthread_mutex_unlock(&c->mutex);
+
+	return NULL;
+}
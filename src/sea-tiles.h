@@ -0,0 +1,156 @@
+#ifndef _sea_tiles_h
+#define _sea_tiles_h
+
+/* requires:
+	#include <list>
+	#include <deque>
+	#include <vector>
+	#include <memory>
+	#include <unordered_map>
+	#include <unordered_set>
+	#include <stdint.h>
+	#include <pthread.h>
+*/
+
+/**
+ * Tiled, compressed on-disk store of the sea model variables
+ *
+ * The netCDF files are read whole into memory by Sea, which doesn't scale to
+ * long runs of model output. A tile file (see bin/sea-convert) instead holds
+ * each variable cut into tiles of tt time steps x tz x ty x tx nodes, each
+ * tile byte-shuffled & deflated separately, so that only the tiles around the
+ * floats and the current time need to be in memory.
+ *
+ * File layout, native byte order:
+ *   sea_tiles_header_t
+ *   double z[nz]                      as in the netCDF Z variable
+ *   sea_tiles_index_t [n_vars * n_tiles]
+ *   tile data
+ *
+ * Tiles are numbered var-major, then t, z, y, x; the values within a tile are
+ * in [t][z][y][x] order, clipped at the far edges of the grid.
+ */
+
+#define  SEA_TILES_MAGIC  "SSSTILE1"
+
+enum sea_var_t {
+	SEA_VAR_SALT,
+	SEA_VAR_TEMP,
+	SEA_VAR_FLOW_X,
+	SEA_VAR_FLOW_Y,
+	SEA_VAR_FLOW_Z,
+	SEA_VARS
+};
+
+struct sea_tiles_header_t {
+	char magic[8];
+	uint32_t nt, nz, ny, nx;  // grid size, nodes
+	uint32_t tt, tz, ty, tx;  // tile size, nodes
+	uint32_t n_vars, reserved;
+	double t0, step_t;        // seconds
+	double y0, step_y;        // degrees north, as in the netCDF files
+	double x0, step_x;        // degrees east
+};
+
+struct sea_tiles_index_t {
+	uint64_t offset, size;    // of the compressed tile, bytes
+};
+
+
+//-----------------------------------------------------------------------------
+class SeaTileStore {
+	public:
+		sea_tiles_header_t hdr;
+		std::vector<double> z;
+
+		SeaTileStore() : hdr(), z(), nt_t(0), nt_z(0), nt_y(0), nt_x(0), n_tiles(0), index(), fd(-1) {}
+		~SeaTileStore() { close(); }
+
+		bool open(const char * fn);
+		void close();
+
+		unsigned int tiles() const { return n_tiles; }  // per variable
+		size_t tile_size(unsigned int tile) const;      // values
+
+		// tile containing a node, and the node's offset within it
+		unsigned int tile(unsigned int var, unsigned int t, unsigned int z, unsigned int y, unsigned int x, unsigned int * offset) const;
+		bool read(unsigned int tile, std::vector<double> & data) const;  // thread-safe
+
+		// for writers
+		static void pack(const double * data, size_t n, std::vector<unsigned char> & out, int level);
+		static bool unpack(const unsigned char * in, size_t in_size, double * data, size_t n);
+
+	private:
+		unsigned int nt_t, nt_z, nt_y, nt_x;  // tiles per dimension
+		unsigned int n_tiles;
+		std::vector<sea_tiles_index_t> index;
+		int fd;
+
+		SeaTileStore(const SeaTileStore &);
+		SeaTileStore & operator=(const SeaTileStore &);
+};
+
+
+//-----------------------------------------------------------------------------
+// LRU cache of uncompressed tiles, with a background thread for prefetching.
+// Tiles are handed out as shared pointers, so evicting one doesn't pull it
+// from under a reader. node() & corners() keep the last two tiles of each
+// variable per thread, and only take the mutex when they move to another one.
+class SeaTileCache {
+	public:
+		typedef std::shared_ptr<const std::vector<double> > tile_ptr;
+
+		struct stats_t {
+			unsigned long hits, misses, prefetched, evicted;
+			size_t bytes;
+		};
+
+		SeaTileCache(const SeaTileStore & _store, size_t _max_bytes);
+		~SeaTileCache();
+
+		double node(unsigned int var, unsigned int t, unsigned int z, unsigned int y, unsigned int x);
+		// the 16 nodes around a cell, in [t][z][y][x] order
+		void corners(unsigned int var, unsigned int t, unsigned int z, unsigned int y, unsigned int x, double * d);
+		// all nodes of time step t, [z][y][x]
+		void slice(unsigned int var, unsigned int t, double * d);
+
+		// queue the tiles of all variables covering the node ranges, inclusive
+		void prefetch(unsigned int t0, unsigned int t1, unsigned int y0, unsigned int y1, unsigned int x0, unsigned int x1);
+
+		stats_t stats();
+
+	private:
+		typedef std::list<unsigned int> lru_t;
+		struct entry_t {
+			tile_ptr data;
+			lru_t::iterator lru;
+		};
+
+		const SeaTileStore & store;
+		const size_t max_bytes;
+		const unsigned int id;  // tells the caches apart for recent()
+
+		pthread_mutex_t mutex;
+		pthread_cond_t queue_cond;
+		pthread_t thread;
+		bool quit;
+
+		std::unordered_map<unsigned int, entry_t> tiles;
+		lru_t lru;  // front: most recently used
+		std::deque<unsigned int> queue;
+		std::unordered_set<unsigned int> queued;
+		stats_t st;
+
+		tile_ptr get(unsigned int tile);
+		const std::vector<double> & recent(unsigned int var, unsigned int tile);  // one of the calling thread's last tiles of var, or get()
+		tile_ptr find(unsigned int tile);  // requires mutex
+		tile_ptr load(unsigned int tile);  // without mutex
+		void insert(unsigned int tile, tile_ptr data);  // requires mutex
+
+		static void * prefetch_thread(void * arg);
+
+		SeaTileCache(const SeaTileCache &);
+		SeaTileCache & operator=(const SeaTileCache &);
+};
+
+#endif // _sea_tiles_h
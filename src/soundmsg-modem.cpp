@@ -8,6 +8,7 @@
 #include <map>
 #include <netinet/in.h>
 #include <svl/SVL.h>
+#include <atomic>
 
 #include "sssim.h"
 #include "udp.h"
@@ -44,6 +45,7 @@ SoundModem::SoundModem() : thread_id(),
 void *SoundModem::thread()
 {
 	SimSocket tx_skt(&env_addr);
+	char tx_msg[MSGQUEUE_SLOT_SIZE];
 
 	while (true)
 	{
@@ -77,11 +79,11 @@ void *SoundModem::thread()
 		}
 		else if (ct < ct_tx_slot_start + sim_time.cycle.tx_slot_seconds)
 		{
-			t_msg tx_msg = tx_queue.pop();
-			if (!tx_msg.empty())
+			const ssize_t tx_len = tx_queue.pop(tx_msg, sizeof(tx_msg));
+			if (tx_len > 0)
 			{
-				tx_skt.UDPclient::send(&tx_msg.front(), tx_msg.size());
-				//dprint(" > msg %zuc\n", tx_msg.size());
+				tx_skt.UDPclient::send(tx_msg, tx_len);
+				//dprint(" > msg %zic\n", tx_len);
 			}
 			sleep_time = SOUNDMODEM_TX_MSG_GAP;
 		}
@@ -139,12 +141,15 @@ int SoundModem::rx(SoundMsg *msg)
 
 	try
 	{
-		t_msg raw_msg = soundmsg_rx_queue.pop();
-		if (raw_msg.empty())
+		char raw_msg[MSGQUEUE_SLOT_SIZE];
+		const ssize_t raw_len = soundmsg_rx_queue.pop(raw_msg, sizeof(raw_msg));
+		if (raw_len == 0)
 			throw no_messages();
+		if (raw_len < 0)
+			throw SoundMsg::data_err();
 
-		*msg = SoundMsg(&raw_msg.front(), raw_msg.size());
-		//dprint("rx"); for (unsigned int i = 0; i < raw_msg.size(); ++i) printf(" %02hhX", raw_msg[i]); putchar('\n');
+		*msg = SoundMsg(raw_msg, raw_len);
+		//dprint("rx"); for (unsigned int i = 0; i < raw_len; ++i) printf(" %02hhX", raw_msg[i]); putchar('\n');
 		//printf("\t:: from %i time %u type %02hhX id %02hhX body_len %u\n", msg->from, msg->time, msg->type, msg->id, msg->body_len);
 	}
 	catch (no_messages x)
@@ -85,6 +85,8 @@ const char *msg_name(const unsigned char c)
 		return "GET_PROFILE";
 	case MSG_GET_DDEPTH:
 		return "GET_DDEPTH";
+	case MSG_GET_STATS:
+		return "GET_STATS";
 	default:
 		return "[unrecognised]";
 	}
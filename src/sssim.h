@@ -27,6 +27,9 @@ T CLAMP(const T &value, const T &low, const T &high)
 #define LOGDIR_SYMLINK "logs/latest"
 #define LOGFILE_BASE_FMT "base_%02d", client_id
 #define LOGFILE_FLOAT_FMT "float_%02d", client_id
+#define LOGFILE_TRAJECTORIES "trajectories.sstj" // see src/traj-log.h
+#define LOGFILE_EVENTS "env.events" // see src/env-events.h
+#define LOGFILE_STATS "env.stats" // see src/env-stats.h
 
 #define GRAVITY 9.80665
 
@@ -79,6 +82,7 @@ inline double meters_north_to_degrees(double m) { return m / METERS_PER_DEGREE_N
 #define MSG_GET_ENV 0x22
 #define MSG_GET_PROFILE 0x23
 #define MSG_GET_DDEPTH 0x24
+#define MSG_GET_STATS 0x25
 
 #define FLAG16_INIT_OK 0x0001
 #define FLAG16_ENV_OK 0x0002
@@ -0,0 +1,444 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Runs env, base & n floats headless, for each n of a list in turn, and
+ * reports how the speed of the simulation scales with the size of the swarm;
+ * the scripted version of the run_* scripts. Run from the top directory, with
+ * bin/env, bin/base & bin/float built.
+ *
+ * usage: swarm-scale [-n counts] [-t seconds] [-w seconds] [-s seed] [-c cpus] [-l logdir] [-o output]
+ *
+ * The counts default to 1,2,5,10,20,50,100. Each run has the same $SSSIM_SEED
+ * (-s, default 1) and stops after -t seconds of env_time ($SSSIM_RUN_TIME,
+ * default 3600), or is killed & reported as failed after -w seconds of wall
+ * time (default 10 × -t + 60); $SSSIM_SWARM_SIZE is set to its n. The floats
+ * are started one by one in a fixed order, with the densities of run_thirthy,
+ * and time is started once they have all registered. With -c cpus (default
+ * all this may run on; 0 for none), env is pinned to the first CPU and the
+ * clients in turn to the rest.
+ * The output of env goes to logdir/env.out and that of the clients to
+ * logdir/clients.out (logdir default logs/swarm-scale), overwritten by each run.
+ *
+ * The report (stdout, or -o file) has a line per run, with fixed columns so
+ * that the reports of two versions can be diffed:
+ *   n        floats
+ *   ticks    seconds of env_time run, from logs/latest/env.stats
+ *   wall_s   wall-clock time from MSG_PLAY to the exit of env
+ *   speed    ticks / wall_s, i.e. × realtime
+ *   dgrams   datagrams received by env per tick, but for MSG_GET_STATS
+ *   env_cpu_s, env_vcsw, env_ivcsw
+ *            user+system CPU time & voluntary/involuntary context switches of env
+ *   base_cpu_s
+ *   float_cpu_s, float_vcsw, float_ivcsw
+ *            the same per float, as the mean over the floats
+ */
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "sssim.h"
+#include "udp.h"
+#include "util-mkdirp.h"
+
+#define USAGE "usage: %s [-n counts] [-t seconds] [-w seconds] [-s seed] [-c cpus] [-l logdir] [-o output]\n"
+#define COUNTS_DEFAULT "1,2,5,10,20,50,100"
+#define RUN_TIME_DEFAULT 3600 // s of env_time
+#define RUN_WALL_FACTOR 10 // s of wall time per s of env_time, before a run is failed
+#define RUN_WALL_SLACK 60 // s, added to that
+#define SEED_DEFAULT 1
+#define LOGDIR_DEFAULT "logs/swarm-scale"
+#define FLOAT_DENSITY_0 1004 // kg/m^3, as in run_thirthy
+#define FLOAT_DENSITIES 30
+#define ENV_START_TIMEOUT 60.0 // s, for reading the sea data
+#define CLIENT_START_TIMEOUT 5.0 // s
+#define CLIENT_QUIT_TIMEOUT 5.0 // s, after env is done
+#define POLL_INTERVAL 20000 // µs
+
+struct child_t
+{
+	pid_t pid;
+	bool done;
+	rusage ru;
+};
+
+static std::vector<child_t> children; // env, base, floats
+static const char *logdir = LOGDIR_DEFAULT;
+static std::vector<int> cpus; // to pin to, of those allowed
+
+static double now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+static double cpu_s(const rusage &ru)
+{
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + 1.0e-6 * (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+//-----------------------------------------------------------------------------
+// starts bin/<argv[0]> with its output to logdir/<out>, on a CPU of its own if pinning
+static bool spawn(const char *out, const char *const argv[])
+{
+	char bin[64], out_fn[256];
+	snprintf(bin, sizeof(bin), "bin/%s", argv[0]);
+	snprintf(out_fn, sizeof(out_fn), "%s/%s", logdir, out);
+
+	const unsigned int i = children.size();
+	const pid_t pid = fork();
+	if (pid < 0)
+	{
+		perror("fork");
+		return false;
+	}
+	if (pid == 0)
+	{
+		const int fd = open(out_fn, O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (fd >= 0)
+		{
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+		if (!cpus.empty())
+		{
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpus[((i == 0) || (cpus.size() == 1)) ? 0 : 1 + (i - 1) % (cpus.size() - 1)], &set);
+			if (sched_setaffinity(0, sizeof(set), &set))
+				perror("sched_setaffinity");
+		}
+		execv(bin, const_cast<char *const *>(argv));
+		perror(bin);
+		_exit(127);
+	}
+
+	child_t c;
+	c.pid = pid;
+	c.done = false;
+	memset(&c.ru, 0, sizeof(c.ru));
+	children.push_back(c);
+	return true;
+}
+
+// true once all children have exited, waiting for at most timeout s
+static bool reap(double timeout)
+{
+	const double t_end = now() + timeout;
+	for (;;)
+	{
+		bool all = true;
+		for (std::vector<child_t>::iterator it = children.begin(); it != children.end(); ++it)
+			if (!it->done)
+			{
+				int status;
+				if (wait4(it->pid, &status, WNOHANG, &it->ru) == it->pid)
+					it->done = true;
+				else
+					all = false;
+			}
+		if (all)
+			return true;
+		if (now() > t_end)
+			return false;
+		usleep(POLL_INTERVAL);
+	}
+}
+
+static void kill_all()
+{
+	for (std::vector<child_t>::iterator it = children.begin(); it != children.end(); ++it)
+		if (!it->done)
+			kill(it->pid, SIGTERM);
+	if (!reap(CLIENT_QUIT_TIMEOUT))
+		for (std::vector<child_t>::iterator it = children.begin(); it != children.end(); ++it)
+			if (!it->done)
+				kill(it->pid, SIGKILL);
+	reap(CLIENT_QUIT_TIMEOUT);
+}
+
+//-----------------------------------------------------------------------------
+// true once env has read the sea data & is waiting for time to start
+static bool env_ready()
+{
+	char fn[256], line[256];
+	snprintf(fn, sizeof(fn), "%s/env.out", logdir);
+	FILE *f = fopen(fn, "r");
+	if (f == NULL)
+		return false;
+	bool ready = false;
+	while (!ready && fgets(line, sizeof(line), f))
+		ready = !strncmp(line, "|| start time", 13);
+	fclose(f);
+	return ready;
+}
+
+// n of the messages named msg_name that env has received, see src/env-stats.h; -1 if no reply
+static long env_msg_count(UDPclient &env, const char *msg_name)
+{
+	static char buf[65536];
+	const char msg = MSG_GET_STATS;
+	if (env.send(&msg, 1) <= 0)
+		return -1;
+	timeval tv = {1, 0};
+	const ssize_t len = env.recv(buf, sizeof(buf) - 1, &tv);
+	if ((len < 1) || (buf[0] != (char)(MSG_GET_STATS | MSG_ACK_MASK)))
+		return -1;
+	buf[len] = '\0';
+
+	char name[32];
+	unsigned long n;
+	for (const char *s = buf + 1; s != NULL && *s; s = strchr(s, '\n'), s = s ? s + 1 : NULL)
+		if ((sscanf(s, "msg\t%31[^\t]\t%lu", name, &n) == 2) && !strcmp(name, msg_name))
+			return n;
+	return 0;
+}
+
+static bool wait_for_count(UDPclient &env, const char *msg_name, long count, double timeout)
+{
+	const double t_end = now() + timeout;
+	while (now() < t_end)
+	{
+		if (env_msg_count(env, msg_name) >= count)
+			return true;
+		if (reap(0.0) || children.front().done)
+			return false;
+		usleep(POLL_INTERVAL);
+	}
+	return false;
+}
+
+// from the last report in logs/latest/env.stats: ticks, and datagrams received but for MSG_GET_STATS
+static bool read_stats(unsigned long &ticks, unsigned long &dgrams)
+{
+	FILE *f = fopen(LOGDIR_SYMLINK "/" LOGFILE_STATS, "r");
+	if (f == NULL)
+		return false;
+	char line[256], kind[16], name[32];
+	unsigned long n;
+	ticks = dgrams = 0;
+	while (fgets(line, sizeof(line), f))
+	{
+		if (!strncmp(line, "# env_time", 10))
+			ticks = dgrams = 0;
+		else if (sscanf(line, "%15[^\t]\t%31[^\t]\t%lu", kind, name, &n) != 3)
+			continue;
+		else if (!strcmp(kind, "phase") && !strcmp(name, "tick"))
+			ticks = n;
+		else if (!strcmp(kind, "msg") && strcmp(name, "GET_STATS"))
+			dgrams += n;
+	}
+	fclose(f);
+	return ticks > 0;
+}
+
+//-----------------------------------------------------------------------------
+// one run with n floats, as a line of the report; failed if env runs for over wall_limit s
+static bool run(FILE *out, unsigned int n, double wall_limit)
+{
+	const char *outs[] = {"env.out", "clients.out"};
+	for (unsigned int i = 0; i < 2; ++i)
+	{
+		char fn[256];
+		snprintf(fn, sizeof(fn), "%s/%s", logdir, outs[i]);
+		if (truncate(fn, 0) && (errno != ENOENT))
+			perror(fn);
+	}
+	children.clear();
+
+	char swarm_size[16];
+	snprintf(swarm_size, sizeof(swarm_size), "%u", n);
+	setenv("SSSIM_SWARM_SIZE", swarm_size, 1);
+
+	sockaddr_in env_addr = inet(SSS_ENV_ADDRESS).addr;
+	UDPclient env(&env_addr);
+	const char *failed = NULL;
+
+	const char *env_argv[] = {"env", "0", NULL};
+	if (!spawn("env.out", env_argv))
+		failed = "env";
+	for (const double t_end = now() + ENV_START_TIMEOUT; !failed && !env_ready(); usleep(POLL_INTERVAL))
+		if ((now() > t_end) || reap(0.0) || children.front().done)
+			failed = "env start";
+
+	const char *base_argv[] = {"base", NULL};
+	if (!failed && !(spawn("clients.out", base_argv) && wait_for_count(env, "NEW_BASE", 1, CLIENT_START_TIMEOUT)))
+		failed = "base start";
+
+	for (unsigned int i = 0; !failed && (i < n); ++i)
+	{
+		char density[16];
+		snprintf(density, sizeof(density), "%u", FLOAT_DENSITY_0 + i % FLOAT_DENSITIES);
+		const char *float_argv[] = {"float", density, NULL};
+		if (!(spawn("clients.out", float_argv) && wait_for_count(env, "NEW_FLOAT", i + 1, CLIENT_START_TIMEOUT)))
+			failed = "float start";
+	}
+
+	double wall_s = 0.0;
+	if (!failed)
+	{
+		const char msg = MSG_PLAY;
+		const double t0 = now();
+		if (env.send(&msg, 1) <= 0)
+			failed = "MSG_PLAY";
+		else
+		{
+			child_t &e = children.front();
+			int status = 0;
+			pid_t r = 0;
+			while ((r == 0) && (now() - t0 < wall_limit))
+				if ((r = wait4(e.pid, &status, WNOHANG, &e.ru)) == 0)
+					usleep(POLL_INTERVAL);
+			wall_s = now() - t0;
+			e.done = (r == e.pid);
+			if (r == 0)
+				failed = "env timeout";
+			else if (!e.done || !WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS))
+				failed = "env exit";
+		}
+	}
+
+	if (!failed && !reap(CLIENT_QUIT_TIMEOUT))
+		fprintf(stderr, "|| n=%u: clients still running, killing them\n", n);
+	kill_all();
+
+	unsigned long ticks = 0, dgrams = 0;
+	if (!failed && !read_stats(ticks, dgrams))
+		failed = "no " LOGDIR_SYMLINK "/" LOGFILE_STATS;
+	if (failed)
+	{
+		fprintf(stderr, "|| n=%u: failed at %s, see %s\n", n, failed, logdir);
+		fprintf(out, "%u\tfailed: %s\n", n, failed);
+		return false;
+	}
+
+	double float_cpu = 0.0, float_vcsw = 0.0, float_ivcsw = 0.0;
+	for (unsigned int i = 2; i < children.size(); ++i)
+	{
+		float_cpu += cpu_s(children[i].ru) / n;
+		float_vcsw += (double)children[i].ru.ru_nvcsw / n;
+		float_ivcsw += (double)children[i].ru.ru_nivcsw / n;
+	}
+	const rusage &env_ru = children[0].ru;
+	fprintf(out, "%u\t%lu\t%.3f\t%.1f\t%.2f\t%.3f\t%ld\t%ld\t%.3f\t%.3f\t%.0f\t%.0f\n", n, ticks, wall_s, ticks / wall_s,
+			(double)dgrams / ticks,
+			cpu_s(env_ru), env_ru.ru_nvcsw, env_ru.ru_nivcsw,
+			cpu_s(children[1].ru),
+			float_cpu, float_vcsw, float_ivcsw);
+	fflush(out);
+	fprintf(stderr, "|| n=%u: %lu s in %.2f s: %.1f × realtime\n", n, ticks, wall_s, ticks / wall_s);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	const char *counts = COUNTS_DEFAULT;
+	long run_time = RUN_TIME_DEFAULT;
+	double wall_limit = -1.0;
+	long seed = SEED_DEFAULT;
+	const char *out_fn = NULL;
+	int n_cpus = -1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:t:w:s:c:l:o:h")) != -1)
+		switch (opt)
+		{
+		case 'n':
+			counts = optarg;
+			break;
+		case 't':
+			run_time = atol(optarg);
+			break;
+		case 'w':
+			wall_limit = atof(optarg);
+			break;
+		case 's':
+			seed = atol(optarg);
+			break;
+		case 'c':
+			n_cpus = atoi(optarg);
+			break;
+		case 'l':
+			logdir = optarg;
+			break;
+		case 'o':
+			out_fn = optarg;
+			break;
+		default:
+			fprintf(stderr, USAGE, argv[0]);
+			exit(1);
+		}
+
+	std::vector<unsigned int> n;
+	for (const char *s = counts; s != NULL; s = strchr(s, ','), s = s ? s + 1 : NULL)
+		if (atoi(s) > 0)
+			n.push_back(atoi(s));
+	if (wall_limit < 0.0)
+		wall_limit = RUN_WALL_FACTOR * run_time + RUN_WALL_SLACK;
+	if (n.empty() || (run_time <= 0) || (wall_limit <= 0.0))
+	{
+		fprintf(stderr, USAGE, argv[0]);
+		exit(1);
+	}
+
+	if ((mkdirp(logdir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) < 0) && (errno != EEXIST))
+	{
+		perror(logdir);
+		exit(1);
+	}
+
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+		for (int c = 0; (c < CPU_SETSIZE) && ((n_cpus < 0) || ((int)cpus.size() < n_cpus)); ++c)
+			if (CPU_ISSET(c, &allowed))
+				cpus.push_back(c);
+
+	// for env & the clients, as set in their environment
+	char s[32];
+	snprintf(s, sizeof(s), "%ld", seed);
+	setenv("SSSIM_SEED", s, 1);
+	snprintf(s, sizeof(s), "%ld", run_time);
+	setenv("SSSIM_RUN_TIME", s, 1);
+	setenv("SSSIM_STATS_STEP", s, 1); // for the report at the end
+
+	FILE *out = out_fn ? fopen(out_fn, "w") : stdout;
+	if (out == NULL)
+	{
+		perror(out_fn);
+		exit(1);
+	}
+
+	fprintf(out, "# swarm-scale: seed %ld, %ld s of env_time per run, at most %.0f s of wall time, %u cpus pinned\n", seed, run_time, wall_limit, (unsigned int)cpus.size());
+	fprintf(out, "# n\tticks\twall_s\tspeed\tdgrams\tenv_cpu_s\tenv_vcsw\tenv_ivcsw\tbase_cpu_s\tfloat_cpu_s\tfloat_vcsw\tfloat_ivcsw\n");
+	fflush(out);
+
+	unsigned int failures = 0;
+	for (std::vector<unsigned int>::const_iterator it = n.begin(); it != n.end(); ++it)
+		if (!run(out, *it, wall_limit))
+			++failures;
+
+	if (out_fn && fclose(out))
+	{
+		perror(out_fn);
+		exit(1);
+	}
+	return failures ? 1 : 0;
+}
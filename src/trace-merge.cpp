@@ -0,0 +1,195 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Merges the traces of env & the clients of a run (see src/util-trace.h) into
+ * one Chrome trace, for chrome://tracing or ui.perfetto.dev. Without inputs,
+ * reads the *.trace.json files of logs/latest; writes to stdout, or with -o
+ * to a file.
+ *
+ * usage: trace-merge [-s] [-o output] [input ..]
+ *
+ * Each input becomes a process of its own. By default the events are laid on
+ * the wall clock, from the first of them; with -s, on simulation time instead,
+ * each second of it as long as its spans last, and with the wall-clock time
+ * of a span in the second measured from the first span of that second in any
+ * input. Spans over several seconds of simulation time, like sleep_until,
+ * then last just those seconds.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <glob.h>
+#include <unistd.h>
+
+#include "sssim.h"
+
+#define USAGE "usage: %s [-s] [-o output] [input ..]\n"
+#define TRACE_GLOB LOGDIR_SYMLINK "/*.trace.json"
+
+struct span_t
+{
+	std::string name, cat;
+	int pid, tid;
+	uint64_t ts, dur; // ns
+	uint32_t t0, t1;
+
+	bool operator<(const span_t &s2) const { return ts < s2.ts; }
+};
+
+struct meta_t
+{
+	std::string name, value;
+	int pid, tid;
+};
+
+//-----------------------------------------------------------------------------
+// the events of one trace, as written by util-trace; false if it can't be read
+static bool read_trace(const char *fn, int pid, std::vector<span_t> &spans, std::vector<meta_t> &meta)
+{
+	FILE *f = fopen(fn, "r");
+	if (f == NULL)
+		return false;
+
+	char line[512];
+	unsigned long n = 0;
+	while (fgets(line, sizeof(line), f))
+	{
+		const char *s = line + strspn(line, "[, \t");
+		char name[128], cat[64], value[128];
+		unsigned long long ts, dur;
+		unsigned int ts_ns, dur_ns;
+		int tid;
+		span_t sp;
+		meta_t m;
+		if (sscanf(s, "{\"name\":\"%127[^\"]\",\"cat\":\"%63[^\"]\",\"ph\":\"X\",\"ts\":%llu.%u,\"dur\":%llu.%u,\"pid\":%*d,\"tid\":%d,\"args\":{\"t0\":%u,\"t1\":%u}}",
+				   name, cat, &ts, &ts_ns, &dur, &dur_ns, &tid, &sp.t0, &sp.t1) == 9)
+		{
+			sp.name = name;
+			sp.cat = cat;
+			sp.pid = pid;
+			sp.tid = tid;
+			sp.ts = ts * 1000 + ts_ns;
+			sp.dur = dur * 1000 + dur_ns;
+			spans.push_back(sp);
+			++n;
+		}
+		else if (sscanf(s, "{\"name\":\"%127[^\"]\",\"ph\":\"M\",\"pid\":%*d,\"tid\":%d,\"args\":{\"name\":\"%127[^\"]\"}}", name, &tid, value) == 3)
+		{
+			m.name = name;
+			m.value = value;
+			m.pid = pid;
+			m.tid = tid;
+			meta.push_back(m);
+		}
+	}
+	fclose(f);
+	fprintf(stderr, "%s: %lu spans\n", fn, n);
+	return true;
+}
+
+static void print_us(FILE *f, const char *key, uint64_t ns)
+{
+	fprintf(f, ",\"%s\":%llu.%03u", key, (unsigned long long)(ns / 1000), (unsigned int)(ns % 1000));
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	bool sim_axis = false;
+	const char *out_fn = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "so:h")) != -1)
+		switch (opt)
+		{
+		case 's':
+			sim_axis = true;
+			break;
+		case 'o':
+			out_fn = optarg;
+			break;
+		default:
+			fprintf(stderr, USAGE, argv[0]);
+			exit(1);
+		}
+
+	std::vector<std::string> inputs(argv + optind, argv + argc);
+	if (inputs.empty())
+	{
+		glob_t g;
+		if (glob(TRACE_GLOB, 0, NULL, &g) == 0)
+			inputs.assign(g.gl_pathv, g.gl_pathv + g.gl_pathc);
+		globfree(&g);
+	}
+	if (inputs.empty())
+	{
+		fprintf(stderr, "%s: no traces; run with SSSIM_TRACE=1\n", argv[0]);
+		exit(1);
+	}
+
+	std::vector<span_t> spans;
+	std::vector<meta_t> meta;
+	for (size_t i = 0; i < inputs.size(); ++i)
+		if (!read_trace(inputs[i].c_str(), i + 1, spans, meta))
+			perror(inputs[i].c_str());
+	if (spans.empty())
+		exit(1);
+	std::stable_sort(spans.begin(), spans.end());
+
+	// the start of the axis, and with -s the start of each second of simulation time
+	const uint64_t ts_0 = spans.front().ts;
+	uint32_t t_0 = ~(uint32_t)0;
+	std::map<uint32_t, uint64_t> second_ts;
+	for (std::vector<span_t>::const_iterator it = spans.begin(); it != spans.end(); ++it)
+	{
+		if (it->t0 < t_0)
+			t_0 = it->t0;
+		if (!second_ts.count(it->t0))
+			second_ts[it->t0] = it->ts;
+	}
+
+	FILE *out = out_fn ? fopen(out_fn, "w") : stdout;
+	if (out == NULL)
+	{
+		perror(out_fn);
+		exit(1);
+	}
+
+	fprintf(out, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < inputs.size(); ++i)
+		fprintf(out, "{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,\"args\":{\"sort_index\":%u}},\n", (unsigned int)i + 1, (unsigned int)i + 1);
+	for (std::vector<meta_t>::const_iterator it = meta.begin(); it != meta.end(); ++it)
+		fprintf(out, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n", it->name.c_str(), it->pid, it->tid, it->value.c_str());
+
+	for (std::vector<span_t>::const_iterator it = spans.begin(); it != spans.end(); ++it)
+	{
+		uint64_t ts = it->ts - ts_0, dur = it->dur;
+		if (sim_axis)
+		{
+			ts = (it->t0 - t_0) * 1000000000ULL + (it->ts - second_ts[it->t0]);
+			if (it->t1 > it->t0)
+				dur = (it->t1 - it->t0) * 1000000000ULL;
+		}
+		fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\"", (it == spans.begin()) ? "" : ",\n", it->name.c_str(), it->cat.c_str());
+		print_us(out, "ts", ts);
+		print_us(out, "dur", dur);
+		fprintf(out, ",\"pid\":%d,\"tid\":%d,\"args\":{\"t0\":%u,\"t1\":%u}}", it->pid, it->tid, it->t0, it->t1);
+	}
+	fprintf(out, "\n],\n\"displayTimeUnit\":\"ms\"}\n");
+
+	if (out_fn && fclose(out))
+	{
+		perror(out_fn);
+		exit(1);
+	}
+	fprintf(stderr, "%lu spans of %lu traces\n", (unsigned long)spans.size(), (unsigned long)inputs.size());
+	return 0;
+}
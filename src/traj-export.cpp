@@ -0,0 +1,165 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Exports a trajectory log (see src/traj-log.h) as CSV, or as netCDF if the
+ * output name ends in ".nc". Without an output, the CSV goes to stdout.
+ *
+ * usage: traj-export [-t from,to] [-i id,..] input [output]
+ *
+ * -t limits the records to simulation times from..to (s), inclusive;
+ * -i to the given float ids.
+ */
+
+#include <deque>
+#include <vector>
+#include <set>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <netcdfcpp.h>
+
+#include "traj-log.h"
+
+static const char *csv_header = "t,id,x,y,z,vx,vy,vz,volume,bottom_depth";
+
+//-----------------------------------------------------------------------------
+static bool write_csv(FILE *f, const std::vector<traj_record_t> &records)
+{
+	fprintf(f, "%s\n", csv_header);
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const traj_record_t &r = records[i];
+		fprintf(f, "%u,%d,%.3f,%.3f,%.3f,%.6f,%.6f,%.6f,%.9g,%.3f\n",
+				r.t, r.id, r.pos[0], r.pos[1], r.pos[2], r.vel[0], r.vel[1], r.vel[2], r.volume, r.bottom_depth);
+	}
+	return !ferror(f);
+}
+
+// one value of every record per variable, along a "record" dimension
+static bool write_nc(const char *fn, const std::vector<traj_record_t> &records, uint32_t step)
+{
+	NcError err(NcError::verbose_nonfatal);
+	NcFile nc(fn, NcFile::Replace);
+	if (!nc.is_valid())
+		return false;
+
+	const long n = records.size();
+	nc.add_att("title", "SeaSwarmSim float trajectories");
+	nc.add_att("step", (int)step);
+	NcDim *rec = nc.add_dim("record", n);
+
+	std::vector<int> iv(n);
+	std::vector<double> dv(n);
+	bool ok = true;
+
+	NcVar *v = nc.add_var("t", ncInt, rec);
+	v->add_att("units", "s");
+	for (long i = 0; i < n; ++i)
+		iv[i] = records[i].t;
+	ok = ok && v->put(n ? &iv[0] : NULL, n);
+
+	v = nc.add_var("id", ncInt, rec);
+	for (long i = 0; i < n; ++i)
+		iv[i] = records[i].id;
+	ok = ok && v->put(n ? &iv[0] : NULL, n);
+
+	static const char *names[8] = {"x", "y", "z", "vx", "vy", "vz", "volume", "bottom_depth"};
+	static const char *units[8] = {"m", "m", "m", "m/s", "m/s", "m/s", "m3", "m"};
+	for (unsigned int k = 0; k < 8; ++k)
+	{
+		v = nc.add_var(names[k], ncDouble, rec);
+		v->add_att("units", units[k]);
+		for (long i = 0; i < n; ++i)
+		{
+			const traj_record_t &r = records[i];
+			dv[i] = (k < 3) ? r.pos[k] : (k < 6) ? r.vel[k - 3] : (k == 6) ? r.volume : r.bottom_depth;
+		}
+		ok = ok && v->put(n ? &dv[0] : NULL, n);
+	}
+
+	return ok && nc.close();
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	uint32_t t0 = 0, t1 = ~(uint32_t)0;
+	std::set<int> ids;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:i:h")) != -1)
+		switch (opt)
+		{
+		case 't':
+			if (sscanf(optarg, "%u,%u", &t0, &t1) != 2)
+			{
+				fprintf(stderr, "%s: bad time range %s\n", argv[0], optarg);
+				exit(1);
+			}
+			break;
+		case 'i':
+			for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ","))
+				ids.insert(atoi(s));
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t from,to] [-i id,..] input [output]\n", argv[0]);
+			exit(1);
+		}
+	if ((optind != argc - 1) && (optind != argc - 2))
+	{
+		fprintf(stderr, "usage: %s [-t from,to] [-i id,..] input [output]\n", argv[0]);
+		exit(1);
+	}
+	const char *in_fn = argv[optind];
+	const char *out_fn = (optind == argc - 2) ? argv[optind + 1] : NULL;
+
+	TrajReader log;
+	if (!log.open(in_fn))
+	{
+		fprintf(stderr, "%s: not a trajectory log\n", in_fn);
+		exit(1);
+	}
+
+	std::vector<traj_record_t> records;
+	if (!log.read(t0, t1, records))
+	{
+		fprintf(stderr, "%s: read failed\n", in_fn);
+		exit(1);
+	}
+	if (!ids.empty())
+	{
+		size_t k = 0;
+		for (size_t i = 0; i < records.size(); ++i)
+			if (ids.count(records[i].id))
+				records[k++] = records[i];
+		records.resize(k);
+	}
+
+	const size_t len = out_fn ? strlen(out_fn) : 0;
+	bool ok;
+	if ((len > 3) && !strcmp(out_fn + len - 3, ".nc"))
+		ok = write_nc(out_fn, records, log.hdr.step);
+	else if (out_fn && strcmp(out_fn, "-"))
+	{
+		FILE *f = fopen(out_fn, "w");
+		ok = f && write_csv(f, records);
+		ok = f && !fclose(f) && ok;
+	}
+	else
+		ok = write_csv(stdout, records);
+
+	if (!ok)
+	{
+		fprintf(stderr, "%s: write failed\n", out_fn ? out_fn : "stdout");
+		exit(1);
+	}
+	fprintf(stderr, "%zu records from %u chunks\n", records.size(), log.chunks());
+	return 0;
+}
@@ -0,0 +1,309 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "traj-log.h"
+
+
+// the columns of a chunk, as the fields of traj_record_t
+struct traj_column_t {
+	size_t offset, size;
+};
+
+static const traj_column_t columns[] = {
+	{ offsetof(traj_record_t, t), sizeof(uint32_t) },
+	{ offsetof(traj_record_t, id), sizeof(int32_t) },
+	{ offsetof(traj_record_t, pos), sizeof(double) },
+	{ offsetof(traj_record_t, pos) + sizeof(double), sizeof(double) },
+	{ offsetof(traj_record_t, pos) + 2 * sizeof(double), sizeof(double) },
+	{ offsetof(traj_record_t, vel), sizeof(double) },
+	{ offsetof(traj_record_t, vel) + sizeof(double), sizeof(double) },
+	{ offsetof(traj_record_t, vel) + 2 * sizeof(double), sizeof(double) },
+	{ offsetof(traj_record_t, volume), sizeof(double) },
+	{ offsetof(traj_record_t, bottom_depth), sizeof(double) }
+};
+static const unsigned int n_columns = sizeof(columns) / sizeof(columns[0]);
+
+static size_t row_bytes() {
+	size_t n = 0;
+	for (unsigned int c = 0; c < n_columns; ++c) n += columns[c].size;
+	return n;
+}
+
+static bool pread_all(int fd, void * buf, size_t len, off_t offset) {
+	char * p = reinterpret_cast<char *>(buf);
+	while (len > 0) {
+		const ssize_t r = pread(fd, p, len, offset);
+		if (r <= 0) return false;
+		p += r;
+		len -= r;
+		offset += r;
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+TrajWriter::TrajWriter() : file(NULL), rows(NULL), index(), queue(), quit(false) {
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&queue_cond, NULL);
+}
+
+TrajWriter::~TrajWriter() {
+	close();
+	pthread_cond_destroy(&queue_cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+bool TrajWriter::open(const char * fn, uint32_t step) {
+	close();
+
+	file = fopen(fn, "wb");
+	if (file == NULL) return false;
+
+	traj_header_t hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRAJ_MAGIC, sizeof(hdr.magic));
+	hdr.step = step;
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1) {
+		fclose(file);
+		file = NULL;
+		return false;
+	}
+
+	index.clear();
+	rows = new std::vector<traj_record_t>();
+	rows->reserve(TRAJ_CHUNK_ROWS);
+	quit = false;
+	if (pthread_create(&thread, NULL, &writer_thread, this)) {
+		delete rows;
+		rows = NULL;
+		fclose(file);
+		file = NULL;
+		return false;
+	}
+	return true;
+}
+
+void TrajWriter::add(const traj_record_t & r) {
+	if (file == NULL) return;
+
+	rows->push_back(r);
+	if (rows->size() < TRAJ_CHUNK_ROWS) return;
+
+	pthread_mutex_lock(&mutex);
+	queue.push_back(rows);
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&mutex);
+
+	rows = new std::vector<traj_record_t>();
+	rows->reserve(TRAJ_CHUNK_ROWS);
+}
+
+void TrajWriter::close() {
+	if (file == NULL) return;
+
+	pthread_mutex_lock(&mutex);
+	if (rows->empty()) delete rows;
+	else queue.push_back(rows);
+	rows = NULL;
+	quit = true;
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(thread, NULL);
+
+	traj_footer_t footer;
+	memset(&footer, 0, sizeof(footer));
+	footer.index_offset = ftello(file);
+	footer.n_chunks = index.size();
+	memcpy(footer.magic, TRAJ_INDEX_MAGIC, sizeof(footer.magic));
+	if (!index.empty()) fwrite(&index[0], sizeof(traj_chunk_t), index.size(), file);
+	fwrite(&footer, sizeof(footer), 1, file);
+
+	fclose(file);
+	file = NULL;
+}
+
+void TrajWriter::write(const std::vector<traj_record_t> & chunk) {
+	std::vector<unsigned char> packed;
+	TrajReader::pack(&chunk[0], chunk.size(), packed, TRAJ_LEVEL);
+
+	traj_chunk_t c;
+	memset(&c, 0, sizeof(c));
+	c.rows = chunk.size();
+	c.t0 = chunk.front().t;
+	c.t1 = chunk.back().t;
+	c.offset = ftello(file) + sizeof(c);
+	c.size = packed.size();
+
+	// flushed whole, so that a reader of a running or crashed log sees only
+	// complete chunks
+	if ((fwrite(&c, sizeof(c), 1, file) != 1) || (fwrite(&packed[0], 1, packed.size(), file) != packed.size()) || fflush(file)) {
+		perror("TrajWriter::write");
+		return;
+	}
+	index.push_back(c);
+}
+
+void * TrajWriter::writer_thread(void * arg) {
+	TrajWriter * w = reinterpret_cast<TrajWriter *>(arg);
+
+	pthread_mutex_lock(&w->mutex);
+	for (;;) {
+		while (w->queue.empty() && !w->quit) pthread_cond_wait(&w->queue_cond, &w->mutex);
+		if (w->queue.empty()) break;
+
+		std::vector<traj_record_t> * chunk = w->queue.front();
+		w->queue.pop_front();
+		pthread_mutex_unlock(&w->mutex);
+
+		w->write(*chunk);
+		delete chunk;
+
+		pthread_mutex_lock(&w->mutex);
+	}
+	pthread_mutex_unlock(&w->mutex);
+
+	return NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+bool TrajReader::open(const char * fn) {
+	close();
+
+	fd = ::open(fn, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if ((fstat(fd, &st) != 0)
+	    || !pread_all(fd, &hdr, sizeof(hdr), 0)
+	    || memcmp(hdr.magic, TRAJ_MAGIC, sizeof(hdr.magic))) {
+		close();
+		return false;
+	}
+
+	traj_footer_t footer;
+	if ((st.st_size >= (off_t)(sizeof(hdr) + sizeof(footer)))
+	    && pread_all(fd, &footer, sizeof(footer), st.st_size - sizeof(footer))
+	    && !memcmp(footer.magic, TRAJ_INDEX_MAGIC, sizeof(footer.magic))
+	    && (footer.index_offset + footer.n_chunks * sizeof(traj_chunk_t) + sizeof(footer) == (uint64_t)st.st_size)) {
+		index.resize(footer.n_chunks);
+		if (index.empty() || pread_all(fd, &index[0], index.size() * sizeof(traj_chunk_t), footer.index_offset))
+			return true;
+	}
+
+	// no index: the run is still going, or didn't end cleanly
+	if (!scan(st.st_size)) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool TrajReader::scan(off_t size) {
+	index.clear();
+	off_t pos = sizeof(hdr);
+	traj_chunk_t c;
+	while ((pos + (off_t)sizeof(c) <= size) && pread_all(fd, &c, sizeof(c), pos)) {
+		if ((c.offset != pos + sizeof(c)) || (c.offset + c.size > (uint64_t)size) || !c.rows || (c.t1 < c.t0))
+			break;
+		index.push_back(c);
+		pos = c.offset + c.size;
+	}
+	return true;
+}
+
+void TrajReader::close() {
+	if (fd >= 0) ::close(fd);
+	fd = -1;
+	index.clear();
+}
+
+
+//-----------------------------------------------------------------------------
+static bool chunk_before(const traj_chunk_t & c, uint32_t t) { return c.t1 < t; }
+
+unsigned int TrajReader::find(uint32_t t) const {
+	return std::lower_bound(index.begin(), index.end(), t, chunk_before) - index.begin();
+}
+
+bool TrajReader::read(unsigned int i, std::vector<traj_record_t> & records) const {
+	if ((fd < 0) || (i >= index.size())) return false;
+
+	const traj_chunk_t & c = index[i];
+	std::vector<unsigned char> buf(c.size);
+	if (!pread_all(fd, &buf[0], c.size, c.offset)) return false;
+
+	const size_t n = records.size();
+	records.resize(n + c.rows);
+	if (!unpack(&buf[0], buf.size(), &records[n], c.rows)) {
+		records.resize(n);
+		return false;
+	}
+	return true;
+}
+
+bool TrajReader::read(uint32_t t0, uint32_t t1, std::vector<traj_record_t> & records) const {
+	for (unsigned int i = find(t0); (i < index.size()) && (index[i].t0 <= t1); ++i) {
+		const size_t n = records.size();
+		if (!read(i, records)) return false;
+		if ((index[i].t0 < t0) || (index[i].t1 > t1)) {
+			size_t k = n;
+			for (size_t j = n; j < records.size(); ++j)
+				if ((records[j].t >= t0) && (records[j].t <= t1)) records[k++] = records[j];
+			records.resize(k);
+		}
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// each column byte-shuffled as the sea tiles: byte k of row i goes to k * n + i
+void TrajReader::pack(const traj_record_t * records, size_t n, std::vector<unsigned char> & out, int level) {
+	std::vector<unsigned char> shuffled(n * row_bytes());
+	unsigned char * dst = &shuffled[0];
+	for (unsigned int c = 0; c < n_columns; ++c) {
+		const unsigned char * src = reinterpret_cast<const unsigned char *>(records) + columns[c].offset;
+		for (size_t k = 0; k < columns[c].size; ++k)
+			for (size_t i = 0; i < n; ++i)
+				*dst++ = src[i * sizeof(traj_record_t) + k];
+	}
+
+	uLongf len = compressBound(shuffled.size());
+	out.resize(len);
+	if (compress2(&out[0], &len, &shuffled[0], shuffled.size(), level) != Z_OK) len = 0;
+	out.resize(len);
+}
+
+bool TrajReader::unpack(const unsigned char * in, size_t in_size, traj_record_t * records, size_t n) {
+	std::vector<unsigned char> shuffled(n * row_bytes());
+	uLongf len = shuffled.size();
+	if ((uncompress(&shuffled[0], &len, in, in_size) != Z_OK) || (len != shuffled.size())) return false;
+
+	memset(records, 0, n * sizeof(traj_record_t));
+	const unsigned char * src = &shuffled[0];
+	for (unsigned int c = 0; c < n_columns; ++c) {
+		unsigned char * dst = reinterpret_cast<unsigned char *>(records) + columns[c].offset;
+		for (size_t k = 0; k < columns[c].size; ++k)
+			for (size_t i = 0; i < n; ++i)
+				dst[i * sizeof(traj_record_t) + k] = *src++;
+	}
+	return true;
+}
@@ -0,0 +1,132 @@
+#ifndef _traj_log_h
+#define _traj_log_h
+
+/* requires:
+	#include <deque>
+	#include <vector>
+	#include <cstdio>
+	#include <stdint.h>
+	#include <pthread.h>
+	#include <sys/types.h>
+*/
+
+/**
+ * Binary, column-oriented log of the float trajectories
+ *
+ * Written by env from the simulated floats as the ground truth of a run, and
+ * read back with TrajReader or exported with bin/traj-export. Records are
+ * collected into chunks of up to TRAJ_CHUNK_ROWS, each stored column by column,
+ * byte-shuffled & deflated, as the sea tiles. The chunks are in time order, and
+ * an index at the end of the file lets readers seek to a time; if the run dies
+ * before the index is written, readers rebuild it from the chunk headers.
+ *
+ * File layout, native byte order:
+ *   traj_header_t
+ *   { traj_chunk_t, deflated columns } for each chunk
+ *   traj_chunk_t [n_chunks]           index
+ *   traj_footer_t
+ *
+ * The columns of a chunk are those of traj_record_t, in order, each rows long.
+ */
+
+#define  TRAJ_MAGIC        "SSSTRAJ1"
+#define  TRAJ_INDEX_MAGIC  "SSSTRIDX"
+#define  TRAJ_CHUNK_ROWS   4096
+#define  TRAJ_LEVEL        6	// zlib compression level
+
+struct traj_record_t {
+	uint32_t t;	// seconds
+	int32_t id;	// as in the float logs
+	double pos[3], vel[3];	// m, m/s; depth positive down
+	double volume;	// m^3
+	double bottom_depth;	// m
+};
+
+struct traj_header_t {
+	char magic[8];
+	uint32_t step;	// s between records of a float, as logged
+	uint32_t reserved;
+};
+
+struct traj_chunk_t {
+	uint32_t rows;
+	uint32_t t0, t1;	// of the first & last record
+	uint32_t reserved;
+	uint64_t offset, size;	// of the deflated columns, bytes
+};
+
+struct traj_footer_t {
+	uint64_t index_offset;
+	uint32_t n_chunks, reserved;
+	char magic[8];
+};
+
+
+//-----------------------------------------------------------------------------
+// Records are added from one thread; the chunks are packed & written by a
+// background thread.
+class TrajWriter {
+	public:
+		TrajWriter();
+		~TrajWriter();
+
+		bool open(const char * fn, uint32_t step);
+		bool is_open() const { return file != NULL; }
+		void close();	// writes the last chunk & the index
+
+		void add(const traj_record_t & r);	// in order of time
+
+	private:
+		FILE * file;
+		std::vector<traj_record_t> * rows;	// the chunk being filled
+		std::vector<traj_chunk_t> index;	// writer thread only
+
+		pthread_mutex_t mutex;
+		pthread_cond_t queue_cond;
+		pthread_t thread;
+		std::deque<std::vector<traj_record_t> *> queue;
+		bool quit;
+
+		void write(const std::vector<traj_record_t> & chunk);
+		static void * writer_thread(void * arg);
+
+		TrajWriter(const TrajWriter &);
+		TrajWriter & operator=(const TrajWriter &);
+};
+
+
+//-----------------------------------------------------------------------------
+class TrajReader {
+	public:
+		traj_header_t hdr;
+
+		TrajReader() : hdr(), index(), fd(-1) {}
+		~TrajReader() { close(); }
+
+		bool open(const char * fn);
+		void close();
+
+		unsigned int chunks() const { return index.size(); }
+		const traj_chunk_t & chunk(unsigned int i) const { return index[i]; }
+		unsigned int find(uint32_t t) const;	// first chunk with records at or after t
+
+		// appends the records of a chunk, or of all chunks from t0 to t1,
+		// inclusive; thread-safe
+		bool read(unsigned int i, std::vector<traj_record_t> & records) const;
+		bool read(uint32_t t0, uint32_t t1, std::vector<traj_record_t> & records) const;
+
+		// for writers
+		static void pack(const traj_record_t * records, size_t n, std::vector<unsigned char> & out, int level);
+		static bool unpack(const unsigned char * in, size_t in_size, traj_record_t * records, size_t n);
+
+	private:
+		std::vector<traj_chunk_t> index;
+		int fd;
+
+		bool scan(off_t size);	// index from the chunk headers
+
+		TrajReader(const TrajReader &);
+		TrajReader & operator=(const TrajReader &);
+};
+
+#endif // _traj_log_h
@@ -41,12 +41,12 @@ inline double salinity_ratio_temp( double T ) {
 }
 
 // R_2 = sqrt(Rt)
-double salinity_RT( double R_2, double T ) {
+static inline double salinity_RT( double R_2, double T ) {
 	double a = 0.0080 + R_2 * ( -0.1692 + R_2 * ( 25.3851 + R_2 * ( 14.0941 + R_2 * ( -7.0261 + R_2 *  2.7081 ) ) ) );
 	double b = 0.0005 + R_2 * ( -0.0056 + R_2 * ( -0.0066 + R_2 * ( -0.0375 + R_2 * (  0.0636 + R_2 * -0.0144 ) ) ) );
 	return ( a + b * (T-15) / ( 1 + (T-15) * 0.0162 ) );
 }
-double deriv_salinity_RT( double R_2, double T ) {
+static inline double deriv_salinity_RT( double R_2, double T ) {
 	double a = -0.1692 + R_2 * ( 50.7702 + R_2 * ( 42.2823 + R_2 * ( -28.1044 + R_2 * 13.5405 ) ) );
 	double b = -0.0056 + R_2 * ( -0.0132 + R_2 * ( -0.1125 + R_2 * (   0.2544 + R_2 * -0.0720 ) ) );
 	return ( a + b * (T-15) / ( 1 + (T-15) * 0.0162 ) );
@@ -54,22 +54,26 @@ double deriv_salinity_RT( double R_2, double T ) {
 
 // in: conductivity (mS/cm), temperature (ITS-90), gauge pressure (millibar)
 // out: salinity (PSS-78)
-double salinity_from_CTD( double conduct, double temp, unsigned int pressure ) {
+static inline double _salinity_from_CTD( double conduct, double temp, double pressure ) {
 	double
 		T = temp * CONVERT_ITS90_TO_IPTS68,
-		P = (double)pressure * 1e-2,	// decibar
+		P = pressure * 1e-2,	// decibar
 		R = conduct / 42.9140,	// raw conductivity ratio, wrt S 35, temp 15, depth 0
 		Rp;
 
-	if ( R < 0.0005 ) return 0.0;
-
 	// pressure correction
 	Rp = 1 + (
 		P * ( 2.07e-5 + P * ( -6.37e-10 + P * 3.989e-15 ) ) /
 		( 1 + R * 0.4215 + T * ( 3.426e-2 + T * 4.464e-4 + R * -3.107e-3 ) )
 	);
 
-	return salinity_RT( sqrt( R / ( Rp * salinity_ratio_temp(T) ) ), T );
+	double S = salinity_RT( sqrt( fabs( R / ( Rp * salinity_ratio_temp(T) ) ) ), T );
+	return ( R < 0.0005 ) ? 0.0 : S;
+}
+
+double salinity_from_CTD( double conduct, double temp, unsigned int pressure ) {
+	if ( conduct / 42.9140 < 0.0005 ) return 0.0;
+	return _salinity_from_CTD( conduct, temp, pressure );
 }
 
 // in: salinity (PSS-78), temperature (ITS-90), gauge pressure (millibar)
@@ -110,10 +114,10 @@ double conductivity_from_STD( double S, double temp, unsigned int pressure ) {
  *	in: Salinity (PSS-78), temperature (ITS-90), gauge pressure (millibar)
  *	out: density (kg/m^3)
  */
-double density_from_STD( double S, double temp, unsigned int pressure ) {
+static inline double _density_from_STD( double S, double temp, double pressure ) {
 	double
 		T = temp * CONVERT_ITS90_TO_IPTS68,
-		P = (double)pressure * 1e-3,	// bar
+		P = pressure * 1e-3,	// bar
 		S_2 = sqrt(S),
 		rho_0 = 999.842594 +
 			T * ( 6.793952e-02 + T * ( -9.09529e-03 + T * ( 1.001685e-04 + T * ( -1.120083e-06 + T * 6.536332e-09 ) ) ) ) +	// pure water
@@ -171,6 +175,10 @@ double density_from_STD( double S, double temp, unsigned int pressure ) {
 */
 }
 
+double density_from_STD( double S, double temp, unsigned int pressure ) {
+	return _density_from_STD( S, temp, pressure );
+}
+
 
 // wrapper for salinity_from_CTD and density_from_STD
 // in: conductivity (mS/cm), temperature (ITS-90), gauge pressure (millibar)
@@ -188,8 +196,8 @@ double density_from_CTD(double conduct, double temp, unsigned int pressure) {
  *	in: Salinity (PSS-78), temperature (ITS-90), gauge pressure (millibar)
  *	out: sound speed (m/s)
  */
-double soundspeed_from_STD( double S, double temp, unsigned int pressure ) {
-	double P = (double)pressure * 1e-3;	// bar
+static inline double _soundspeed_from_STD( double S, double temp, double pressure ) {
+	double P = pressure * 1e-3;	// bar
 
 	double a =	 1402.388  + temp * (  5.03830    + temp * ( -5.8109e-2 + temp * (  3.3432e-4  + temp * ( -1.47797e-6 + temp * 3.1419e-9 ) ) ) )
 	    + P * (  0.153563  + temp * (  6.8999e-4  + temp * ( -8.1829e-6 + temp * (  1.3632e-7  + temp * -6.1260e-10 ) ) )
@@ -230,3 +238,37 @@ void soundspeed_temp_terms( double t[], double temp ) {
 		)
 	);*/
 }
+
+double soundspeed_from_STD( double S, double temp, unsigned int pressure ) {
+	return _soundspeed_from_STD( S, temp, pressure );
+}
+
+
+/*	batch versions
+ *
+ *	Each element goes through the same inline kernel as the scalar functions,
+ *	so with IEEE semantics kept (no -ffast-math, no FMA contraction) every
+ *	result is bit-identical to the scalar one. The loops have no branches or
+ *	calls apart from sqrt, for the compiler to vectorise; see the
+ *	util-convert.opp flags in the Makefile.
+ */
+void salinity_from_CTD_n( const double * conduct, const double * temp, const unsigned int * pressure, double * S, unsigned int n ) {
+	for ( unsigned int i = 0; i < n; ++i )
+		S[i] = _salinity_from_CTD( conduct[i], temp[i], (int)pressure[i] );
+}
+
+void density_from_STD_n( const double * S, const double * temp, const unsigned int * pressure, double * rho, unsigned int n ) {
+	for ( unsigned int i = 0; i < n; ++i )
+		rho[i] = _density_from_STD( S[i], temp[i], (int)pressure[i] );
+}
+
+void soundspeed_from_STD_n( const double * S, const double * temp, const unsigned int * pressure, double * ss, unsigned int n ) {
+	for ( unsigned int i = 0; i < n; ++i )
+		ss[i] = _soundspeed_from_STD( S[i], temp[i], (int)pressure[i] );
+}
+
+// Newton iteration, element by element
+void conductivity_from_STD_n( const double * S, const double * temp, const unsigned int * pressure, double * conduct, unsigned int n ) {
+	for ( unsigned int i = 0; i < n; ++i )
+		conduct[i] = conductivity_from_STD( S[i], temp[i], pressure[i] );
+}
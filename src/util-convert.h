@@ -86,6 +86,20 @@ double density_from_CTD(double conduct, double temp, unsigned int pressure);
 double soundspeed_from_STD( double S, double temp, unsigned int pressure );
 
 
+/**
+ * Batch versions of salinity_from_CTD, density_from_STD, soundspeed_from_STD
+ * & conductivity_from_STD for n values; out[i] = f(a[i], b[i], pressure[i])
+ *
+ * Results are bit-identical to the scalar functions; all but the
+ * conductivity are written to be vectorised by the compiler.
+ * See bench-convert for timings.
+ */
+void salinity_from_CTD_n( const double * conduct, const double * temp, const unsigned int * pressure, double * S, unsigned int n );
+void density_from_STD_n( const double * S, const double * temp, const unsigned int * pressure, double * rho, unsigned int n );
+void soundspeed_from_STD_n( const double * S, const double * temp, const unsigned int * pressure, double * ss, unsigned int n );
+void conductivity_from_STD_n( const double * S, const double * temp, const unsigned int * pressure, double * conduct, unsigned int n );
+
+
 /* Potential temperature calculations
  *
  * simple:
@@ -45,7 +45,7 @@ class HistoryBuffer {
 //-----------------------------------------------------------------------------
 // all inputs in [0,1]
 // algorithm from http://en.wikipedia.org/wiki/HSL_color_space
-void util_HSL_to_RGB( GLdouble * rgb, const GLdouble h, const GLdouble s, const GLdouble l ) {
+inline void util_HSL_to_RGB( GLdouble * rgb, const GLdouble h, const GLdouble s, const GLdouble l ) {
 	GLdouble
 		q = ( l < 0.5 ) ? l * ( 1 + s ) : l + s - (l*s),
 		p = 2*l - q;
@@ -64,7 +64,7 @@ void util_HSL_to_RGB( GLdouble * rgb, const GLdouble h, const GLdouble s, const
 	}
 }
 
-void glColor_depth( const double depth, const double surface_value, const double opac = 1.0 ) {
+inline void glColor_depth( const double depth, const double surface_value, const double opac = 1.0 ) {
 	if ( depth < 1.05 ) glColor4d(surface_value, surface_value, surface_value, opac);
 	else {
 		GLdouble rgb[4];
@@ -76,7 +76,7 @@ void glColor_depth( const double depth, const double surface_value, const double
 
 
 //-----------------------------------------------------------------------------
-void drawOrigo( Vec3 pos ) {
+inline void drawOrigo( Vec3 pos ) {
 	glPushMatrix();
 		glTranslated( EL3(pos) );
 		glBegin(GL_LINES);
@@ -87,7 +87,7 @@ void drawOrigo( Vec3 pos ) {
 	glPopMatrix();
 }
 
-void drawCharArray( char * s, int x, int y ) {
+inline void drawCharArray( char * s, int x, int y ) {
 	for ( char * c = s; *c; ++c ) {
 		glRasterPos2f( x, y );
 		glutBitmapCharacter( GLUT_BITMAP_HELVETICA_10, *c );
@@ -26,6 +26,16 @@ void LeastSquaresTracker::remove(double t, double v) {
 	s_tv -= t*v;
 }
 
+void LeastSquaresTracker::remove_sums(unsigned int m, double m_t, double m_t2, double m_v, double m_v2, double m_tv) {
+	if (m > n) m = n;
+	n -= m;
+	s_t -= m_t;
+	s_t2 -= m_t2;
+	s_v -= m_v;
+	s_v2 -= m_v2;
+	s_tv -= m_tv;
+}
+
 void LeastSquaresTracker::reset() {
 	n = 0;
 	t0 = 0.0;
@@ -21,6 +21,7 @@ class LeastSquaresTracker {
 	public:
 		void add(double t, double v);
 		void remove(double t, double v);
+		void remove_sums(unsigned int m, double m_t, double m_t2, double m_v, double m_v2, double m_tv); // m points, t already relative to t0
 		void reset();
 		bool get_state(double & a, double & b, double & s2) const;  // Expected(v) = a + b * t; s2 is the sample variance
 };
@@ -19,7 +19,7 @@ int mkdirp(const char * path, mode_t mode) {
 
 	for (char * p = _path + 1; *p; ++p) if (*p == '/') {
 		*p = '\0';
-		if (mkdir(_path,  mode) < 0) return -1;
+		if ((mkdir(_path,  mode) < 0) && (errno != EEXIST)) return -1;
 		*p = '/';
 	}
 	return mkdir(_path,  mode);
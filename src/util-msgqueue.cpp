@@ -3,13 +3,13 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
 #include <stdint.h>
-#include <queue>
+#include <atomic>
 #include <pthread.h>
-
-#ifndef _sssim_h
-	typedef uint32_t simtime_t;
-#endif
+#include <unistd.h>
 
 #include "util-msgqueue.h"
 
@@ -17,80 +17,171 @@
 // NOTE/FIXME: queues are sorted by order of insertion, so out-of-order
 //             reception behaviour isn't.
 
-// FIXME: should use lock-free code:
-//			http://www.drdobbs.com/high-performance-computing/210604448	
-//			http://www.ddj.com/cpp/211601363
+// Slot hand-over follows D. Vyukov's bounded MPMC queue: a slot with
+// seq == pos is free for the producer claiming pos, seq == pos + 1 holds
+// a message for the consumer at pos.
 
 //-----------------------------------------------------------------------------
-msg_queue::msg_queue():
+msg_queue::msg_queue(size_t capacity, msg_queue_policy _policy):
+	slots(NULL),
+	mask(0),
 	max_length(-1),
-	queue(),
+	policy(_policy),
+	head(0),
+	tail(0),
+	n_dropped(0),
+	waiting(false),
 	mutex(),
 	push_cond()
-{ 
+{
+	set_capacity(capacity);
+
 	pthread_mutex_init(&mutex, NULL);
-	pthread_cond_init(&push_cond, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&push_cond, &attr);
+	pthread_condattr_destroy(&attr);
 }
 
-msg_queue::~msg_queue() { 
+msg_queue::~msg_queue() {
 	pthread_cond_destroy(&push_cond);
-	pthread_mutex_destroy(&mutex); 
+	pthread_mutex_destroy(&mutex);
+	delete[] slots;
 }
 
 
 //-----------------------------------------------------------------------------
+void msg_queue::set_capacity(size_t capacity) {
+	size_t n = 2;
+	while (n < capacity) n <<= 1;
+	delete[] slots;
+	mask = n - 1;
+	slots = new slot_t[n];
+	for (size_t i = 0; i < n; ++i) slots[i].seq.store(i, std::memory_order_relaxed);
+	head.store(0);
+	tail.store(0);
+}
+
 void msg_queue::set_max_length(ssize_t _max_length) {
-	max_length = _max_length; 
+	max_length = _max_length;
 }
 
-bool msg_queue::empty() const { 
-	return queue.empty();
+size_t msg_queue::size() const {
+	const size_t t = tail.load(std::memory_order_acquire);
+	const size_t h = head.load(std::memory_order_acquire);
+	return (h > t) ? h - t : 0;
 }
 
 void msg_queue::clear() {
-	std::queue<t_msg> _empty;
-	pthread_mutex_lock(&mutex);
-		std::swap(queue, _empty);
-	pthread_mutex_unlock(&mutex);
+	char buf[MSGQUEUE_SLOT_SIZE];
+	while (pop(buf, sizeof(buf)) != 0) { }
 }
 
 
 //-----------------------------------------------------------------------------
+bool msg_queue::try_push(const char * buf, size_t len) {
+	size_t pos = head.load(std::memory_order_relaxed);
+	while (true) {
+		slot_t & s = slots[pos & mask];
+		const size_t seq = s.seq.load(std::memory_order_acquire);
+		const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if (diff == 0) {
+			if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				memcpy(s.data, buf, len);
+				s.len = len;
+				s.seq.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0) return false;  // full
+		else pos = head.load(std::memory_order_relaxed);
+	}
+}
+
 bool msg_queue::push(const char * buf, ssize_t len) {
-	if (len < 0) return false;
-	if ((max_length >= 0) && (queue.size() > static_cast<size_t>(max_length))) return false;
-	pthread_mutex_lock(&mutex);
-		queue.push(t_msg(buf, buf + len));
-		pthread_cond_broadcast(&push_cond);
-	pthread_mutex_unlock(&mutex);
+	if (len <= 0) return false;
+	if (len > MSGQUEUE_SLOT_SIZE) {
+		++n_dropped;
+		return false;
+	}
+
+	bool ok = false;
+	while (true) {
+		const bool at_limit = (max_length >= 0) && (size() >= static_cast<size_t>(max_length));
+		if (!at_limit && try_push(buf, len)) {
+			ok = true;
+			break;
+		}
+		if (policy != MSGQUEUE_DROP_OLDEST) break;
+
+		char old[MSGQUEUE_SLOT_SIZE];
+		if (pop(old, sizeof(old)) > 0) ++n_dropped;
+		else if (at_limit) break;  // max_length 0
+	}
+	if (!ok) {
+		++n_dropped;
+		return false;
+	}
+
+	// pairs with the seq_cst store of waiting in wait_for_msg()
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiting.load()) {
+		pthread_mutex_lock(&mutex);
+			pthread_cond_signal(&push_cond);
+		pthread_mutex_unlock(&mutex);
+	}
 	return true;
 }
 
 
 //-----------------------------------------------------------------------------
 int msg_queue::wait_for_msg(long timeout_ns) {
-	if (!queue.empty()) return 0;
+	if (!empty()) return 0;
+
+	timespec ts;
+	if (timeout_ns > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_sec += timeout_ns / 1000000000L;
+		ts.tv_nsec += timeout_ns % 1000000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_nsec -= 1000000000L;
+			++ts.tv_sec;
+		}
+	}
 
 	int rc = 0;
 	pthread_mutex_lock(&mutex);
-		if (timeout_ns > 0) {
-			const timespec ts = { timeout_ns / 1e9l, timeout_ns };
-			rc = pthread_cond_timedwait(&push_cond, &mutex, &ts);
-		} else {
-			rc = pthread_cond_wait(&push_cond, &mutex);
+		waiting.store(true);
+		while (empty() && (rc != ETIMEDOUT)) {
+			rc = (timeout_ns > 0)
+				? pthread_cond_timedwait(&push_cond, &mutex, &ts)
+				: pthread_cond_wait(&push_cond, &mutex);
 		}
+		waiting.store(false);
 	pthread_mutex_unlock(&mutex);
 
-	return rc;
+	return empty() ? ETIMEDOUT : 0;
 }
 
 
 //-----------------------------------------------------------------------------
-t_msg msg_queue::_get(bool pop) {
-	if (queue.empty()) return t_msg();
-	pthread_mutex_lock(&mutex);
-		t_msg msg(queue.front());
-		if (pop) queue.pop();
-	pthread_mutex_unlock(&mutex);
-	return msg;
+ssize_t msg_queue::pop(char * buf, size_t buf_len) {
+	size_t pos = tail.load(std::memory_order_relaxed);
+	while (true) {
+		slot_t & s = slots[pos & mask];
+		const size_t seq = s.seq.load(std::memory_order_acquire);
+		const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+		if (diff == 0) {
+			const ssize_t len = s.len;  // stable while seq == pos + 1; if taken meanwhile, the CAS fails
+			if (len > static_cast<ssize_t>(buf_len)) return -len;
+			if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				memcpy(buf, s.data, len);
+				s.seq.store(pos + mask + 1, std::memory_order_release);
+				return len;
+			}
+		}
+		else if (diff < 0) return 0;  // empty
+		else pos = tail.load(std::memory_order_relaxed);
+	}
 }
@@ -2,36 +2,76 @@
 #define _util_msgqueue_h
 
 /* requires:
-	#include <queue>
-	#include <string>
+	#include <atomic>
+	#include <pthread.h>
+	#include <unistd.h>
 */
 
-typedef std::vector<char> t_msg;
+#define MSGQUEUE_SLOT_SIZE 1536       // inline bytes per message; > SATMSG__MAXLEN + headers
+#define MSGQUEUE_DEFAULT_CAPACITY 64  // rounded up to a power of two
 
-// custom thread-safe wrapper for std::queue
+enum msg_queue_policy {
+	MSGQUEUE_DROP_NEWEST,  // push() fails when full
+	MSGQUEUE_DROP_OLDEST   // push() discards the oldest message to make room
+};
+
+/**
+ * Bounded lock-free message queue with inline fixed-size slots
+ *
+ * Any number of threads may push(); pop() is meant for one consumer thread.
+ * Each slot carries a sequence number that hands it between producers and
+ * the consumer, so neither side takes a lock. wait_for_msg() only touches
+ * the mutex & condition when the consumer is actually blocked.
+ */
 class msg_queue {
 	private:
+		struct slot_t {
+			std::atomic<size_t> seq;
+			size_t len;
+			char data[MSGQUEUE_SLOT_SIZE];
+		};
+
+		slot_t * slots;
+		size_t mask;
 		ssize_t max_length;
-		std::queue<t_msg> queue;
+		msg_queue_policy policy;
+
+		std::atomic<size_t> head;  // next push
+		std::atomic<size_t> tail;  // next pop
+		std::atomic<unsigned long> n_dropped;
+
+		std::atomic<bool> waiting;
 		pthread_mutex_t mutex;
 		pthread_cond_t push_cond;
 
-		t_msg _get(bool pop);
+		msg_queue(const msg_queue & _);
+		msg_queue & operator= (const msg_queue & _);
+
+		bool try_push(const char * buf, size_t len);
 
 	public:
-		msg_queue(); ~msg_queue();
+		msg_queue(size_t capacity = MSGQUEUE_DEFAULT_CAPACITY, msg_queue_policy _policy = MSGQUEUE_DROP_NEWEST);
+		~msg_queue();
+
+		void set_capacity(size_t capacity);  // before any other thread uses the queue; drops its messages
+		void set_max_length(ssize_t _max_length);  // < 0: whole capacity
+		void set_policy(msg_queue_policy _policy) { policy = _policy; }
 
-		void set_max_length(ssize_t _max_length);
-		bool empty() const;
+		size_t capacity() const { return mask + 1; }
+		size_t size() const;
+		bool empty() const { return size() == 0; }
+		unsigned long dropped() const { return n_dropped.load(); }
 		void clear();
 
-		bool push(const char * buf, ssize_t len); // returns false if max_length reached
+		bool push(const char * buf, ssize_t len);  // returns false if dropped
 
+		// returns 0 once a message is queued, ETIMEDOUT after timeout_ns (if > 0)
 		int wait_for_msg(long timeout_ns = 0);
 
-		// returns empty string if queue is empty
-		t_msg pop() { return _get(true); }
-		t_msg peek() { return _get(false); }
+		// copies the oldest message to buf; returns its length, 0 if the
+		// queue is empty, or minus its length if buf is too small (the
+		// message is left in the queue)
+		ssize_t pop(char * buf, size_t buf_len);
 };
 
 #endif
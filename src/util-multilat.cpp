@@ -0,0 +1,222 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cmath>
+#include <vector>
+
+#include "util-multilat.h"
+
+#define MULTILAT_MIN_DIST 1e-3
+#define MULTILAT_LAMBDA_0 1e-3
+#define MULTILAT_LAMBDA_MAX 1e9
+#define MULTILAT_DIAG_MIN 1e-9
+
+
+//-----------------------------------------------------------------------------
+// in-place Cholesky solve of the m x m system A x = b; false if A isn't
+// positive definite
+static bool cholesky_solve(std::vector<double> & A, std::vector<double> & b, int m) {
+	for (int j = 0; j < m; ++j) {
+		double * Aj = &A[j * m];
+		double d = Aj[j];
+		for (int k = 0; k < j; ++k) d -= Aj[k] * Aj[k];
+		if (d <= 0.0) return false;
+		d = sqrt(d);
+		Aj[j] = d;
+		for (int i = j + 1; i < m; ++i) {
+			double * Ai = &A[i * m];
+			double s = Ai[j];
+			for (int k = 0; k < j; ++k) s -= Ai[k] * Aj[k];
+			Ai[j] = s / d;
+		}
+	}
+	for (int i = 0; i < m; ++i) {
+		double s = b[i];
+		for (int k = 0; k < i; ++k) s -= A[i * m + k] * b[k];
+		b[i] = s / A[i * m + i];
+	}
+	for (int i = m - 1; i >= 0; --i) {
+		double s = b[i];
+		for (int k = i + 1; k < m; ++k) s -= A[k * m + i] * b[k];
+		b[i] = s / A[i * m + i];
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+MultilatSolver::MultilatSolver(int _n) : n(0) {
+	resize(_n);
+}
+
+void MultilatSolver::resize(int _n) {
+	n = _n;
+	x.assign(n, 0.0);
+	y.assign(n, 0.0);
+	z.assign(n, 0.0);
+	clear_priors();
+	clear_ranges();
+}
+
+void MultilatSolver::set_prior(int i, double _x, double _y, double sigma) {
+	prior_x[i] = _x;
+	prior_y[i] = _y;
+	prior_w[i] = (sigma > 0.0) ? 1.0 / (sigma * sigma) : 0.0;
+}
+
+void MultilatSolver::clear_priors() {
+	prior_x.assign(n, 0.0);
+	prior_y.assign(n, 0.0);
+	prior_w.assign(n, 0.0);
+}
+
+void MultilatSolver::set_range(int i, int j, double d, double sigma) {
+	if ((i == j) || (i < 0) || (j < 0) || (i >= n) || (j >= n) || (sigma <= 0.0)) return;
+	pi.push_back(i);
+	pj.push_back(j);
+	range.push_back(d);
+	range_w.push_back(1.0 / (sigma * sigma));
+}
+
+void MultilatSolver::clear_ranges() {
+	pi.clear();
+	pj.clear();
+	range.clear();
+	range_w.clear();
+}
+
+
+//-----------------------------------------------------------------------------
+void MultilatSolver::eval_pairs(const double * px, const double * py) {
+	const size_t m = range.size();
+	dx.resize(m);
+	dy.resize(m);
+	r.resize(m);
+	res.resize(m);
+
+	for (size_t k = 0; k < m; ++k) {
+		dx[k] = px[pi[k]] - px[pj[k]];
+		dy[k] = py[pi[k]] - py[pj[k]];
+	}
+	for (size_t k = 0; k < m; ++k) {
+		const double dz = z[pi[k]] - z[pj[k]];
+		r[k] = sqrt(dx[k] * dx[k] + dy[k] * dy[k] + dz * dz);
+		if (r[k] < MULTILAT_MIN_DIST) r[k] = MULTILAT_MIN_DIST;
+		res[k] = r[k] - range[k];
+	}
+}
+
+double MultilatSolver::cost(const double * px, const double * py) const {
+	double c = 0.0;
+	const size_t m = range.size();
+	for (size_t k = 0; k < m; ++k) {
+		const double ddx = px[pi[k]] - px[pj[k]];
+		const double ddy = py[pi[k]] - py[pj[k]];
+		const double dz = z[pi[k]] - z[pj[k]];
+		const double e = sqrt(ddx * ddx + ddy * ddy + dz * dz) - range[k];
+		c += range_w[k] * e * e;
+	}
+	for (int i = 0; i < n; ++i) {
+		const double ex = px[i] - prior_x[i], ey = py[i] - prior_y[i];
+		c += prior_w[i] * (ex * ex + ey * ey);
+	}
+	return c;
+}
+
+
+//-----------------------------------------------------------------------------
+MultilatSolver::result_t MultilatSolver::solve(int max_iter, double tol) {
+	result_t result = { -1, 0.0 };
+	if (n <= 0) return result;
+
+	const int m = 2 * n;  // unknowns: x0 y0 x1 y1 ...
+	std::vector<double> A(m * m), A_damped(m * m), g(m), step(m);
+	std::vector<double> tx(n), ty(n);
+
+	double c = cost(&x[0], &y[0]);
+	double lambda = -1.0;
+	int it = 0;
+	for (; it < max_iter; ++it) {
+		eval_pairs(&x[0], &y[0]);
+
+		// normal equations: A = J'WJ, g = -J'Wr
+		std::fill(A.begin(), A.end(), 0.0);
+		std::fill(g.begin(), g.end(), 0.0);
+		for (size_t k = 0; k < range.size(); ++k) {
+			const double ux = dx[k] / r[k], uy = dy[k] / r[k];
+			const double w = range_w[k];
+			const double axx = w * ux * ux, axy = w * ux * uy, ayy = w * uy * uy;
+			const int a = 2 * pi[k], b = 2 * pj[k];
+
+			A[a * m + a] += axx;          A[a * m + a + 1] += axy;
+			A[(a + 1) * m + a] += axy;    A[(a + 1) * m + a + 1] += ayy;
+			A[b * m + b] += axx;          A[b * m + b + 1] += axy;
+			A[(b + 1) * m + b] += axy;    A[(b + 1) * m + b + 1] += ayy;
+			A[a * m + b] -= axx;          A[a * m + b + 1] -= axy;
+			A[(a + 1) * m + b] -= axy;    A[(a + 1) * m + b + 1] -= ayy;
+			A[b * m + a] -= axx;          A[b * m + a + 1] -= axy;
+			A[(b + 1) * m + a] -= axy;    A[(b + 1) * m + a + 1] -= ayy;
+
+			const double wr = w * res[k];
+			g[a] -= wr * ux;  g[a + 1] -= wr * uy;
+			g[b] += wr * ux;  g[b + 1] += wr * uy;
+		}
+		for (int i = 0; i < n; ++i) {
+			A[2 * i * m + 2 * i] += prior_w[i];
+			A[(2 * i + 1) * m + 2 * i + 1] += prior_w[i];
+			g[2 * i] -= prior_w[i] * (x[i] - prior_x[i]);
+			g[2 * i + 1] -= prior_w[i] * (y[i] - prior_y[i]);
+		}
+
+		if (lambda < 0.0) {
+			double d_max = 0.0;
+			for (int i = 0; i < m; ++i) if (A[i * m + i] > d_max) d_max = A[i * m + i];
+			lambda = MULTILAT_LAMBDA_0 * (d_max > 0.0 ? d_max : 1.0);
+		}
+
+		// damped step; grow lambda until the cost goes down
+		bool improved = false;
+		double step_max = 0.0;
+		while (!improved && (lambda < MULTILAT_LAMBDA_MAX)) {
+			A_damped = A;
+			for (int i = 0; i < m; ++i) {
+				double & d = A_damped[i * m + i];
+				d += lambda * (d > MULTILAT_DIAG_MIN ? d : MULTILAT_DIAG_MIN) + MULTILAT_DIAG_MIN;
+			}
+			step = g;
+			if (!cholesky_solve(A_damped, step, m)) {
+				lambda *= 10.0;
+				continue;
+			}
+
+			step_max = 0.0;
+			for (int i = 0; i < n; ++i) {
+				tx[i] = x[i] + step[2 * i];
+				ty[i] = y[i] + step[2 * i + 1];
+				if (fabs(step[2 * i]) > step_max) step_max = fabs(step[2 * i]);
+				if (fabs(step[2 * i + 1]) > step_max) step_max = fabs(step[2 * i + 1]);
+			}
+
+			const double tc = cost(&tx[0], &ty[0]);
+			if (tc <= c) {
+				x.swap(tx);
+				y.swap(ty);
+				c = tc;
+				lambda *= 0.1;
+				improved = true;
+			} else lambda *= 10.0;
+		}
+		if (!improved || (step_max < tol)) {
+			++it;
+			break;
+		}
+	}
+
+	eval_pairs(&x[0], &y[0]);
+	double ss = 0.0;
+	for (size_t k = 0; k < res.size(); ++k) ss += res[k] * res[k];
+	result.iterations = it;
+	result.rms_residual = res.empty() ? 0.0 : sqrt(ss / res.size());
+	return result;
+}
@@ -0,0 +1,67 @@
+#ifndef _util_multilat_h
+#define _util_multilat_h
+
+/* requires:
+	#include <vector>
+*/
+
+/**
+ * Batch Levenberg-Marquardt multilateration of a group of floats
+ *
+ * Solves the horizontal positions of n units from one cycle's pairwise
+ * ranges and known depths, minimising
+ *
+ *   sum_ij w_ij (|p_i - p_j| - d_ij)^2 + sum_i |p_i - prior_i|^2 / sigma_i^2
+ *
+ * The priors (GPS fixes, previous estimates) fix the translation and rotation
+ * of the group; at least one unit should have one. Pairwise terms are stored
+ * as flat arrays so that residuals and the Jacobian are computed in straight
+ * loops over all pairs.
+ *
+ * To use, set_depth() & set_prior() per unit, set_range() per measured pair,
+ * then solve(). Positions carry over between solves, so the next cycle is
+ * warm-started from the previous solution; call clear_ranges() in between.
+ */
+class MultilatSolver {
+	public:
+		struct result_t {
+			int iterations;       // < 0 if not solved
+			double rms_residual;  // of the range terms, meters
+		};
+
+	private:
+		int n;
+		std::vector<double> x, y, z;
+		std::vector<double> prior_x, prior_y, prior_w;
+
+		// pairwise terms
+		std::vector<int> pi, pj;
+		std::vector<double> range, range_w;
+		std::vector<double> dx, dy, r, res;  // scratch, per pair
+
+		double cost(const double * px, const double * py) const;
+		void eval_pairs(const double * px, const double * py);
+
+	public:
+		MultilatSolver(int _n = 0);
+
+		void resize(int _n);
+		int size() const { return n; }
+
+		void set_position(int i, double _x, double _y) { x[i] = _x; y[i] = _y; }  // initial guess
+		void set_depth(int i, double _z) { z[i] = _z; }
+		void set_prior(int i, double _x, double _y, double sigma);  // sigma <= 0 removes prior
+		void clear_priors();
+
+		void set_range(int i, int j, double d, double sigma = 5.0);
+		void clear_ranges();
+		int n_ranges() const { return range.size(); }
+
+		result_t solve(int max_iter = 20, double tol = 0.01);
+
+		double get_x(int i) const { return x[i]; }
+		double get_y(int i) const { return y[i]; }
+		double get_z(int i) const { return z[i]; }
+};
+
+#endif // _util_multilat_h
@@ -0,0 +1,126 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "util-trace.h"
+
+
+std::atomic<FILE *> trace_file(NULL);
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char * trace_buf = NULL;
+static int trace_pid = 0;
+static int64_t trace_wall_offset = 0;	// ns, CLOCK_REALTIME - CLOCK_MONOTONIC
+static uint32_t (*trace_sim)() = NULL;
+
+static std::atomic<int> trace_next_tid(1);
+static thread_local int trace_tid = 0;
+
+//-----------------------------------------------------------------------------
+static int this_tid() {
+	if (!trace_tid) trace_tid = trace_next_tid.fetch_add(1);
+	return trace_tid;
+}
+
+// the first event of the file is written without a separator
+static void trace_write(FILE * f, const char * line) {
+	static bool first = true;
+	fputs(first ? "\n" : ",\n", f);
+	fputs(line, f);
+	first = false;
+}
+
+uint32_t trace_sim_now() {
+	return trace_sim ? trace_sim() : 0;
+}
+
+//-----------------------------------------------------------------------------
+bool trace_open(const char * fn, const char * process_name, uint32_t (*sim_now)()) {
+	const char * env = getenv(TRACE_ENV);
+	if (!env || !env[0] || !strcmp(env, "0")) return false;
+
+	pthread_mutex_lock(&trace_mutex);
+	if (trace_file.load()) {
+		pthread_mutex_unlock(&trace_mutex);
+		return false;
+	}
+	FILE * f = fopen(fn, "w");
+	if (f == NULL) {
+		pthread_mutex_unlock(&trace_mutex);
+		return false;
+	}
+	trace_buf = (char *)malloc(TRACE_BUFFER);
+	if (trace_buf) setvbuf(f, trace_buf, _IOFBF, TRACE_BUFFER);
+
+	timespec rt, mt;
+	clock_gettime(CLOCK_REALTIME, &rt);
+	clock_gettime(CLOCK_MONOTONIC, &mt);
+	trace_wall_offset = (int64_t)(rt.tv_sec - mt.tv_sec) * 1000000000LL + (rt.tv_nsec - mt.tv_nsec);
+	trace_pid = getpid();
+	trace_sim = sim_now;
+
+	char line[256];
+	snprintf(line, sizeof(line), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"%s\"}}", trace_pid, process_name);
+	fputc('[', f);
+	trace_write(f, line);
+	trace_file.store(f);
+	pthread_mutex_unlock(&trace_mutex);
+
+	atexit(trace_close);
+	return true;
+}
+
+void trace_close() {
+	pthread_mutex_lock(&trace_mutex);
+	FILE * f = trace_file.exchange(NULL);
+	if (f) {
+		fputs("\n]\n", f);
+		fclose(f);
+		free(trace_buf);
+		trace_buf = NULL;
+	}
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+//-----------------------------------------------------------------------------
+void trace_span(const char * name, const char * cat, uint64_t t0, uint64_t t1, uint32_t sim_t0, uint32_t sim_t1, int tid) {
+	if (!trace_on()) return;
+	if (tid < 0) tid = this_tid();
+
+	const uint64_t ts = t0 + trace_wall_offset;
+	const uint64_t dur = (t1 > t0) ? t1 - t0 : 0;
+	char line[256];
+	snprintf(line, sizeof(line),
+		"{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"pid\":%d,\"tid\":%d,\"args\":{\"t0\":%u,\"t1\":%u}}",
+		name, cat,
+		(unsigned long long)(ts / 1000), (unsigned int)(ts % 1000),
+		(unsigned long long)(dur / 1000), (unsigned int)(dur % 1000),
+		trace_pid, tid, sim_t0, sim_t1);
+
+	pthread_mutex_lock(&trace_mutex);
+	FILE * f = trace_file.load();
+	if (f) trace_write(f, line);
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+void trace_thread_name(int tid, const char * name) {
+	if (!trace_on()) return;
+	if (tid < 0) tid = this_tid();
+
+	char line[256];
+	snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", trace_pid, tid, name);
+
+	pthread_mutex_lock(&trace_mutex);
+	FILE * f = trace_file.load();
+	if (f) trace_write(f, line);
+	pthread_mutex_unlock(&trace_mutex);
+}
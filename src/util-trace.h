@@ -0,0 +1,74 @@
+#ifndef _util_trace_h
+#define _util_trace_h
+
+/* requires:
+	#include <atomic>
+	#include <cstdio>
+	#include <stdint.h>
+	#include <time.h>
+*/
+
+/**
+ * Optional timeline of a process, as Chrome trace events
+ *
+ * If $SSSIM_TRACE is set (and not 0), trace_open() starts a trace file, and
+ * each span of work is written to it as a complete ("X") event, one per line,
+ * with its wall-clock start & duration in ts & dur (µs), and its simulation
+ * times in args t0 & t1 (s). The file is a JSON array, left unclosed if the
+ * process is killed, as chrome://tracing and Perfetto accept; bin/trace-merge
+ * combines the traces of env & the clients of a run into one, on the
+ * wall-clock or simulation time axis.
+ *
+ * Times are given as ns of CLOCK_MONOTONIC, as from trace_now(), and written
+ * as µs of the wall clock, so that the processes of a host share the axis.
+ * Spans may be added from any thread.
+ */
+
+#define  TRACE_ENV     "SSSIM_TRACE"
+#define  TRACE_SUFFIX  ".trace.json"
+#define  TRACE_BUFFER  (1 << 20)	// bytes of stdio buffer
+#define  TRACE_TIDS    1000	// tids from here up are free for tracks of their own
+
+extern std::atomic<FILE *> trace_file;
+
+inline bool trace_on() { return trace_file.load(std::memory_order_relaxed) != NULL; }
+
+inline uint64_t trace_now() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// as pid, the process id; "process_name" e.g. "float 3"; sim_now for TraceScope
+bool trace_open(const char * fn, const char * process_name, uint32_t (*sim_now)());
+void trace_close();
+
+// tid -1 for the calling thread, or TRACE_TIDS + n for a track of its own,
+// e.g. one per client in env
+void trace_span(const char * name, const char * cat, uint64_t t0, uint64_t t1, uint32_t sim_t0, uint32_t sim_t1, int tid = -1);
+void trace_thread_name(int tid, const char * name);
+
+
+//-----------------------------------------------------------------------------
+uint32_t trace_sim_now();
+
+// a span over a scope, if tracing; the simulation time is read at both ends
+class TraceScope {
+	public:
+		TraceScope(const char * _name, const char * _cat) :
+			name(_name), cat(_cat),
+			t0(trace_on() ? trace_now() : 0),
+			sim_t0(t0 ? trace_sim_now() : 0) {}
+		~TraceScope() { if (t0) trace_span(name, cat, t0, trace_now(), sim_t0, trace_sim_now()); }
+
+	private:
+		const char * name;
+		const char * cat;
+		const uint64_t t0;
+		const uint32_t sim_t0;
+
+		TraceScope(const TraceScope &);
+		TraceScope & operator=(const TraceScope &);
+};
+
+#endif // _util_trace_h
@@ -0,0 +1,44 @@
+#ifndef _util_triplebuf_h
+#define _util_triplebuf_h
+
+/* requires:
+	#include <atomic>
+*/
+
+// Latest value from one thread to another, neither ever waiting: the writer
+// fills back() & publish()es it, the reader acquire()s the latest published
+// value, e.g. once per frame, and reads front() until the next acquire().
+// back() is as published two times ago, so the writer rewrites all of it;
+// publish() tells if the value published before was acquired, or dropped.
+const unsigned int TRIPLE_FRESH = 0x4;
+
+template< typename T >
+class TripleBuffer {
+	private:
+		T buffer[3];
+		unsigned int front_i, back_i;	// reader & writer only
+		std::atomic<unsigned int> ready;	// TRIPLE_FRESH if newer than front
+	public:
+		TripleBuffer() :
+			buffer(),
+			front_i( 0 ),
+			back_i( 1 ),
+			ready( 2 )
+		{ }
+
+		T & back() { return buffer[back_i]; }
+		bool publish() {
+			const unsigned int prev = ready.exchange( back_i | TRIPLE_FRESH );
+			back_i = prev & ~TRIPLE_FRESH;
+			return !( prev & TRIPLE_FRESH );
+		}
+
+		bool acquire() {
+			if ( !( ready.load() & TRIPLE_FRESH ) ) return false;
+			front_i = ready.exchange( front_i ) & ~TRIPLE_FRESH;
+			return true;
+		}
+		const T & front() const { return buffer[front_i]; }
+};
+
+#endif